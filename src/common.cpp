@@ -1,6 +1,7 @@
 #include "common.h"
 
 #include <nmmintrin.h>
+#include <intrin.h>
 
 #pragma comment(lib, "dbghelp.lib")
 
@@ -15,7 +16,8 @@ static const char* error_parsing_the_input = "Error parsing the input.\n";
 static const char* max_path_len_error = "Path exceeds the maximum of %lu characters.\n";
 static const char* cmd_args[] = { "-h", "--help", "-f", "--show-failed-readings", "-t=", "--threads=", "-v", "--version",
                                 "-p", "--process", "-d", "--dump", "-b=", "--blocks=", "-n", "--no-page-caching", "-c", "--clear-standby-list", 
-                                "-s", "--disable-symbols"};
+                                "-s", "--disable-symbols", "-g", "--guest", "-m=", "--mem-limit=", "-r", "--persist-results",
+                                "-a=", "--scan-ahead=", "-u", "--release-scanned"};
 static constexpr size_t cmd_args_size = _countof(cmd_args) / 2; // given that every option has a long and a short forms
 static const char* program_version = "Version 0.3.9";
 static const char* program_name = "Quick Memory Tools";
@@ -215,52 +217,320 @@ static void parse_input(char* pattern, search_data_info *data, input_type in_typ
     }
 }
 
-const uint8_t* strstr_u8(const uint8_t* str, size_t str_sz, const uint8_t* substr, size_t substr_sz) {
-    constexpr size_t step =  sizeof(__m128i) / sizeof(uint8_t);
+// Search kernels specialized on the pattern length class, the range check and the output mode.
+// Patterns of 1, 2, 4 and 8 bytes are matched exactly at 16 positions at once by AND-ing the byte compares
+// of shifted loads; longer ones are filtered by their first and last bytes and verified with vector compares
+// (up to 32 bytes) or memcmp. The vector loop never reads past the buffer, the tail is searched byte by byte.
+enum pattern_class {
+    pc_1,
+    pc_2,
+    pc_4,
+    pc_8,
+    pc_16,
+    pc_32,
+    pc_long,
+
+    pc_count
+};
+
+template <pattern_class PC>
+struct pattern_class_traits {
+    static constexpr size_t width = (PC == pc_1) ? 1 : ((PC == pc_2) ? 2 : ((PC == pc_4) ? 4 : 8));
+    static constexpr bool exact = PC <= pc_8;
+};
+
+// the bytes past a 16 byte step the vector loop may read, beyond the pattern length for pc_long
+template <pattern_class PC>
+constexpr size_t kernel_reach() {
+    return pattern_class_traits<PC>::exact ? (pattern_class_traits<PC>::width - 1 + sizeof(__m128i))
+        : ((PC == pc_16) ? 2 * sizeof(__m128i) : ((PC == pc_32) ? 3 * sizeof(__m128i) - 1 : sizeof(__m128i) - 1));
+}
 
-    if (/*!substr_sz || */(str_sz < substr_sz)) {
-        return NULL;
+template <pattern_class PC, bool RANGED, scan_mode MODE>
+static size_t scan_kernel_impl(const uint8_t* data, size_t size, const char* address, const scan_kernel_args& args, std::vector<const char*>* matches) {
+    const uint8_t* pattern = args.pattern;
+    const size_t len = args.pattern_len;
+    if (RANGED) { // only the matches starting inside the range count, the rest of the buffer isn't searched
+        const uint64_t begin = (uint64_t)address, range_start = (uint64_t)args.range_start, range_end = (uint64_t)args.range_end;
+        if ((range_end <= begin) || (range_start >= (begin + size))) {
+            return 0;
+        }
+        const size_t skip = (range_start > begin) ? (size_t)(range_start - begin) : 0;
+        const size_t end = _min(size, (size_t)(range_end - begin) + len - 1);
+        if (end <= skip) {
+            return 0;
+        }
+        data += skip;
+        address += skip;
+        size = end - skip;
+    }
+    if (size < len) {
+        return 0;
     }
-    const __m128i first = _mm_set1_epi8(substr[0]);
-    const __m128i last = _mm_set1_epi8(substr[substr_sz - 1]);
-    const uint8_t skip_first = (uint8_t)(substr_sz > 2);
-    const size_t cmp_size = substr_sz - (1llu << skip_first);
+    const size_t max_matches = (MODE == sm_first_n) ? args.max_matches : SIZE_MAX;
+    size_t found = 0;
 
-    for (size_t j = 0, sz = str_sz - substr_sz; j <= sz; j += step) {
-        const uint8_t* f = str + j;
-        const uint8_t* l = str + j + substr_sz - 1;
-        __m128i xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(f));
-        __m128i xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(l));
+    __m128i bytes[sizeof(uint64_t)]; // the pattern bytes, or its first and last ones
+    if (pattern_class_traits<PC>::exact) {
+        for (size_t k = 0; k < pattern_class_traits<PC>::width; k++) {
+            bytes[k] = _mm_set1_epi8((char)pattern[k]);
+        }
+    } else {
+        bytes[0] = _mm_set1_epi8((char)pattern[0]);
+        bytes[1] = _mm_set1_epi8((char)pattern[len - 1]);
+    }
+    __m128i pattern_lo = _mm_setzero_si128(), pattern_hi = _mm_setzero_si128();
+    uint32_t len_mask_lo = 0, len_mask_hi = 0;
+    if ((PC == pc_16) || (PC == pc_32)) {
+        uint8_t padded[2 * sizeof(__m128i)] = {};
+        memcpy(padded, pattern, len);
+        pattern_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded));
+        pattern_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded + sizeof(__m128i)));
+        len_mask_lo = (len >= sizeof(__m128i)) ? 0xFFFF : ((1u << len) - 1);
+        len_mask_hi = (len > sizeof(__m128i)) ? ((1u << (len - sizeof(__m128i))) - 1) : 0;
+    }
+
+    const size_t reach = kernel_reach<PC>() + ((PC == pc_long) ? len : 0);
+    size_t j = 0;
+    for (; (j + reach) <= size; j += sizeof(__m128i)) {
+        const uint8_t* p = data + j;
+        uint32_t mask;
+        if (pattern_class_traits<PC>::exact) {
+            __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), bytes[0]);
+            for (size_t k = 1; k < pattern_class_traits<PC>::width; k++) {
+                eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k)), bytes[k]));
+            }
+            mask = (uint32_t)_mm_movemask_epi8(eq);
+        } else {
+            const __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), bytes[0]);
+            const __m128i last = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + len - 1)), bytes[1]);
+            mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(first, last));
+        }
+        unsigned long bit = 0;
+        while (_BitScanForward(&bit, mask)) {
+            mask &= mask - 1;
+            const uint8_t* candidate = p + bit;
+            if ((PC == pc_16) || (PC == pc_32)) {
+                const __m128i lo = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(candidate)), pattern_lo);
+                bool equal = ((uint32_t)_mm_movemask_epi8(lo) & len_mask_lo) == len_mask_lo;
+                if (PC == pc_32) {
+                    const __m128i hi = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(candidate + sizeof(__m128i))), pattern_hi);
+                    equal &= ((uint32_t)_mm_movemask_epi8(hi) & len_mask_hi) == len_mask_hi;
+                }
+                if (!equal) {
+                    continue;
+                }
+            } else if ((PC == pc_long) && (memcmp(candidate + 1, pattern + 1, len - 2) != 0)) {
+                continue;
+            }
+            matches->push_back(address + (candidate - data));
+            if (++found == max_matches) {
+                return found;
+            }
+        }
+    }
+    for (; (j + len) <= size; j++) {
+        if (memcmp(data + j, pattern, len) == 0) {
+            matches->push_back(address + j);
+            if (++found == max_matches) {
+                return found;
+            }
+        }
+    }
+    return found;
+}
 
-        xmm0 = _mm_cmpeq_epi8(first, xmm0);
-        xmm1 = _mm_cmpeq_epi8(last, xmm1);
-        xmm0 = _mm_and_si128(xmm0, xmm1);
+#define SCAN_KERNELS_OF_CLASS(pc) \
+    { { scan_kernel_impl<pc, false, sm_collect>, scan_kernel_impl<pc, false, sm_first_n> }, \
+      { scan_kernel_impl<pc, true, sm_collect>, scan_kernel_impl<pc, true, sm_first_n> } }
+
+static const scan_kernel scan_kernels[pc_count][2][sm_count] = {
+    SCAN_KERNELS_OF_CLASS(pc_1),
+    SCAN_KERNELS_OF_CLASS(pc_2),
+    SCAN_KERNELS_OF_CLASS(pc_4),
+    SCAN_KERNELS_OF_CLASS(pc_8),
+    SCAN_KERNELS_OF_CLASS(pc_16),
+    SCAN_KERNELS_OF_CLASS(pc_32),
+    SCAN_KERNELS_OF_CLASS(pc_long),
+};
+
+#undef SCAN_KERNELS_OF_CLASS
+
+scan_kernel select_scan_kernel(size_t pattern_len, bool ranged, scan_mode mode) {
+    pattern_class pc;
+    switch (pattern_len) {
+    case 1: pc = pc_1; break;
+    case 2: pc = pc_2; break;
+    case 4: pc = pc_4; break;
+    case 8: pc = pc_8; break;
+    default:
+        pc = (pattern_len <= sizeof(__m128i)) ? pc_16 : ((pattern_len <= 2 * sizeof(__m128i)) ? pc_32 : pc_long);
+        break;
+    }
+    return scan_kernels[pc][ranged ? 1 : 0][mode];
+}
 
-        uint32_t mask = (uint32_t)_mm_movemask_epi8(xmm0);
+void init_scan_kernel(search_context_common* common, const pattern_data& pdata, scan_mode mode, size_t max_matches) {
+    const bool ranged = pdata.scope_type == search_scope_type::mrt_range;
+    common->kernel = select_scan_kernel((size_t)pdata.pattern_len, ranged, mode);
+    common->kernel_args.pattern = (const uint8_t*)pdata.pattern;
+    common->kernel_args.pattern_len = (size_t)pdata.pattern_len;
+    common->kernel_args.range_start = pdata.range.start;
+    common->kernel_args.range_end = pdata.range.start + pdata.range.length;
+    common->kernel_args.max_matches = max_matches;
+}
 
-        const uint8_t max_offset = (uint8_t)_min(step, str_sz - (j + substr_sz) + 1);
-        const uint32_t max_offset_mask = (1 << max_offset) - 1;
-        mask &= max_offset_mask;
-        unsigned long bit = 0;
+void find_pattern_with_kernel(search_context_common* common, const char* data, int64_t size, uint64_t info_id, const char* address) {
+    std::vector<const char*> found; // collected per segment, the lock is taken once
+    if (!common->kernel((const uint8_t*)data, (size_t)size, address, common->kernel_args, &found)) {
+        return;
+    }
+    common->matches_lock.lock();
+    for (const char* match : found) {
+        common->matches.push_back(search_match{ info_id, match });
+    }
+    common->matches_lock.unlock();
+}
 
-        while (_BitScanForward(&bit, mask)) {
-            const uint32_t offset = bit;
-            const uint8_t* m0 = str + j + offset + skip_first;
-            const uint8_t* m1 = substr + skip_first;
-            if (memcmp(m0, m1, cmp_size) == 0)
-                return (str + j + offset);
+// x64 opcodes taking a ModRM operand: 0 - none, otherwise the size of the immediate operand + 1
+static const uint8_t modrm_opcodes_1[0x100] = {
+    1,1,1,1,0,0,0,0, 1,1,1,1,0,0,0,0, 1,1,1,1,0,0,0,0, 1,1,1,1,0,0,0,0, // 0x00
+    1,1,1,1,0,0,0,0, 1,1,1,1,0,0,0,0, 1,1,1,1,0,0,0,0, 1,1,1,1,0,0,0,0, // 0x20
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, // 0x40
+    0,0,0,1,0,0,0,0, 0,5,0,2,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, // 0x60
+    2,5,0,2,1,1,1,1, 1,1,1,1,1,1,1,1, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, // 0x80
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, // 0xA0
+    2,2,0,0,0,0,2,5, 0,0,0,0,0,0,0,0, 1,1,1,1,0,0,0,0, 1,1,1,1,1,1,1,1, // 0xC0
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,1,1, 0,0,0,0,0,0,1,1, // 0xE0
+};
+
+static const uint8_t modrm_opcodes_0f[0x100] = {
+    1,1,1,1,0,0,0,0, 0,0,0,0,0,1,0,0, 1,1,1,1,1,1,1,1, 1,0,0,0,0,0,0,1, // 0x00
+    0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, // 0x20
+    1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, // 0x40
+    1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 2,2,2,2,1,1,1,0, 0,0,0,0,1,1,1,1, // 0x60
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, // 0x80
+    0,0,0,1,2,1,0,0, 0,0,0,1,2,1,1,1, 1,1,0,1,0,0,1,1, 1,0,2,1,1,1,1,1, // 0xA0
+    1,1,2,1,2,2,2,1, 0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, // 0xC0
+    1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,0, // 0xE0
+};
+
+inline bool is_rex(uint8_t b) {
+    return (b & 0xF0) == 0x40;
+}
+
+inline bool is_legacy_prefix(uint8_t b) {
+    return (b == 0x66) || (b == 0xF2) || (b == 0xF3);
+}
 
-            mask ^= (1 << bit); // clear bit
+// Checks whether the rel32 at data[pos] belongs to an instruction referencing the target,
+// returns the offset of the instruction start or -1.
+static int64_t confirm_xref(const uint8_t* data, size_t pos, const char* address, uint64_t target) {
+    const int64_t rel32 = (int64_t)*(const int32_t*)(data + pos);
+    const uint64_t next = (uint64_t)(address + pos + sizeof(int32_t));
+
+    // call / jmp rel32
+    if ((pos >= 1) && ((data[pos - 1] == 0xE8) || (data[pos - 1] == 0xE9))) {
+        if ((next + rel32) == target) {
+            return (int64_t)pos - 1;
+        }
+    }
+    // jcc rel32
+    if ((pos >= 2) && (data[pos - 2] == 0x0F) && ((data[pos - 1] & 0xF0) == 0x80)) {
+        if ((next + rel32) == target) {
+            return (int64_t)pos - 2;
+        }
+    }
+    // [rip + disp32]
+    if ((pos >= 2) && ((data[pos - 1] & 0xC7) == 0x05)) {
+        int64_t start = -1;
+        uint8_t imm_size = 0;
+        if ((pos >= 3) && (data[pos - 3] == 0x0F) && modrm_opcodes_0f[data[pos - 2]]) {
+            start = (int64_t)pos - 3;
+            imm_size = modrm_opcodes_0f[data[pos - 2]] - 1;
+        } else if (modrm_opcodes_1[data[pos - 2]]) {
+            const uint8_t opcode = data[pos - 2];
+            start = (int64_t)pos - 2;
+            imm_size = modrm_opcodes_1[opcode] - 1;
+            // test r/m, imm is /0 of the F6/F7 group
+            if (((opcode == 0xF6) || (opcode == 0xF7)) && ((data[pos - 1] & 0x38) == 0)) {
+                imm_size = (opcode == 0xF6) ? 1 : 4;
+            }
+        }
+        if (start >= 0) {
+            if ((start >= 1) && is_rex(data[start - 1])) {
+                start--;
+            }
+            if ((start >= 1) && is_legacy_prefix(data[start - 1])) {
+                start--;
+                if ((data[start] == 0x66) && (imm_size == 4)) {
+                    imm_size = 2;
+                }
+            }
+            if ((next + imm_size + rel32) == target) {
+                return start;
+            }
         }
     }
+    return -1;
+}
+
+// Finds the code referencing the target with a rel32 displacement: p + 4 (+ imm) + rel32 == target.
+// The low dwords are compared four positions at a time, the candidates are confirmed by the opcode bytes.
+void find_xrefs(const uint8_t* data, size_t size, const char* address, uint64_t target, std::vector<const char*>& xrefs) {
+    constexpr size_t step = sizeof(__m128i);
+    if (size < sizeof(int32_t)) {
+        return;
+    }
 
-    return NULL;
+    const uint32_t target_lo = (uint32_t)target;
+    // an immediate operand following the displacement moves the next instruction by 1, 2 or 4 bytes
+    const __m128i t0 = _mm_set1_epi32((int)target_lo);
+    const __m128i t1 = _mm_set1_epi32((int)(target_lo - 1));
+    const __m128i t2 = _mm_set1_epi32((int)(target_lo - 2));
+    const __m128i t4 = _mm_set1_epi32((int)(target_lo - 4));
+    const uint32_t base_lo = (uint32_t)((uint64_t)address + sizeof(int32_t));
+    const __m128i lane_offsets = _mm_set_epi32(12, 8, 4, 0);
+    const __m128i step_v = _mm_set1_epi32((int)step);
+    __m128i pos_v[4];
+    for (int k = 0; k < 4; k++) {
+        pos_v[k] = _mm_add_epi32(_mm_set1_epi32((int)(base_lo + k)), lane_offsets);
+    }
+
+    size_t i = 0;
+    for (; (i + step + 3) <= size; i += step) {
+        for (int k = 0; k < 4; k++) {
+            const __m128i rel = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + k));
+            const __m128i dst = _mm_add_epi32(rel, pos_v[k]);
+            __m128i eq = _mm_or_si128(_mm_cmpeq_epi32(dst, t0), _mm_cmpeq_epi32(dst, t1));
+            eq = _mm_or_si128(eq, _mm_or_si128(_mm_cmpeq_epi32(dst, t2), _mm_cmpeq_epi32(dst, t4)));
+            uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(eq));
+            unsigned long bit = 0;
+            while (_BitScanForward(&bit, mask)) {
+                const size_t pos = i + k + bit * 4;
+                const int64_t start = confirm_xref(data, pos, address, target);
+                if (start >= 0) {
+                    xrefs.push_back(address + start);
+                }
+                mask ^= (1 << bit);
+            }
+            pos_v[k] = _mm_add_epi32(pos_v[k], step_v);
+        }
+    }
+    // tail
+    for (; (i + sizeof(int32_t)) <= size; i++) {
+        const int64_t start = confirm_xref(data, i, address, target);
+        if (start >= 0) {
+            xrefs.push_back(address + start);
+        }
+    }
 }
 
 static void print_help() {
-    puts("\n*** The program has to be launched in either process or dump inspection mode. ***\n");
+    puts("\n*** The program has to be launched in either process, dump or guest inspection mode. ***\n");
     puts("-p || --process\t\t\t\t\t -- launch in process inspection mode");
-    puts("-d || --dump\t\t\t\t\t -- launch in dump inspection mode\n");
+    puts("-d || --dump\t\t\t\t\t -- launch in dump inspection mode");
+    puts("-g || --guest\t\t\t\t\t -- launch in guest physical memory image inspection mode (QEMU ELF core or raw)\n");
     puts("-t=<num_threads> || --threads=<num_threads>\t -- limit the number of worker threads");
     puts("-b=<N> || --block_info=<N>\t\t\t -- alloc block_info size == (dwAllocationGranularity * N), N=[1-8]");
     puts("-f || --show-failed-readings\t\t\t -- show the regions, that failed to be read (process mode only)");
@@ -271,9 +541,34 @@ static void print_help() {
     puts("-c || --clear-standby-list\t\t\t -- clear standby physical pages (dump mode only)");
 #endif // DISABLE_STANDBY_LIST_PURGE
     puts("-s || --disable-symbols\t\t\t\t -- disable symbol resolution");
+    puts("-m=<size> || --mem-limit=<size>\t\t\t -- limit the memory of caches and indexes (e.g. 512M, 8G)");
+    puts("-r || --persist-results\t\t\t\t -- keep the search result sets beside the dump across sessions (dump mode only)");
+    puts("-a=<size> || --scan-ahead=<size>\t\t -- how far ahead of a search the dump is read, 0 - disabled (dump mode only)");
+    puts("-u || --release-scanned\t\t\t\t -- give the scanned pages of the dump back to the system first (dump mode only)");
     puts("");
 }
 
+// a size in bytes with an optional K/M/G suffix
+static bool parse_size_arg(const char* arg, uint64_t* size) {
+    char* end = NULL;
+    uint64_t value = strtoull(arg, &end, 10);
+    if ((arg == end) || (*arg == '-')) {
+        return false;
+    }
+    int shift = 0;
+    switch (*end) {
+    case 'g': case 'G': shift = 30; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'k': case 'K': shift = 10; end++; break;
+    default: break;
+    }
+    if (*end || (value > (UINT64_MAX >> shift))) {
+        return false;
+    }
+    *size = value << shift;
+    return true;
+}
+
 bool parse_cmd_args(int argc, const char** argv) {
     if (argc > (cmd_args_size + 1)) {
         fprintf(stderr, "Too many arguments provided: some will be discarded.\n");
@@ -333,11 +628,34 @@ bool parse_cmd_args(int argc, const char** argv) {
         } else if ((0 == strcmp(argv[i], cmd_args[18])) || (argv[i] == strstr(argv[i], cmd_args[19]))) { // disable symbols
             g_disable_symbols = 1;
             selected_options |= 1 << 10;
+        } else if ((0 == strcmp(argv[i], cmd_args[20])) || (0 == strcmp(argv[i], cmd_args[21]))) { // guest mode
+            g_inspection_mode = inspection_mode::im_guest;
+            selected_options |= 1 << 11;
+        } else if ((argv[i] == strstr(argv[i], cmd_args[22])) || (argv[i] == strstr(argv[i], cmd_args[23]))) { // memory limit
+            const char* ml = (argv[i][1] == '-') ? (argv[i] + strlen(cmd_args[23])) : (argv[i] + strlen(cmd_args[22]));
+            if (!parse_size_arg(ml, &g_mem_limit)) {
+                fprintf(stderr, "Invalid memory limit: %s\n", ml);
+                return false;
+            }
+            selected_options |= 1 << 12;
+        } else if ((0 == strcmp(argv[i], cmd_args[24])) || (0 == strcmp(argv[i], cmd_args[25]))) { // persist search results
+            g_persist_results = 1;
+            selected_options |= 1 << 13;
+        } else if ((argv[i] == strstr(argv[i], cmd_args[26])) || (argv[i] == strstr(argv[i], cmd_args[27]))) { // scan-ahead distance
+            const char* sa = (argv[i][1] == '-') ? (argv[i] + strlen(cmd_args[27])) : (argv[i] + strlen(cmd_args[26]));
+            if (!parse_size_arg(sa, &g_scan_ahead)) {
+                fprintf(stderr, "Invalid scan-ahead distance: %s\n", sa);
+                return false;
+            }
+            selected_options |= 1 << 14;
+        } else if ((0 == strcmp(argv[i], cmd_args[28])) || (0 == strcmp(argv[i], cmd_args[29]))) { // release scanned pages
+            g_release_scanned = 1;
+            selected_options |= 1 << 15;
         }
             // ...
     }
-    constexpr uint32_t incompatible_mask = (1 << 5) | (1 << 6); // both -p and -d
-    const bool incompatible_options = ((selected_options & incompatible_mask) == incompatible_mask);
+    constexpr uint32_t modes_mask = (1 << 5) | (1 << 6) | (1 << 11); // more than one of -p, -d and -g
+    const bool incompatible_options = !is_pow_2(selected_options & modes_mask);
     if ((g_inspection_mode == inspection_mode::im_none) || incompatible_options) {
         print_help();
         return false;
@@ -390,13 +708,23 @@ void print_help_main_common() {
     puts("q | exit\t\t - quit program");
 }
 
+static void print_help_region_filters() {
+    puts("*  Region filter modifiers can be combined with each other and with the above (e.g. /:w:p <pattern>):");
+    puts("   :r|:w|:x|:g - readable, writable, executable, guard pages (all of the given)");
+    puts("   :p|:m - private or mapped memory (any of the given), :i for image");
+    puts("   :c|:u|:f - committed, reserved or free memory (any of the given)");
+    puts("   :><size>|:<<size> - region size greater / less than the hex size");
+}
+
 void print_help_search_common() {
     puts("\n------------------------------------");
     puts("/ <pattern>\t\t - search for a hex string");
     puts("/x <pattern>\t\t - search for a hex value (1-8 bytes wide)");
     puts("/a <pattern>\t\t - search for an ascii string");
+    puts("/xref <address>\t\t - search image code for calls, jumps and RIP-relative operands referencing the address");
     puts("*  Search commands have optional :i|:s|:o modifiers to limit the search to image, stack or other (e.g. /:s <pattern>)");
     puts("** Alternatively search could be ranged (e.g. /x@<start-address>:<length> <pattern>)");
+    print_help_region_filters();
 }
 
 void print_help_redirect_common() {
@@ -415,6 +743,8 @@ void print_help_hexdump_common() {
     puts("* All hexdump commands can have an operation applied to the data.");
     puts("x(b|w|d|q)@<address>:<N>^<hex-string> - XOR hex-data with a hex-string");
     puts("x(b|w|d|q)@<address>:<N>&<hex-string> - AND hex-data with a hex-string");
+    puts("x+\t\t\t - hexdump the next N units after the last hexdump");
+    puts("x-\t\t\t - hexdump the N units before the last hexdump");
 }
 
 void print_help_list_common() {
@@ -424,6 +754,7 @@ void print_help_list_common() {
     puts("lm\t\t\t - list memory regions info");
     puts("lmc\t\t\t - list committed memory regions info");
     puts("*  Memory listing commands have optional :i|:s|:o modifiers to display only image, stack or other");
+    print_help_region_filters();
 }
 
 void print_help_inspect_common() {
@@ -432,13 +763,19 @@ void print_help_inspect_common() {
     puts("iM <name>\t\t - inspect module");
     puts("it <tid>\t\t - inspect thread");
     puts("ii <file-path>\t\t - inspect image");
+    puts("verify [name]\t\t - compare the code of loaded modules (or the <name> module) with their files on disk");
+    puts("imb\t\t\t - show the memory used by the tool's caches and indexes");
 }
 
 void print_help_calculate_common() {
     puts("\n------------------------------------");
     puts("%entropy@<address>:<size>\t\t - calculate entropy of a block");
     puts("%crc32c@<address>:<size>\t\t - calculate the crc32c of a block");
-    puts("*  Block's size is clamped to the memory region size");
+    puts("%xxh3@<address>:<size>\t\t - calculate the 64 bit xxh3 of a block");
+    puts("%sha256@<address>:<size>\t\t - calculate the sha256 of a block");
+    puts("%blake3@<address>:<size>\t\t - calculate the blake3 of a block (%hash is the same), split across the worker threads");
+    puts("*  Block's size is clamped to the memory region size (xxh3, sha256 and blake3 take blocks up to 1GB)");
+    puts("*  Region filter modifiers make sure the block is in a matching region (e.g. %entropy:w:p@<address>:<size>)");
 }
 
 void print_help_symbols_common() {
@@ -470,6 +807,126 @@ inline search_scope_type set_scope(char ch) {
     return scope_type;
 }
 
+bool region_filter_set(const region_filter& filter) {
+    return filter.protect || filter.type || filter.state || filter.min_size || filter.max_size;
+}
+
+bool region_filter_match(const region_filter& filter, DWORD protect, DWORD type, DWORD state, uint64_t size) {
+    if (filter.protect) {
+        const DWORD access = protect & 0xFF;
+        uint32_t flags = rp_none;
+        if (access & (PAGE_READONLY | PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) {
+            flags |= rp_read;
+        }
+        if (access & (PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) {
+            flags |= rp_write;
+        }
+        if (access & (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) {
+            flags |= rp_execute;
+        }
+        if (protect & PAGE_GUARD) {
+            flags |= rp_guard;
+        }
+        if ((flags & filter.protect) != filter.protect) {
+            return false;
+        }
+    }
+    if (filter.type) {
+        const uint32_t flags = (type == MEM_PRIVATE) ? rt_private : ((type == MEM_MAPPED) ? rt_mapped : rt_none);
+        if (!(flags & filter.type)) {
+            return false;
+        }
+    }
+    if (filter.state) {
+        const uint32_t flags = (state == MEM_COMMIT) ? rs_commit : ((state == MEM_RESERVE) ? rs_reserve : ((state == MEM_FREE) ? rs_free : rs_none));
+        if (!(flags & filter.state)) {
+            return false;
+        }
+    }
+    if (filter.min_size && (size <= filter.min_size)) {
+        return false;
+    }
+    if (filter.max_size && (size >= filter.max_size)) {
+        return false;
+    }
+    return true;
+}
+
+// parses a single ':<modifier>' starting at cmd[0], returns the number of characters consumed or 0 on error
+static int parse_region_modifier(const char* cmd, size_t len, search_scope_type* scope_type, region_filter* filter) {
+    if ((len < 2) || (cmd[0] != ':')) {
+        fprintf(stderr, unknown_command);
+        return 0;
+    }
+    switch (cmd[1]) {
+    case 'i':
+    case 's':
+    case 'o':
+        if (*scope_type != search_scope_type::mrt_all) {
+            fprintf(stderr, "Only one of the i|s|o modifiers can be used.\n");
+            return 0;
+        }
+        *scope_type = set_scope(cmd[1]);
+        return 2;
+    case 'r':
+        filter->protect |= rp_read;
+        return 2;
+    case 'w':
+        filter->protect |= rp_write;
+        return 2;
+    case 'x':
+        filter->protect |= rp_execute;
+        return 2;
+    case 'g':
+        filter->protect |= rp_guard;
+        return 2;
+    case 'p':
+        filter->type |= rt_private;
+        return 2;
+    case 'm':
+        filter->type |= rt_mapped;
+        return 2;
+    case 'c':
+        filter->state |= rs_commit;
+        return 2;
+    case 'u':
+        filter->state |= rs_reserve;
+        return 2;
+    case 'f':
+        filter->state |= rs_free;
+        return 2;
+    case '>':
+    case '<': {
+        size_t i = 2;
+        if (((i + 1) < len) && (cmd[i] == '0') && (cmd[i + 1] == 'x')) {
+            i += 2;
+        }
+        uint64_t size = 0;
+        size_t num_digits = 0;
+        for (; (i < len) && isxdigit((uint8_t)cmd[i]); i++, num_digits++) {
+            const char ch = cmd[i];
+            size = (size << 4) | (uint64_t)((ch <= '9') ? (ch - '0') : ((ch | 0x20) - 'a' + 10));
+        }
+        if ((i < len) && (cmd[i] == 'h')) {
+            i++;
+        }
+        if (!num_digits || (num_digits > 16) || ((i < len) && (cmd[i] != ':') && (cmd[i] != '@') && (cmd[i] != ' '))) {
+            fprintf(stderr, error_parsing_the_input);
+            return 0;
+        }
+        if (cmd[1] == '>') {
+            filter->min_size = size;
+        } else {
+            filter->max_size = size;
+        }
+        return (int)i;
+    }
+    default:
+        fprintf(stderr, unknown_command);
+        return 0;
+    }
+}
+
 static bool get_ptr(const char* cmd, void** p) {
     int res = sscanf_s(cmd, " @ %p", p);
     return res == 1;
@@ -560,6 +1017,138 @@ inline int skip_whitespace(const char* buf, size_t len) {
     }
 }
 
+static bool parse_module_name(const char* args, inspect_data* i_data) {
+    memset(i_data->module_name, 0, sizeof(i_data->module_name));
+#ifdef _UNICODE
+    char buffer[MAX_PATH];
+    memset(buffer, 0, sizeof(buffer));
+#elif defined(_MBCS)
+    static_assert(sizeof(i_data->module_name) == MAX_PATH, "Module name exceeds maximum size.");
+    char* buffer = i_data->module_name;
+#endif
+
+    int res = sscanf_s(args, " %s", buffer, MAX_PATH);
+    if (res < 1) {
+        fprintf(stderr, error_parsing_the_input);
+        return false;
+    }
+#ifdef _UNICODE
+    const int wc_size = MultiByteToWideChar(CP_UTF8, 0, buffer, -1, NULL, 0);
+    if (wc_size && (wc_size <= _countof(i_data->module_name))) {
+        int result = MultiByteToWideChar(CP_UTF8, 0, buffer, -1, i_data->module_name, wc_size);
+        if (result == 0) {
+            fprintf(stderr, "Error converting to wide character string: %s\n", buffer);
+            return false;
+        }
+    } else {
+        fprintf(stderr, "Module name exceeds maximum length: %s\n", buffer);
+        return false;
+    }
+#endif
+    return true;
+}
+
+// A result set reference: its decimal id or a name given with 'rs name'.
+static const char* parse_set_ref(const char* str, char* out) {
+    while (*str == ' ') {
+        str++;
+    }
+    size_t len = 0;
+    while (isalnum((unsigned char)str[len]) || (str[len] == '_')) {
+        len++;
+    }
+    if ((len == 0) || (len >= MAX_SET_NAME_LEN)) {
+        out[0] = 0;
+        return nullptr;
+    }
+    memcpy(out, str, len);
+    out[len] = 0;
+    return str + len;
+}
+
+static input_command parse_result_set_command(common_processing_context* ctx, const char* args) {
+    result_set_data& rs = ctx->rsdata;
+    static const struct { const char* name; result_set_op op; } ops[] = {
+        { "union", rso_union }, { "intersect", rso_intersect }, { "minus", rso_minus },
+        { "shift", rso_shift }, { "name", rso_name }, { "xb", rso_hexdump }, { "xw", rso_hexdump },
+        { "xd", rso_hexdump }, { "xq", rso_hexdump },
+    };
+    while (*args == ' ') {
+        args++;
+    }
+    rs.op = rso_show;
+    for (size_t i = 0; i < _countof(ops); i++) {
+        const size_t len = strlen(ops[i].name);
+        if ((0 == strncmp(args, ops[i].name, len)) && (args[len] == ' ')) {
+            rs.op = ops[i].op;
+            args += len;
+            break;
+        }
+    }
+    if (rs.op == rso_hexdump) {
+        switch (args[-1]) {
+        case 'b': rs.hex_mode = hexdump_mode::hm_bytes; break;
+        case 'w': rs.hex_mode = hexdump_mode::hm_words; break;
+        case 'd': rs.hex_mode = hexdump_mode::hm_dwords; break;
+        default: rs.hex_mode = hexdump_mode::hm_qwords; break;
+        }
+    }
+    rs.num_operands = 0;
+    rs.shift = 0;
+    rs.name[0] = 0;
+    // the operands, then the shift, the name or the hexdump length
+    const size_t max_operands = ((rs.op == rso_union) || (rs.op == rso_intersect)) ? MAX_SET_OPERANDS : ((rs.op == rso_minus) ? 2 : 1);
+    while (rs.num_operands < max_operands) {
+        while (*args == ' ') {
+            args++;
+        }
+        if ((*args == 0) || (*args == '+') || (*args == '-')) {
+            break;
+        }
+        args = parse_set_ref(args, rs.operands[rs.num_operands]);
+        if ((args == nullptr) || ((*args != ' ') && (*args != 0))) {
+            fprintf(stderr, error_parsing_the_input);
+            return c_continue;
+        }
+        rs.num_operands++;
+    }
+    while (*args == ' ') {
+        args++;
+    }
+    bool valid = rs.num_operands == max_operands;
+    switch (rs.op) {
+    case rso_union :
+    case rso_intersect :
+        valid = (rs.num_operands >= 2) && (*args == 0);
+        break;
+    case rso_shift : {
+        char* end = NULL;
+        const bool negative = *args == '-';
+        rs.shift = (int64_t)strtoull(args + 1, &end, 16);
+        rs.shift = negative ? -rs.shift : rs.shift;
+        valid = valid && ((*args == '+') || negative) && (end != args + 1) && (*end == 0);
+        break;
+    }
+    case rso_name :
+        args = parse_set_ref(args, rs.name);
+        valid = valid && (args != nullptr) && (*args == 0) && !isdigit((unsigned char)rs.name[0]);
+        break;
+    case rso_hexdump : {
+        char* end = NULL;
+        rs.hex_num = (size_t)strtoull(args, &end, 16);
+        valid = valid && (end != args) && (*end == 0) && rs.hex_num && ((rs.hex_num * rs.hex_mode) <= MAX_BYTE_TO_HEXDUMP);
+        break;
+    }
+    default:
+        valid = valid && (*args == 0);
+    }
+    if (!valid) {
+        fprintf(stderr, error_parsing_the_input);
+        return c_continue;
+    }
+    return c_result_set;
+}
+
 input_command parse_command_common(common_processing_context *ctx, search_data_info *data, char *pattern) {
     char* cmd = ctx->command;
     input_command command;
@@ -569,6 +1158,68 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
         fprintf(stderr, "Empty input.\n");
         return c_continue;
     }
+    ctx->background = false;
+    ctx->refine_set[0] = 0;
+    ctx->refine_offset = 0;
+    ctx->estimate_fraction = 0.0;
+    if (0 == strncmp(cmd, "/~est", 5)) { // /~est[=<percent>]<search command without the '/'> or /~est[=<percent>] <search command>
+        const char* rest = cmd + 5;
+        double percent = DEFAULT_ESTIMATE_PERCENT;
+        if (*rest == '=') {
+            char* end = NULL;
+            percent = strtod(rest + 1, &end);
+            if ((end == rest + 1) || (percent <= 0.0) || (percent > 100.0)) {
+                fprintf(stderr, error_parsing_the_input);
+                return c_continue;
+            }
+            rest = end;
+        }
+        const char* full = rest;
+        while (*full == ' ') {
+            full++;
+        }
+        if (*full == '/') {
+            rest = full + 1;
+        }
+        ctx->estimate_fraction = percent / 100.0;
+        memmove(cmd + 1, rest, strlen(rest) + 1);
+    }
+    if ((0 == strncmp(cmd, "/in", 3)) && (cmd[3] == ' ')) { // /in <set>[+|-<hex-offset>] <search command>
+        const char* end = parse_set_ref(cmd + 4, ctx->refine_set);
+        int64_t offset = 0;
+        if ((end != nullptr) && ((*end == '+') || (*end == '-'))) {
+            char* off_end = NULL;
+            offset = (int64_t)strtoull(end + 1, &off_end, 16);
+            if (off_end == end + 1) {
+                ctx->refine_set[0] = 0;
+                fprintf(stderr, error_parsing_the_input);
+                return c_continue;
+            }
+            offset = (*end == '-') ? -offset : offset;
+            end = off_end;
+        }
+        while ((end != nullptr) && (*end == ' ')) {
+            end++;
+        }
+        if ((end == nullptr) || (*end != '/')) {
+            ctx->refine_set[0] = 0;
+            fprintf(stderr, error_parsing_the_input);
+            return c_continue;
+        }
+        memmove(cmd, end, strlen(end) + 1);
+        ctx->refine_offset = offset;
+    }
+    if (cmd[0] == '/') {
+        size_t len = strlen(cmd);
+        if ((len > 2) && (cmd[len - 1] == '&') && (cmd[len - 2] == ' ')) {
+            len -= 2;
+            while (len && (cmd[len - 1] == ' ')) {
+                len--;
+            }
+            cmd[len] = 0;
+            ctx->background = true;
+        }
+    }
     if (cmd[0] == 0) {
         command = c_continue;
     } else if (((cmd[0] == 'q') && (cmd[1] == 0)) || (0 == strcmp(cmd, "exit"))) {
@@ -600,6 +1251,137 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
     } else if (0 == strcmp(cmd, "clear")) {
         clear_screen();
         command = c_continue;
+    } else if (0 == strcmp(cmd, "lr")) {
+        command = c_list_results;
+    } else if ((0 == strncmp(cmd, "rs", 2)) && (cmd[2] == ' ')) {
+        command = parse_result_set_command(ctx, cmd + 2);
+    } else if (0 == strcmp(cmd, "jobs")) {
+        command = c_list_jobs;
+    } else if ((0 == strncmp(cmd, "resume", 6)) && (cmd[6] == ' ')) {
+        DWORD id = 0;
+        if (!get_id(cmd + 6, &id)) {
+            fprintf(stderr, error_parsing_the_input);
+            return c_continue;
+        }
+        ctx->job_id = id;
+        command = c_resume_job;
+    } else if (((0 == strncmp(cmd, "wait", 4)) || (0 == strncmp(cmd, "kill", 4)) || (0 == strncmp(cmd, "show", 4))) && (cmd[4] == ' ')) {
+        DWORD id = 0;
+        if (!get_id(cmd + 4, &id)) {
+            fprintf(stderr, error_parsing_the_input);
+            return c_continue;
+        }
+        ctx->job_id = id;
+        command = (cmd[0] == 'w') ? c_wait_job : ((cmd[0] == 'k') ? c_kill_job : c_show_job);
+    } else if ((0 == strncmp(cmd, "verify", 6)) && ((cmd[6] == ' ') || (cmd[6] == 0))) {
+        const char* args = cmd + 6;
+        while (*args == ' ') {
+            args++;
+        }
+        if (*args == 0) {
+            memset(ctx->i_data.module_name, 0, sizeof(ctx->i_data.module_name));
+        } else if (!parse_module_name(args, &ctx->i_data)) {
+            return c_continue;
+        }
+        command = c_verify_modules;
+    } else if ((0 == strncmp(cmd, "extract", 7)) && (cmd[7] == ' ')) {
+        const char* args = cmd + 7;
+        while (*args == ' ') {
+            args++;
+        }
+        const char* dir = args;
+        while (*dir && (*dir != ' ')) {
+            dir++;
+        }
+        while (*dir == ' ') {
+            dir++;
+        }
+        if ((*args == 0) || (*dir == 0) || (strlen(dir) >= MAX_PATH)) {
+            fprintf(stderr, error_parsing_the_input);
+            return c_continue;
+        }
+        if ((args[0] == '*') && (args[1] == ' ')) {
+            memset(ctx->i_data.module_name, 0, sizeof(ctx->i_data.module_name));
+        } else if (!parse_module_name(args, &ctx->i_data)) {
+            return c_continue;
+        }
+        strcpy_s(ctx->i_data.file_path, MAX_PATH, dir);
+        command = c_extract_modules;
+    } else if ((0 == strncmp(cmd, "pack", 4)) && (cmd[4] == ' ')) {
+        const char* path = cmd + 4;
+        while (*path == ' ') {
+            path++;
+        }
+        if ((*path == 0) || (strlen(path) >= MAX_PATH)) {
+            fprintf(stderr, error_parsing_the_input);
+            return c_continue;
+        }
+        strcpy_s(ctx->i_data.file_path, MAX_PATH, path);
+        command = c_pack_dump;
+    } else if ((0 == strncmp(cmd, "carve", 5)) && ((cmd[5] == ' ') || (cmd[5] == ':') || (cmd[5] == '@') || (cmd[5] == '^'))) {
+        const char* args = cmd + 5;
+        const char* path = find_char(args, strlen(args), ' ');
+        if (!path) {
+            fprintf(stderr, error_parsing_the_input);
+            return c_continue;
+        }
+        const size_t spec_len = (size_t)(path - args);
+        while (*path == ' ') {
+            path++;
+        }
+        if ((*path == 0) || (strlen(path) >= MAX_PATH)) {
+            fprintf(stderr, error_parsing_the_input);
+            return c_continue;
+        }
+
+        carve_data& cvdata = ctx->cvdata;
+        cvdata.source = carve_source::cs_regions;
+        cvdata.scope_type = search_scope_type::mrt_all;
+        cvdata.filter = {};
+        cvdata.ranges.clear();
+        cvdata.context = 0;
+        if (args[0] == '@') {
+            cvdata.source = carve_source::cs_ranges;
+            const char* range = args;
+            while (range < path) {
+                const char* comma = find_char(range, spec_len - (size_t)(range - args), ',');
+                const size_t range_len = comma ? (size_t)(comma - range) : (spec_len - (size_t)(range - args));
+                char buffer[MAX_ARG_LEN];
+                void* p = nullptr;
+                int64_t size = 0;
+                if ((range_len + 1 >= sizeof(buffer))
+                    || (0 > sprintf_s(buffer, sizeof(buffer), "%.*s ", (int)range_len, range))
+                    || !get_ptr_and_size_1(buffer, &p, &size) || (size <= 0)) {
+                    fprintf(stderr, error_parsing_the_input);
+                    return c_continue;
+                }
+                cvdata.ranges.push_back(search_range{ (const char*)p, (uint64_t)size });
+                if (!comma) {
+                    break;
+                }
+                range = comma + 1;
+            }
+        } else if (args[0] == '^') {
+            cvdata.source = carve_source::cs_matches;
+            if (1 != sscanf_s(args + 1, "%llx", &cvdata.context)) {
+                fprintf(stderr, error_parsing_the_input);
+                return c_continue;
+            }
+        } else {
+            while (*args == ':') {
+                const int consumed = parse_region_modifier(args, (size_t)(path - args), &cvdata.scope_type, &cvdata.filter);
+                if (!consumed) {
+                    return c_continue;
+                }
+                args += consumed;
+            }
+            if (*args != ' ') {
+                fprintf(stderr, unknown_command);
+                return c_continue;
+            }
+        }
+        strcpy_s(ctx->i_data.file_path, MAX_PATH, path);
+        command = c_carve_dump;
     } else if (cmd[0] == '/') {
         if (cmd[1] == '?') {
             return c_help_search;
@@ -621,6 +1403,25 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
 #endif
         const int64_t pattern_len = arg_len - (ptrdiff_t)(args - cmd);
 
+        if ((0 == strncmp(cmd + 1, "xref", 4)) && ((cmd[5] == ' ') || (cmd[5] == 0))) {
+            void* p = nullptr;
+            if (sscanf_s(args, " %p", &p) != 1) {
+                fprintf(stderr, error_parsing_the_input);
+                return c_continue;
+            }
+            // executable image memory only
+            const uint64_t target = (uint64_t)p;
+            memset(pattern, 0, MAX_PATTERN_LEN);
+            memcpy(pattern, &target, sizeof(target));
+            ctx->pdata.pattern = pattern;
+            ctx->pdata.pattern_len = sizeof(target);
+            ctx->pdata.scope_type = search_scope_type::mrt_image;
+            ctx->pdata.filter = region_filter{};
+            ctx->pdata.filter.protect = rp_execute;
+            ctx->pdata.op = search_op::so_xref;
+            return c_search_pattern;
+        }
+
         int64_t cmd_length = arg_len - pattern_len;
         for (; cmd_length < arg_len; cmd_length--) {
             if (cmd[cmd_length - 1] != ' ') break;
@@ -629,6 +1430,7 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
         // defaults
         input_type in_type = input_type::it_hex_string;
         search_scope_type scope_type = search_scope_type::mrt_all;
+        region_filter filter = {};
         command = c_search_pattern;
         // modifiers
         bool stop_parsing = false;
@@ -640,23 +1442,14 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
             case 'a':
                 in_type = input_type::it_ascii_string;
                 break;
-            case ':':
-                if (scope_type != search_scope_type::mrt_all) {
-                    fprintf(stderr, "Scoped search and ranged search are incompatible.\n");
-                    return c_continue;
-                }
-                if ((i + 1) < cmd_length) {
-                    scope_type = set_scope(cmd[i + 1]);
-                    if (scope_type == search_scope_type::mrt_none) {
-                        puts(unknown_command);
-                        return c_continue;
-                    }
-                } else {
-                    puts(unknown_command);
+            case ':': {
+                const int consumed = parse_region_modifier(cmd + i, cmd_length - i, &scope_type, &filter);
+                if (!consumed) {
                     return c_continue;
                 }
-                stop_parsing = true;
+                i += consumed - 1;
                 break;
+            }
             case 'r':
                 in_type = input_type::it_hex_value; // temp
                 command = c_search_pattern_in_registers;
@@ -696,13 +1489,15 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
         }
 
         if (command == c_search_pattern_in_registers) {
-            if ((in_type != input_type::it_hex_value) || (scope_type != search_scope_type::mrt_all)) {
+            if ((in_type != input_type::it_hex_value) || (scope_type != search_scope_type::mrt_all) || region_filter_set(filter)) {
                 fprintf(stderr, unknown_command);
                 return c_continue;
             }
         }
 
         ctx->pdata.scope_type = scope_type;
+        ctx->pdata.filter = filter;
+        ctx->pdata.op = search_op::so_pattern;
         memset(pattern, 0, MAX_PATTERN_LEN);
         memcpy(pattern, args, pattern_len);
         data->pdata.pattern_len = (int64_t)pattern_len;
@@ -719,6 +1514,20 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
         if (cmd[1] == '?') {
             return c_help_hexdump;
         }
+        if (((cmd[1] == '+') || (cmd[1] == '-')) && (cmd[2] == 0)) {
+            if (!ctx->hdata.num_requested) {
+                fprintf(stderr, "No hexdump to continue.\n");
+                return c_continue;
+            }
+            // forward from the end of what was shown, back by the requested length
+            const uint64_t address = (uint64_t)ctx->hdata.address;
+            const uint64_t requested = ctx->hdata.num_requested * ctx->hdata.mode;
+            const uint64_t shown = ctx->hdata.num_to_display ? (ctx->hdata.num_to_display * ctx->hdata.mode) : requested;
+            ctx->hdata.address = (const uint8_t*)((cmd[1] == '+') ? (address + shown) : ((address > requested) ? (address - requested) : 0));
+            ctx->hdata.num_to_display = ctx->hdata.num_requested;
+            ctx->hdata.continued = true;
+            return c_print_hexdump;
+        }
         hexdump_mode mode;
         if (cmd[1] == 'b') {
             mode = hexdump_mode::hm_bytes;
@@ -783,6 +1592,8 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
 
         ctx->hdata.address = (uint8_t*)p;
         ctx->hdata.num_to_display = size;
+        ctx->hdata.num_requested = size;
+        ctx->hdata.continued = false;
         ctx->hdata.mode = mode;
         ctx->hdata.hex_op.op = op;
 
@@ -793,6 +1604,10 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
         }
         switch (cmd[1]) {
         case 'm': {
+            if ((cmd[2] == 'b') && (cmd[3] == 0)) {
+                command = c_inspect_memory_budget;
+                break;
+            }
             void* p = nullptr;
             if (!get_ptr(cmd + 2, &p)) {
                 return c_not_set;
@@ -803,33 +1618,9 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
         }
         case 'i': // same code as 'M'
         case 'M': {
-            memset(ctx->i_data.module_name, 0, sizeof(ctx->i_data.module_name));
-#ifdef _UNICODE
-            char buffer[MAX_PATH];
-            memset(buffer, 0, sizeof(buffer));
-#elif defined(_MBCS)
-            static_assert(sizeof(ctx->i_data.module_name) == MAX_PATH, "Module name exceeds maximum size.");
-            char* buffer = ctx->i_data.module_name;
-#endif
-
-            int res = sscanf_s(cmd + 2, " %s", buffer, MAX_PATH);
-            if (res < 1) {
-                fprintf(stderr, error_parsing_the_input);
+            if (!parse_module_name(cmd + 2, &ctx->i_data)) {
                 return c_continue;
             }
-#ifdef _UNICODE
-            const int wc_size = MultiByteToWideChar(CP_UTF8, 0, buffer, -1, NULL, 0);
-            if (wc_size && (wc_size <= _countof(ctx->i_data.module_name))) {
-                int result = MultiByteToWideChar(CP_UTF8, 0, buffer, -1, ctx->i_data.module_name, wc_size);
-                if (result == 0) {
-                    fprintf(stderr, "Error converting to wide character string: %s\n", buffer);
-                    return c_continue;
-                }
-            } else {
-                fprintf(stderr, "Module name exceeds maximum length: %s\n", buffer);
-                return c_continue;
-            }
-#endif
             if (cmd[1] == 'M') {
                 command = c_inspect_module;
             } else { // if cmd[1] == 'i'
@@ -872,21 +1663,21 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
                 // defaults
                 command = c_list_memory_regions_info;
                 search_scope_type scope_type = search_scope_type::mrt_all;
-                bool stop_parsing = false;
-                for (int i = 2; (i < cmd_length) && !stop_parsing; i++) {
+                region_filter filter = {};
+                for (int i = 2; i < cmd_length; i++) {
                     switch (cmd[i]) {
                     case 'c':
+                        if (i != 2) {
+                            return c_not_set;
+                        }
                         command = c_list_memory_regions_info_committed;
                         break;
                     case ':': {
-                        if ((i + 1) < cmd_length) {
-                            scope_type = set_scope(cmd[i + 1]);
-                            if (scope_type == search_scope_type::mrt_none) {
-                                fprintf(stderr, unknown_command);
-                                return c_continue;
-                            }
+                        const int consumed = parse_region_modifier(cmd + i, cmd_length - i, &scope_type, &filter);
+                        if (!consumed) {
+                            return c_continue;
                         }
-                        stop_parsing = true;
+                        i += consumed - 1;
                         break;
                     }
                     default:
@@ -894,6 +1685,7 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
                     }
                 }
                 ctx->pdata.scope_type = scope_type;
+                ctx->pdata.filter = filter;
 
             }
         } else if (cmd[1] == 'h' && cmd[2] == 0) {
@@ -908,6 +1700,12 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
         }
         const char* entropy = "entropy"; constexpr size_t entropy_sz = 7;
         const char* crc32c = "crc32c"; constexpr size_t crc32c_sz = 6;
+        const char* xxh3 = "xxh3"; constexpr size_t xxh3_sz = 4;
+        const char* sha256 = "sha256"; constexpr size_t sha256_sz = 6;
+        const char* blake3 = "blake3"; constexpr size_t blake3_sz = 6;
+        const char* hash = "hash"; constexpr size_t hash_sz = 4; // blake3
+        const char* regions = ":regions"; constexpr size_t regions_sz = 8;
+        const char* module = ":module "; constexpr size_t module_sz = 8;
 
         calculate_op op = calculate_op::co_none;
         size_t command_len = strlen(cmd);
@@ -922,10 +1720,81 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
             args += crc32c_sz;
             op = calculate_op::co_crc32c;
         }
+        else if (0 == memcmp(args, xxh3, xxh3_sz)) {
+            args += xxh3_sz;
+            op = calculate_op::co_xxh3;
+        }
+        else if (0 == memcmp(args, sha256, sha256_sz)) {
+            args += sha256_sz;
+            op = calculate_op::co_sha256;
+        }
+        else if (0 == memcmp(args, blake3, blake3_sz)) {
+            args += blake3_sz;
+            op = calculate_op::co_blake3;
+        }
+        else if (0 == memcmp(args, hash, hash_sz)) {
+            args += hash_sz;
+            op = calculate_op::co_blake3;
+        }
         else {
             fprintf(stderr, unknown_command);
             return c_continue;
         }
+        search_scope_type scope_type = search_scope_type::mrt_all;
+        region_filter filter = {};
+        if (0 == memcmp(args, module, module_sz)) {
+            if (op == calculate_op::co_entropy) {
+                fprintf(stderr, "Only the hashes can be calculated for a module.\n");
+                return c_continue;
+            }
+            if (!parse_module_name(args + module_sz, &ctx->i_data)) {
+                return c_continue;
+            }
+            ctx->cdata.address = nullptr;
+            ctx->cdata.size = 0;
+            ctx->cdata.op = op;
+            ctx->cdata.filter = filter;
+            ctx->cdata.scope_type = search_scope_type::mrt_all;
+            return c_hash_module;
+        }
+        const bool all_regions = (0 == memcmp(args, regions, regions_sz)) && ((args[regions_sz] == ':') || (args[regions_sz] == 0));
+        if (all_regions) {
+            if (op == calculate_op::co_entropy) {
+                fprintf(stderr, "Only the hashes can be calculated per region.\n");
+                return c_continue;
+            }
+            args += regions_sz;
+            while (*args == ':') {
+                const int consumed = parse_region_modifier(args, strlen(args), &scope_type, &filter);
+                if (!consumed) {
+                    return c_continue;
+                }
+                args += consumed;
+            }
+            if (*args) {
+                fprintf(stderr, error_parsing_the_input);
+                return c_continue;
+            }
+            ctx->cdata.address = nullptr;
+            ctx->cdata.size = 0;
+            ctx->cdata.op = op;
+            ctx->cdata.filter = filter;
+            ctx->cdata.scope_type = scope_type;
+            return c_hash_regions;
+        }
+        while (*args == ':') {
+            const char* at = find_char(args, strlen(args), '@');
+            const size_t modifiers_len = at ? (size_t)(at - args) : strlen(args);
+            const int consumed = parse_region_modifier(args, modifiers_len, &scope_type, &filter);
+            if (!consumed) {
+                return c_continue;
+            }
+            args += consumed;
+        }
+        if (scope_type != search_scope_type::mrt_all) {
+            fprintf(stderr, "Calculation commands accept only the region filter modifiers.\n");
+            return c_continue;
+        }
         void* p = nullptr;
         int64_t size = 0;
         if (!get_ptr_and_size_1(args, &p, &size)) {
@@ -933,15 +1802,47 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
             return c_continue;
         }
 
-        if (size <= 0 || size > MAX_CALCULATION_BLOCK_SIZE) {
-            fprintf(stderr, "Block size exceed maximum size: 0x%llx", MAX_CALCULATION_BLOCK_SIZE);
+        const bool is_hash = (op != calculate_op::co_entropy) && (op != calculate_op::co_crc32c);
+        const int64_t max_size = is_hash ? MAX_HASH_BLOCK_SIZE : MAX_CALCULATION_BLOCK_SIZE;
+        if (size <= 0 || size > max_size) {
+            fprintf(stderr, "Block size exceed maximum size: 0x%llx", max_size);
             return c_continue;
         }
 
         ctx->cdata.address = (const uint8_t*)p;
         ctx->cdata.size = size;
         ctx->cdata.op = op;
+        ctx->cdata.filter = filter;
+        ctx->cdata.scope_type = search_scope_type::mrt_all;
         command = c_calculate;
+    } else if ((0 == strncmp(cmd, "sim", 3)) && ((cmd[3] == ':') || (cmd[3] == '@'))) {
+        const char* args = cmd + 3;
+        search_scope_type scope_type = search_scope_type::mrt_all;
+        region_filter filter = {};
+        while (*args == ':') {
+            const char* at = find_char(args, strlen(args), '@');
+            const size_t modifiers_len = at ? (size_t)(at - args) : strlen(args);
+            const int consumed = parse_region_modifier(args, modifiers_len, &scope_type, &filter);
+            if (!consumed) {
+                return c_continue;
+            }
+            args += consumed;
+        }
+        void* p = nullptr;
+        int64_t size = 0;
+        if (!get_ptr_and_size_1(args, &p, &size)) {
+            fprintf(stderr, error_parsing_the_input);
+            return c_continue;
+        }
+        if ((size < SIM_MIN_WINDOW) || (size > MAX_CALCULATION_BLOCK_SIZE)) {
+            fprintf(stderr, "The block size has to be between 0x%x and 0x%x.\n", SIM_MIN_WINDOW, MAX_CALCULATION_BLOCK_SIZE);
+            return c_continue;
+        }
+        ctx->simdata.address = (const uint8_t*)p;
+        ctx->simdata.size = size;
+        ctx->simdata.scope_type = scope_type;
+        ctx->simdata.filter = filter;
+        command = c_similarity_search;
     } else if (cmd[0] == 's') {
         if (g_disable_symbols) {
             fprintf(stderr, unknown_command);
@@ -1006,6 +1907,26 @@ input_command parse_command_common(common_processing_context *ctx, search_data_i
     return command;
 }
 
+static void evict_last_matches(void* owner) {
+    std::vector<const char*>().swap(((common_processing_context*)owner)->last_matches);
+}
+
+void store_last_matches(common_processing_context* ctx, const std::vector<search_match>& matches) {
+    if (ctx->last_matches_budget_id == -1) {
+        ctx->last_matches_budget_id = mem_budget_register("last search matches", 0x01, evict_last_matches, ctx);
+    }
+    mem_budget_release(ctx->last_matches_budget_id, ctx->last_matches.size() * sizeof(const char*));
+    std::vector<const char*>().swap(ctx->last_matches);
+    if (!mem_budget_charge(ctx->last_matches_budget_id, matches.size() * sizeof(const char*))) {
+        fprintf(stderr, "The memory limit has been reached, the matches are not kept.\n");
+        return;
+    }
+    ctx->last_matches.reserve(matches.size());
+    for (const search_match& match : matches) {
+        ctx->last_matches.push_back(match.match_address);
+    }
+}
+
 uint64_t prepare_matches(const common_processing_context* ctx, std::vector<search_match>& matches) {
     uint64_t num_matches = matches.size();
 
@@ -1018,11 +1939,16 @@ uint64_t prepare_matches(const common_processing_context* ctx, std::vector<searc
         return 0;
     }
 
+    dedup_matches(matches);
+
+    return matches.size();
+}
+
+// sorts the matches, overlapping blocks and resumed jobs report some of them twice
+void dedup_matches(std::vector<search_match>& matches) {
     std::sort(matches.begin(), matches.end(), search_match_less);
     matches.erase(std::unique(matches.begin(), matches.end(),
         [](const search_match& a, const search_match& b) { return a.match_address == b.match_address; }), matches.end());
-
-    return matches.size();
 }
 
 void print_hexdump(const hexdump_data& hdata, const uint8_t* bytes, size_t length) {
@@ -1114,6 +2040,160 @@ void print_hexdump(const hexdump_data& hdata, const uint8_t* bytes, size_t lengt
     puts("");
 }
 
+void init_hexdump_cache(hexdump_cache* cache, hexdump_read_page_callback read_page, void* owner, uint32_t max_age_ms) {
+    cache->read_page = read_page;
+    cache->owner = owner;
+    cache->max_age_ms = max_age_ms;
+}
+
+// the cache lock is held
+static const hexdump_page* find_hexdump_page(hexdump_cache* cache, uint64_t address) {
+    auto it = cache->pages.find(address);
+    if (it == cache->pages.end()) {
+        return nullptr;
+    }
+    if (cache->max_age_ms && ((GetTickCount64() - it->second.read_tick) > cache->max_age_ms)) {
+        cache->pages.erase(it);
+        return nullptr;
+    }
+    it->second.last_use = ++cache->clock;
+    return &it->second;
+}
+
+// the cache lock is held
+static const hexdump_page* insert_hexdump_page(hexdump_cache* cache, uint64_t address, const uint8_t* data, size_t size, ULONGLONG read_tick) {
+    if ((cache->pages.size() >= HEXDUMP_CACHE_PAGES) && !cache->pages.count(address)) {
+        auto victim = cache->pages.begin();
+        for (auto it = cache->pages.begin(); it != cache->pages.end(); ++it) {
+            if (it->second.last_use < victim->second.last_use) {
+                victim = it;
+            }
+        }
+        cache->pages.erase(victim);
+    }
+    hexdump_page& page = cache->pages[address];
+    page.size = size;
+    page.last_use = ++cache->clock;
+    page.read_tick = read_tick;
+    memcpy(page.data, data, size);
+    return &page;
+}
+
+static void prefetch_hexdump_pages(hexdump_cache* cache) {
+    std::vector<uint64_t> addresses;
+    std::vector<uint8_t> data(HEXDUMP_PAGE_SIZE);
+    while (1) {
+        {
+            std::unique_lock<std::mutex> lk(cache->lock);
+            cache->prefetch_cv.wait(lk, [cache] { return cache->exit || !cache->prefetch_queue.empty(); });
+            if (cache->exit) {
+                return;
+            }
+            addresses.swap(cache->prefetch_queue);
+            cache->prefetch_queue.clear();
+        }
+        for (uint64_t address : addresses) {
+            uint32_t generation;
+            {
+                std::unique_lock<std::mutex> lk(cache->lock);
+                if (cache->exit || !cache->prefetch_queue.empty()) {
+                    break; // a newer dump has been requested
+                }
+                if (find_hexdump_page(cache, address)) {
+                    continue;
+                }
+                generation = cache->generation;
+            }
+            size_t size;
+            {
+                std::unique_lock<std::mutex> rlk(cache->read_lock);
+                size = cache->read_page(cache->owner, address, data.data());
+            }
+            std::unique_lock<std::mutex> lk(cache->lock);
+            if (generation == cache->generation) {
+                insert_hexdump_page(cache, address, data.data(), size, GetTickCount64());
+            }
+        }
+    }
+}
+
+void stop_hexdump_cache(hexdump_cache* cache) {
+    {
+        std::unique_lock<std::mutex> lk(cache->lock);
+        cache->exit = true;
+    }
+    cache->prefetch_cv.notify_one();
+    if (cache->prefetcher.joinable()) {
+        cache->prefetcher.join();
+    }
+}
+
+// The source has changed (another process has been selected). change_source runs with the reads blocked,
+// so the prefetch thread never reads through a source being replaced.
+void invalidate_hexdump_cache(hexdump_cache* cache, void (*change_source)(void* owner)) {
+    std::unique_lock<std::mutex> rlk(cache->read_lock);
+    if (change_source) {
+        change_source(cache->owner);
+    }
+    std::unique_lock<std::mutex> lk(cache->lock);
+    cache->pages.clear();
+    cache->prefetch_queue.clear();
+    cache->generation++;
+}
+
+// Reads through the cache up to the first unmapped byte and queues the pages of the previous and the next
+// dump of the same length for the prefetch. Returns the number of bytes read.
+size_t read_hexdump_memory(hexdump_cache* cache, uint64_t address, uint8_t* buffer, size_t size) {
+    constexpr uint64_t page_mask = HEXDUMP_PAGE_SIZE - 1;
+    size_t bytes_read = 0;
+    while (bytes_read < size) {
+        const uint64_t page_address = (address + bytes_read) & ~page_mask;
+        const size_t offset = (size_t)((address + bytes_read) & page_mask);
+        std::unique_lock<std::mutex> lk(cache->lock);
+        const hexdump_page* page = find_hexdump_page(cache, page_address);
+        if (!page) {
+            lk.unlock();
+            uint8_t data[HEXDUMP_PAGE_SIZE];
+            size_t page_size;
+            {
+                std::unique_lock<std::mutex> rlk(cache->read_lock);
+                page_size = cache->read_page(cache->owner, page_address, data);
+            }
+            lk.lock();
+            page = insert_hexdump_page(cache, page_address, data, page_size, GetTickCount64());
+        }
+        if (page->size <= offset) {
+            break;
+        }
+        const size_t bytes_to_copy = _min(page->size - offset, size - bytes_read);
+        memcpy(buffer + bytes_read, page->data + offset, bytes_to_copy);
+        bytes_read += bytes_to_copy;
+        if (page->size < HEXDUMP_PAGE_SIZE) {
+            break;
+        }
+    }
+
+    const uint64_t first_page = address & ~page_mask;
+    const uint64_t span = ((address + size + page_mask) & ~page_mask) - first_page;
+    {
+        std::unique_lock<std::mutex> lk(cache->lock);
+        cache->prefetch_queue.clear();
+        for (uint64_t p = first_page + span, end = p + span; p < end; p += HEXDUMP_PAGE_SIZE) {
+            cache->prefetch_queue.push_back(p);
+        }
+        if (first_page >= span) {
+            for (uint64_t p = first_page - span; p < first_page; p += HEXDUMP_PAGE_SIZE) {
+                cache->prefetch_queue.push_back(p);
+            }
+        }
+        if (!cache->prefetcher.joinable() && !cache->exit) {
+            cache->prefetcher = std::thread(prefetch_hexdump_pages, cache);
+        }
+    }
+    cache->prefetch_cv.notify_one();
+    return bytes_read;
+}
+
 static void clear_screen() {
     wprintf(L"\x1b[2J \x1b[3J \x1b[0;0H");
 }
@@ -1235,6 +2315,283 @@ void print_image_info(const common_processing_context* ctx) {
     CloseHandle(file_handle);
 }
 
+struct verify_chunk {
+    uint32_t section;
+    uint32_t rva;
+    uint32_t size;
+};
+
+struct verify_diff {
+    uint32_t rva;
+    uint32_t size;
+};
+
+inline bool verify_diff_less(const verify_diff& a, const verify_diff& b) {
+    return a.rva < b.rva;
+}
+
+static void add_verify_diff(std::vector<verify_diff>& diffs, uint32_t rva, uint32_t size) {
+    if (!diffs.empty() && ((diffs.back().rva + diffs.back().size) == rva)) {
+        diffs.back().size += size;
+    } else {
+        diffs.push_back(verify_diff{ rva, size });
+    }
+}
+
+static void find_diff_ranges(const uint8_t* a, const uint8_t* b, uint32_t size, uint32_t rva, std::vector<verify_diff>& diffs) {
+    constexpr uint32_t step = sizeof(__m128i);
+    uint32_t i = 0;
+    for (; (i + step) <= size; i += step) {
+        const __m128i xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(xmm0, xmm1)) ^ 0xFFFF;
+        unsigned long bit = 0;
+        while (_BitScanForward(&bit, mask)) {
+            add_verify_diff(diffs, rva + i + bit, 1);
+            mask ^= (1 << bit);
+        }
+    }
+    for (; i < size; i++) {
+        if (a[i] != b[i]) {
+            add_verify_diff(diffs, rva + i, 1);
+        }
+    }
+}
+
+// Builds the image the loader would have produced at base_of_image: sections at their RVAs, relocations applied.
+static uint8_t* build_scratch_image(const uint8_t* file_base, uint64_t file_size, const IMAGE_NT_HEADERS* nt_headers, const char* base_of_image) {
+    const IMAGE_OPTIONAL_HEADER& optional_header = nt_headers->OptionalHeader;
+    const uint32_t size_of_image = optional_header.SizeOfImage;
+    uint8_t* image = (uint8_t*)VirtualAlloc(NULL, size_of_image, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!image) {
+        return nullptr;
+    }
+    memcpy(image, file_base, _min(optional_header.SizeOfHeaders, _min(file_size, size_of_image)));
+
+    const IMAGE_SECTION_HEADER* sections = IMAGE_FIRST_SECTION(nt_headers);
+    for (WORD i = 0; i < nt_headers->FileHeader.NumberOfSections; i++) {
+        const IMAGE_SECTION_HEADER& section = sections[i];
+        if (!section.SizeOfRawData || (section.PointerToRawData >= file_size) || (section.VirtualAddress >= size_of_image)) {
+            continue;
+        }
+        uint64_t raw_size = _min(section.SizeOfRawData, file_size - section.PointerToRawData);
+        if (section.Misc.VirtualSize) {
+            raw_size = _min(raw_size, section.Misc.VirtualSize);
+        }
+        raw_size = _min(raw_size, size_of_image - section.VirtualAddress);
+        memcpy(image + section.VirtualAddress, file_base + section.PointerToRawData, raw_size);
+    }
+
+    const int64_t delta = (int64_t)((uint64_t)base_of_image - optional_header.ImageBase);
+    const IMAGE_DATA_DIRECTORY& reloc_dir = optional_header.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+    if (delta && reloc_dir.VirtualAddress && ((uint64_t)reloc_dir.VirtualAddress + reloc_dir.Size <= size_of_image)) {
+        const uint8_t* reloc = image + reloc_dir.VirtualAddress;
+        const uint8_t* reloc_end = reloc + reloc_dir.Size;
+        while ((reloc + sizeof(IMAGE_BASE_RELOCATION)) <= reloc_end) {
+            const IMAGE_BASE_RELOCATION* block = (const IMAGE_BASE_RELOCATION*)reloc;
+            if ((block->SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION)) || ((reloc + block->SizeOfBlock) > reloc_end)) {
+                break;
+            }
+            const WORD* entries = (const WORD*)(reloc + sizeof(IMAGE_BASE_RELOCATION));
+            const size_t num_entries = (block->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
+            for (size_t e = 0; e < num_entries; e++) {
+                const WORD type = entries[e] >> 12;
+                const uint64_t rva = (uint64_t)block->VirtualAddress + (entries[e] & 0xFFF);
+                if (type == IMAGE_REL_BASED_DIR64) {
+                    if ((rva + sizeof(uint64_t)) <= size_of_image) {
+                        *(uint64_t*)(image + rva) += delta;
+                    }
+                } else if (type == IMAGE_REL_BASED_HIGHLOW) {
+                    if ((rva + sizeof(uint32_t)) <= size_of_image) {
+                        *(uint32_t*)(image + rva) += (uint32_t)delta;
+                    }
+                }
+            }
+            reloc += block->SizeOfBlock;
+        }
+    }
+    return image;
+}
+
+struct verify_context {
+    const uint8_t* scratch;
+    const char* base_of_image;
+    uint32_t iat_rva;
+    uint32_t iat_size;
+    const std::vector<verify_chunk>* chunks;
+    std::atomic<size_t> next_chunk{ 0 };
+    read_memory_callback read_memory;
+    const void* read_ctx;
+    std::vector<std::vector<verify_diff>> diffs; // per section
+    std::vector<uint64_t> unreadable; // per section
+    std::mutex mtx;
+};
+
+static void verify_worker(verify_context* vctx) {
+    SYSTEM_INFO sysinfo = { 0 };
+    GetSystemInfo(&sysinfo);
+    const uint32_t page_size = sysinfo.dwPageSize;
+
+    uint8_t* buffer = (uint8_t*)malloc(VERIFY_CHUNK_SIZE);
+    std::vector<verify_diff> diffs;
+    const std::vector<verify_chunk>& chunks = *vctx->chunks;
+    while (1) {
+        const size_t chunk_id = vctx->next_chunk++;
+        if (chunk_id >= chunks.size()) {
+            break;
+        }
+        const verify_chunk& chunk = chunks[chunk_id];
+        const uint8_t* expected = vctx->scratch + chunk.rva;
+        diffs.clear();
+        uint64_t unreadable = 0;
+
+        const bool chunk_read = vctx->read_memory(vctx->read_ctx, vctx->base_of_image + chunk.rva, buffer, chunk.size);
+        for (uint32_t offset = 0; offset < chunk.size; offset += page_size) {
+            const uint32_t size = _min(page_size, chunk.size - offset);
+            if (!chunk_read && !vctx->read_memory(vctx->read_ctx, vctx->base_of_image + chunk.rva + offset, buffer + offset, size)) {
+                unreadable += size;
+                continue;
+            }
+            // the loader writes the import addresses
+            const uint32_t rva = chunk.rva + offset;
+            if (vctx->iat_size && (rva < (vctx->iat_rva + vctx->iat_size)) && ((rva + size) > vctx->iat_rva)) {
+                const uint32_t start = _max(rva, vctx->iat_rva);
+                const uint32_t end = _min(rva + size, vctx->iat_rva + vctx->iat_size);
+                memcpy(buffer + offset + (start - rva), expected + offset + (start - rva), end - start);
+            }
+            if (compute_crc32c(buffer + offset, size) == compute_crc32c(expected + offset, size)) {
+                continue;
+            }
+            find_diff_ranges(buffer + offset, expected + offset, size, rva, diffs);
+        }
+
+        if (!diffs.empty() || unreadable) {
+            std::unique_lock<std::mutex> lk(vctx->mtx);
+            auto& section_diffs = vctx->diffs[chunk.section];
+            section_diffs.insert(section_diffs.end(), diffs.begin(), diffs.end());
+            vctx->unreadable[chunk.section] += unreadable;
+        }
+    }
+    free(buffer);
+}
+
+int64_t verify_module(const char* file_path, const char* base_of_image, uint64_t size_of_image, read_memory_callback read_memory, const void* read_ctx) {
+    HANDLE file_handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Error opening file: %lu\n", GetLastError());
+        return -1;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size)) {
+        fprintf(stderr, "Error reading the file size: %lu\n", GetLastError());
+        CloseHandle(file_handle);
+        return -1;
+    }
+    HANDLE mapping_handle = CreateFileMapping(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping_handle) {
+        fprintf(stderr, "Error creating file mapping: %lu\n", GetLastError());
+        CloseHandle(file_handle);
+        return -1;
+    }
+    LPVOID file_base = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (!file_base) {
+        fprintf(stderr, "Error mapping view of file: %lu\n", GetLastError());
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        return -1;
+    }
+
+    int64_t num_diff_bytes = -1;
+    uint8_t* scratch = nullptr;
+    PIMAGE_NT_HEADERS nt_headers = ImageNtHeader(file_base);
+    if (!nt_headers || (nt_headers->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR64_MAGIC)) {
+        fprintf(stderr, "Invalid or not a 64-bit PE file\n");
+    } else if (nt_headers->OptionalHeader.SizeOfImage != size_of_image) {
+        fprintf(stderr, "The file doesn't match the loaded module: size of image 0x%x, expected 0x%llx\n", nt_headers->OptionalHeader.SizeOfImage, size_of_image);
+    } else if (!(scratch = build_scratch_image((const uint8_t*)file_base, (uint64_t)file_size.QuadPart, nt_headers, base_of_image))) {
+        fprintf(stderr, "Failed allocating 0x%llx bytes.\n", size_of_image);
+    } else {
+        // writable sections are expected to differ
+        const IMAGE_SECTION_HEADER* sections = IMAGE_FIRST_SECTION(nt_headers);
+        const WORD num_sections = nt_headers->FileHeader.NumberOfSections;
+        std::vector<verify_chunk> chunks;
+        for (WORD i = 0; i < num_sections; i++) {
+            const IMAGE_SECTION_HEADER& section = sections[i];
+            if ((section.Characteristics & IMAGE_SCN_MEM_WRITE) || !section.SizeOfRawData || (section.VirtualAddress >= size_of_image)) {
+                continue;
+            }
+            const uint64_t section_size = _min((uint64_t)(section.Misc.VirtualSize ? section.Misc.VirtualSize : section.SizeOfRawData), size_of_image - section.VirtualAddress);
+            for (uint64_t offset = 0; offset < section_size; offset += VERIFY_CHUNK_SIZE) {
+                chunks.push_back(verify_chunk{ i, (uint32_t)(section.VirtualAddress + offset), (uint32_t)(_min(VERIFY_CHUNK_SIZE, section_size - offset)) });
+            }
+        }
+
+        verify_context vctx;
+        vctx.scratch = scratch;
+        vctx.base_of_image = base_of_image;
+        vctx.iat_rva = nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IAT].VirtualAddress;
+        vctx.iat_size = nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IAT].Size;
+        vctx.chunks = &chunks;
+        vctx.read_memory = read_memory;
+        vctx.read_ctx = read_ctx;
+        vctx.diffs.resize(num_sections);
+        vctx.unreadable.resize(num_sections, 0);
+
+        const size_t num_threads = _min(_min(std::thread::hardware_concurrency(), (size_t)g_max_threads), chunks.size());
+        std::vector<std::thread> workers; workers.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; i++) {
+            workers.push_back(std::thread(verify_worker, &vctx));
+        }
+        for (auto& w : workers) {
+            if (w.joinable()) {
+                w.join();
+            }
+        }
+
+        num_diff_bytes = 0;
+        for (WORD i = 0; i < num_sections; i++) {
+            auto& diffs = vctx.diffs[i];
+            if (diffs.empty() && !vctx.unreadable[i]) {
+                continue;
+            }
+            std::sort(diffs.begin(), diffs.end(), verify_diff_less);
+            std::vector<verify_diff> merged;
+            uint64_t section_diff_bytes = 0;
+            for (const auto& d : diffs) {
+                add_verify_diff(merged, d.rva, d.size);
+                section_diff_bytes += d.size;
+            }
+            num_diff_bytes += section_diff_bytes;
+
+            char name[IMAGE_SIZEOF_SHORT_NAME + 1];
+            memcpy(name, sections[i].Name, IMAGE_SIZEOF_SHORT_NAME);
+            name[IMAGE_SIZEOF_SHORT_NAME] = 0;
+            printf("Section %s: %llu modified range(s), 0x%llx byte(s)", name, (uint64_t)merged.size(), section_diff_bytes);
+            if (vctx.unreadable[i]) {
+                printf(", 0x%llx byte(s) couldn't be read", vctx.unreadable[i]);
+            }
+            puts("");
+            for (size_t d = 0, sz = merged.size(); d < sz; d++) {
+                if (d == TOO_MANY_RESULTS) {
+                    printf("\t... %llu more\n", (uint64_t)(sz - d));
+                    break;
+                }
+                const char* start = base_of_image + merged[d].rva;
+                printf("\t0x%p - 0x%p (0x%x bytes)\n", start, start + merged[d].size, merged[d].size);
+            }
+        }
+        if (!num_diff_bytes) {
+            puts("No modifications found.");
+        }
+        VirtualFree(scratch, 0, MEM_RELEASE);
+    }
+
+    UnmapViewOfFile(file_base);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    return num_diff_bytes;
+}
+
 uint32_t compute_crc32c(const uint8_t* data, size_t length) {
     constexpr size_t chunk_size = sizeof(uint64_t);
     uint32_t crc = 0xFFFFFFFF;
@@ -1263,13 +2620,607 @@ void data_block_calculate_common(calculate_data* cdata, uint8_t* bytes, size_t s
         entropy_calculate_frequencies(&e_ctx, bytes, size);
         const double entropy = entropy_compute(&e_ctx, size);
         printf("Block Start: 0x%p, Size: 0x%llx, Entropy: %.2f\n", cdata->address, size, entropy);
-    } else { // if ctx->common.cdata.op == calculate_op::co_crc32c
+    } else if (cdata->op == calculate_op::co_crc32c) {
         const uint32_t crc = compute_crc32c(bytes, size);
         printf("Block Start: 0x%p, Size: 0x%llx, CRC32C: 0x%08x\n", cdata->address, size, crc);
+    } else {
+        uint8_t digest[MAX_DIGEST_SIZE];
+        const size_t num_threads = _min((size_t)std::thread::hardware_concurrency(), (size_t)g_max_threads);
+        const size_t digest_size = compute_digest(cdata->op, bytes, size, digest, num_threads);
+        printf("Block Start: 0x%p, Size: 0x%llx, %s: ", cdata->address, size, calculate_op_name(cdata->op));
+        print_digest(digest, digest_size);
+        puts("");
     }
     puts("");
 }
 
+size_t compute_digest(calculate_op op, const uint8_t* data, size_t length, uint8_t* digest, size_t num_threads) {
+    switch (op) {
+    case calculate_op::co_crc32c: {
+        const uint32_t crc = _byteswap_ulong(compute_crc32c(data, length));
+        memcpy(digest, &crc, sizeof(crc));
+        return sizeof(crc);
+    }
+    case calculate_op::co_xxh3: {
+        const uint64_t h = _byteswap_uint64(compute_xxh3(data, length));
+        memcpy(digest, &h, sizeof(h));
+        return sizeof(h);
+    }
+    case calculate_op::co_sha256:
+        compute_sha256(data, length, digest);
+        return 0x20;
+    case calculate_op::co_blake3:
+        compute_blake3(data, length, digest, num_threads);
+        return 0x20;
+    default:
+        return 0;
+    }
+}
+
+const char* calculate_op_name(calculate_op op) {
+    switch (op) {
+    case calculate_op::co_entropy: return "Entropy";
+    case calculate_op::co_crc32c: return "CRC32C";
+    case calculate_op::co_xxh3: return "XXH3";
+    case calculate_op::co_sha256: return "SHA256";
+    case calculate_op::co_blake3: return "BLAKE3";
+    default: return "";
+    }
+}
+
+void print_digest(const uint8_t* digest, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        printf("%02x", digest[i]);
+    }
+}
+
+// xxh3 (64 bit, default secret, seed 0)
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+#define XXH_STRIPE_LEN 0x40
+#define XXH_SECRET_SIZE 0xC0
+#define XXH_STRIPES_PER_BLOCK ((XXH_SECRET_SIZE - XXH_STRIPE_LEN) / 8)
+
+static const uint8_t xxh3_secret[XXH_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+inline uint32_t read_u32(const uint8_t* p) {
+    uint32_t v; memcpy(&v, p, sizeof(v)); return v;
+}
+
+inline uint64_t read_u64(const uint8_t* p) {
+    uint64_t v; memcpy(&v, p, sizeof(v)); return v;
+}
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t mul128_fold64(uint64_t a, uint64_t b) {
+    uint64_t hi = 0;
+    const uint64_t lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+}
+
+static uint64_t xxh64_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+static uint64_t xxh3_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    return h ^ (h >> 32);
+}
+
+static uint64_t xxh3_rrmxmx(uint64_t h, uint64_t len) {
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= XXH_PRIME_MX2;
+    h ^= (h >> 35) + len;
+    h *= XXH_PRIME_MX2;
+    return h ^ (h >> 28);
+}
+
+inline uint64_t xxh3_mix16(const uint8_t* data, const uint8_t* secret) {
+    return mul128_fold64(read_u64(data) ^ read_u64(secret), read_u64(data + 8) ^ read_u64(secret + 8));
+}
+
+static uint64_t xxh3_short(const uint8_t* data, size_t len) {
+    const uint8_t* secret = xxh3_secret;
+    if (len > 8) {
+        const uint64_t lo = read_u64(data) ^ (read_u64(secret + 24) ^ read_u64(secret + 32));
+        const uint64_t hi = read_u64(data + len - 8) ^ (read_u64(secret + 40) ^ read_u64(secret + 48));
+        return xxh3_avalanche(len + _byteswap_uint64(lo) + hi + mul128_fold64(lo, hi));
+    }
+    if (len >= 4) {
+        const uint64_t input = read_u32(data + len - 4) + ((uint64_t)read_u32(data) << 32);
+        return xxh3_rrmxmx(input ^ (read_u64(secret + 8) ^ read_u64(secret + 16)), len);
+    }
+    if (len) {
+        const uint32_t combined = ((uint32_t)data[0] << 16) | ((uint32_t)data[len >> 1] << 24) | data[len - 1] | ((uint32_t)len << 8);
+        return xxh64_avalanche(combined ^ (uint64_t)(read_u32(secret) ^ read_u32(secret + 4)));
+    }
+    return xxh64_avalanche(read_u64(secret + 56) ^ read_u64(secret + 64));
+}
+
+static uint64_t xxh3_medium(const uint8_t* data, size_t len) {
+    const uint8_t* secret = xxh3_secret;
+    uint64_t acc = len * XXH_PRIME64_1;
+    if (len <= 128) {
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc += xxh3_mix16(data + 48, secret + 96);
+                    acc += xxh3_mix16(data + len - 64, secret + 112);
+                }
+                acc += xxh3_mix16(data + 32, secret + 64);
+                acc += xxh3_mix16(data + len - 48, secret + 80);
+            }
+            acc += xxh3_mix16(data + 16, secret + 32);
+            acc += xxh3_mix16(data + len - 32, secret + 48);
+        }
+        acc += xxh3_mix16(data, secret);
+        acc += xxh3_mix16(data + len - 16, secret + 16);
+        return xxh3_avalanche(acc);
+    }
+    for (size_t i = 0; i < 8; i++) {
+        acc += xxh3_mix16(data + 16 * i, secret + 16 * i);
+    }
+    acc = xxh3_avalanche(acc);
+    for (size_t i = 8, rounds = len / 16; i < rounds; i++) {
+        acc += xxh3_mix16(data + 16 * i, secret + 16 * (i - 8) + 3);
+    }
+    acc += xxh3_mix16(data + len - 16, secret + 136 - 17);
+    return xxh3_avalanche(acc);
+}
+
+inline void xxh3_accumulate_stripe(__m128i* acc, const uint8_t* data, const uint8_t* secret) {
+    for (size_t i = 0; i < 4; i++) {
+        const __m128i data_vec = _mm_loadu_si128((const __m128i*)(data + 16 * i));
+        const __m128i data_key = _mm_xor_si128(data_vec, _mm_loadu_si128((const __m128i*)(secret + 16 * i)));
+        const __m128i product = _mm_mul_epu32(data_key, _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1)));
+        acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, _mm_shuffle_epi32(data_vec, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+}
+
+inline void xxh3_scramble(__m128i* acc, const uint8_t* secret) {
+    const __m128i prime = _mm_set1_epi32((int)XXH_PRIME32_1);
+    for (size_t i = 0; i < 4; i++) {
+        __m128i a = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*)(secret + 16 * i)));
+        const __m128i product_lo = _mm_mul_epu32(a, prime);
+        const __m128i product_hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        acc[i] = _mm_add_epi64(product_lo, _mm_slli_epi64(product_hi, 32));
+    }
+}
+
+static uint64_t xxh3_long(const uint8_t* data, size_t len) {
+    const uint8_t* secret = xxh3_secret;
+    constexpr size_t block_len = XXH_STRIPE_LEN * XXH_STRIPES_PER_BLOCK;
+    __m128i acc[4] = {
+        _mm_set_epi64x(XXH_PRIME64_1, XXH_PRIME32_3), _mm_set_epi64x(XXH_PRIME64_3, XXH_PRIME64_2),
+        _mm_set_epi64x(XXH_PRIME32_2, XXH_PRIME64_4), _mm_set_epi64x(XXH_PRIME32_1, XXH_PRIME64_5),
+    };
+    const size_t num_blocks = (len - 1) / block_len;
+    for (size_t b = 0; b < num_blocks; b++) {
+        for (size_t s = 0; s < XXH_STRIPES_PER_BLOCK; s++) {
+            xxh3_accumulate_stripe(acc, data + b * block_len + s * XXH_STRIPE_LEN, secret + s * 8);
+        }
+        xxh3_scramble(acc, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN);
+    }
+    const size_t num_stripes = ((len - 1) - num_blocks * block_len) / XXH_STRIPE_LEN;
+    for (size_t s = 0; s < num_stripes; s++) {
+        xxh3_accumulate_stripe(acc, data + num_blocks * block_len + s * XXH_STRIPE_LEN, secret + s * 8);
+    }
+    xxh3_accumulate_stripe(acc, data + len - XXH_STRIPE_LEN, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN - 7);
+
+    uint64_t lanes[8];
+    memcpy(lanes, acc, sizeof(lanes));
+    uint64_t result = len * XXH_PRIME64_1;
+    for (size_t i = 0; i < 4; i++) {
+        result += mul128_fold64(lanes[2 * i] ^ read_u64(secret + 11 + 16 * i), lanes[2 * i + 1] ^ read_u64(secret + 11 + 16 * i + 8));
+    }
+    return xxh3_avalanche(result);
+}
+
+uint64_t compute_xxh3(const uint8_t* data, size_t length) {
+    if (length <= 16) {
+        return xxh3_short(data, length);
+    }
+    if (length <= 240) {
+        return xxh3_medium(data, length);
+    }
+    return xxh3_long(data, length);
+}
+
+// sha256
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t rotr32(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+static void sha256_blocks(uint32_t* state, const uint8_t* data, size_t num_blocks) {
+    for (; num_blocks; num_blocks--, data += 64) {
+        uint32_t w[64];
+        for (size_t i = 0; i < 16; i++) {
+            w[i] = _byteswap_ulong(read_u32(data + 4 * i));
+        }
+        for (size_t i = 16; i < 64; i++) {
+            const uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+        for (size_t i = 0; i < 64; i++) {
+            const uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+            const uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+// SHA extensions: the state is kept as ABEF | CDGH, two rounds per sha256rnds2
+static void sha256_blocks_shani(uint32_t* state, const uint8_t* data, size_t num_blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    const __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    const __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i abef = _mm_alignr_epi8(dcba, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, dcba, 0xF0);
+
+    for (; num_blocks; num_blocks--, data += 64) {
+        const __m128i abef_start = abef;
+        const __m128i cdgh_start = cdgh;
+        __m128i w[4];
+        for (size_t i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), byte_swap);
+        }
+        for (size_t i = 0; i < 16; i++) {
+            __m128i wk = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i*)&sha256_k[4 * i]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+            wk = _mm_shuffle_epi32(wk, 0x0E);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, wk);
+            if (i < 12) { // the schedule words of the rounds i + 4
+                __m128i next = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                w[i & 3] = _mm_sha256msg2_epu32(next, w[(i + 3) & 3]);
+            }
+        }
+        abef = _mm_add_epi32(abef, abef_start);
+        cdgh = _mm_add_epi32(cdgh, cdgh_start);
+    }
+
+    const __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    const __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+static bool cpu_has_sha_extensions() {
+    static const bool has_sha = []() {
+        int regs[4] = {};
+        __cpuidex(regs, 0, 0);
+        if (regs[0] < 7) {
+            return false;
+        }
+        __cpuidex(regs, 1, 0);
+        const bool sse41 = (regs[2] & (1 << 19)) != 0;
+        __cpuidex(regs, 7, 0);
+        return sse41 && ((regs[1] & (1 << 29)) != 0);
+    }();
+    return has_sha;
+}
+
+void compute_sha256(const uint8_t* data, size_t length, uint8_t* digest) {
+    uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    auto process = cpu_has_sha_extensions() ? sha256_blocks_shani : sha256_blocks;
+    const size_t num_blocks = length / 64;
+    process(state, data, num_blocks);
+
+    uint8_t tail[128] = {};
+    const size_t tail_len = length - num_blocks * 64;
+    memcpy(tail, data + num_blocks * 64, tail_len);
+    tail[tail_len] = 0x80;
+    const size_t tail_blocks = (tail_len < 56) ? 1 : 2;
+    const uint64_t bits = _byteswap_uint64((uint64_t)length * 8);
+    memcpy(tail + tail_blocks * 64 - sizeof(bits), &bits, sizeof(bits));
+    process(state, tail, tail_blocks);
+
+    for (size_t i = 0; i < 8; i++) {
+        const uint32_t v = _byteswap_ulong(state[i]);
+        memcpy(digest + 4 * i, &v, sizeof(v));
+    }
+}
+
+// blake3, hash mode only. Inputs larger than a subtree are split into complete subtrees of BLAKE3_SUBTREE_SIZE
+// bytes, hashed independently, their chaining values are merged in the order of the reference implementation.
+
+#define BLAKE3_BLOCK_LEN 0x40
+#define BLAKE3_CHUNK_LEN 0x400
+#define BLAKE3_CHUNK_START (1 << 0)
+#define BLAKE3_CHUNK_END (1 << 1)
+#define BLAKE3_PARENT (1 << 2)
+#define BLAKE3_ROOT (1 << 3)
+#define BLAKE3_MAX_DEPTH 0x36
+
+static const uint32_t blake3_iv[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+static const uint8_t blake3_schedule[7][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+    { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+    { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+    { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+    { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+    { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+inline __m128i rotr_epi32(__m128i x, int r) {
+    return _mm_or_si128(_mm_srli_epi32(x, r), _mm_slli_epi32(x, 32 - r));
+}
+
+inline void blake3_g(__m128i& a, __m128i& b, __m128i& c, __m128i& d, __m128i mx, __m128i my) {
+    a = _mm_add_epi32(_mm_add_epi32(a, b), mx);
+    d = rotr_epi32(_mm_xor_si128(d, a), 16);
+    c = _mm_add_epi32(c, d);
+    b = rotr_epi32(_mm_xor_si128(b, c), 12);
+    a = _mm_add_epi32(_mm_add_epi32(a, b), my);
+    d = rotr_epi32(_mm_xor_si128(d, a), 8);
+    c = _mm_add_epi32(c, d);
+    b = rotr_epi32(_mm_xor_si128(b, c), 7);
+}
+
+// one row of the state per register, the diagonal step rotates the rows
+static void blake3_compress(uint32_t* cv, const uint8_t* block, uint64_t counter, uint32_t block_len, uint32_t flags) {
+    uint32_t m[16];
+    memcpy(m, block, sizeof(m));
+    __m128i row0 = _mm_loadu_si128((const __m128i*)&cv[0]);
+    __m128i row1 = _mm_loadu_si128((const __m128i*)&cv[4]);
+    __m128i row2 = _mm_loadu_si128((const __m128i*)&blake3_iv[0]);
+    __m128i row3 = _mm_set_epi32((int)flags, (int)block_len, (int)(counter >> 32), (int)counter);
+    for (size_t r = 0; r < 7; r++) {
+        const uint8_t* s = blake3_schedule[r];
+        blake3_g(row0, row1, row2, row3,
+            _mm_set_epi32((int)m[s[6]], (int)m[s[4]], (int)m[s[2]], (int)m[s[0]]),
+            _mm_set_epi32((int)m[s[7]], (int)m[s[5]], (int)m[s[3]], (int)m[s[1]]));
+        row1 = _mm_shuffle_epi32(row1, _MM_SHUFFLE(0, 3, 2, 1));
+        row2 = _mm_shuffle_epi32(row2, _MM_SHUFFLE(1, 0, 3, 2));
+        row3 = _mm_shuffle_epi32(row3, _MM_SHUFFLE(2, 1, 0, 3));
+        blake3_g(row0, row1, row2, row3,
+            _mm_set_epi32((int)m[s[14]], (int)m[s[12]], (int)m[s[10]], (int)m[s[8]]),
+            _mm_set_epi32((int)m[s[15]], (int)m[s[13]], (int)m[s[11]], (int)m[s[9]]));
+        row1 = _mm_shuffle_epi32(row1, _MM_SHUFFLE(2, 1, 0, 3));
+        row2 = _mm_shuffle_epi32(row2, _MM_SHUFFLE(1, 0, 3, 2));
+        row3 = _mm_shuffle_epi32(row3, _MM_SHUFFLE(0, 3, 2, 1));
+    }
+    _mm_storeu_si128((__m128i*)&cv[0], _mm_xor_si128(row0, row2));
+    _mm_storeu_si128((__m128i*)&cv[4], _mm_xor_si128(row1, row3));
+}
+
+// the last block of a chunk or a parent node, compressed with the root flag if nothing follows
+struct blake3_output {
+    uint32_t cv[8];
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    uint64_t counter;
+    uint32_t block_len;
+    uint32_t flags;
+};
+
+static void blake3_output_cv(const blake3_output& out, uint32_t* cv) {
+    memcpy(cv, out.cv, sizeof(out.cv));
+    blake3_compress(cv, out.block, out.counter, out.block_len, out.flags);
+}
+
+static blake3_output blake3_parent_output(const uint32_t* left, const uint32_t* right) {
+    blake3_output out;
+    memcpy(out.cv, blake3_iv, sizeof(out.cv));
+    memcpy(out.block, left, 0x20);
+    memcpy(out.block + 0x20, right, 0x20);
+    out.counter = 0;
+    out.block_len = BLAKE3_BLOCK_LEN;
+    out.flags = BLAKE3_PARENT;
+    return out;
+}
+
+static blake3_output blake3_chunk_output(const uint8_t* data, size_t len, uint64_t chunk_counter) {
+    blake3_output out;
+    memcpy(out.cv, blake3_iv, sizeof(out.cv));
+    uint32_t flags = BLAKE3_CHUNK_START;
+    while (len > BLAKE3_BLOCK_LEN) {
+        blake3_compress(out.cv, data, chunk_counter, BLAKE3_BLOCK_LEN, flags);
+        flags = 0;
+        data += BLAKE3_BLOCK_LEN;
+        len -= BLAKE3_BLOCK_LEN;
+    }
+    memset(out.block, 0, sizeof(out.block));
+    memcpy(out.block, data, len);
+    out.counter = chunk_counter;
+    out.block_len = (uint32_t)len;
+    out.flags = flags | BLAKE3_CHUNK_END;
+    return out;
+}
+
+struct blake3_cv_stack {
+    uint32_t cvs[BLAKE3_MAX_DEPTH][8];
+    size_t len = 0;
+};
+
+// total is the number of subtrees of this size pushed so far, a complete pair is merged into its parent
+static void blake3_push_cv(blake3_cv_stack* stack, const uint32_t* cv, uint64_t total) {
+    uint32_t merged[8];
+    memcpy(merged, cv, sizeof(merged));
+    for (; (total & 1) == 0; total >>= 1) {
+        blake3_output_cv(blake3_parent_output(stack->cvs[--stack->len], merged), merged);
+    }
+    memcpy(stack->cvs[stack->len++], merged, sizeof(merged));
+}
+
+// hashes the chunks from the first_chunk, the output of the last one is merged with the stack
+static blake3_output blake3_hash_chunks(blake3_cv_stack* stack, const uint8_t* data, size_t len, uint64_t first_chunk) {
+    uint64_t chunk = first_chunk;
+    for (; len > BLAKE3_CHUNK_LEN; chunk++, data += BLAKE3_CHUNK_LEN, len -= BLAKE3_CHUNK_LEN) {
+        uint32_t cv[8];
+        blake3_output_cv(blake3_chunk_output(data, BLAKE3_CHUNK_LEN, chunk), cv);
+        blake3_push_cv(stack, cv, chunk + 1);
+    }
+    blake3_output out = blake3_chunk_output(data, len, chunk);
+    while (stack->len) {
+        uint32_t cv[8];
+        blake3_output_cv(out, cv);
+        out = blake3_parent_output(stack->cvs[--stack->len], cv);
+    }
+    return out;
+}
+
+void blake3_subtree_cv(const uint8_t* subtree, uint64_t index, uint32_t* cv) {
+    blake3_cv_stack stack;
+    constexpr uint64_t chunks_per_subtree = BLAKE3_SUBTREE_SIZE / BLAKE3_CHUNK_LEN;
+    blake3_output_cv(blake3_hash_chunks(&stack, subtree, BLAKE3_SUBTREE_SIZE, index * chunks_per_subtree), cv);
+}
+
+void blake3_finalize(const uint32_t* subtree_cvs, uint64_t num_subtrees, const uint8_t* tail, size_t tail_size, uint8_t* digest) {
+    blake3_cv_stack stack;
+    for (uint64_t i = 0; i < num_subtrees; i++) {
+        blake3_push_cv(&stack, subtree_cvs + 8 * i, i + 1);
+    }
+    constexpr uint64_t chunks_per_subtree = BLAKE3_SUBTREE_SIZE / BLAKE3_CHUNK_LEN;
+    blake3_output out = blake3_hash_chunks(&stack, tail, tail_size, num_subtrees * chunks_per_subtree);
+    out.flags |= BLAKE3_ROOT;
+    uint32_t cv[8];
+    blake3_output_cv(out, cv);
+    memcpy(digest, cv, sizeof(cv));
+}
+
+void compute_blake3(const uint8_t* data, size_t length, uint8_t* digest, size_t num_threads) {
+    const uint64_t num_subtrees = blake3_num_subtrees(length);
+    std::vector<uint32_t> cvs(num_subtrees * 8);
+    std::atomic<uint64_t> next_subtree{ 0 };
+    auto hash_subtrees = [&]() {
+        for (uint64_t i = next_subtree++; i < num_subtrees; i = next_subtree++) {
+            blake3_subtree_cv(data + i * BLAKE3_SUBTREE_SIZE, i, &cvs[8 * i]);
+        }
+    };
+    num_threads = (size_t)(_min((uint64_t)num_threads, num_subtrees));
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < num_threads; i++) {
+        workers.push_back(std::thread(hash_subtrees));
+    }
+    hash_subtrees();
+    for (auto& w : workers) {
+        w.join();
+    }
+    const uint64_t tail_offset = num_subtrees * BLAKE3_SUBTREE_SIZE;
+    blake3_finalize(cvs.data(), num_subtrees, data + tail_offset, (size_t)(length - tail_offset), digest);
+}
+
+#define SIM_CHUNK_MASK 0xF800000000000000ULL // ~32 byte shingles
+#define SIM_MIN_CHUNK 0x08
+#define SIM_MAX_CHUNK 0x100
+
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// fixed seeds, so the signatures of two sessions (and the persisted index) are comparable
+struct minhash_tables {
+    uint64_t gear[0x100];
+    uint64_t mul[SIM_NUM_HASHES]; // odd
+    uint64_t add[SIM_NUM_HASHES];
+};
+
+static const minhash_tables& get_minhash_tables() {
+    static const minhash_tables tables = [] {
+        minhash_tables t;
+        uint64_t state = 0x51CA7E5EED5ULL;
+        for (size_t i = 0; i < _countof(t.gear); i++) {
+            t.gear[i] = splitmix64(&state);
+        }
+        for (size_t i = 0; i < SIM_NUM_HASHES; i++) {
+            t.mul[i] = splitmix64(&state) | 1;
+            t.add[i] = splitmix64(&state);
+        }
+        return t;
+    }();
+    return tables;
+}
+
+// MinHash over content-defined shingles: a gear rolling hash cuts the data where its top bits are zero,
+// so an edit or an insertion only changes the shingles around it. Every shingle is reduced to its crc32c,
+// the signature keeps the minimum of SIM_NUM_HASHES multiply-shift hashes of those.
+void compute_minhash_signature(const uint8_t* data, size_t size, uint32_t* signature) {
+    const minhash_tables& t = get_minhash_tables();
+    for (size_t i = 0; i < SIM_NUM_HASHES; i++) {
+        signature[i] = UINT32_MAX;
+    }
+    uint64_t h = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < size; i++) {
+        h = (h << 1) + t.gear[data[i]];
+        const size_t len = i + 1 - start;
+        if (((len >= SIM_MIN_CHUNK) && !(h & SIM_CHUNK_MASK)) || (len >= SIM_MAX_CHUNK) || ((i + 1) == size)) {
+            const uint64_t shingle = compute_crc32c(data + start, len);
+            for (size_t k = 0; k < SIM_NUM_HASHES; k++) {
+                signature[k] = _min(signature[k], (uint32_t)((t.mul[k] * shingle + t.add[k]) >> 32));
+            }
+            start = i + 1;
+            h = 0;
+        }
+    }
+}
+
+// estimates the Jaccard similarity of the shingle sets
+double minhash_similarity(const uint32_t* a, const uint32_t* b) {
+    size_t equal = 0;
+    for (size_t i = 0; i < SIM_NUM_HASHES; i++) {
+        equal += (a[i] == b[i]);
+    }
+    return (double)equal / SIM_NUM_HASHES;
+}
+
+uint32_t minhash_band_hash(const uint32_t* signature, size_t band) {
+    constexpr size_t rows = SIM_NUM_HASHES / SIM_NUM_BANDS;
+    return compute_crc32c((const uint8_t*)(signature + band * rows), rows * sizeof(uint32_t));
+}
+
 #include <stdio.h>
 #include <windows.h> // Include for SYMBOL_INFO and related definitions
 
@@ -1465,6 +3416,268 @@ bool symbol_set_path_common(const common_processing_context* ctx) {
     return true;
 }
 
+// ---- memory budget ----
+
+struct mem_budget_entry {
+    const char* name;
+    uint64_t bytes;
+    uint64_t last_use;
+    uint32_t cost; // relative cost of rebuilding the data
+    mem_budget_evict_callback evict; // nullptr - can't be evicted
+    void* owner;
+    bool registered;
+};
+
+static struct {
+    std::mutex mtx;
+    std::vector<mem_budget_entry> entries;
+    uint64_t total = 0;
+    uint64_t peak = 0;
+    uint64_t clock = 0;
+    uint64_t num_evictions = 0;
+    HANDLE low_memory = NULL;
+} mem_budget;
+
+uint64_t g_mem_limit = 0;
+int g_persist_results = 0;
+uint64_t g_scan_ahead = DEFAULT_SCAN_AHEAD;
+int g_release_scanned = 0;
+
+static bool low_memory_signaled() {
+    if (!mem_budget.low_memory) {
+        mem_budget.low_memory = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+    }
+    BOOL low = FALSE;
+    return mem_budget.low_memory && QueryMemoryResourceNotification(mem_budget.low_memory, &low) && low;
+}
+
+// evicts the entry with the largest (age * size / cost) until 'needed' more bytes fit under the limit
+static void mem_budget_evict(uint64_t limit, uint64_t needed, int keep_id) {
+    while ((mem_budget.total + needed) > limit) {
+        int victim = -1;
+        double victim_score = 0.0;
+        for (int i = 0, sz = (int)mem_budget.entries.size(); i < sz; i++) {
+            const mem_budget_entry& e = mem_budget.entries[i];
+            if ((i == keep_id) || !e.registered || !e.evict || !e.bytes) {
+                continue;
+            }
+            const double score = (double)(mem_budget.clock - e.last_use + 1) * (double)e.bytes / (double)e.cost;
+            if (score > victim_score) {
+                victim_score = score;
+                victim = i;
+            }
+        }
+        if (victim == -1) {
+            break;
+        }
+        mem_budget_entry& e = mem_budget.entries[victim];
+        e.evict(e.owner);
+        mem_budget.total -= e.bytes;
+        e.bytes = 0;
+        mem_budget.num_evictions++;
+    }
+}
+
+int mem_budget_register(const char* name, uint32_t cost, mem_budget_evict_callback evict, void* owner) {
+    std::unique_lock<std::mutex> lk(mem_budget.mtx);
+    const mem_budget_entry entry = { name, 0, mem_budget.clock, _max(cost, 1u), evict, owner, true };
+    for (int i = 0, sz = (int)mem_budget.entries.size(); i < sz; i++) {
+        if (!mem_budget.entries[i].registered) {
+            mem_budget.entries[i] = entry;
+            return i;
+        }
+    }
+    mem_budget.entries.push_back(entry);
+    return (int)mem_budget.entries.size() - 1;
+}
+
+void mem_budget_unregister(int id) {
+    std::unique_lock<std::mutex> lk(mem_budget.mtx);
+    if ((id < 0) || (id >= (int)mem_budget.entries.size())) {
+        return;
+    }
+    mem_budget.total -= mem_budget.entries[id].bytes;
+    mem_budget.entries[id].bytes = 0;
+    mem_budget.entries[id].registered = false;
+}
+
+bool mem_budget_charge(int id, uint64_t bytes) {
+    std::unique_lock<std::mutex> lk(mem_budget.mtx);
+    if ((id < 0) || (id >= (int)mem_budget.entries.size())) {
+        return false;
+    }
+    mem_budget_entry& entry = mem_budget.entries[id];
+    entry.last_use = ++mem_budget.clock;
+    // under memory pressure nothing grows without something else being released
+    const uint64_t limit = low_memory_signaled() ? mem_budget.total : (g_mem_limit ? g_mem_limit : UINT64_MAX);
+    if ((mem_budget.total + bytes) > limit) {
+        mem_budget_evict(limit, bytes, id);
+        if ((mem_budget.total + bytes) > limit) {
+            return false;
+        }
+    }
+    entry.bytes += bytes;
+    mem_budget.total += bytes;
+    mem_budget.peak = _max(mem_budget.peak, mem_budget.total);
+    return true;
+}
+
+// Never evicts: for charges made where the other entries may be in use (a page fault can come from any code)
+bool mem_budget_try_charge(int id, uint64_t bytes) {
+    std::unique_lock<std::mutex> lk(mem_budget.mtx);
+    if ((id < 0) || (id >= (int)mem_budget.entries.size())) {
+        return false;
+    }
+    mem_budget_entry& entry = mem_budget.entries[id];
+    entry.last_use = ++mem_budget.clock;
+    const uint64_t limit = low_memory_signaled() ? mem_budget.total : (g_mem_limit ? g_mem_limit : UINT64_MAX);
+    if ((mem_budget.total + bytes) > limit) {
+        return false;
+    }
+    entry.bytes += bytes;
+    mem_budget.total += bytes;
+    mem_budget.peak = _max(mem_budget.peak, mem_budget.total);
+    return true;
+}
+
+void mem_budget_release(int id, uint64_t bytes) {
+    std::unique_lock<std::mutex> lk(mem_budget.mtx);
+    if ((id < 0) || (id >= (int)mem_budget.entries.size())) {
+        return;
+    }
+    mem_budget_entry& entry = mem_budget.entries[id];
+    bytes = _min(bytes, entry.bytes);
+    entry.bytes -= bytes;
+    mem_budget.total -= bytes;
+}
+
+void mem_budget_touch(int id) {
+    std::unique_lock<std::mutex> lk(mem_budget.mtx);
+    if ((id >= 0) && (id < (int)mem_budget.entries.size())) {
+        mem_budget.entries[id].last_use = ++mem_budget.clock;
+    }
+}
+
+void mem_budget_trim() {
+    std::unique_lock<std::mutex> lk(mem_budget.mtx);
+    if (!low_memory_signaled()) {
+        return;
+    }
+    const uint64_t total = mem_budget.total;
+    mem_budget_evict(0, 0, -1);
+    if (total != mem_budget.total) {
+        printf("Low memory: 0x%llx bytes released from the caches.\n", total - mem_budget.total);
+    }
+}
+
+uint64_t mem_budget_available() {
+    DWORDLONG available_phys_mem = 0, total_phys_mem = 0;
+    get_available_phys_memory(&total_phys_mem, &available_phys_mem);
+    if (!g_mem_limit) {
+        return available_phys_mem;
+    }
+    std::unique_lock<std::mutex> lk(mem_budget.mtx);
+    const uint64_t budget_left = (g_mem_limit > mem_budget.total) ? (g_mem_limit - mem_budget.total) : 0;
+    return _min(budget_left, (uint64_t)available_phys_mem);
+}
+
+void print_mem_budget() {
+    std::unique_lock<std::mutex> lk(mem_budget.mtx);
+    if (g_mem_limit) {
+        printf("Limit: 0x%llx | ", g_mem_limit);
+    } else {
+        printf("Limit: none | ");
+    }
+    printf("Used: 0x%llx | Peak: 0x%llx | Evictions: %llu | Low memory: %s\n",
+        mem_budget.total, mem_budget.peak, mem_budget.num_evictions, low_memory_signaled() ? "yes" : "no");
+    for (const mem_budget_entry& e : mem_budget.entries) {
+        if (e.registered) {
+            printf("%-24s Size: 0x%016llx | Cost: %u | %s\n", e.name, e.bytes, e.cost, e.evict ? "evictable" : "pinned");
+        }
+    }
+}
+
+// Workers are spread round robin over the NUMA nodes with processors and pinned to them,
+// their buffers are allocated on the node (large pages when SeLockMemoryPrivilege can be enabled).
+struct numa_topology {
+    std::vector<USHORT> nodes;
+    std::vector<GROUP_AFFINITY> affinities;
+    size_t large_page_size = 0; // 0 - no large pages
+};
+
+static bool enable_lock_memory_privilege() {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return false;
+    }
+    TOKEN_PRIVILEGES tp;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+        && AdjustTokenPrivileges(token, FALSE, &tp, sizeof(tp), nullptr, nullptr)
+        && (GetLastError() == ERROR_SUCCESS); // not all assigned otherwise
+    CloseHandle(token);
+    return enabled;
+}
+
+static const numa_topology& get_numa_topology() {
+    static const numa_topology topology = []() {
+        numa_topology t;
+        ULONG highest_node = 0;
+        if (GetNumaHighestNodeNumber(&highest_node)) {
+            for (ULONG n = 0; (n <= highest_node) && (t.nodes.size() < MAX_NUMA_NODES); n++) {
+                GROUP_AFFINITY affinity;
+                memset(&affinity, 0, sizeof(affinity));
+                if (GetNumaNodeProcessorMaskEx((USHORT)n, &affinity) && affinity.Mask) {
+                    t.nodes.push_back((USHORT)n);
+                    t.affinities.push_back(affinity);
+                }
+            }
+        }
+        if (enable_lock_memory_privilege()) {
+            t.large_page_size = GetLargePageMinimum();
+        }
+        return t;
+    }();
+    return topology;
+}
+
+uint32_t get_num_numa_nodes(size_t num_workers) {
+    const size_t num_nodes = get_numa_topology().nodes.size();
+    return (uint32_t)(_max((_min(num_nodes, num_workers)), (size_t)1));
+}
+
+uint32_t numa_node_of_worker(size_t worker, size_t num_workers) {
+    return (uint32_t)(worker % get_num_numa_nodes(num_workers));
+}
+
+void pin_thread_to_numa_node(uint32_t node) {
+    const numa_topology& topology = get_numa_topology();
+    if (topology.nodes.size() > 1) {
+        SetThreadGroupAffinity(GetCurrentThread(), &topology.affinities[node % topology.nodes.size()], nullptr);
+    }
+}
+
+void* alloc_node_buffer(size_t size, uint32_t node) {
+    const numa_topology& topology = get_numa_topology();
+    const DWORD node_number = topology.nodes.empty() ? 0 : topology.nodes[node % topology.nodes.size()];
+    void* buffer = nullptr;
+    if (topology.large_page_size) {
+        const size_t large_size = multiple_of_n(size, topology.large_page_size);
+        buffer = VirtualAllocExNuma(GetCurrentProcess(), nullptr, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE, node_number);
+    }
+    if (!buffer) { // no contiguous large pages left
+        buffer = VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node_number);
+    }
+    return buffer;
+}
+
+void free_node_buffer(void* buffer) {
+    if (buffer) {
+        VirtualFree(buffer, 0, MEM_RELEASE);
+    }
+}
+
 #ifndef NDEBUG
 void print_last_error_message() {
     DWORD error_code = GetLastError(); // Get the last error code
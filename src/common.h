@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <math.h>
 #include <windows.h>
 #include <dbghelp.h>
@@ -15,6 +16,8 @@
 #include <condition_variable>
 #include <vector> // temp
 #include <algorithm>
+#include <map>
+#include <thread>
 
 #include "circular_buffer.h"
 #include "semaphore.h"
@@ -41,10 +44,25 @@
 #define NEXT_DOT_INTERVAL 0x10
 #define WAIT_FOR_MS 400
 #define AVAIL_PHYS_MEM_FACTOR 0x04 // ?
+#define DEFAULT_SCAN_AHEAD 0x10000000
 #define INVALID_ID ((DWORD)(-1))
 #define MAX_OP_HEX_STRING_LEN 0x40
 #define MAX_CALCULATION_BLOCK_SIZE 0x1000000
+#define MAX_HASH_BLOCK_SIZE 0x40000000 // the hashes, the other calculations are limited to MAX_CALCULATION_BLOCK_SIZE
+#define MAX_DIGEST_SIZE 0x20
+#define BLAKE3_SUBTREE_SIZE 0x10000 // 64 chunks, the unit of work of a parallel blake3
 #define SYMBOL_PATHS_SIZE (MAX_PATH * 8)
+#define CLEAN_IMAGE_CACHE_MAX_ENTRIES 0x10000
+#define VERIFY_CHUNK_SIZE 0x10000
+#define PACK_CHUNK_SIZE 0x100000
+#define PACK_BATCH_CHUNKS_PER_THREAD 0x04
+#define PACK_CACHE_MAX_CHUNKS 0x400 // decoded chunks of a packed dump kept mapped
+#define PACK_CACHE_MIN_CHUNKS 0x40 // kept even when the memory budget refuses them
+#define PRECOMPUTE_PAGE_SIZE 0x1000
+#define PRECOMPUTE_BLOCK_PAGES 0x10 // checkpoint granularity
+#define FUSED_SCAN_SLICE_SIZE 0x10000
+#define MAX_FUSED_JOBS 0x10
+#define CHECKPOINT_INTERVAL_MS 10000
 
 //#define DISABLE_STANDBY_LIST_PURGE
 
@@ -91,14 +109,31 @@ enum input_command {
     c_list_memory_regions_info_committed,
     c_list_handles,
     c_list_symbols,
+    c_list_results,
+    c_result_set,
 
     c_inspect_memory,
     c_inspect_module,
     c_inspect_thread,
     c_inspect_image,
     c_inspect_memory_usage,
+    c_inspect_memory_budget,
+
+    c_verify_modules,
+    c_extract_modules,
+    c_carve_dump,
+    c_pack_dump,
 
     c_calculate,
+    c_similarity_search,
+    c_hash_regions,
+    c_hash_module,
+
+    c_list_jobs,
+    c_wait_job,
+    c_kill_job,
+    c_show_job,
+    c_resume_job,
 
     c_symbol_resolve_at_address,
     c_symbol_resolve_by_name,
@@ -121,6 +156,7 @@ enum input_command {
 enum inspection_mode {
     im_process,
     im_dump,
+    im_guest,
     im_none
 };
 
@@ -137,10 +173,39 @@ enum hexdump_op {
     ho_and,
 };
 
+enum search_op {
+    so_pattern,
+    so_xref,
+};
+
 enum calculate_op {
     co_none,
     co_entropy,
-    co_crc32c
+    co_crc32c,
+    co_xxh3,
+    co_sha256,
+    co_blake3
+};
+
+enum region_protect_flags {
+    rp_none = 0,
+    rp_read = 1 << 0,
+    rp_write = 1 << 1,
+    rp_execute = 1 << 2,
+    rp_guard = 1 << 3,
+};
+
+enum region_type_flags {
+    rt_none = 0,
+    rt_private = 1 << 0,
+    rt_mapped = 1 << 1,
+};
+
+enum region_state_flags {
+    rs_none = 0,
+    rs_commit = 1 << 0,
+    rs_reserve = 1 << 1,
+    rs_free = 1 << 2,
 };
 
 struct search_range {
@@ -148,11 +213,21 @@ struct search_range {
     uint64_t length;
 };
 
+struct region_filter {
+    uint32_t protect; // all of the region_protect_flags have to be present
+    uint32_t type; // any of the region_type_flags
+    uint32_t state; // any of the region_state_flags
+    uint64_t min_size; // region size has to be greater, 0 - not set
+    uint64_t max_size; // region size has to be less, 0 - not set
+};
+
 struct pattern_data {
     const char* pattern;
     int64_t pattern_len;
     search_scope_type scope_type;
     search_range range;
+    region_filter filter;
+    search_op op;
 };
 
 struct hexdump_operaton {
@@ -166,6 +241,40 @@ struct hexdump_data {
     size_t num_to_display;
     hexdump_mode mode;
     hexdump_operaton hex_op;
+    size_t num_requested = 0; // x+ and x- page by the count of the last x command
+    bool continued = false; // x+ or x-
+};
+
+#define HEXDUMP_PAGE_SIZE 0x1000
+#define HEXDUMP_CACHE_PAGES 0x100
+#define HEXDUMP_LIVE_PAGE_TTL_MS 0x7D0
+
+// Reads the page at page_address (HEXDUMP_PAGE_SIZE aligned) into page.
+// Returns the number of bytes read from the start of the page, 0 - not mapped.
+typedef size_t (*hexdump_read_page_callback)(void* owner, uint64_t page_address, uint8_t* page);
+
+struct hexdump_page {
+    size_t size;
+    uint64_t last_use;
+    ULONGLONG read_tick;
+    uint8_t data[HEXDUMP_PAGE_SIZE];
+};
+
+// LRU of the pages read by the hexdump commands, the pages around the last dump are read ahead by a helper thread.
+// A fixed size of HEXDUMP_CACHE_PAGES keeps it out of the memory budget.
+struct hexdump_cache {
+    hexdump_read_page_callback read_page = nullptr;
+    void* owner = nullptr;
+    uint32_t max_age_ms = 0; // live memory, 0 - the pages never go stale
+    std::map<uint64_t, hexdump_page> pages;
+    uint64_t clock = 0;
+    uint32_t generation = 0; // bumped on invalidation, the reads started earlier are dropped
+    std::mutex lock;
+    std::mutex read_lock; // one read of the source at a time
+    std::condition_variable prefetch_cv;
+    std::vector<uint64_t> prefetch_queue;
+    std::thread prefetcher;
+    bool exit = false;
 };
 
 struct redirection_data {
@@ -179,12 +288,66 @@ struct inspect_data {
     const char* memory_address;
     DWORD tid;
     TCHAR module_name[MAX_PATH];
+    char file_path[MAX_PATH]; // output file or directory
 };
 
 struct calculate_data {
     const uint8_t* address;
     uint64_t size;
     calculate_op op;
+    region_filter filter;
+    search_scope_type scope_type; // %<hash>:regions
+};
+
+#define SIM_NUM_HASHES 0x40
+#define SIM_NUM_BANDS 0x10 // LSH: windows with an equal band (SIM_NUM_HASHES / SIM_NUM_BANDS hashes) are the candidates
+#define SIM_MIN_WINDOW 0x100
+#define SIM_TOP_K 0x10
+
+// sim[:<modifiers>]@<address>:<size>
+struct similarity_data {
+    const uint8_t* address;
+    uint64_t size;
+    search_scope_type scope_type;
+    region_filter filter;
+};
+
+enum carve_source {
+    cs_regions, // regions matching the scope and the region filter
+    cs_ranges, // address list
+    cs_matches, // last search matches +/- context
+};
+
+struct carve_data {
+    carve_source source;
+    search_scope_type scope_type;
+    region_filter filter;
+    std::vector<search_range> ranges;
+    uint64_t context;
+};
+
+#define MAX_SET_OPERANDS 0x08
+#define DEFAULT_ESTIMATE_PERCENT 1.0
+#define MAX_SET_NAME_LEN 0x20
+
+enum result_set_op {
+    rso_show,
+    rso_union,
+    rso_intersect,
+    rso_minus,
+    rso_shift,
+    rso_name,
+    rso_hexdump,
+};
+
+struct result_set_data {
+    result_set_op op;
+    uint32_t num_operands;
+    char operands[MAX_SET_OPERANDS][MAX_SET_NAME_LEN]; // set ids or names
+    char name[MAX_SET_NAME_LEN];
+    int64_t shift;
+    hexdump_mode hex_mode;
+    size_t hex_num;
 };
 
 struct symbol_context {
@@ -203,8 +366,19 @@ struct common_processing_context {
     redirection_data rdata;
     char* command = nullptr;
     inspect_data i_data{ nullptr, INVALID_ID };
-    calculate_data cdata{ nullptr, 0, calculate_op::co_none };
+    calculate_data cdata{ nullptr, 0, calculate_op::co_none, {}, search_scope_type::mrt_all };
+    similarity_data simdata{ nullptr, 0, search_scope_type::mrt_all };
+    carve_data cvdata{ carve_source::cs_regions, search_scope_type::mrt_all };
+    std::vector<const char*> last_matches;
+    int last_matches_budget_id = -1;
+    bool background = false; // the command ended with '&'
+    uint32_t job_id = 0;
+    char refine_set[MAX_SET_NAME_LEN]; // /in <set>: the result set to check the search predicate on
+    int64_t refine_offset = 0;
+    double estimate_fraction = 0.0; // /~est: the fraction of the searched memory to sample
+    result_set_data rsdata;
     symbol_context sym_ctx;
+    hexdump_cache hex_cache;
 };
 
 struct search_data_info {
@@ -218,8 +392,28 @@ struct search_match {
     const char* match_address;
 };
 
+enum scan_mode {
+    sm_collect,
+    sm_first_n, // stops after max_matches
+
+    sm_count
+};
+
+struct scan_kernel_args {
+    const uint8_t* pattern;
+    size_t pattern_len;
+    const char* range_start; // ranged kernels only
+    const char* range_end;
+    size_t max_matches; // sm_first_n only
+};
+
+// Appends the addresses of the matches in [data, data + size), mapped at 'address' in the inspected memory. Returns their number.
+typedef size_t (*scan_kernel)(const uint8_t* data, size_t size, const char* address, const scan_kernel_args& args, std::vector<const char*>* matches);
+
 struct search_context_common {
     std::vector<search_match> matches;
+    scan_kernel kernel = nullptr; // selected at the start of the search, see init_scan_kernel
+    scan_kernel_args kernel_args{};
     semaphore master_sem;
     semaphore_counting workers_sem;
     volatile int exit_workers;
@@ -240,6 +434,10 @@ extern inspection_mode g_inspection_mode;
 extern int g_purge_standby_pages;
 extern int g_disable_page_caching;
 extern int g_disable_symbols;
+extern uint64_t g_mem_limit;
+extern int g_persist_results;
+extern uint64_t g_scan_ahead;
+extern int g_release_scanned;
 
 #define _max(x,y) (x) > (y) ? (x) : (y)
 #define _min(x,y) (x) < (y) ? (x) : (y)
@@ -249,7 +447,10 @@ const char* get_page_state(DWORD state);
 void print_page_type(DWORD state);
 const char* get_page_protect(DWORD state);
 bool too_many_results(size_t num_lines, bool redirected, bool precise=true);
-const uint8_t* strstr_u8(const uint8_t* str, size_t str_sz, const uint8_t* substr, size_t substr_sz);
+scan_kernel select_scan_kernel(size_t pattern_len, bool ranged, scan_mode mode);
+void init_scan_kernel(search_context_common* common, const pattern_data& pdata, scan_mode mode, size_t max_matches = 0);
+void find_pattern_with_kernel(search_context_common* common, const char* data, int64_t size, uint64_t info_id, const char* address);
+void find_xrefs(const uint8_t* data, size_t size, const char* address, uint64_t target, std::vector<const char*>& xrefs);
 char* skip_to_args(char* cmd, size_t len);
 bool parse_cmd_args(int argc, const char** argv);
 
@@ -264,19 +465,77 @@ void print_help_symbols_common();
 
 input_command parse_command_common(common_processing_context* ctx, search_data_info* data, char* pattern);
 uint64_t prepare_matches(const common_processing_context *ctx, std::vector<search_match>& matches);
+void dedup_matches(std::vector<search_match>& matches);
+void store_last_matches(common_processing_context* ctx, const std::vector<search_match>& matches);
 void print_hexdump(const hexdump_data& hdata, const uint8_t* bytes, size_t length);
+void init_hexdump_cache(hexdump_cache* cache, hexdump_read_page_callback read_page, void* owner, uint32_t max_age_ms);
+void stop_hexdump_cache(hexdump_cache* cache);
+void invalidate_hexdump_cache(hexdump_cache* cache, void (*change_source)(void* owner) = nullptr);
+size_t read_hexdump_memory(hexdump_cache* cache, uint64_t address, uint8_t* buffer, size_t size);
 void try_redirect_output_to_file(common_processing_context* ctx);
 void redirect_output_to_stdout(common_processing_context* ctx);
 void print_image_info(const common_processing_context* ctx);
 uint32_t compute_crc32c(const uint8_t* data, size_t length);
+uint64_t compute_xxh3(const uint8_t* data, size_t length);
+void compute_sha256(const uint8_t* data, size_t length, uint8_t* digest);
+void compute_blake3(const uint8_t* data, size_t length, uint8_t* digest, size_t num_threads);
+// the complete subtrees before the last (partial) one, hashed independently
+inline uint64_t blake3_num_subtrees(uint64_t size) {
+    return size ? ((size - 1) / BLAKE3_SUBTREE_SIZE) : 0;
+}
+void blake3_subtree_cv(const uint8_t* subtree, uint64_t index, uint32_t* cv);
+void blake3_finalize(const uint32_t* subtree_cvs, uint64_t num_subtrees, const uint8_t* tail, size_t tail_size, uint8_t* digest);
+// returns the size of the digest, big endian for crc32c and xxh3
+size_t compute_digest(calculate_op op, const uint8_t* data, size_t length, uint8_t* digest, size_t num_threads);
+const char* calculate_op_name(calculate_op op);
+void print_digest(const uint8_t* digest, size_t size);
+
+typedef bool (*read_memory_callback)(const void* read_ctx, const char* address, uint8_t* buffer, size_t size);
+// returns the number of modified bytes or -1 on error
+int64_t verify_module(const char* file_path, const char* base_of_image, uint64_t size_of_image, read_memory_callback read_memory, const void* read_ctx);
+
+bool region_filter_set(const region_filter& filter);
+bool region_filter_match(const region_filter& filter, DWORD protect, DWORD type, DWORD state, uint64_t size);
 
 void data_block_calculate_common(calculate_data* cdata, uint8_t* bytes, size_t size);
+void compute_minhash_signature(const uint8_t* data, size_t size, uint32_t* signature);
+double minhash_similarity(const uint32_t* a, const uint32_t* b);
+uint32_t minhash_band_hash(const uint32_t* signature, size_t band);
 void symbol_find_at_address(common_processing_context* ctx);
 void symbol_find_by_name(common_processing_context* ctx);
 void symbol_find_next(common_processing_context* ctx);
 void symbol_find_prev(common_processing_context* ctx);
 void symbol_get_path(const common_processing_context* ctx);
 bool symbol_set_path_common(const common_processing_context* ctx);
+
+// Caches and indexes register with the memory budget and charge their allocations to it.
+// When a charge would exceed --mem-limit (or the system signals low memory) the other entries are evicted,
+// the least recently used and cheapest to rebuild first. A refused charge is expected to be skipped, nothing is spilled to disk.
+// The evict callback runs under the budget lock and must not call back into the budget.
+typedef void (*mem_budget_evict_callback)(void* owner);
+int mem_budget_register(const char* name, uint32_t cost, mem_budget_evict_callback evict, void* owner);
+void mem_budget_unregister(int id);
+bool mem_budget_charge(int id, uint64_t bytes);
+bool mem_budget_try_charge(int id, uint64_t bytes);
+void mem_budget_release(int id, uint64_t bytes);
+void mem_budget_touch(int id);
+void mem_budget_trim();
+uint64_t mem_budget_available();
+void print_mem_budget();
+
+#define MAX_NUMA_NODES 0x08
+
+uint32_t get_num_numa_nodes(size_t num_workers);
+uint32_t numa_node_of_worker(size_t worker, size_t num_workers);
+void pin_thread_to_numa_node(uint32_t node);
+void* alloc_node_buffer(size_t size, uint32_t node);
+void free_node_buffer(void* buffer);
+
+// dump files are split into stripes assigned round robin to the nodes, a stripe's pages are read on its node
+inline uint32_t numa_node_of_offset(uint64_t offset, uint64_t stripe_size, uint32_t num_nodes) {
+    return (uint32_t)((offset / stripe_size) % num_nodes);
+}
+
 #ifndef NDEBUG
 void print_last_error_message();
 #endif // NDEBUG
@@ -1,5 +1,14 @@
 #include "common.h"
 
+#include <nmmintrin.h>
+#include <compressapi.h>
+#include <unordered_map>
+#include <set>
+#include <random>
+
+#pragma comment(lib, "Cabinet.lib")
+#pragma comment(lib, "Onecore.lib")
+
 struct module_data {
     LPWSTR name;
     char* base_of_image;
@@ -24,6 +33,110 @@ struct cpu_info_data {
 struct cache_memory_regions_ctx {
     volatile int ready = 1;
     volatile int interrupt = 0;
+    volatile int paused = 0; // a search reads its own blocks ahead, the rest of the dump is cached afterwards
+};
+
+enum region_class {
+    rc_other,
+    rc_image,
+    rc_stack,
+};
+
+// Per page metrics computed in the background while the tool waits for input.
+// Pages are processed in dump order, the data of page p is valid once p < num_pages_done.
+struct precompute_ctx {
+    std::vector<MINIDUMP_MEMORY_DESCRIPTOR64> regions; // copies, the dump view is remapped after searches
+    std::vector<MINIDUMP_MEMORY_DESCRIPTOR64> sorted_regions; // by address, for the pointer lookups
+    std::vector<uint64_t> rva_offsets;
+    std::vector<uint64_t> first_page; // global index of the first page of every region
+    std::vector<uint8_t> region_class;
+    // the per page arrays share one allocation, the pass is skipped when the memory budget refuses it
+    std::vector<uint8_t> storage;
+    uint64_t* zero_pages = nullptr; // bitmap
+    uint32_t* page_crc = nullptr;
+    uint16_t* page_pointers = nullptr; // qwords pointing into the dumped memory
+    uint8_t* page_entropy = nullptr; // entropy * 0x1F
+    int budget_id = -1;
+    std::atomic<uint64_t> num_pages_done{ 0 };
+    uint64_t num_pages = 0;
+    uint64_t cursor_region = 0; // checkpoint
+    uint64_t cursor_page = 0;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool pause = false;
+    bool paused = false;
+    bool exit = false;
+    std::thread worker;
+};
+
+struct search_job;
+struct result_entry;
+
+// Search results keyed by everything they depend on, the dump never changes so they never go stale.
+// Optionally persisted beside the dump (--persist-results). Every set is charged to the memory budget
+// on its own, so memory pressure drops the least recently used sets first.
+struct result_cache_ctx {
+    std::vector<result_entry*> entries;
+    uint32_t next_id = 1;
+    std::vector<int> evicted_budget_ids; // unregistered outside of the budget lock
+    char persist_path[MAX_PATH];
+};
+
+// The band hashes of the windows of a similarity scan, reused by the queries with the same window length and scope
+struct sim_index_key {
+    uint64_t window_len;
+    uint32_t scope_type;
+    uint32_t reserved;
+    region_filter filter;
+};
+
+struct sim_band_entry {
+    uint32_t hash;
+    uint32_t window;
+};
+
+struct similarity_index {
+    sim_index_key key;
+    bool valid = false;
+    std::vector<uint64_t> windows; // start addresses
+    std::vector<sim_band_entry> bands[SIM_NUM_BANDS]; // sorted by hash
+    int budget_id = -1;
+};
+
+#define SIM_INDEX_MAGIC 0x58444E494D495351ULL // "QSIMINDX"
+#define SIM_INDEX_VERSION 0x02
+
+// Searches launched with a trailing '&' are queued for the runner thread, which fuses the queued
+// whole-memory searches into a single pass. The results are kept until the program exits.
+struct search_jobs_ctx {
+    std::vector<search_job*> jobs;
+    std::vector<search_job*> pending;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread runner;
+    uint32_t next_id = 1;
+    bool exit = false;
+    volatile int foreground_busy = 0;
+    const char* dump_path = nullptr; // the checkpoints are written beside the dump
+};
+
+// Page cache residency of the dump file. Windows has no mincore, so the tool records when it last read each chunk
+// (scans and the background caching) and assumes the system cache evicts in LRU order: a chunk stays resident
+// while fewer bytes than the cache can hold have been read since.
+struct residency_map {
+    std::vector<std::atomic<uint64_t>> touched; // read clock after the chunk was last read, 0 - never
+    std::vector<std::atomic<uint8_t>> released; // scanned with low memory priority (-u), not warmed again
+    size_t num_chunks = 0;
+    uint64_t chunk_size = 0;
+    std::atomic<uint64_t> clock{ 0 }; // bytes read so far
+    bool ssd = true;
+    bool threads_from_cmdline = false;
+};
+
+struct dump_memory_range {
+    uint64_t address;
+    uint64_t size;
+    uint64_t rva;
 };
 
 struct dump_processing_context {
@@ -31,10 +144,19 @@ struct dump_processing_context {
     HANDLE file_handle;
     HANDLE file_mapping;
     HANDLE file_base;
+    uint64_t dump_size;
+    bool packed; // file_base is the reserved range of a packed dump decoded on demand, file_mapping is NULL
+    uint32_t dump_id; // see compute_dump_id
     std::vector<module_data> m_data;
     std::vector<thread_info_dump> t_data;
     cpu_info_data cpu_info;
     cache_memory_regions_ctx pages_caching_state;
+    precompute_ctx precompute;
+    search_jobs_ctx jobs;
+    result_cache_ctx results;
+    residency_map residency;
+    std::vector<dump_memory_range> ranges_by_address; // hexdump page reads, similarity search
+    similarity_index sim_index;
 };
 
 struct reg_search_result {
@@ -53,20 +175,228 @@ struct block_info_dump {
     DWORD low;
     DWORD high;
     uint64_t info_id;
+    uint64_t num_regions; // > 1 if file contiguous small regions have been coalesced into a single mapping
+    uint64_t rva; // file offset of the first byte to search
+};
+
+// /~est: one block is drawn from each stratum of about equal bytes, with a probability proportional to its size
+struct sample_block {
+    uint64_t rva;
+    uint64_t bytes; // up to the next block, the overlap is searched by both
+    uint64_t stratum_bytes; // sampled blocks only
+    uint64_t hits;
+    bool sampled;
+};
+
+struct sample_plan {
+    double fraction;
+    bool counting = false; // the first pass only lists the blocks
+    size_t next_block = 0;
+    bool exact = false; // every block is sampled
+    std::vector<sample_block> blocks;
 };
 
+// Foreground scans search the resident blocks first while the cold ones are read ahead of the producer
+struct io_plan {
+    bool counting = false; // the first pass classifies the blocks
+    bool reorder = false; // some blocks are resident, some are not
+    bool read_ahead = false;
+    bool deferring = false; // the second pass queues the resident blocks only
+    size_t next_block = 0;
+    uint64_t capacity = 0; // bytes the system cache is assumed to hold
+    uint64_t warm_bytes = 0;
+    uint64_t cold_bytes = 0;
+    std::vector<uint8_t> cold; // per block
+    std::vector<block_info_dump> cold_blocks;
+    std::atomic<uint64_t> cold_bytes_queued{ 0 }; // paces the prefetch
+    volatile int exit_prefetch = 0;
+};
+
+#define PREFETCH_RANGE_LEN 0x2000000
+
+static void mark_resident(residency_map& residency, uint64_t rva, uint64_t size) {
+    if (!residency.num_chunks || !size) {
+        return;
+    }
+    const uint64_t now = residency.clock.fetch_add(size) + size;
+    const size_t last = (size_t)(_min((rva + size - 1) / residency.chunk_size, (uint64_t)residency.num_chunks - 1));
+    for (size_t c = (size_t)(rva / residency.chunk_size); c <= last; c++) {
+        residency.touched[c].store(now, std::memory_order_relaxed);
+    }
+}
+
+static void mark_released(residency_map& residency, uint64_t rva, uint64_t size) {
+    if (!residency.num_chunks || !size) {
+        return;
+    }
+    const size_t last = (size_t)(_min((rva + size - 1) / residency.chunk_size, (uint64_t)residency.num_chunks - 1));
+    for (size_t c = (size_t)(rva / residency.chunk_size); c <= last; c++) {
+        residency.released[c].store(1, std::memory_order_relaxed);
+    }
+}
+
+static bool is_released(const residency_map& residency, uint64_t rva, uint64_t size) {
+    const size_t last = (size_t)(_min((rva + size - 1) / residency.chunk_size, (uint64_t)residency.num_chunks - 1));
+    for (size_t c = (size_t)(rva / residency.chunk_size); c <= last; c++) {
+        if (!residency.released[c].load(std::memory_order_relaxed)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_resident(const residency_map& residency, uint64_t rva, uint64_t size, uint64_t capacity) {
+    const uint64_t now = residency.clock.load(std::memory_order_relaxed);
+    const size_t last = (size_t)(_min((rva + size - 1) / residency.chunk_size, (uint64_t)residency.num_chunks - 1));
+    for (size_t c = (size_t)(rva / residency.chunk_size); c <= last; c++) {
+        const uint64_t touched = residency.touched[c].load(std::memory_order_relaxed);
+        if (!touched || ((now - touched) >= capacity)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Lowers the priority of the pages the thread reads, they are the first the system repurposes
+static void lower_memory_priority() {
+    MEMORY_PRIORITY_INFORMATION priority = { MEMORY_PRIORITY_VERY_LOW };
+    SetThreadInformation(GetCurrentThread(), ThreadMemoryPriority, &priority, sizeof(priority));
+}
+
+// a stripe of the dump file is as long as a queue of blocks, so each node has work queued while the next stripe is produced
+#define NUMA_STRIPE_BLOCKS (1 << SEARCH_DATA_QUEUE_SIZE_POW2)
+
 struct search_context_dump {
-    circular_buffer<block_info_dump, SEARCH_DATA_QUEUE_SIZE_POW2> block_info_queue;
+    // one queue per NUMA node, a block goes to the node its file stripe was cached on (see cache_memory_regions), idle nodes steal
+    circular_buffer<block_info_dump, SEARCH_DATA_QUEUE_SIZE_POW2> block_info_queues[MAX_NUMA_NODES];
+    semaphore_counting node_workers_sem[MAX_NUMA_NODES];
+    uint32_t num_nodes = 1;
+    uint64_t stripe_size = 0;
     std::vector<MINIDUMP_MEMORY_DESCRIPTOR64> mem_info;
+    std::vector<uint64_t> rva_offsets;
     const MINIDUMP_MEMORY_DESCRIPTOR64* memory_descriptors = nullptr; 
     const MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
     dump_processing_context *ctx = nullptr;
     search_context_common common{};
+    const pattern_data* pdata = nullptr; // the command's pattern or the copy owned by a background job
+    search_job* job = nullptr; // background searches, a foreground search for its checkpoints
+    // a fused scan reads every block once and hands it to each of the consumers (the jobs' own contexts)
+    std::vector<search_context_dump*> consumers;
+    std::vector<int64_t> consumer_info_ids; // [info_id * consumers.size() + consumer], -1 - not searched by the consumer
+    int64_t min_pattern_len = 0; // the shortest pattern of the consumers, pdata holds the longest for the block overlap
+    bool background = false;
+    // checkpoints: the blocks below the watermark (the lowest block in flight) have been searched
+    std::multiset<uint64_t> blocks_in_flight;
+    std::mutex progress_lock;
+    uint64_t resume_rva = 0; // a resumed job skips the blocks ending below
+    ULONGLONG checkpoint_tick = 0;
+    volatile int stopped = 0; // set by the producer once the final checkpoint is written
+    std::atomic<uint64_t> bytes_scanned{ 0 };
+    uint64_t bytes_total = 0;
+    bool skip_zero_pages = false; // a pattern with a non-zero byte can't match inside zero pages
+    sample_plan* sample = nullptr; // /~est only
+    io_plan* io = nullptr; // foreground scans only
+    int num_threads = 0; // picked by the I/O planner, 0 - g_max_threads
+};
+
+enum job_state {
+    js_queued,
+    js_running,
+    js_done,
+    js_killed,
+    js_interrupted, // found as a checkpoint left by an earlier session
+};
+
+// everything a job's results depend on, the checkpoint is rejected if its crc doesn't match
+struct checkpoint_params {
+    char pattern[MAX_PATTERN_LEN];
+    int64_t pattern_len;
+    uint64_t range_start;
+    uint64_t range_length;
+    region_filter filter;
+    uint32_t scope_type;
+    uint32_t op;
+    uint64_t dump_size;
+    uint32_t dump_id;
+    uint32_t reserved;
+};
+
+struct checkpoint_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t job_id;
+    uint64_t watermark;
+    uint64_t bytes_scanned;
+    uint64_t bytes_total;
+    uint64_t num_matches; // followed by search_match[num_matches]
+    uint32_t params_crc32c;
+    uint32_t matches_crc32c;
+    checkpoint_params params;
+    char command[MAX_COMMAND_LEN + MAX_ARG_LEN];
+};
+
+#define CHECKPOINT_MAGIC 0x54504B434D454D51ULL // "QMEMCKPT"
+#define CHECKPOINT_VERSION 0x02
+
+struct result_key {
+    checkpoint_params params;
+    uint32_t parent_id; // /in refinements: the result set the predicate was checked on
+    uint32_t reserved; // rs operations: the result_set_op, the operand ids are in params.pattern
+    int64_t offset; // predicate offset from the parent's match sites, the rs shift
+};
+
+#define RESULT_BLOCK_LEN 0x80
+
+struct result_entry {
+    uint32_t id;
+    result_key key;
+    char name[MAX_SET_NAME_LEN];
+    char command[MAX_COMMAND_LEN + MAX_ARG_LEN];
+    uint64_t num_addresses;
+    std::vector<uint8_t> packed; // sorted unique addresses, delta encoded (see pack_addresses)
+    int budget_id;
+    result_cache_ctx* cache;
+};
+
+#define RESULT_RECORD_RENAME 0x01
+
+struct result_record_header {
+    uint32_t id;
+    uint32_t flags;
+    uint64_t num_addresses;
+    uint64_t packed_size; // followed by the packed addresses
+    uint32_t packed_crc32c;
+    uint32_t reserved;
+    result_key key;
+    char name[MAX_SET_NAME_LEN];
+    char command[MAX_COMMAND_LEN + MAX_ARG_LEN];
+};
+
+#define RESULTS_MAGIC 0x544C53524D454D51ULL // "QMEMRSLT"
+#define RESULTS_VERSION 0x03
+
+struct search_job {
+    uint32_t id;
+    char command[MAX_COMMAND_LEN + MAX_ARG_LEN];
+    char pattern[MAX_PATTERN_LEN];
+    pattern_data pdata;
+    search_context_dump search_ctx;
+    std::atomic<int> state{ js_queued };
+    volatile int cancel = 0;
+    bool reported = false;
+    uint32_t fused = 0; // number of jobs sharing the memory pass
+    checkpoint_params params;
+    int budget_id = -1; // the matches, charged by the producer as they grow
+    uint64_t charged_bytes = 0;
+    ULONGLONG start_tick = 0;
+    ULONGLONG end_tick = 0;
 };
 
 static void get_system_info(dump_processing_context* ctx);
 static void gather_modules(dump_processing_context* ctx);
 static void gather_threads(dump_processing_context* ctx);
+static void gather_memory_ranges(dump_processing_context* ctx);
+static size_t read_dump_page(void* owner, uint64_t page_address, uint8_t* page);
 static bool list_memory64_regions(const dump_processing_context* ctx);
 static bool list_memory_regions(const dump_processing_context* ctx);
 static void list_modules(const dump_processing_context* ctx);
@@ -75,20 +405,567 @@ static void list_thread_registers(const dump_processing_context* ctx);
 static void list_memory_regions_info(const dump_processing_context* ctx, bool show_commited);
 static void print_memory_info(const dump_processing_context* ctx);
 static void print_module_info(const dump_processing_context* ctx);
+static void verify_dump_modules(const dump_processing_context* ctx);
+static void extract_modules(const dump_processing_context* ctx);
+static void carve_dump(const dump_processing_context* ctx);
+static bool write_file_data(HANDLE file_handle, const char* data, uint64_t size);
 static void print_thread_info(const dump_processing_context* ctx);
 static void list_handle_descriptors(const dump_processing_context* ctx);
 static bool init_symbols(dump_processing_context* ctx);
 static void deinit_symbols(common_processing_context* ctx);
 static void symbol_set_path(const dump_processing_context* ctx);
 static bool is_drive_ssd(const char* file_path);
+static void init_residency_map(residency_map* residency, uint64_t file_size);
 static void cache_memory_regions(dump_processing_context* ctx);
-static void wait_for_memory_regions_caching(cache_memory_regions_ctx* ctx);
+static void pause_memory_regions_caching(cache_memory_regions_ctx* ctx);
+static void resume_memory_regions_caching(cache_memory_regions_ctx* ctx);
 static void stop_memory_regions_caching(cache_memory_regions_ctx* ctx, std::thread& t);
 static bool is_elevated();
 static bool purge_standby_list();
 static void data_block_calculate(dump_processing_context* ctx);
+static void similarity_search(dump_processing_context* ctx);
+static void hash_regions(dump_processing_context* ctx);
+static void hash_module(dump_processing_context* ctx);
+static uint64_t hash_dump_range(dump_processing_context* ctx, const uint8_t* address, uint64_t size);
+static const uint8_t* map_dump_view(const dump_processing_context* ctx, uint64_t rva, uint64_t size, HANDLE* view);
+static void unmap_dump_view(HANDLE view);
+static void start_precompute(dump_processing_context* ctx);
+static void pause_precompute(precompute_ctx* pctx);
+static void resume_precompute(precompute_ctx* pctx);
+static void stop_precompute(precompute_ctx* pctx);
+static bool precomputed_zero_range(const precompute_ctx* pctx, uint64_t rva, uint64_t size);
+static void print_precomputed_info(const precompute_ctx* pctx, uint64_t address);
+static void fill_checkpoint_params(const dump_processing_context* ctx, const pattern_data& pdata, checkpoint_params* params);
+static const result_entry* find_cached_result(const dump_processing_context* ctx, const result_key& key);
+static void print_cached_result(dump_processing_context* ctx, const result_entry* entry);
+static const result_entry* cache_search_result(dump_processing_context* ctx, const result_key& key, const std::vector<search_match>& matches, const char* command);
+static void refine_cached_result(dump_processing_context* ctx);
+static void result_set_command(dump_processing_context* ctx);
+static void list_cached_results(const dump_processing_context* ctx);
+static void load_cached_results(dump_processing_context* ctx, const char* dump_path);
+static void free_cached_results(result_cache_ctx* rcache);
+
+// Packed dump layout: compressed chunks | chunk index | footer.
+// Every chunk covers PACK_CHUNK_SIZE bytes of the original file (the last one may be shorter).
+#define PACK_MAGIC 0x4b4341504d454d51ULL // "QMEMPACK"
+#define PACK_VERSION 1
+
+enum pack_chunk_flags {
+    pc_compressed = 0,
+    pc_zero = 1 << 0, // all bytes are zero, nothing stored
+    pc_uniform = 1 << 1, // all bytes are equal to fill, nothing stored
+    pc_stored = 1 << 2, // stored uncompressed
+    pc_duplicate = 1 << 3, // same content as the chunk at index offset, nothing stored
+};
+
+struct pack_chunk_entry {
+    uint64_t offset; // offset in the container or the index of the source chunk for pc_duplicate
+    uint32_t stored_size;
+    uint16_t flags;
+    uint8_t fill;
+    uint8_t reserved;
+    uint32_t crc32c; // of the original bytes
+    uint32_t reserved_1;
+    uint64_t content_hash;
+};
+
+struct pack_footer {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t chunk_size;
+    uint64_t original_size;
+    uint64_t num_chunks;
+    uint64_t index_offset;
+    uint32_t index_crc32c;
+    uint32_t reserved;
+};
+
+// four independent crc lanes, wide enough for a dedup key, a hit is confirmed with memcmp
+static uint64_t compute_content_hash(const uint8_t* data, size_t length) {
+    uint64_t h0 = 0x9E3779B9, h1 = 0x85EBCA6B, h2 = 0xC2B2AE35, h3 = 0x27D4EB2F;
+    size_t i = 0;
+    for (; (i + 4 * sizeof(uint64_t)) <= length; i += 4 * sizeof(uint64_t)) {
+        h0 = _mm_crc32_u64(h0, *(const uint64_t*)(data + i));
+        h1 = _mm_crc32_u64(h1, *(const uint64_t*)(data + i + 8));
+        h2 = _mm_crc32_u64(h2, *(const uint64_t*)(data + i + 16));
+        h3 = _mm_crc32_u64(h3, *(const uint64_t*)(data + i + 24));
+    }
+    for (; i < length; i++) {
+        h0 = _mm_crc32_u8((uint32_t)h0, data[i]);
+    }
+    return ((h0 ^ (h2 << 7)) << 32) ^ (h1 ^ (h3 << 13)) ^ length;
+}
+
+static bool is_uniform(const uint8_t* data, size_t length, uint8_t* fill) {
+    *fill = data[0];
+    const __m128i xmm_fill = _mm_set1_epi8((char)data[0]);
+    size_t i = 0;
+    for (; (i + sizeof(__m128i)) <= length; i += sizeof(__m128i)) {
+        const __m128i xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(xmm0, xmm_fill)) != 0xFFFF) {
+            return false;
+        }
+    }
+    for (; i < length; i++) {
+        if (data[i] != *fill) {
+            return false;
+        }
+    }
+    return true;
+}
+
+enum packed_chunk_state : uint8_t {
+    pcs_absent,
+    pcs_decoding,
+    pcs_mapped,
+};
+
+// A packed dump is decoded on demand. The address range of the original file is reserved as one placeholder
+// per chunk; the first access to a chunk faults, the chunk is decoded into its own section and the view
+// replaces the placeholder, so the readers only ever see complete chunks. The mapped chunks form an LRU,
+// bounded by PACK_CACHE_MAX_CHUNKS and charged to the memory budget; the least recently used one is unmapped
+// back into its placeholder and faults again on its next access.
+struct packed_dump {
+    HANDLE container_mapping = NULL;
+    const uint8_t* container = nullptr;
+    const pack_footer* footer = nullptr;
+    const pack_chunk_entry* index = nullptr;
+    uint8_t* base = nullptr; // the original file, one placeholder or view per chunk
+    uint64_t chunk_size = 0;
+    uint64_t num_chunks = 0;
+    PVOID fault_handler = nullptr;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<packed_chunk_state> state;
+    std::vector<uint32_t> lru_prev; // intrusive, a fault must not allocate
+    std::vector<uint32_t> lru_next;
+    uint32_t lru_head = UINT32_MAX; // most recently used
+    uint32_t lru_tail = UINT32_MAX;
+    uint64_t num_mapped = 0;
+    uint64_t num_charged = 0; // mapped chunks paid for by the budget
+    int budget_id = -1;
+    std::vector<DECOMPRESSOR_HANDLE> decompressors; // idle ones
+    std::atomic<uint64_t> num_decoded{ 0 };
+    std::atomic<uint64_t> num_corrupted{ 0 };
+};
+
+static packed_dump g_packed_dump; // at most one dump is open
+
+static void lru_unlink(packed_dump* pd, uint32_t c) {
+    const uint32_t prev = pd->lru_prev[c], next = pd->lru_next[c];
+    (prev != UINT32_MAX ? pd->lru_next[prev] : pd->lru_head) = next;
+    (next != UINT32_MAX ? pd->lru_prev[next] : pd->lru_tail) = prev;
+}
+
+static void lru_push_front(packed_dump* pd, uint32_t c) {
+    pd->lru_prev[c] = UINT32_MAX;
+    pd->lru_next[c] = pd->lru_head;
+    (pd->lru_head != UINT32_MAX ? pd->lru_prev[pd->lru_head] : pd->lru_tail) = c;
+    pd->lru_head = c;
+}
+
+// under pd->mtx, a thread still reading the chunk faults and maps it again
+static void unmap_packed_chunk(packed_dump* pd, uint32_t c) {
+    lru_unlink(pd, c);
+    UnmapViewOfFile2(GetCurrentProcess(), pd->base + c * pd->chunk_size, MEM_PRESERVE_PLACEHOLDER);
+    pd->state[c] = pcs_absent;
+    pd->num_mapped--;
+}
+
+// called with the budget lock held
+static void evict_packed_chunks(void* owner) {
+    packed_dump* pd = (packed_dump*)owner;
+    std::unique_lock<std::mutex> lk(pd->mtx);
+    while (pd->lru_tail != UINT32_MAX) {
+        unmap_packed_chunk(pd, pd->lru_tail);
+    }
+    pd->num_charged = 0;
+}
+
+static bool decode_packed_chunk(packed_dump* pd, uint64_t c, uint8_t* dst, DECOMPRESSOR_HANDLE decompressor) {
+    const uint64_t original_size = pd->footer->original_size;
+    const size_t size = (size_t)(_min(pd->chunk_size, original_size - c * pd->chunk_size));
+    const pack_chunk_entry* entry = &pd->index[c];
+    while (entry->flags & pc_duplicate) { // the source index is lower, validated at open
+        entry = &pd->index[entry->offset];
+    }
+    const uint64_t source = entry - pd->index;
+    if (size != (size_t)(_min(pd->chunk_size, original_size - source * pd->chunk_size))) {
+        return false; // only the last chunk is shorter, it can't be the source of another one
+    }
+    if (entry->flags & pc_zero) {
+        return true; // a fresh section is zero filled
+    } else if (entry->flags & pc_uniform) {
+        memset(dst, entry->fill, size);
+    } else if (entry->flags & pc_stored) {
+        if (entry->stored_size != size) {
+            return false;
+        }
+        memcpy(dst, pd->container + entry->offset, size);
+    } else {
+        SIZE_T decompressed_size = 0;
+        if (!decompressor || !Decompress(decompressor, pd->container + entry->offset, entry->stored_size, dst, size, &decompressed_size)
+            || (decompressed_size != size)) {
+            return false;
+        }
+    }
+    return compute_crc32c(dst, size) == entry->crc32c;
+}
+
+// Maps chunk c, returns false if it can't be (the fault is then passed on)
+static bool map_packed_chunk(packed_dump* pd, uint32_t c) {
+    DECOMPRESSOR_HANDLE decompressor = NULL;
+    {
+        std::unique_lock<std::mutex> lk(pd->mtx);
+        pd->cv.wait(lk, [pd, c] { return pd->state[c] != pcs_decoding; });
+        if (pd->state[c] == pcs_mapped) {
+            lru_unlink(pd, c);
+            lru_push_front(pd, c);
+            return true;
+        }
+        pd->state[c] = pcs_decoding;
+        if (!pd->decompressors.empty()) {
+            decompressor = pd->decompressors.back();
+            pd->decompressors.pop_back();
+        }
+    }
+    // the fault may come from any code, so nothing else is evicted to make room, the chunks recycle their own
+    const bool charged = mem_budget_try_charge(pd->budget_id, pd->chunk_size);
+    if (!decompressor && !CreateDecompressor(COMPRESS_ALGORITHM_XPRESS_HUFF | COMPRESS_RAW, NULL, &decompressor)) {
+        decompressor = NULL;
+    }
+
+    const DWORD high = (DWORD)((pd->chunk_size >> 0x20) & 0xFFFFFFFF);
+    const DWORD low = (DWORD)(pd->chunk_size & 0xFFFFFFFF);
+    HANDLE section = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, high, low, NULL);
+    uint8_t* dst = section ? (uint8_t*)MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, 0) : nullptr;
+    bool mapped = false;
+    if (dst) {
+        if (!decode_packed_chunk(pd, c, dst, decompressor)) {
+            if (1 == ++pd->num_corrupted) {
+                fprintf(stderr, "\n*** Corrupted chunk(s) in the packed dump, their bytes are unreliable ***\n");
+            }
+        }
+        UnmapViewOfFile(dst);
+        // the view is read only, the readers see the chunk complete or fault
+        mapped = (nullptr != MapViewOfFile3(section, GetCurrentProcess(), pd->base + c * pd->chunk_size, 0, pd->chunk_size,
+            MEM_REPLACE_PLACEHOLDER, PAGE_READONLY, NULL, 0));
+    }
+    if (section) {
+        CloseHandle(section); // the view keeps it
+    }
+    pd->num_decoded++;
 
-static bool map_file(const char* dump_file_path, HANDLE* file_handle, HANDLE* file_mapping_handle, LPVOID* file_base) {
+    uint64_t to_release = 0;
+    {
+        std::unique_lock<std::mutex> lk(pd->mtx);
+        if (decompressor) {
+            pd->decompressors.push_back(decompressor);
+        }
+        pd->state[c] = mapped ? pcs_mapped : pcs_absent;
+        if (mapped) {
+            lru_push_front(pd, c);
+            pd->num_mapped++;
+        }
+        pd->num_charged += charged;
+        while ((pd->num_mapped > PACK_CACHE_MAX_CHUNKS)
+            || ((pd->num_mapped > pd->num_charged) && (pd->num_mapped > PACK_CACHE_MIN_CHUNKS))) {
+            unmap_packed_chunk(pd, pd->lru_tail);
+        }
+        if (pd->num_charged > pd->num_mapped) {
+            to_release = pd->num_charged - pd->num_mapped;
+            pd->num_charged = pd->num_mapped;
+        }
+        pd->cv.notify_all();
+    }
+    if (to_release) {
+        mem_budget_release(pd->budget_id, to_release * pd->chunk_size);
+    }
+    return mapped;
+}
+
+static LONG CALLBACK packed_dump_fault_handler(PEXCEPTION_POINTERS info) {
+    const EXCEPTION_RECORD* record = info->ExceptionRecord;
+    packed_dump* pd = &g_packed_dump;
+    if ((record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION) || (record->NumberParameters < 2) || (record->ExceptionInformation[0] != 0)) {
+        return EXCEPTION_CONTINUE_SEARCH; // only reads fault in a packed dump
+    }
+    const uint8_t* address = (const uint8_t*)record->ExceptionInformation[1];
+    if (!pd->base || (address < pd->base) || (address >= (pd->base + pd->num_chunks * pd->chunk_size))) {
+        return EXCEPTION_CONTINUE_SEARCH;
+    }
+    const uint32_t c = (uint32_t)((address - pd->base) / pd->chunk_size);
+    return map_packed_chunk(pd, c) ? EXCEPTION_CONTINUE_EXECUTION : EXCEPTION_CONTINUE_SEARCH;
+}
+
+// true if [rva, rva + size) lies in chunks stored as zero, they are searched without being mapped
+static bool packed_zero_range(uint64_t rva, uint64_t size) {
+    const packed_dump* pd = &g_packed_dump;
+    if (!pd->base || !size || ((rva + size) > pd->footer->original_size)) {
+        return false;
+    }
+    for (uint64_t c = rva / pd->chunk_size, last = (rva + size - 1) / pd->chunk_size; c <= last; c++) {
+        const pack_chunk_entry* entry = &pd->index[c];
+        while (entry->flags & pc_duplicate) {
+            entry = &pd->index[entry->offset];
+        }
+        if (!(entry->flags & pc_zero)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void close_packed_dump() {
+    packed_dump* pd = &g_packed_dump;
+    if (!pd->base) {
+        return;
+    }
+    RemoveVectoredExceptionHandler(pd->fault_handler);
+    mem_budget_unregister(pd->budget_id);
+    {
+        std::unique_lock<std::mutex> lk(pd->mtx);
+        while (pd->lru_tail != UINT32_MAX) {
+            unmap_packed_chunk(pd, pd->lru_tail);
+        }
+    }
+    for (uint64_t c = 0; c < pd->num_chunks; c++) {
+        VirtualFree(pd->base + c * pd->chunk_size, 0, MEM_RELEASE);
+    }
+    for (DECOMPRESSOR_HANDLE decompressor : pd->decompressors) {
+        CloseDecompressor(decompressor);
+    }
+    pd->decompressors.clear();
+    UnmapViewOfFile(pd->container);
+    CloseHandle(pd->container_mapping);
+    pd->base = nullptr;
+}
+
+// Opens the container in place of the dump: *file_base becomes the reserved range of the original file,
+// *file_mapping_handle is closed (the dump is read through file_base only, see map_dump_view).
+// Nothing is decoded here, opening a packed dump reads the index and the footer only.
+static bool open_packed_dump(HANDLE* file_mapping_handle, LPVOID* file_base, uint64_t file_size, uint64_t* dump_size) {
+    if (file_size < sizeof(pack_footer)) {
+        return false;
+    }
+    const uint8_t* container = (const uint8_t*)*file_base;
+    const pack_footer* footer = (const pack_footer*)(container + file_size - sizeof(pack_footer));
+    if ((footer->magic != PACK_MAGIC) || (footer->version != PACK_VERSION) || !footer->chunk_size
+        || (footer->chunk_size % get_alloc_granularity()) // a placeholder per chunk
+        || (footer->num_chunks != ((footer->original_size + footer->chunk_size - 1) / footer->chunk_size))
+        || (footer->num_chunks >= UINT32_MAX)
+        || ((footer->index_offset + footer->num_chunks * sizeof(pack_chunk_entry)) > (file_size - sizeof(pack_footer)))) {
+        return false;
+    }
+    const pack_chunk_entry* index = (const pack_chunk_entry*)(container + footer->index_offset);
+    if (compute_crc32c((const uint8_t*)index, footer->num_chunks * sizeof(pack_chunk_entry)) != footer->index_crc32c) {
+        fprintf(stderr, "\nThe packed dump index is corrupted.\n");
+        return false;
+    }
+    for (uint64_t i = 0; i < footer->num_chunks; i++) {
+        const pack_chunk_entry& entry = index[i];
+        if ((entry.flags & pc_duplicate) ? (entry.offset >= i) : ((entry.offset + entry.stored_size) > footer->index_offset)) {
+            fprintf(stderr, "\nThe packed dump index is corrupted.\n");
+            return false;
+        }
+    }
+
+    packed_dump* pd = &g_packed_dump;
+    pd->chunk_size = footer->chunk_size;
+    pd->num_chunks = footer->num_chunks;
+    pd->base = (uint8_t*)VirtualAlloc2(NULL, NULL, pd->num_chunks * pd->chunk_size, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER, PAGE_NOACCESS, NULL, 0);
+    if (!pd->base) {
+        fprintf(stderr, "\nFailed to reserve the address range of the packed dump: %lu\n", GetLastError());
+        return false;
+    }
+    for (uint64_t c = 0; (c + 1) < pd->num_chunks; c++) { // split into one placeholder per chunk
+        if (!VirtualFree(pd->base + c * pd->chunk_size, pd->chunk_size, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER)) {
+            fprintf(stderr, "\nFailed to reserve the address range of the packed dump: %lu\n", GetLastError());
+            for (uint64_t p = 0; p <= c; p++) {
+                VirtualFree(pd->base + p * pd->chunk_size, 0, MEM_RELEASE);
+            }
+            pd->base = nullptr;
+            return false;
+        }
+    }
+    pd->container_mapping = *file_mapping_handle;
+    pd->container = container;
+    pd->footer = footer;
+    pd->index = index;
+    pd->state.assign((size_t)pd->num_chunks, pcs_absent);
+    pd->lru_prev.assign((size_t)pd->num_chunks, UINT32_MAX);
+    pd->lru_next.assign((size_t)pd->num_chunks, UINT32_MAX);
+    pd->budget_id = mem_budget_register("packed dump chunks", 0x08, evict_packed_chunks, pd);
+    pd->fault_handler = AddVectoredExceptionHandler(1, packed_dump_fault_handler);
+
+    *file_base = pd->base;
+    *file_mapping_handle = NULL;
+    *dump_size = footer->original_size;
+    return true;
+}
+
+struct pack_chunk_result {
+    std::vector<uint8_t> data;
+    pack_chunk_entry entry;
+};
+
+struct pack_context {
+    const uint8_t* dump;
+    uint64_t dump_size;
+    uint64_t first_chunk;
+    uint64_t num_chunks;
+    std::vector<pack_chunk_result>* results;
+    std::atomic<uint64_t> next_chunk{ 0 };
+};
+
+static void pack_chunks(pack_context* pctx) {
+    COMPRESSOR_HANDLE compressor = NULL;
+    if (!CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF | COMPRESS_RAW, NULL, &compressor)) {
+        compressor = NULL; // chunks will be stored
+    }
+    while (1) {
+        const uint64_t n = pctx->next_chunk++;
+        if (n >= pctx->num_chunks) {
+            break;
+        }
+        const uint64_t i = pctx->first_chunk + n;
+        pack_chunk_result& result = (*pctx->results)[n];
+        const uint8_t* src = pctx->dump + i * PACK_CHUNK_SIZE;
+        const size_t size = (size_t)(_min((uint64_t)PACK_CHUNK_SIZE, pctx->dump_size - i * PACK_CHUNK_SIZE));
+        pack_chunk_entry& entry = result.entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.crc32c = compute_crc32c(src, size);
+        result.data.clear();
+        if (is_uniform(src, size, &entry.fill)) {
+            entry.flags = entry.fill ? pc_uniform : pc_zero;
+            continue;
+        }
+        entry.content_hash = compute_content_hash(src, size);
+        result.data.resize(size);
+        SIZE_T compressed_size = 0;
+        if (compressor && Compress(compressor, src, size, result.data.data(), size, &compressed_size) && (compressed_size < size)) {
+            entry.flags = pc_compressed;
+            entry.stored_size = (uint32_t)compressed_size;
+            result.data.resize(compressed_size);
+        } else {
+            entry.flags = pc_stored;
+            entry.stored_size = (uint32_t)size;
+            memcpy(result.data.data(), src, size);
+        }
+    }
+    if (compressor) {
+        CloseCompressor(compressor);
+    }
+}
+
+static void pack_dump(const dump_processing_context* ctx) {
+    const char* file_path = ctx->common.i_data.file_path;
+    HANDLE file_handle = CreateFileA(file_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to create the file %s: %lu\n", file_path, GetLastError());
+        return;
+    }
+
+    const uint8_t* dump = (const uint8_t*)ctx->file_base;
+    const uint64_t num_chunks = (ctx->dump_size + PACK_CHUNK_SIZE - 1) / PACK_CHUNK_SIZE;
+    std::vector<pack_chunk_entry> index(num_chunks);
+    std::unordered_map<uint64_t, uint64_t> chunks_by_hash;
+    uint64_t num_zero = 0, num_uniform = 0, num_duplicate = 0;
+
+    // chunks are compressed in parallel batches and written in order
+    const size_t num_threads = _min(std::thread::hardware_concurrency(), (unsigned)g_max_threads);
+    const uint64_t batch_size = num_threads * PACK_BATCH_CHUNKS_PER_THREAD;
+    std::vector<pack_chunk_result> results(batch_size);
+    uint64_t offset = 0;
+    bool success = true;
+    for (uint64_t first_chunk = 0; success && (first_chunk < num_chunks); first_chunk += batch_size) {
+        pack_context pctx;
+        pctx.dump = dump;
+        pctx.dump_size = ctx->dump_size;
+        pctx.first_chunk = first_chunk;
+        pctx.num_chunks = _min(batch_size, num_chunks - first_chunk);
+        pctx.results = &results;
+        std::vector<std::thread> workers; workers.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; i++) {
+            workers.push_back(std::thread(pack_chunks, &pctx));
+        }
+        for (auto& w : workers) {
+            if (w.joinable()) {
+                w.join();
+            }
+        }
+
+        for (uint64_t n = 0; success && (n < pctx.num_chunks); n++) {
+            const uint64_t i = first_chunk + n;
+            pack_chunk_entry& entry = results[n].entry;
+            if (entry.flags & pc_zero) {
+                num_zero++;
+            } else if (entry.flags & pc_uniform) {
+                num_uniform++;
+            } else {
+                const size_t size = (size_t)(_min((uint64_t)PACK_CHUNK_SIZE, ctx->dump_size - i * PACK_CHUNK_SIZE));
+                auto it = chunks_by_hash.find(entry.content_hash);
+                if ((it != chunks_by_hash.end()) && (index[it->second].crc32c == entry.crc32c)
+                    && (size == (size_t)(_min((uint64_t)PACK_CHUNK_SIZE, ctx->dump_size - it->second * PACK_CHUNK_SIZE)))
+                    && (0 == memcmp(dump + it->second * PACK_CHUNK_SIZE, dump + i * PACK_CHUNK_SIZE, size))) {
+                    entry.flags = pc_duplicate;
+                    entry.offset = it->second;
+                    entry.stored_size = 0;
+                    num_duplicate++;
+                } else {
+                    chunks_by_hash.emplace(entry.content_hash, i);
+                    entry.offset = offset;
+                    success = write_file_data(file_handle, (const char*)results[n].data.data(), results[n].data.size());
+                    offset += results[n].data.size();
+                }
+            }
+            index[i] = entry;
+        }
+    }
+
+    pack_footer footer = { PACK_MAGIC, PACK_VERSION, PACK_CHUNK_SIZE, ctx->dump_size, num_chunks, offset, 0, 0 };
+    footer.index_crc32c = compute_crc32c((const uint8_t*)index.data(), index.size() * sizeof(pack_chunk_entry));
+    success = success
+        && write_file_data(file_handle, (const char*)index.data(), index.size() * sizeof(pack_chunk_entry))
+        && write_file_data(file_handle, (const char*)&footer, sizeof(footer));
+    CloseHandle(file_handle);
+    if (!success) {
+        fprintf(stderr, "Failed writing to the file %s: %lu\n", file_path, GetLastError());
+        DeleteFileA(file_path);
+        return;
+    }
+
+    const uint64_t packed_size = offset + index.size() * sizeof(pack_chunk_entry) + sizeof(footer);
+    printf("Chunks: %llu | Zero: %llu | Uniform: %llu | Duplicate: %llu\n", num_chunks, num_zero, num_uniform, num_duplicate);
+    printf("Original size: 0x%llx | Packed size: 0x%llx (%.1f%%)\n", ctx->dump_size, packed_size,
+        ctx->dump_size ? (100.0 * (double)packed_size / (double)ctx->dump_size) : 0.0);
+    printf("*** Written to %s ***\n", file_path);
+}
+
+// Tells apart dumps of the same size, a checkpoint, a result set or an index saved for another dump is rejected.
+// The header carries the time stamp and the flags, the directory the size and the location of every stream.
+static uint32_t compute_dump_id(const dump_processing_context* ctx) {
+    const MINIDUMP_HEADER* header = (const MINIDUMP_HEADER*)ctx->file_base;
+    std::vector<uint8_t> bytes((const uint8_t*)header, (const uint8_t*)header + sizeof(MINIDUMP_HEADER));
+    const uint64_t directory_size = (uint64_t)header->NumberOfStreams * sizeof(MINIDUMP_DIRECTORY);
+    if ((header->StreamDirectoryRva + directory_size) <= ctx->dump_size) {
+        const uint8_t* directory = (const uint8_t*)header + header->StreamDirectoryRva;
+        bytes.insert(bytes.end(), directory, directory + directory_size);
+    }
+    return compute_crc32c(bytes.data(), bytes.size());
+}
+
+static void close_dump_file(HANDLE file_handle, HANDLE file_mapping_handle, LPVOID file_base, bool packed) {
+    if (packed) {
+        close_packed_dump();
+    } else {
+        UnmapViewOfFile(file_base);
+        CloseHandle(file_mapping_handle);
+    }
+    CloseHandle(file_handle);
+}
+
+static bool map_file(const char* dump_file_path, HANDLE* file_handle, HANDLE* file_mapping_handle, LPVOID* file_base, uint64_t* dump_size, bool* packed) {
     *file_handle = CreateFileA(dump_file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN /*FILE_ATTRIBUTE_NORMAL*/, NULL);
     if (*file_handle == INVALID_HANDLE_VALUE) {
         fprintf(stderr, "\nFailed to open the file.\n");
@@ -110,22 +987,26 @@ static bool map_file(const char* dump_file_path, HANDLE* file_handle, HANDLE* fi
         return false;
     }
 
+    LARGE_INTEGER file_size; file_size.QuadPart = 0;
+    GetFileSizeEx(*file_handle, &file_size);
+    *dump_size = (uint64_t)file_size.QuadPart;
+    *packed = false;
+    if ((*dump_size < sizeof(MINIDUMP_HEADER)) || (((MINIDUMP_HEADER*)*file_base)->Signature != MINIDUMP_SIGNATURE)) {
+        *packed = open_packed_dump(file_mapping_handle, file_base, *dump_size, dump_size);
+    }
+
     MINIDUMP_HEADER* header = (MINIDUMP_HEADER*)*file_base;
     
     if (header->Signature != MINIDUMP_SIGNATURE) {
         fprintf(stderr, "The provided file is not a crash dump! Exiting...\n");
-        UnmapViewOfFile(*file_base);
-        CloseHandle(*file_mapping_handle);
-        CloseHandle(*file_handle);
+        close_dump_file(*file_handle, *file_mapping_handle, *file_base, *packed);
         return false;
     }
 
     const bool is_full_dump = (header->Flags & MiniDumpWithFullMemory) != 0;
     if (!is_full_dump) {
         fprintf(stderr, "Crash dump is not a full dump - no point analysing it. Exiting..\n");
-        UnmapViewOfFile(*file_base);
-        CloseHandle(*file_mapping_handle);
-        CloseHandle(*file_handle);
+        close_dump_file(*file_handle, *file_mapping_handle, *file_base, *packed);
         return false;
     }
 
@@ -142,80 +1023,153 @@ static bool remap_file(HANDLE file_mapping_handle, LPVOID* file_base) {
     return true;
 }
 
-static void find_pattern(search_context_dump* search_ctx) {
-    const char* pattern = search_ctx->ctx->common.pdata.pattern;
-    const int64_t pattern_len = search_ctx->ctx->common.pdata.pattern_len;
+static void find_pattern_in_segment(search_context_dump* search_ctx, const char* data, int64_t size, uint64_t info_id, const char* address) {
+    const char* pattern = search_ctx->pdata->pattern;
     auto& matches = search_ctx->common.matches;
-    auto& mem_info = search_ctx->mem_info;
-    auto& block_info_queue = search_ctx->block_info_queue;
-    auto& exit_workers = search_ctx->common.exit_workers;
 
-    const bool ranged_search = search_ctx->ctx->common.pdata.scope_type == search_scope_type::mrt_range;
-    const char* range_start = search_ctx->ctx->common.pdata.range.start;
-    const char* range_end = search_ctx->ctx->common.pdata.range.start + search_ctx->ctx->common.pdata.range.length;
+    // pages known to be zero filled (background pass, zero chunks of a packed dump) can't hold a pattern with a non-zero byte
+    if (search_ctx->skip_zero_pages
+        && precomputed_zero_range(&search_ctx->ctx->precompute, search_ctx->rva_offsets[info_id] + ((uint64_t)address - search_ctx->mem_info[info_id].StartOfMemoryRange), (uint64_t)size)) {
+        return;
+    }
 
-    block_info_dump block;
-    while (1) {
-        int exit = false;
-        while (!block_info_queue.try_pop(block)) {
-            if (search_ctx->common.exit_workers) {
-                exit = true;
-                break;
+    if (search_ctx->pdata->op == search_op::so_xref) {
+        std::vector<const char*> xrefs;
+        find_xrefs((const uint8_t*)data, (size_t)size, address, *(const uint64_t*)pattern, xrefs);
+        if (!xrefs.empty()) {
+            search_ctx->common.matches_lock.lock();
+            for (const char* xref : xrefs) {
+                matches.push_back(search_match{ info_id, xref });
             }
-            search_ctx->common.workers_sem.wait();
+            search_ctx->common.matches_lock.unlock();
         }
-        search_ctx->common.master_sem.signal();
-        if (exit && !block_info_queue.try_pop(block)) {
-            break;
-        }
-
-        const size_t bytes_to_map = block.bytes_to_map;
-        const size_t bytes_to_read = block.bytes_to_read;
-        const size_t start_offset = block.start_offset;
-        const DWORD low = block.low;
-        const DWORD high = block.high;
-        const size_t reminder = bytes_to_map - bytes_to_read;
-        const size_t info_id = block.info_id;
-        const MINIDUMP_MEMORY_DESCRIPTOR64& r_info = mem_info[info_id];
+        return;
+    }
 
-        HANDLE file_base = MapViewOfFile(search_ctx->ctx->file_mapping, FILE_MAP_READ, high, low, bytes_to_map);
+    find_pattern_with_kernel(&search_ctx->common, data, size, info_id, address);
+}
 
-        if (!file_base) {
-            puts("Failed to map view of file.");
-            continue;
+// a fused scan goes on until all of its jobs are killed
+static bool scan_cancelled(const search_context_dump& search_ctx) {
+    for (const search_context_dump* consumer : search_ctx.consumers) {
+        if (!consumer->job->cancel) {
+            return false;
         }
+    }
+    return search_ctx.consumers.empty() ? (search_ctx.job && search_ctx.job->cancel) : true;
+}
 
-        const char* buffer = ((const char*)file_base + reminder);
-
-        if (!buffer) {
-            UnmapViewOfFile(file_base);
-            puts("Empty memory region!");
-            continue;
+static void dispatch_segment(search_context_dump* search_ctx, const char* data, int64_t size, uint64_t info_id, const char* address) {
+    if (search_ctx->consumers.empty()) {
+        find_pattern_in_segment(search_ctx, data, size, info_id, address);
+        return;
+    }
+    // the segment is walked in slices small enough to stay in L2 while every consumer searches them,
+    // a slice overlaps the next one by pattern_len - 1 bytes so each match is found exactly once
+    const size_t num_consumers = search_ctx->consumers.size();
+    for (int64_t offset = 0; offset < size; offset += FUSED_SCAN_SLICE_SIZE) {
+        for (size_t c = 0; c < num_consumers; c++) {
+            search_context_dump* consumer = search_ctx->consumers[c];
+            const int64_t consumer_info_id = search_ctx->consumer_info_ids[info_id * num_consumers + c];
+            if ((consumer_info_id < 0) || consumer->stopped) {
+                continue;
+            }
+            const uint64_t segment_rva = consumer->rva_offsets[consumer_info_id] + ((uint64_t)address - consumer->mem_info[consumer_info_id].StartOfMemoryRange);
+            if ((segment_rva + size) <= consumer->resume_rva) { // searched before the job was interrupted
+                continue;
+            }
+            if (consumer->pdata->op == search_op::so_xref) { // instructions may straddle the slices
+                if (offset == 0) {
+                    find_pattern_in_segment(consumer, data, size, (uint64_t)consumer_info_id, address);
+                    consumer->bytes_scanned += size;
+                }
+                continue;
+            }
+            const int64_t slice_size = _min(size - offset, FUSED_SCAN_SLICE_SIZE + consumer->pdata->pattern_len - 1);
+            find_pattern_in_segment(consumer, data + offset, slice_size, (uint64_t)consumer_info_id, address + offset);
+            consumer->bytes_scanned += (_min(size - offset, (int64_t)FUSED_SCAN_SLICE_SIZE));
         }
+    }
+}
 
-        if (bytes_to_read >= pattern_len) {
-            const char* buffer_ptr = buffer;
-            int64_t buffer_size = (int64_t)bytes_to_read;
+// A node out of blocks takes them from the other nodes' queues, the stripes don't always split the work evenly
+// (a scope or a range falling on a few stripes, pages faulted in by the prefetch thread rather than a node's reads).
+static bool pop_block(search_context_dump* search_ctx, uint32_t node, block_info_dump& block) {
+    const uint32_t num_nodes = search_ctx->num_nodes;
+    for (uint32_t n = 0; n < num_nodes; n++) {
+        if (search_ctx->block_info_queues[(node + n) % num_nodes].try_pop(block)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-            while (buffer_size >= pattern_len) {
-                const char* old_buf_ptr = buffer_ptr;
-                buffer_ptr = (const char*)strstr_u8((const uint8_t*)buffer_ptr, buffer_size, (const uint8_t*)pattern, pattern_len);
-                if (!buffer_ptr) {
-                    break;
-                }
+static void find_pattern(search_context_dump* search_ctx, uint32_t node) {
+    // a block too short for the pattern is skipped, in a fused scan too short for every consumer
+    const int64_t pattern_len = search_ctx->min_pattern_len ? search_ctx->min_pattern_len : search_ctx->pdata->pattern_len;
+    auto& mem_info = search_ctx->mem_info;
+    auto& rva_offsets = search_ctx->rva_offsets;
+    auto& workers_sem = search_ctx->node_workers_sem[node];
+    auto& exit_workers = search_ctx->common.exit_workers;
+    pin_thread_to_numa_node(node);
+    if (search_ctx->background) {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+    }
+    if (g_release_scanned) {
+        lower_memory_priority();
+    }
 
-                const ptrdiff_t buffer_offset = buffer_ptr - buffer;
-                const char* match = (const char*)(r_info.StartOfMemoryRange + buffer_offset + start_offset);
-                if (!ranged_search || ((match >= range_start) && ((match < range_end)))) {
-                    search_ctx->common.matches_lock.lock();
-                    matches.push_back(search_match{ block.info_id, match });
-                    search_ctx->common.matches_lock.unlock();
-                }
-                buffer_ptr++;
-                buffer_size -= (buffer_ptr - old_buf_ptr);
+    block_info_dump block;
+    while (1) {
+        int exit = false;
+        while (!pop_block(search_ctx, node, block)) {
+            if (search_ctx->common.exit_workers) {
+                exit = true;
+                break;
             }
+            workers_sem.wait();
+        }
+        search_ctx->common.master_sem.signal();
+        if (exit && !pop_block(search_ctx, node, block)) {
+            break;
+        }
+        if (search_ctx->background && search_ctx->stopped) {
+            continue; // drain the queue, the blocks stay in flight for the checkpoint
+        }
+        search_ctx->bytes_scanned += block.bytes_to_read;
+
+        const size_t bytes_to_read = block.bytes_to_read;
+        const size_t start_offset = block.start_offset;
+        const size_t info_id = block.info_id;
+        const MINIDUMP_MEMORY_DESCRIPTOR64& r_info = mem_info[info_id];
+
+        HANDLE file_base = NULL;
+        const char* buffer = (const char*)map_dump_view(search_ctx->ctx, block.rva, bytes_to_read, &file_base);
+        if (!buffer) {
+            puts("Failed to map view of file.");
+            continue;
+        }
+
+        if (block.num_regions > 1) {
+            // coalesced regions are searched one by one, matches never cross region boundaries
+            for (size_t r = info_id, r_end = info_id + block.num_regions; r < r_end; r++) {
+                const MINIDUMP_MEMORY_DESCRIPTOR64& seg_info = mem_info[r];
+                const char* seg = buffer + (rva_offsets[r] - rva_offsets[info_id]);
+                dispatch_segment(search_ctx, seg, (int64_t)seg_info.DataSize, r, (const char*)seg_info.StartOfMemoryRange);
+            }
+        } else if (bytes_to_read >= pattern_len) {
+            dispatch_segment(search_ctx, buffer, (int64_t)bytes_to_read, info_id, (const char*)(r_info.StartOfMemoryRange + start_offset));
+        }
+        unmap_dump_view(file_base);
+        if (g_release_scanned) {
+            mark_released(search_ctx->ctx->residency, block.rva, block.bytes_to_read);
+        } else {
+            mark_resident(search_ctx->ctx->residency, block.rva, block.bytes_to_read);
+        }
+        if (search_ctx->background || search_ctx->job) {
+            std::unique_lock<std::mutex> lk(search_ctx->progress_lock);
+            search_ctx->blocks_in_flight.erase(search_ctx->blocks_in_flight.find(block.rva));
         }
-        UnmapViewOfFile(file_base);
     }
 }
 
@@ -285,22 +1239,55 @@ static bool identify_memory_region_type(search_scope_type scope_type, const MINI
     return false;
 }
 
-static void search_and_sync(search_context_dump& search_ctx) {
-    dump_processing_context& ctx = *search_ctx.ctx;
+static bool memory_info_less(uint64_t address, const MINIDUMP_MEMORY_INFO& info) {
+    return address < info.BaseAddress;
+}
 
-    const uint64_t alloc_granularity = get_alloc_granularity();
+// the memory info entries are sorted by base address
+static const MINIDUMP_MEMORY_INFO* find_memory_info(const MINIDUMP_MEMORY_INFO_LIST* memory_info_list, uint64_t address) {
+    const MINIDUMP_MEMORY_INFO* memory_info = (MINIDUMP_MEMORY_INFO*)((char*)(memory_info_list) + memory_info_list->SizeOfHeader);
+    const MINIDUMP_MEMORY_INFO* memory_info_end = memory_info + memory_info_list->NumberOfEntries;
+    const MINIDUMP_MEMORY_INFO* it = std::upper_bound(memory_info, memory_info_end, address, memory_info_less);
+    if (it == memory_info) {
+        return nullptr;
+    }
+    --it;
+    return (address < (it->BaseAddress + it->RegionSize)) ? it : nullptr;
+}
+
+// Picks the regions matching the scope and the filters. Reads the dump view and the module and thread lists,
+// so it runs on the main thread even for background jobs.
+static bool collect_search_regions(search_context_dump& search_ctx) {
+    dump_processing_context& ctx = *search_ctx.ctx;
 
     auto& mem_info = search_ctx.mem_info;
-    const char* pattern = ctx.common.pdata.pattern;
-    const int64_t pattern_len = ctx.common.pdata.pattern_len;
-    const bool ranged_search = ctx.common.pdata.scope_type == search_scope_type::mrt_range;
+    const int64_t pattern_len = search_ctx.pdata->pattern_len;
+    const bool ranged_search = search_ctx.pdata->scope_type == search_scope_type::mrt_range;
+    for (int64_t i = 0; i < pattern_len; i++) {
+        search_ctx.skip_zero_pages |= (search_ctx.pdata->pattern[i] != 0);
+    }
+
+    init_scan_kernel(&search_ctx.common, *search_ctx.pdata, sm_collect);
+
+    // region filters need protection, type and state which only the memory info stream has
+    const region_filter& filter = search_ctx.pdata->filter;
+    const bool filtered_search = region_filter_set(filter);
+    MINIDUMP_MEMORY_INFO_LIST* memory_info_list = nullptr;
+    if (filtered_search) {
+        ULONG stream_size = 0;
+        if (!MiniDumpReadDumpStream(ctx.file_base, MemoryInfoListStream, nullptr, reinterpret_cast<void**>(&memory_info_list), &stream_size)) {
+            fprintf(stderr, "Failed to read MemoryInfoListStream, region filters can't be applied.\n");
+            return false;
+        }
+    }
 
     // collect memory regions
     size_t num_regions = search_ctx.memory_list->NumberOfMemoryRanges;
     mem_info.reserve(num_regions);
-    std::vector<uint64_t> rva_offsets; rva_offsets.reserve(num_regions);
+    auto& rva_offsets = search_ctx.rva_offsets;
+    rva_offsets.reserve(num_regions);
     size_t cumulative_offset = 0;
-    const bool scoped_search = ctx.common.pdata.scope_type != search_scope_type::mrt_all;
+    const bool scoped_search = search_ctx.pdata->scope_type != search_scope_type::mrt_all;
     for (ULONG i = 0; i < num_regions; ++i) {
         const MINIDUMP_MEMORY_DESCRIPTOR64& mem_desc = search_ctx.memory_descriptors[i];
         const uint64_t offset = search_ctx.memory_list->BaseRva + cumulative_offset;
@@ -311,44 +1298,223 @@ static void search_and_sync(search_context_dump& search_ctx) {
         }
         if (scoped_search) {
             if (ranged_search) {
-                if (!ranges_intersect((uint64_t)mem_desc.StartOfMemoryRange, mem_desc.DataSize, (uint64_t)ctx.common.pdata.range.start, ctx.common.pdata.range.length)) {
+                if (!ranges_intersect((uint64_t)mem_desc.StartOfMemoryRange, mem_desc.DataSize, (uint64_t)search_ctx.pdata->range.start, search_ctx.pdata->range.length)) {
                     continue;
                 }
-            } else if (!identify_memory_region_type(ctx.common.pdata.scope_type, mem_desc, ctx)) {
+            } else if (!identify_memory_region_type(search_ctx.pdata->scope_type, mem_desc, ctx)) {
+                continue;
+            }
+        }
+        if (filtered_search) {
+            const MINIDUMP_MEMORY_INFO* info = find_memory_info(memory_info_list, mem_desc.StartOfMemoryRange);
+            if (!info || !region_filter_match(filter, info->Protect, info->Type, info->State, mem_desc.DataSize)) {
                 continue;
             }
         }
         mem_info.push_back(mem_desc);
         rva_offsets.push_back(offset);
+        search_ctx.bytes_total += mem_desc.DataSize;
+    }
+    search_ctx.memory_list = nullptr; // the dump view may be remapped before the scan
+    search_ctx.memory_descriptors = nullptr;
+    return !mem_info.empty();
+}
+
+// Background jobs yield their blocks to the commands run from the prompt. Returns false once the job is killed.
+static bool yield_to_foreground(const search_context_dump& search_ctx) {
+    if (!search_ctx.background) {
+        return true;
+    }
+    while (search_ctx.ctx->jobs.foreground_busy && !scan_cancelled(search_ctx)) {
+        Sleep(1);
     }
+    return !scan_cancelled(search_ctx);
+}
+
+static void write_job_checkpoint(search_context_dump* consumer, uint64_t watermark);
+static void get_checkpoint_path(const search_jobs_ctx& jctx, uint32_t id, char* path);
+static search_job* find_search_job(search_jobs_ctx& jctx, uint32_t id);
+
+static uint64_t scan_watermark(search_context_dump& search_ctx, uint64_t next_rva) {
+    std::unique_lock<std::mutex> lk(search_ctx.progress_lock);
+    return search_ctx.blocks_in_flight.empty() ? next_rva : (_min(next_rva, *search_ctx.blocks_in_flight.begin()));
+}
 
-    num_regions = mem_info.size();
-    if (!num_regions) {
-        if (remap_file(ctx.file_mapping, &ctx.file_base)) {
-            gather_modules(&ctx);
-            gather_threads(&ctx);
+// Charges the growth of the jobs' matches, a job the budget refuses is stopped at its next checkpoint (it can be resumed).
+// Never evicts: the cached result sets are in use by the prompt.
+static void charge_job_matches(search_context_dump& search_ctx) {
+    for (search_context_dump* consumer : search_ctx.consumers) {
+        search_job* job = consumer->job;
+        if (consumer->stopped || job->cancel) {
+            continue;
+        }
+        consumer->common.matches_lock.lock();
+        const uint64_t bytes = consumer->common.matches.size() * sizeof(search_match);
+        consumer->common.matches_lock.unlock();
+        if (bytes <= job->charged_bytes) {
+            continue;
+        }
+        if (!mem_budget_try_charge(job->budget_id, bytes - job->charged_bytes)) {
+            fprintf(stderr, "Job %u has reached the memory limit and has been stopped (resume %u continues it).\n", job->id, job->id);
+            job->cancel = 1;
+            continue;
         }
+        job->charged_bytes = bytes;
+    }
+}
+
+// A foreground search writes a job checkpoint every CHECKPOINT_INTERVAL_MS, so a Ctrl-C doesn't lose its progress:
+// the next session lists it as an interrupted job. The job id is taken at the first checkpoint.
+static void checkpoint_foreground_search(search_context_dump& search_ctx, uint64_t next_rva) {
+    const ULONGLONG tick = GetTickCount64();
+    if ((tick - search_ctx.checkpoint_tick) < CHECKPOINT_INTERVAL_MS) {
         return;
     }
+    search_ctx.checkpoint_tick = tick;
+    search_job* job = search_ctx.job;
+    if (!job->id) {
+        std::unique_lock<std::mutex> lk(search_ctx.ctx->jobs.mtx);
+        job->id = search_ctx.ctx->jobs.next_id++;
+    }
+    uint64_t watermark = scan_watermark(search_ctx, next_rva);
+    if (search_ctx.io && search_ctx.io->deferring && !search_ctx.io->cold_blocks.empty()) {
+        watermark = _min(watermark, search_ctx.io->cold_blocks.front().rva); // not queued yet
+    }
+    write_job_checkpoint(&search_ctx, watermark);
+}
+
+// Queues a block for the workers. A foreground scan drops the caches when the system signals low memory
+// and writes its periodic checkpoint.
+// A background scan charges the matches of its jobs, yields to the prompt, writes the checkpoints,
+// stops the killed jobs and skips the blocks searched before an interruption. Returns false once stopped.
+static bool produce_block(search_context_dump& search_ctx, const block_info_dump& block) {
+    if (search_ctx.sample) {
+        sample_plan& plan = *search_ctx.sample;
+        if (plan.counting) {
+            plan.blocks.push_back(sample_block{ block.rva, block.bytes_to_read, 0, 0, false });
+            return true;
+        }
+        if (!plan.blocks[plan.next_block++].sampled) {
+            return true;
+        }
+    }
+    if (search_ctx.io) {
+        io_plan& plan = *search_ctx.io;
+        if (plan.counting) {
+            const bool cold = !is_resident(search_ctx.ctx->residency, block.rva, block.bytes_to_read, plan.capacity);
+            plan.cold.push_back(cold);
+            if (cold) {
+                plan.cold_blocks.push_back(block);
+                plan.cold_bytes += block.bytes_to_read;
+            } else {
+                plan.warm_bytes += block.bytes_to_read;
+            }
+            return true;
+        }
+        const bool cold = plan.cold[plan.next_block++];
+        if (cold && plan.deferring) {
+            return true; // queued after the resident blocks
+        }
+        if (cold) {
+            plan.cold_bytes_queued += block.bytes_to_read;
+        }
+    }
+    if (!search_ctx.background) {
+        mem_budget_trim();
+        if (search_ctx.job) {
+            checkpoint_foreground_search(search_ctx, block.rva);
+            std::unique_lock<std::mutex> lk(search_ctx.progress_lock);
+            search_ctx.blocks_in_flight.insert(block.rva);
+        }
+    } else {
+        charge_job_matches(search_ctx);
+        const bool all_cancelled = !yield_to_foreground(search_ctx);
+        const ULONGLONG tick = GetTickCount64();
+        const bool periodic = (tick - search_ctx.checkpoint_tick) >= CHECKPOINT_INTERVAL_MS;
+        uint64_t watermark = (uint64_t)(-1);
+        for (search_context_dump* consumer : search_ctx.consumers) {
+            if (consumer->stopped || (!consumer->job->cancel && !periodic)) {
+                continue;
+            }
+            if (watermark == (uint64_t)(-1)) {
+                watermark = scan_watermark(search_ctx, block.rva);
+            }
+            write_job_checkpoint(consumer, _max(watermark, consumer->resume_rva));
+            consumer->stopped = consumer->job->cancel;
+        }
+        if (periodic) {
+            search_ctx.checkpoint_tick = tick;
+        }
+        if (all_cancelled) {
+            search_ctx.stopped = 1;
+            return false;
+        }
+        if ((block.rva + block.bytes_to_read) <= search_ctx.resume_rva) {
+            return true;
+        }
+        std::unique_lock<std::mutex> lk(search_ctx.progress_lock);
+        search_ctx.blocks_in_flight.insert(block.rva);
+    }
+    const uint32_t node = numa_node_of_offset(block.rva, search_ctx.stripe_size, search_ctx.num_nodes);
+    auto& block_info_queue = search_ctx.block_info_queues[node];
+    while (block_info_queue.is_full()) {
+        search_ctx.common.master_sem.wait();
+    }
+    block_info_queue.try_push(block);
+    search_ctx.node_workers_sem[node].signal();
+    // the workers of an idle node steal the block rather than wait for their own stripe
+    for (uint32_t n = 0; n < search_ctx.num_nodes; n++) {
+        if ((n != node) && search_ctx.block_info_queues[n].is_empty()) {
+            search_ctx.node_workers_sem[n].signal();
+        }
+    }
+    return true;
+}
+
+static void produce_blocks(search_context_dump& search_ctx) {
+    const uint64_t alloc_granularity = get_alloc_granularity();
+    auto& mem_info = search_ctx.mem_info;
+    auto& rva_offsets = search_ctx.rva_offsets;
+    const size_t num_regions = mem_info.size();
+    const int64_t pattern_len = search_ctx.pdata->pattern_len;
+    const bool ranged_search = search_ctx.pdata->scope_type == search_scope_type::mrt_range;
 
     const size_t extra_chunk = multiple_of_n(pattern_len, sizeof(__m128i));
     const size_t block_size = alloc_granularity * g_num_alloc_blocks;
     const size_t bytes_to_read_ideal = block_size + extra_chunk;
 
-    const size_t num_threads = _min(std::thread::hardware_concurrency(), g_max_threads);
-    search_ctx.common.workers_sem.set_max_count(num_threads);
-    std::vector<char*> buffers(num_threads);
-    std::vector<std::thread> workers; workers.reserve(num_threads);
-    for (size_t i = 0; i < num_threads; i++) {
-        workers.push_back(std::thread(find_pattern, &search_ctx));
-    }
-
-    //produce block_info
-    auto& block_info_queue = search_ctx.block_info_queue;
-    for (ULONG i = 0; i < num_regions; ++i) {
+    bool cancelled = false;
+    for (ULONG i = 0; (i < num_regions) && !cancelled; ++i) {
         const MINIDUMP_MEMORY_DESCRIPTOR64& mem_desc = mem_info[i];
         const SIZE_T region_size = static_cast<SIZE_T>(mem_desc.DataSize);
 
+        // coalesce small regions lying back to back in the file into a single mapping
+        if (region_size < block_size) {
+            size_t num_segments = 1;
+            uint64_t total_size = region_size;
+            while ((i + num_segments) < num_regions) {
+                const size_t n = i + num_segments;
+                if ((rva_offsets[n] != (rva_offsets[n - 1] + mem_info[n - 1].DataSize)) || ((total_size + mem_info[n].DataSize) > block_size)) {
+                    break;
+                }
+                total_size += mem_info[n].DataSize;
+                num_segments++;
+            }
+            if (num_segments > 1) {
+                const uint64_t offset_aligned = rva_offsets[i] & ~(alloc_granularity - 1);
+                const uint64_t reminder = rva_offsets[i] - offset_aligned;
+                const DWORD high = (DWORD)((offset_aligned >> 0x20) & 0xFFFFFFFF);
+                const DWORD low = (DWORD)(offset_aligned & 0xFFFFFFFF);
+                block_info_dump b = { 0, total_size + reminder, total_size, low, high, i, num_segments, rva_offsets[i] };
+                if (!produce_block(search_ctx, b)) {
+                    cancelled = true;
+                    break;
+                }
+                i += (ULONG)(num_segments - 1);
+                continue;
+            }
+        }
+
         const uint64_t offset = rva_offsets[i];
         uint64_t offset_aligned = offset & ~(alloc_granularity - 1);
         uint64_t reminder = offset - offset_aligned;
@@ -356,9 +1522,6 @@ static void search_and_sync(search_context_dump& search_ctx) {
         size_t start_offset = 0;
 
         while (total_bytes_to_map) {
-            while (block_info_queue.is_full()) {
-                search_ctx.common.master_sem.wait();
-            }
             size_t bytes_to_map;
             if (total_bytes_to_map >= bytes_to_read_ideal) {
                 bytes_to_map = bytes_to_read_ideal;
@@ -372,31 +1535,174 @@ static void search_and_sync(search_context_dump& search_ctx) {
             const DWORD high = (DWORD)((offset_aligned >> 0x20) & 0xFFFFFFFF);
             const DWORD low = (DWORD)(offset_aligned & 0xFFFFFFFF);
             offset_aligned += block_size;
-            if (!ranged_search || ranges_intersect(mem_desc.StartOfMemoryRange + start_offset, bytes_to_read, (uint64_t)ctx.common.pdata.range.start, ctx.common.pdata.range.length)) {
-                block_info_dump b = { start_offset, bytes_to_map, bytes_to_read, low, high, i };
-                block_info_queue.try_push(b);
-                search_ctx.common.workers_sem.signal();
+            if (!ranged_search || ranges_intersect(mem_desc.StartOfMemoryRange + start_offset, bytes_to_read, (uint64_t)search_ctx.pdata->range.start, search_ctx.pdata->range.length)) {
+                block_info_dump b = { start_offset, bytes_to_map, bytes_to_read, low, high, i, 1, offset + start_offset };
+                if (!produce_block(search_ctx, b)) {
+                    cancelled = true;
+                    break;
+                }
             }
             start_offset += bytes_to_read - extra_chunk;
             reminder = 0;
         }
     }
+}
+
+// Classifies the blocks by residency and picks the worker count: a cold scan from an HDD gets the few workers the disk
+// can feed, a fully cached one gets the caching thread count. Returns false if the blocks are neither reordered nor read ahead.
+static bool plan_io(search_context_dump& search_ctx, io_plan& plan) {
+    dump_processing_context& ctx = *search_ctx.ctx;
+    const residency_map& residency = ctx.residency;
+    if (ctx.packed || search_ctx.background || search_ctx.sample || !residency.num_chunks) {
+        return false;
+    }
+    if (!residency.clock && !g_scan_ahead) {
+        return false; // nothing has been read yet, the file order is the best guess
+    }
+    DWORDLONG total_phys_mem, available_phys_mem;
+    if (!get_available_phys_memory(&total_phys_mem, &available_phys_mem)) {
+        return false;
+    }
+    plan.capacity = g_mem_limit ? (_min((uint64_t)available_phys_mem, g_mem_limit)) : (uint64_t)available_phys_mem;
+
+    plan.counting = true;
+    search_ctx.io = &plan;
+    produce_blocks(search_ctx);
+    plan.counting = false;
+
+    if (!residency.threads_from_cmdline) {
+        if (!plan.cold_bytes) {
+            search_ctx.num_threads = IDEAL_THREAD_NUM_DUMP_W_CACHING;
+        } else if (!residency.ssd) {
+            search_ctx.num_threads = IDEAL_THREAD_NUM_DUMP;
+        }
+    }
+    plan.reorder = plan.warm_bytes && plan.cold_bytes;
+    plan.read_ahead = plan.cold_bytes && g_scan_ahead;
+    if (!plan.reorder && !plan.read_ahead) {
+        search_ctx.io = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// Reads the cold blocks of the search at most g_scan_ahead bytes ahead of the producer with large sequential requests.
+// The view of the whole file is used, so the pages land in the system cache without being charged to the working set.
+static void prefetch_cold_blocks(io_plan* plan, const char* base) {
+    if (g_release_scanned) {
+        lower_memory_priority();
+    }
+    const uint64_t room = (plan->capacity > plan->warm_bytes) ? (plan->capacity - plan->warm_bytes) : 0;
+    const uint64_t max_ahead = _min(room, g_scan_ahead); // don't evict the blocks waiting to be searched
+    const auto& cold_blocks = plan->cold_blocks;
+    uint64_t bytes_prefetched = 0;
+    size_t b = 0;
+    while ((b < cold_blocks.size()) && !plan->exit_prefetch) {
+        // coalesce the file contiguous blocks
+        const uint64_t start = cold_blocks[b].rva;
+        uint64_t end = start;
+        while ((b < cold_blocks.size()) && (cold_blocks[b].rva <= end) && ((end - start) < PREFETCH_RANGE_LEN)) {
+            end = _max(end, cold_blocks[b].rva + cold_blocks[b].bytes_to_read);
+            b++;
+        }
+        while (((bytes_prefetched + (end - start)) > (plan->cold_bytes_queued + max_ahead)) && !plan->exit_prefetch) {
+            Sleep(1);
+        }
+        WIN32_MEMORY_RANGE_ENTRY range = { (PVOID)(base + start), (SIZE_T)(end - start) };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        bytes_prefetched += end - start;
+    }
+}
+
+static void scan_regions(search_context_dump& search_ctx) {
+    io_plan plan;
+    const bool planned = plan_io(search_ctx, plan);
+    const size_t num_threads = _min(std::thread::hardware_concurrency(), (search_ctx.num_threads ? search_ctx.num_threads : g_max_threads));
+    search_ctx.num_nodes = get_num_numa_nodes(num_threads);
+    search_ctx.stripe_size = get_alloc_granularity() * g_num_alloc_blocks * NUMA_STRIPE_BLOCKS;
+    for (uint32_t n = 0; n < search_ctx.num_nodes; n++) {
+        search_ctx.node_workers_sem[n].set_max_count((int)((num_threads + search_ctx.num_nodes - 1 - n) / search_ctx.num_nodes));
+    }
+    std::vector<std::thread> workers; workers.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        workers.push_back(std::thread(find_pattern, &search_ctx, numa_node_of_worker(i, num_threads)));
+    }
+
+    if (planned) {
+        std::thread prefetcher;
+        if (plan.read_ahead) {
+            prefetcher = std::thread(prefetch_cold_blocks, &plan, (const char*)search_ctx.ctx->file_base);
+        }
+        plan.deferring = plan.reorder;
+        produce_blocks(search_ctx);
+        search_ctx.io = nullptr;
+        if (plan.reorder) {
+            for (const block_info_dump& b : plan.cold_blocks) {
+                plan.cold_bytes_queued += b.bytes_to_read;
+                produce_block(search_ctx, b);
+            }
+        }
+        plan.exit_prefetch = 1;
+        if (prefetcher.joinable()) {
+            prefetcher.join();
+        }
+    } else {
+        produce_blocks(search_ctx);
+    }
 
     search_ctx.common.exit_workers = 1;
-    search_ctx.common.workers_sem.signal(num_threads);
+    for (uint32_t n = 0; n < search_ctx.num_nodes; n++) {
+        search_ctx.node_workers_sem[n].signal((int)num_threads);
+    }
     for (auto& w : workers) {
         if (w.joinable()) {
             w.join();
         }
     }
+}
+
+static void plan_block_sample(search_context_dump& search_ctx);
+
+static void search_and_sync(search_context_dump& search_ctx) {
+    dump_processing_context& ctx = *search_ctx.ctx;
+    if (collect_search_regions(search_ctx)) {
+        if (search_ctx.sample) {
+            plan_block_sample(search_ctx);
+        }
+        scan_regions(search_ctx);
+    }
 
-    if (!remap_file(ctx.file_mapping, &ctx.file_base)) {
+    if (!ctx.packed && !remap_file(ctx.file_mapping, &ctx.file_base)) {
         return;
     }
     gather_modules(&ctx);
     gather_threads(&ctx);
 }
 
+static void print_match_region_header(const dump_processing_context* ctx, const MINIDUMP_MEMORY_DESCRIPTOR64& r_info) {
+    puts("\n------------------------------------\n");
+    bool found_on_stack = false;
+    for (size_t t = 0, sz = ctx->t_data.size(); t < sz; t++) {
+        const thread_info_dump& tdata = ctx->t_data[t];
+        if (((ULONG64)tdata.stack_base >= r_info.StartOfMemoryRange) && (tdata.context->Rsp <= (r_info.StartOfMemoryRange + r_info.DataSize))) {
+            wprintf((LPWSTR)L"Stack: Thread Id 0x%04x\n", tdata.tid);
+            found_on_stack = true;
+            break;
+        }
+    }
+    if (!found_on_stack) {
+        for (size_t m = 0, sz = ctx->m_data.size(); m < sz; m++) {
+            const module_data& mdata = ctx->m_data[m];
+            if (((ULONG64)mdata.base_of_image <= r_info.StartOfMemoryRange) && (((ULONG64)mdata.base_of_image + mdata.size_of_image) >= (r_info.StartOfMemoryRange + r_info.DataSize))) {
+                wprintf((LPWSTR)L"Module name: %s\n", mdata.name);
+                break;
+            }
+        }
+    }
+    printf("Start of Memory Region: 0x%p | Region Size: 0x%016llx\n\n",
+        r_info.StartOfMemoryRange, r_info.DataSize);
+}
+
 static void print_search_results(search_context_dump& search_ctx) {
     const uint64_t num_matches = prepare_matches(&search_ctx.ctx->common, search_ctx.common.matches);
     if (!num_matches) {
@@ -410,29 +1716,7 @@ static void print_search_results(search_context_dump& search_ctx) {
     for (size_t i = 0; i < num_matches; i++) {
         const size_t info_id = search_ctx.common.matches[i].info_id;
         if (info_id != prev_info_id) {
-            puts("\n------------------------------------\n");
-            const MINIDUMP_MEMORY_DESCRIPTOR64& r_info = search_ctx.mem_info[info_id];
-            bool found_on_stack = false;
-            for (size_t t = 0, sz = search_ctx.ctx->t_data.size(); t < sz; t++) {
-                const thread_info_dump& tdata = search_ctx.ctx->t_data[t];
-                if (((ULONG64)tdata.stack_base >= r_info.StartOfMemoryRange) && (tdata.context->Rsp <= (r_info.StartOfMemoryRange + r_info.DataSize))) {
-                    wprintf((LPWSTR)L"Stack: Thread Id 0x%04x\n", tdata.tid);
-                    found_on_stack = true;
-                    break;
-                }
-            }
-            if (!found_on_stack) {
-                for (size_t m = 0, sz = search_ctx.ctx->m_data.size(); m < sz; m++) {
-                    const module_data& mdata = search_ctx.ctx->m_data[m];
-                    if (((ULONG64)mdata.base_of_image <= r_info.StartOfMemoryRange) && (((ULONG64)mdata.base_of_image + mdata.size_of_image) >= (r_info.StartOfMemoryRange + r_info.DataSize))) {
-                        wprintf((LPWSTR)L"Module name: %s\n", mdata.name);
-                        break;
-                    }
-                }
-            }
-            printf("Start of Memory Region: 0x%p | Region Size: 0x%016llx\n\n",
-                r_info.StartOfMemoryRange, r_info.DataSize);
-
+            print_match_region_header(search_ctx.ctx, search_ctx.mem_info[info_id]);
             prev_info_id = info_id;
         }
         printf("\tMatch at address: 0x%p\n", search_ctx.common.matches[i].match_address);
@@ -454,126 +1738,810 @@ static void search_pattern_in_memory(dump_processing_context *ctx) {
         puts(ctx->common.command);
         puts("");
     }
+
+    result_key key;
+    memset(&key, 0, sizeof(key));
+    fill_checkpoint_params(ctx, ctx->common.pdata, &key.params);
+    const result_entry* cached = find_cached_result(ctx, key);
+    if (cached) {
+        printf("*** Served from result set #%u ***\n", cached->id);
+        print_cached_result(ctx, cached);
+        return;
+    }
+
     puts("Searching crash dump memory...");
     puts("\n------------------------------------\n");
 
+    // only the id, the command and the parameters of the job are used by the checkpoints
+    search_job* checkpoint_job = new search_job;
+    memcpy(checkpoint_job->command, ctx->common.command, sizeof(checkpoint_job->command));
+    checkpoint_job->params = key.params;
+    checkpoint_job->id = 0;
+
     search_context_dump search_ctx;
     search_ctx.memory_list = memory_list;
     search_ctx.memory_descriptors = memory_descriptors;
     search_ctx.ctx = ctx;
+    search_ctx.pdata = &ctx->common.pdata;
     search_ctx.common.exit_workers = 0;
+    search_ctx.job = checkpoint_job;
+    search_ctx.checkpoint_tick = GetTickCount64();
 
     search_and_sync(search_ctx);
+    if (checkpoint_job->id) {
+        char path[MAX_PATH];
+        get_checkpoint_path(ctx->jobs, checkpoint_job->id, path);
+        DeleteFileA(path);
+    }
+    delete checkpoint_job;
+    const result_entry* entry = cache_search_result(ctx, key, search_ctx.common.matches, ctx->common.command);
+    const uint32_t entry_id = entry ? entry->id : 0;
     print_search_results(search_ctx);
+    if (entry_id) {
+        printf("*** Result set #%u ***\n", entry_id);
+    }
 
+    store_last_matches(&ctx->common, search_ctx.common.matches);
 }
 
-static void search_pattern_in_registers(const dump_processing_context *ctx) {
-    std::vector<reg_search_result> matches;
-    reg_search_result match;
-    match.reg_name[0] = 'R';
-    match.reg_name[3] = 0;
-    const uint8_t* pattern = (const uint8_t*)ctx->common.pdata.pattern;
-    int64_t pattern_len = ctx->common.pdata.pattern_len;
-    assert(pattern_len <= sizeof(uint64_t));
-    for (const thread_info_dump &data : ctx->t_data) {
-        if (strstr_u8((const uint8_t*)&data.context->Rax, sizeof(data.context->Rax), pattern, pattern_len)) {
-            match.match = data.context->Rax;
-            match.tid = data.tid;
-            match.reg_name[1] = 'A'; match.reg_name[2] = 'X';
-            matches.push_back(match);
-        }
-        if (strstr_u8((const uint8_t*)&data.context->Rbx, sizeof(data.context->Rbx), pattern, pattern_len)) {
-            match.match = data.context->Rbx;
-            match.tid = data.tid;
-            match.reg_name[1] = 'B'; match.reg_name[2] = 'X';
-            matches.push_back(match);
-        }
-        if (strstr_u8((const uint8_t*)&data.context->Rcx, sizeof(data.context->Rcx), pattern, pattern_len)) {
-            match.match = data.context->Rcx;
-            match.tid = data.tid;
-            match.reg_name[1] = 'C'; match.reg_name[2] = 'X';
-            matches.push_back(match);
-        }
-        if (strstr_u8((const uint8_t*)&data.context->Rdx, sizeof(data.context->Rdx), pattern, pattern_len)) {
-            match.match = data.context->Rdx;
-            match.tid = data.tid;
-            match.reg_name[1] = 'D'; match.reg_name[2] = 'X';
-            matches.push_back(match);
+#define MIN_SAMPLE_STRATA 0x08
+
+static void plan_block_sample(search_context_dump& search_ctx) {
+    sample_plan& plan = *search_ctx.sample;
+    plan.counting = true;
+    produce_blocks(search_ctx);
+    plan.counting = false;
+    plan.next_block = 0;
+
+    auto& blocks = plan.blocks;
+    const size_t num_blocks = blocks.size();
+    uint64_t total_bytes = 0;
+    for (size_t k = 0; k < num_blocks; k++) {
+        if (((k + 1) < num_blocks) && (blocks[k + 1].rva > blocks[k].rva) && (blocks[k + 1].rva < (blocks[k].rva + blocks[k].bytes))) {
+            blocks[k].bytes = blocks[k + 1].rva - blocks[k].rva;
         }
-        if (strstr_u8((const uint8_t*)&data.context->Rdi, sizeof(data.context->Rdi), pattern, pattern_len)) {
-            match.match = data.context->Rdi;
-            match.tid = data.tid;
-            match.reg_name[1] = 'D'; match.reg_name[2] = 'I';
-            matches.push_back(match);
+        total_bytes += blocks[k].bytes;
+    }
+    const size_t num_strata = _max((size_t)ceil(num_blocks * plan.fraction), (_min(num_blocks, (size_t)MIN_SAMPLE_STRATA)));
+    if ((num_strata >= num_blocks) || !total_bytes) {
+        plan.exact = true;
+        for (sample_block& block : blocks) {
+            block.sampled = true;
+            block.stratum_bytes = block.bytes;
         }
-        if (strstr_u8((const uint8_t*)&data.context->Rsi, sizeof(data.context->Rsi), pattern, pattern_len)) {
-            match.match = data.context->Rsi;
-            match.tid = data.tid;
-            match.reg_name[1] = 'S'; match.reg_name[2] = 'I';
-            matches.push_back(match);
+        return;
+    }
+
+    // strata of consecutive blocks (nearby memory is alike), a block belongs to the stratum holding its middle
+    std::mt19937_64 rng(GetTickCount64());
+    uint64_t cumulative = 0;
+    size_t first = 0;
+    size_t stratum = 0;
+    for (size_t k = 0; k < num_blocks; k++) {
+        cumulative += blocks[k].bytes;
+        const size_t next_stratum = ((k + 1) < num_blocks)
+            ? (_min((size_t)((double)(cumulative + blocks[k + 1].bytes / 2) * num_strata / total_bytes), num_strata - 1)) : num_strata;
+        if (next_stratum == stratum) {
+            continue;
         }
-        if (strstr_u8((const uint8_t*)&data.context->Rsp, sizeof(data.context->Rsp), pattern, pattern_len)) {
-            match.match = data.context->Rsp;
-            match.tid = data.tid;
-            match.reg_name[1] = 'S'; match.reg_name[2] = 'P';
-            matches.push_back(match);
+        // blocks [first, k] form the stratum
+        uint64_t stratum_bytes = 0;
+        for (size_t b = first; b <= k; b++) {
+            stratum_bytes += blocks[b].bytes;
         }
-        if (strstr_u8((const uint8_t*)&data.context->Rbp, sizeof(data.context->Rbp), pattern, pattern_len)) {
-            match.match = data.context->Rbp;
-            match.tid = data.tid;
-            match.reg_name[1] = 'B'; match.reg_name[2] = 'P';
-            matches.push_back(match);
+        uint64_t pick = std::uniform_int_distribution<uint64_t>(0, stratum_bytes - 1)(rng);
+        size_t b = first;
+        while (pick >= blocks[b].bytes) {
+            pick -= blocks[b].bytes;
+            b++;
         }
-        if (strstr_u8((const uint8_t*)&data.context->Rip, sizeof(data.context->Rip), pattern, pattern_len)) {
-            match.match = data.context->Rip;
-            match.tid = data.tid;
-            match.reg_name[1] = 'I'; match.reg_name[2] = 'P';
-            matches.push_back(match);
+        blocks[b].sampled = true;
+        blocks[b].stratum_bytes = stratum_bytes;
+        first = k + 1;
+        stratum = next_stratum;
+    }
+}
+
+// /~est <search>: searches a stratified sample of the blocks and extrapolates the number of matches
+static void estimate_search(dump_processing_context* ctx) {
+    MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
+    ULONG stream_size = 0;
+    if (!MiniDumpReadDumpStream(ctx->file_base, Memory64ListStream, nullptr, reinterpret_cast<void**>(&memory_list), &stream_size)) {
+        fprintf(stderr, "Failed to read Memory64ListStream.\n");
+        return;
+    }
+    if (ctx->common.rdata.redirect) {
+        puts(ctx->common.command);
+        puts("");
+    }
+    printf("Sampling %.2f%% of the searched memory...\n", ctx->common.estimate_fraction * 100.0);
+    puts("\n------------------------------------\n");
+
+    sample_plan plan;
+    plan.fraction = ctx->common.estimate_fraction;
+    search_context_dump search_ctx;
+    search_ctx.memory_list = memory_list;
+    search_ctx.memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
+    search_ctx.ctx = ctx;
+    search_ctx.pdata = &ctx->common.pdata;
+    search_ctx.common.exit_workers = 0;
+    search_ctx.sample = &plan;
+
+    const ULONGLONG start_tick = GetTickCount64();
+    search_and_sync(search_ctx);
+    const ULONGLONG elapsed_ms = GetTickCount64() - start_tick;
+    // only counted, so no "No matches" message and no too-many-results prompt
+    dedup_matches(search_ctx.common.matches);
+    const uint64_t num_matches = search_ctx.common.matches.size();
+
+    // attribute the matches to the sampled blocks owning them
+    std::vector<sample_block*> sampled;
+    uint64_t total_bytes = 0, sampled_bytes = 0;
+    for (sample_block& block : plan.blocks) {
+        total_bytes += block.bytes;
+        if (block.sampled) {
+            sampled.push_back(&block);
+            sampled_bytes += block.bytes;
+        }
+    }
+    std::map<uint64_t, uint64_t> region_hits;
+    for (size_t i = 0; i < num_matches; i++) {
+        const search_match& match = search_ctx.common.matches[i];
+        const MINIDUMP_MEMORY_DESCRIPTOR64& r_info = search_ctx.mem_info[match.info_id];
+        const uint64_t rva = search_ctx.rva_offsets[match.info_id] + ((uint64_t)match.match_address - r_info.StartOfMemoryRange);
+        auto it = std::upper_bound(sampled.begin(), sampled.end(), rva, [](uint64_t v, const sample_block* b) { return v < b->rva; });
+        if ((it == sampled.begin()) || (rva >= ((*(it - 1))->rva + (*(it - 1))->bytes))) {
+            continue; // in the overlap with the next, unsampled block
+        }
+        (*(it - 1))->hits++;
+        region_hits[match.info_id]++;
+    }
+
+    // Hansen-Hurwitz per stratum, the variance from the differences of adjacent strata (collapsed strata)
+    std::vector<double> totals;
+    uint64_t sample_hits = 0;
+    for (const sample_block* block : sampled) {
+        totals.push_back((double)block->hits * block->stratum_bytes / block->bytes);
+        sample_hits += block->hits;
+    }
+    double estimate = 0.0, variance = 0.0;
+    for (size_t h = 0, sz = totals.size(); h < sz; h++) {
+        estimate += totals[h];
+        if ((h & 1) && !plan.exact) {
+            variance += (totals[h] - totals[h - 1]) * (totals[h] - totals[h - 1]);
+        }
+    }
+    if ((totals.size() & 1) && (totals.size() > 1) && !plan.exact) {
+        const size_t h = totals.size() - 1;
+        variance += (totals[h] - totals[h - 1]) * (totals[h] - totals[h - 1]);
+    }
+    const double margin = 1.96 * sqrt(variance);
+
+    printf("Sampled blocks: %llu of %llu | Sampled bytes: 0x%llx of 0x%llx | %llu ms\n",
+        (uint64_t)sampled.size(), (uint64_t)plan.blocks.size(), sampled_bytes, total_bytes, elapsed_ms);
+    printf("Matches in the sample: %llu\n", sample_hits);
+    if (plan.exact) {
+        puts("*** Every block has been searched, the count is exact. ***");
+    } else {
+        const double low = _max(estimate - margin, (double)sample_hits);
+        printf("*** Estimated number of matches: %.0f (95%% CI: %.0f - %.0f) ***\n", estimate, low, estimate + margin);
+        if (sampled_bytes) {
+            printf("*** Estimated full scan time: %.1f s ***\n", (double)elapsed_ms * total_bytes / sampled_bytes / 1000.0);
+        }
+    }
+    if (region_hits.empty() || too_many_results(region_hits.size(), output_redirected(&ctx->common))) {
+        puts("");
+        return;
+    }
+    puts("\nRegions with matches in the sample:");
+    for (const auto& hits : region_hits) {
+        print_match_region_header(ctx, search_ctx.mem_info[hits.first]);
+        printf("\tMatches in the sample: %llu\n", hits.second);
+    }
+    puts("");
+}
+
+// Builds a single pass over the union of the regions of the jobs, every region remembers its index in each job.
+static void run_fused_scan(dump_processing_context* ctx, const std::vector<search_job*>& group) {
+    search_context_dump carrier;
+    carrier.ctx = ctx;
+    carrier.background = true;
+    pattern_data pdata = group.front()->pdata;
+    carrier.min_pattern_len = pdata.pattern_len;
+    std::map<uint64_t, size_t> regions; // rva offset -> index in the pass
+    for (const search_job* job : group) {
+        pdata.pattern_len = _max(pdata.pattern_len, job->pdata.pattern_len); // the widest block overlap
+        carrier.min_pattern_len = _min(carrier.min_pattern_len, job->pdata.pattern_len);
+        for (size_t i = 0, sz = job->search_ctx.rva_offsets.size(); i < sz; i++) {
+            if (regions.emplace(job->search_ctx.rva_offsets[i], carrier.mem_info.size()).second) {
+                carrier.mem_info.push_back(job->search_ctx.mem_info[i]);
+                carrier.rva_offsets.push_back(job->search_ctx.rva_offsets[i]);
+            }
+        }
+    }
+    // scan_regions coalesces regions lying back to back in the file, keep the file order
+    std::vector<size_t> order(carrier.mem_info.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&carrier](size_t a, size_t b) { return carrier.rva_offsets[a] < carrier.rva_offsets[b]; });
+    std::vector<MINIDUMP_MEMORY_DESCRIPTOR64> mem_info(order.size());
+    std::vector<uint64_t> rva_offsets(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        mem_info[i] = carrier.mem_info[order[i]];
+        rva_offsets[i] = carrier.rva_offsets[order[i]];
+        regions[rva_offsets[i]] = i;
+        carrier.bytes_total += mem_info[i].DataSize;
+    }
+    carrier.mem_info.swap(mem_info);
+    carrier.rva_offsets.swap(rva_offsets);
+
+    const size_t num_consumers = group.size();
+    carrier.consumer_info_ids.assign(carrier.mem_info.size() * num_consumers, -1);
+    for (size_t c = 0; c < num_consumers; c++) {
+        search_context_dump& consumer = group[c]->search_ctx;
+        for (size_t i = 0, sz = consumer.rva_offsets.size(); i < sz; i++) {
+            carrier.consumer_info_ids[regions[consumer.rva_offsets[i]] * num_consumers + c] = (int64_t)i;
+        }
+        carrier.consumers.push_back(&consumer);
+    }
+    carrier.resume_rva = (uint64_t)(-1);
+    for (const search_job* job : group) {
+        carrier.resume_rva = _min(carrier.resume_rva, job->search_ctx.resume_rva);
+    }
+    carrier.checkpoint_tick = GetTickCount64();
+    carrier.pdata = &pdata;
+    carrier.common.exit_workers = 0;
+    scan_regions(carrier);
+}
+
+static void run_search_jobs(dump_processing_context* ctx) {
+    search_jobs_ctx& jctx = ctx->jobs;
+    while (1) {
+        std::vector<search_job*> group;
+        {
+            std::unique_lock<std::mutex> lk(jctx.mtx);
+            jctx.cv.wait(lk, [&jctx] { return jctx.exit || !jctx.pending.empty(); });
+            if (jctx.exit) {
+                return;
+            }
+            // whole-memory searches share a pass, a ranged search reads just its range on its own
+            group.push_back(jctx.pending.front());
+            jctx.pending.erase(jctx.pending.begin());
+            if (group.front()->pdata.scope_type != search_scope_type::mrt_range) {
+                for (auto it = jctx.pending.begin(); (it != jctx.pending.end()) && (group.size() < MAX_FUSED_JOBS);) {
+                    if ((*it)->pdata.scope_type != search_scope_type::mrt_range) {
+                        group.push_back(*it);
+                        it = jctx.pending.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            const ULONGLONG start_tick = GetTickCount64();
+            for (search_job* job : group) {
+                job->state = js_running;
+                job->start_tick = start_tick;
+                job->fused = (uint32_t)group.size();
+            }
+        }
+        run_fused_scan(ctx, group);
+        {
+            std::unique_lock<std::mutex> lk(jctx.mtx);
+            const ULONGLONG end_tick = GetTickCount64();
+            for (search_job* job : group) {
+                job->end_tick = end_tick;
+                // the status reports the count the results will show
+                dedup_matches(job->search_ctx.common.matches);
+                const uint64_t bytes = job->search_ctx.common.matches.size() * sizeof(search_match);
+                if (bytes < job->charged_bytes) {
+                    mem_budget_release(job->budget_id, job->charged_bytes - bytes);
+                    job->charged_bytes = bytes;
+                }
+                // a job killed after its last block was queued has complete results
+                job->state = job->search_ctx.stopped ? js_killed : js_done;
+                if (job->state == js_done) {
+                    char path[MAX_PATH];
+                    get_checkpoint_path(jctx, job->id, path);
+                    DeleteFileA(path);
+                }
+            }
+            jctx.cv.notify_all();
+        }
+    }
+}
+
+static void get_checkpoint_path(const search_jobs_ctx& jctx, uint32_t id, char* path) {
+    sprintf_s(path, MAX_PATH, "%s.job%u.qck", jctx.dump_path, id);
+}
+
+static void fill_checkpoint_params(const dump_processing_context* ctx, const pattern_data& pdata, checkpoint_params* params) {
+    memset(params, 0, sizeof(*params)); // compared and hashed as raw bytes
+    memcpy(params->pattern, pdata.pattern, _min((size_t)pdata.pattern_len, sizeof(params->pattern)));
+    params->pattern_len = pdata.pattern_len;
+    params->range_start = (uint64_t)pdata.range.start;
+    params->range_length = pdata.range.length;
+    params->filter = pdata.filter;
+    params->scope_type = (uint32_t)pdata.scope_type;
+    params->op = (uint32_t)pdata.op;
+    params->dump_size = ctx->dump_size;
+    params->dump_id = ctx->dump_id;
+}
+
+static void set_checkpoint_params(dump_processing_context* ctx, search_job* job) {
+    fill_checkpoint_params(ctx, job->pdata, &job->params);
+}
+
+static void write_job_checkpoint(search_context_dump* consumer, uint64_t watermark) {
+    const search_job* job = consumer->job;
+    std::vector<search_match> matches;
+    consumer->common.matches_lock.lock();
+    matches = consumer->common.matches;
+    consumer->common.matches_lock.unlock();
+
+    checkpoint_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.job_id = job->id;
+    header.watermark = watermark;
+    header.bytes_scanned = consumer->bytes_scanned;
+    header.bytes_total = consumer->bytes_total;
+    header.num_matches = matches.size();
+    header.params = job->params;
+    header.params_crc32c = compute_crc32c((const uint8_t*)&header.params, sizeof(header.params));
+    header.matches_crc32c = compute_crc32c((const uint8_t*)matches.data(), matches.size() * sizeof(search_match));
+    memcpy(header.command, job->command, sizeof(header.command));
+
+    // written aside and renamed, a crash never leaves a torn checkpoint
+    char path[MAX_PATH], temp_path[MAX_PATH];
+    get_checkpoint_path(consumer->ctx->jobs, job->id, path);
+    sprintf_s(temp_path, MAX_PATH, "%s.tmp", path);
+    HANDLE file = CreateFileA(temp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to write the checkpoint of job %u: %lu\n", job->id, GetLastError());
+        return;
+    }
+    DWORD written = 0;
+    bool ok = WriteFile(file, &header, sizeof(header), &written, NULL) && (written == sizeof(header));
+    if (ok && !matches.empty()) {
+        ok = write_file_data(file, (const char*)matches.data(), matches.size() * sizeof(search_match));
+    }
+    CloseHandle(file);
+    if (!ok || !MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING)) {
+        fprintf(stderr, "Failed to write the checkpoint of job %u: %lu\n", job->id, GetLastError());
+        DeleteFileA(temp_path);
+    }
+}
+
+static bool read_job_checkpoint(const char* path, checkpoint_header* header, std::vector<search_match>* matches) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    DWORD read = 0;
+    bool ok = ReadFile(file, header, sizeof(*header), &read, NULL) && (read == sizeof(*header))
+        && (header->magic == CHECKPOINT_MAGIC) && (header->version == CHECKPOINT_VERSION)
+        && (header->params_crc32c == compute_crc32c((const uint8_t*)&header->params, sizeof(header->params)));
+    if (ok && matches) {
+        LARGE_INTEGER file_size; file_size.QuadPart = 0;
+        GetFileSizeEx(file, &file_size);
+        ok = (header->num_matches == (((uint64_t)file_size.QuadPart - sizeof(*header)) / sizeof(search_match)));
+        if (ok) {
+            matches->resize(header->num_matches);
+            uint8_t* dst = (uint8_t*)matches->data();
+            uint64_t left = header->num_matches * sizeof(search_match);
+            while (ok && left) {
+                const DWORD chunk = (DWORD)(_min(left, (uint64_t)0x4000000));
+                ok = ReadFile(file, dst, chunk, &read, NULL) && (read == chunk);
+                dst += chunk;
+                left -= chunk;
+            }
+            ok = ok && (header->matches_crc32c == compute_crc32c((const uint8_t*)matches->data(), matches->size() * sizeof(search_match)));
+        }
+    }
+    CloseHandle(file);
+    return ok;
+}
+
+// checkpoints left by earlier sessions show up as interrupted jobs
+static void load_job_checkpoints(dump_processing_context* ctx) {
+    search_jobs_ctx& jctx = ctx->jobs;
+    char pattern[MAX_PATH];
+    sprintf_s(pattern, MAX_PATH, "%s.job*.qck", jctx.dump_path);
+    const char* dir_end = strrchr(jctx.dump_path, '\\');
+    const size_t dir_len = dir_end ? (size_t)(dir_end - jctx.dump_path + 1) : 0;
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA(pattern, &find_data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        char path[MAX_PATH];
+        sprintf_s(path, MAX_PATH, "%.*s%s", (int)dir_len, jctx.dump_path, find_data.cFileName);
+        checkpoint_header header;
+        if (!read_job_checkpoint(path, &header, nullptr) || (header.params.dump_size != ctx->dump_size) || (header.params.dump_id != ctx->dump_id)) {
+            continue;
+        }
+        search_job* job = new search_job;
+        job->id = header.job_id;
+        job->params = header.params;
+        memcpy(job->command, header.command, sizeof(job->command));
+        job->command[sizeof(job->command) - 1] = 0;
+        job->search_ctx.ctx = ctx;
+        job->search_ctx.job = job;
+        job->search_ctx.bytes_scanned = header.bytes_scanned;
+        job->search_ctx.bytes_total = header.bytes_total;
+        job->state = js_interrupted;
+        job->reported = true;
+        jctx.jobs.push_back(job);
+        jctx.next_id = _max(jctx.next_id, header.job_id + 1);
+    } while (FindNextFileA(find, &find_data));
+    FindClose(find);
+    if (!jctx.jobs.empty()) {
+        printf("\n%llu interrupted job(s) can be resumed, see jobs.\n", (uint64_t)jctx.jobs.size());
+    }
+}
+
+static bool prepare_search_job(dump_processing_context* ctx, search_job* job) {
+    search_context_dump& search_ctx = job->search_ctx;
+    ULONG stream_size = 0;
+    MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
+    if (!MiniDumpReadDumpStream(ctx->file_base, Memory64ListStream, nullptr, reinterpret_cast<void**>(&memory_list), &stream_size)) {
+        fprintf(stderr, "Failed to read Memory64ListStream.\n");
+        return false;
+    }
+    search_ctx.memory_list = memory_list;
+    search_ctx.memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
+    search_ctx.ctx = ctx;
+    search_ctx.pdata = &job->pdata;
+    search_ctx.job = job;
+    search_ctx.common.exit_workers = 0;
+    if (!collect_search_regions(search_ctx)) {
+        puts("*** No memory regions to search. ***");
+        return false;
+    }
+    return true;
+}
+
+static void queue_search_job(dump_processing_context* ctx, search_job* job) {
+    search_jobs_ctx& jctx = ctx->jobs;
+    if (job->budget_id == -1) {
+        job->budget_id = mem_budget_register("background job matches", 0x20, nullptr, nullptr);
+    }
+    jctx.pending.push_back(job);
+    if (!jctx.runner.joinable()) {
+        jctx.runner = std::thread(run_search_jobs, ctx);
+    }
+    jctx.cv.notify_all();
+    printf("[%u] %s\n", job->id, job->command);
+}
+
+static void launch_search_job(dump_processing_context* ctx) {
+    search_job* job = new search_job;
+    memcpy(job->command, ctx->common.command, sizeof(job->command));
+    memcpy(job->pattern, ctx->common.pdata.pattern, _min((size_t)ctx->common.pdata.pattern_len, sizeof(job->pattern)));
+    job->pdata = ctx->common.pdata;
+    job->pdata.pattern = job->pattern;
+    if (!prepare_search_job(ctx, job)) {
+        delete job;
+        return;
+    }
+    set_checkpoint_params(ctx, job);
+
+    std::unique_lock<std::mutex> lk(ctx->jobs.mtx);
+    job->id = ctx->jobs.next_id++;
+    ctx->jobs.jobs.push_back(job);
+    queue_search_job(ctx, job);
+}
+
+// The job continues from its checkpoint: the blocks below the watermark are skipped,
+// the matches found so far are loaded and the duplicates are dropped when the results are printed.
+static void resume_search_job(dump_processing_context* ctx) {
+    search_jobs_ctx& jctx = ctx->jobs;
+    std::unique_lock<std::mutex> lk(jctx.mtx);
+    search_job* job = find_search_job(jctx, ctx->common.job_id);
+    if (!job) {
+        return;
+    }
+    if ((job->state != js_killed) && (job->state != js_interrupted)) {
+        printf("Job %u is not stopped.\n", job->id);
+        return;
+    }
+    char path[MAX_PATH];
+    get_checkpoint_path(jctx, job->id, path);
+    checkpoint_header header;
+    std::vector<search_match> matches;
+    if (!read_job_checkpoint(path, &header, &matches) || (header.job_id != job->id)
+        || (header.params.dump_size != ctx->dump_size) || (header.params.dump_id != ctx->dump_id)) {
+        fprintf(stderr, "No valid checkpoint for job %u.\n", job->id);
+        return;
+    }
+
+    memcpy(job->pattern, header.params.pattern, sizeof(job->pattern));
+    job->params = header.params;
+    job->pdata.pattern = job->pattern;
+    job->pdata.pattern_len = header.params.pattern_len;
+    job->pdata.range.start = (const char*)header.params.range_start;
+    job->pdata.range.length = header.params.range_length;
+    job->pdata.filter = header.params.filter;
+    job->pdata.scope_type = (search_scope_type)header.params.scope_type;
+    job->pdata.op = (search_op)header.params.op;
+
+    search_context_dump& search_ctx = job->search_ctx;
+    search_ctx.mem_info.clear();
+    search_ctx.rva_offsets.clear();
+    search_ctx.bytes_total = 0;
+    search_ctx.skip_zero_pages = false;
+    if (!prepare_search_job(ctx, job)) {
+        return;
+    }
+    search_ctx.common.matches.swap(matches);
+    mem_budget_release(job->budget_id, job->charged_bytes); // the loaded matches are charged by the scan
+    job->charged_bytes = 0;
+    search_ctx.bytes_scanned = header.bytes_scanned;
+    search_ctx.resume_rva = header.watermark;
+    search_ctx.stopped = 0;
+    job->cancel = 0;
+    job->reported = false;
+    job->start_tick = job->end_tick = 0;
+    job->state = js_queued;
+    queue_search_job(ctx, job);
+}
+
+static search_job* find_search_job(search_jobs_ctx& jctx, uint32_t id) {
+    for (search_job* job : jctx.jobs) {
+        if (job->id == id) {
+            return job;
         }
-        if (strstr_u8((const uint8_t*)&data.context->R8, sizeof(data.context->R8), pattern, pattern_len)) {
+    }
+    printf("No job with id %u.\n", id);
+    return nullptr;
+}
+
+static void print_job_status(search_job* job) {
+    static const char* job_states[] = { "Queued", "Running", "Done", "Killed", "Stopped" };
+    const int state = job->state;
+    const search_context_dump& search_ctx = job->search_ctx;
+    const ULONGLONG end = (state >= js_done) ? job->end_tick : GetTickCount64();
+    const double elapsed = job->start_tick ? (double)(end - job->start_tick) / 1000.0 : 0.0;
+    const uint64_t progress = search_ctx.bytes_total ? _min(100ULL, search_ctx.bytes_scanned * 100 / search_ctx.bytes_total) : 0;
+    // the matches are appended under the lock while the job runs
+    job->search_ctx.common.matches_lock.lock();
+    const size_t num_matches = search_ctx.common.matches.size();
+    job->search_ctx.common.matches_lock.unlock();
+    // a running job may still hold duplicates, the count is exact once it has ended
+    printf("[%u] %-8s %3llu%% | %.2f s | Matches: %s%llu | Pass shared by: %u | %s\n",
+        job->id, job_states[state], progress, elapsed, (state >= js_done) ? "" : "~", (uint64_t)num_matches, job->fused, job->command);
+}
+
+static void list_search_jobs(dump_processing_context* ctx) {
+    std::unique_lock<std::mutex> lk(ctx->jobs.mtx);
+    if (ctx->jobs.jobs.empty()) {
+        puts("No jobs.");
+        return;
+    }
+    for (search_job* job : ctx->jobs.jobs) {
+        print_job_status(job);
+    }
+}
+
+static void wait_search_job(dump_processing_context* ctx) {
+    search_jobs_ctx& jctx = ctx->jobs;
+    std::unique_lock<std::mutex> lk(jctx.mtx);
+    search_job* job = find_search_job(jctx, ctx->common.job_id);
+    if (!job) {
+        return;
+    }
+    jctx.cv.wait(lk, [job] { return job->state >= js_done; });
+    job->reported = true;
+    print_job_status(job);
+}
+
+static void kill_search_job(dump_processing_context* ctx) {
+    search_jobs_ctx& jctx = ctx->jobs;
+    std::unique_lock<std::mutex> lk(jctx.mtx);
+    search_job* job = find_search_job(jctx, ctx->common.job_id);
+    if (!job || (job->state >= js_done)) {
+        return;
+    }
+    job->cancel = 1;
+    if (job->state == js_queued) {
+        jctx.pending.erase(std::find(jctx.pending.begin(), jctx.pending.end(), job));
+        job->search_ctx.stopped = 1;
+        write_job_checkpoint(&job->search_ctx, job->search_ctx.resume_rva);
+        job->state = js_killed;
+    }
+    jctx.cv.wait(lk, [job] { return job->state >= js_done; });
+    job->reported = true;
+    print_job_status(job);
+}
+
+static void show_search_job(dump_processing_context* ctx) {
+    search_job* job = nullptr;
+    {
+        std::unique_lock<std::mutex> lk(ctx->jobs.mtx);
+        job = find_search_job(ctx->jobs, ctx->common.job_id);
+        if (!job) {
+            return;
+        }
+        if (job->state < js_done) {
+            print_job_status(job);
+            return;
+        }
+        if (job->state == js_interrupted) {
+            printf("Job %u was interrupted, resume it first.\n", job->id);
+            return;
+        }
+    }
+    if (ctx->common.rdata.redirect) {
+        puts(job->command);
+        puts("");
+    }
+    if (job->state == js_killed) {
+        puts("*** The job has been killed, the results are partial (resume <id> to complete them). ***\n");
+    }
+    print_search_results(job->search_ctx);
+    store_last_matches(&ctx->common, job->search_ctx.common.matches);
+}
+
+static void report_finished_jobs(dump_processing_context* ctx) {
+    search_jobs_ctx* jctx = &ctx->jobs;
+    std::unique_lock<std::mutex> lk(jctx->mtx);
+    for (search_job* job : jctx->jobs) {
+        if (!job->reported && (job->state >= js_done)) {
+            job->reported = true;
+            print_job_status(job);
+            if (job->state == js_done) {
+                result_key key;
+                memset(&key, 0, sizeof(key));
+                key.params = job->params;
+                if (!find_cached_result(ctx, key)) {
+                    cache_search_result(ctx, key, job->search_ctx.common.matches, job->command);
+                }
+            }
+        }
+    }
+}
+
+static void stop_search_jobs(search_jobs_ctx* jctx) {
+    {
+        std::unique_lock<std::mutex> lk(jctx->mtx);
+        jctx->exit = true;
+        for (search_job* job : jctx->jobs) {
+            job->cancel = 1;
+        }
+        jctx->cv.notify_all();
+    }
+    if (jctx->runner.joinable()) {
+        jctx->runner.join();
+    }
+    // the queued jobs can be resumed in the next session
+    for (search_job* job : jctx->pending) {
+        write_job_checkpoint(&job->search_ctx, job->search_ctx.resume_rva);
+    }
+    for (search_job* job : jctx->jobs) {
+        mem_budget_unregister(job->budget_id);
+        delete job;
+    }
+    jctx->jobs.clear();
+    jctx->pending.clear();
+}
+
+// only whether the register holds the pattern matters, the kernel stops at the first match
+static bool register_holds_pattern(const DWORD64* reg, scan_kernel kernel, const scan_kernel_args& args) {
+    std::vector<const char*> found;
+    return kernel((const uint8_t*)reg, sizeof(*reg), (const char*)reg, args, &found) != 0;
+}
+
+static void search_pattern_in_registers(const dump_processing_context *ctx) {
+    std::vector<reg_search_result> matches;
+    reg_search_result match;
+    match.reg_name[0] = 'R';
+    match.reg_name[3] = 0;
+    const uint8_t* pattern = (const uint8_t*)ctx->common.pdata.pattern;
+    int64_t pattern_len = ctx->common.pdata.pattern_len;
+    assert(pattern_len <= sizeof(uint64_t));
+    const scan_kernel_args args{ pattern, (size_t)pattern_len, nullptr, nullptr, 1 };
+    const scan_kernel kernel = select_scan_kernel((size_t)pattern_len, false, sm_first_n);
+    for (const thread_info_dump &data : ctx->t_data) {
+        if (register_holds_pattern(&data.context->Rax, kernel, args)) {
+            match.match = data.context->Rax;
+            match.tid = data.tid;
+            match.reg_name[1] = 'A'; match.reg_name[2] = 'X';
+            matches.push_back(match);
+        }
+        if (register_holds_pattern(&data.context->Rbx, kernel, args)) {
+            match.match = data.context->Rbx;
+            match.tid = data.tid;
+            match.reg_name[1] = 'B'; match.reg_name[2] = 'X';
+            matches.push_back(match);
+        }
+        if (register_holds_pattern(&data.context->Rcx, kernel, args)) {
+            match.match = data.context->Rcx;
+            match.tid = data.tid;
+            match.reg_name[1] = 'C'; match.reg_name[2] = 'X';
+            matches.push_back(match);
+        }
+        if (register_holds_pattern(&data.context->Rdx, kernel, args)) {
+            match.match = data.context->Rdx;
+            match.tid = data.tid;
+            match.reg_name[1] = 'D'; match.reg_name[2] = 'X';
+            matches.push_back(match);
+        }
+        if (register_holds_pattern(&data.context->Rdi, kernel, args)) {
+            match.match = data.context->Rdi;
+            match.tid = data.tid;
+            match.reg_name[1] = 'D'; match.reg_name[2] = 'I';
+            matches.push_back(match);
+        }
+        if (register_holds_pattern(&data.context->Rsi, kernel, args)) {
+            match.match = data.context->Rsi;
+            match.tid = data.tid;
+            match.reg_name[1] = 'S'; match.reg_name[2] = 'I';
+            matches.push_back(match);
+        }
+        if (register_holds_pattern(&data.context->Rsp, kernel, args)) {
+            match.match = data.context->Rsp;
+            match.tid = data.tid;
+            match.reg_name[1] = 'S'; match.reg_name[2] = 'P';
+            matches.push_back(match);
+        }
+        if (register_holds_pattern(&data.context->Rbp, kernel, args)) {
+            match.match = data.context->Rbp;
+            match.tid = data.tid;
+            match.reg_name[1] = 'B'; match.reg_name[2] = 'P';
+            matches.push_back(match);
+        }
+        if (register_holds_pattern(&data.context->Rip, kernel, args)) {
+            match.match = data.context->Rip;
+            match.tid = data.tid;
+            match.reg_name[1] = 'I'; match.reg_name[2] = 'P';
+            matches.push_back(match);
+        }
+        if (register_holds_pattern(&data.context->R8, kernel, args)) {
             match.match = data.context->R8;
             match.tid = data.tid;
             match.reg_name[1] = '8'; match.reg_name[2] = ' ';
             matches.push_back(match);
         }
-        if (strstr_u8((const uint8_t*)&data.context->R9, sizeof(data.context->R9), pattern, pattern_len)) {
+        if (register_holds_pattern(&data.context->R9, kernel, args)) {
             match.match = data.context->R9;
             match.tid = data.tid;
             match.reg_name[1] = '9'; match.reg_name[2] = ' ';
             matches.push_back(match);
         }
-        if (strstr_u8((const uint8_t*)&data.context->R10, sizeof(data.context->R10), pattern, pattern_len)) {
+        if (register_holds_pattern(&data.context->R10, kernel, args)) {
             match.match = data.context->R10;
             match.tid = data.tid;
             match.reg_name[1] = '1'; match.reg_name[2] = '0';
             matches.push_back(match);
         }
-        if (strstr_u8((const uint8_t*)&data.context->R11, sizeof(data.context->R11), pattern, pattern_len)) {
+        if (register_holds_pattern(&data.context->R11, kernel, args)) {
             match.match = data.context->R11;
             match.tid = data.tid;
             match.reg_name[1] = '1'; match.reg_name[2] = '1';
             matches.push_back(match);
         }
-        if (strstr_u8((const uint8_t*)&data.context->R12, sizeof(data.context->R12), pattern, pattern_len)) {
+        if (register_holds_pattern(&data.context->R12, kernel, args)) {
             match.match = data.context->R12;
             match.tid = data.tid;
             match.reg_name[1] = '1'; match.reg_name[2] = '2';
             matches.push_back(match);
         }
-        if (strstr_u8((const uint8_t*)&data.context->R13, sizeof(data.context->R13), pattern, pattern_len)) {
+        if (register_holds_pattern(&data.context->R13, kernel, args)) {
             match.match = data.context->R13;
             match.tid = data.tid;
             match.reg_name[1] = '1'; match.reg_name[2] = '3';
             matches.push_back(match);
         }
-        if (strstr_u8((const uint8_t*)&data.context->R14, sizeof(data.context->R14), pattern, pattern_len)) {
+        if (register_holds_pattern(&data.context->R14, kernel, args)) {
             match.match = data.context->R14;
             match.tid = data.tid;
             match.reg_name[1] = '1'; match.reg_name[2] = '4';
             matches.push_back(match);
         }
-        if (strstr_u8((const uint8_t*)&data.context->R15, sizeof(data.context->R15), pattern, pattern_len)) {
+        if (register_holds_pattern(&data.context->R15, kernel, args)) {
             match.match = data.context->R15;
             match.tid = data.tid;
             match.reg_name[1] = '1'; match.reg_name[2] = '5';
@@ -607,61 +2575,64 @@ static void search_pattern_in_registers(const dump_processing_context *ctx) {
     puts("");
 }
 
-static void print_hexdump_dump(dump_processing_context* ctx) {
-    std::vector<uint8_t> bytes;
-    const uint8_t* address = ctx->common.hdata.address;
+// Reads within the memory range holding address, returns the number of bytes read. The reads may run beside
+// a remap of the dump view (hexdump read-ahead), so they go through the mapping and the memory list built at open.
+static size_t read_dump_range(const dump_processing_context* ctx, uint64_t address, uint8_t* buffer, size_t size) {
+    const auto& ranges = ctx->ranges_by_address;
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), address,
+        [](uint64_t addr, const dump_memory_range& range) { return addr < range.address; });
+    if (it == ranges.begin()) {
+        return 0;
+    }
+    --it;
+    if (address >= (it->address + it->size)) {
+        return 0;
+    }
+    const size_t bytes_to_read = (size_t)(_min((uint64_t)size, it->address + it->size - address));
+    HANDLE view = NULL;
+    const uint8_t* data = map_dump_view(ctx, it->rva + (address - it->address), bytes_to_read, &view);
+    if (!data) {
+        return 0;
+    }
+    memcpy(buffer, data, bytes_to_read);
+    unmap_dump_view(view);
+    return bytes_to_read;
+}
+
+static size_t read_dump_page(void* owner, uint64_t page_address, uint8_t* page) {
+    return read_dump_range((const dump_processing_context*)owner, page_address, page, HEXDUMP_PAGE_SIZE);
+}
 
+// built once at open, before the hexdump read-ahead starts using it
+static void gather_memory_ranges(dump_processing_context* ctx) {
     MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
     ULONG stream_size = 0;
     if (!MiniDumpReadDumpStream(ctx->file_base, Memory64ListStream, nullptr, reinterpret_cast<void**>(&memory_list), &stream_size)) {
-        fprintf(stderr, "Failed to read Memory64ListStream.\n");
         return;
     }
-    puts("\n------------------------------------\n");
-
     const MINIDUMP_MEMORY_DESCRIPTOR64* memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
-    const uint64_t alloc_granularity = get_alloc_granularity();
-    const size_t num_regions = memory_list->NumberOfMemoryRanges;
-    size_t cumulative_offset = 0;
+    auto& ranges = ctx->ranges_by_address;
+    ranges.clear();
+    ranges.reserve(memory_list->NumberOfMemoryRanges);
+    uint64_t rva = memory_list->BaseRva;
+    for (ULONG64 i = 0; i < memory_list->NumberOfMemoryRanges; ++i) {
+        ranges.push_back(dump_memory_range{ memory_descriptors[i].StartOfMemoryRange, memory_descriptors[i].DataSize, rva });
+        rva += memory_descriptors[i].DataSize;
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const dump_memory_range& a, const dump_memory_range& b) { return a.address < b.address; });
+}
 
-    for (ULONG i = 0; i < num_regions; ++i) {
-        const MINIDUMP_MEMORY_DESCRIPTOR64& mem_desc = memory_descriptors[i];
-        const SIZE_T region_size = static_cast<SIZE_T>(mem_desc.DataSize);
-        if (((ULONG64)address >= mem_desc.StartOfMemoryRange) && ((ULONG64)address < (mem_desc.StartOfMemoryRange + region_size))) {
-            size_t bytes_to_read = ctx->common.hdata.num_to_display * ctx->common.hdata.mode;
-            const ULONG64 start_offset = (ULONG64)address - mem_desc.StartOfMemoryRange;
-            bytes_to_read = _min(bytes_to_read, (region_size - start_offset));
-            ctx->common.hdata.num_to_display = bytes_to_read / ctx->common.hdata.mode;
-            bytes_to_read = ctx->common.hdata.num_to_display * ctx->common.hdata.mode;
-
-            const uint64_t rva_offset = memory_list->BaseRva + cumulative_offset + start_offset;           
-            uint64_t rva_offset_aligned = rva_offset & ~(alloc_granularity - 1);
-            uint64_t reminder = rva_offset - rva_offset_aligned;
-            const size_t bytes_to_map = bytes_to_read + reminder;
-            const DWORD high = (DWORD)((rva_offset_aligned >> 0x20) & 0xFFFFFFFF);
-            const DWORD low = (DWORD)(rva_offset_aligned & 0xFFFFFFFF);
-            HANDLE file_base = MapViewOfFile(ctx->file_mapping, FILE_MAP_READ, high, low, bytes_to_map);
-            const char* buffer = ((const char*)file_base + reminder);
-            if (!buffer) {
-                UnmapViewOfFile(file_base);
-                fprintf(stderr, "Empty memory region!\n");
-                return;
-            }
-            bytes.reserve(bytes_to_read);
-            for (int i = 0; i < bytes_to_read; i++) {
-                bytes.push_back(buffer[i]);
-            }
-
-            UnmapViewOfFile(file_base);
-            break;
-        }
-        cumulative_offset += mem_desc.DataSize;
-    }
-
-    if (0 == bytes.size()) {
+static void print_hexdump_dump(dump_processing_context* ctx) {
+    puts("\n------------------------------------\n");
+    hexdump_data& hdata = ctx->common.hdata;
+    std::vector<uint8_t> bytes(hdata.num_to_display * hdata.mode);
+    const size_t bytes_read = read_hexdump_memory(&ctx->common.hex_cache, (uint64_t)hdata.address, bytes.data(), bytes.size());
+    if (!bytes_read) {
         puts("Address not found in commited memory ranges.");
         return;
     }
+    hdata.num_to_display = bytes_read / hdata.mode;
+    bytes.resize(hdata.num_to_display * hdata.mode);
 
     switch (ctx->common.hdata.hex_op.op) {
     case hexdump_op::ho_xor:
@@ -690,6 +2661,24 @@ static void print_help_search() {
     print_help_search_common();
     puts("--------------------------------");
     puts("/xr <pattern>\t\t - search for a hex value in GP registers");
+    puts("/~est[=<percent>]<search> - estimate the number of matches from a sample of the memory (e.g. /~est=5a needle or /~est=5 /a needle)");
+    puts("sim[:<modifiers>]@<address>:<size> - list the windows of <size> bytes most similar to the block (modifiers same as search)");
+    puts("--------------------------------");
+    puts("<search command> &\t - run the search as a background job (e.g. /a needle &)");
+    puts("jobs\t\t\t - list background jobs");
+    puts("wait <id>\t\t - wait for the job to finish");
+    puts("kill <id>\t\t - stop the job, the matches found so far are kept");
+    puts("show <id>\t\t - print the results of a finished job (can be redirected)");
+    puts("resume <id>\t\t - continue a killed or interrupted job from its last checkpoint");
+    puts("--------------------------------");
+    puts("lr\t\t\t - list the cached search result sets");
+    puts("/in <set>[+|-<hex>] <search command> - keep the sites of result <set> where the pattern is found (at the given offset)");
+    puts("rs <set>\t\t - print a result set (<set> is its id or name)");
+    puts("rs union|intersect <set> <set> [<set>...] - combine result sets into a new one");
+    puts("rs minus <set> <set>\t - the addresses of the first set missing in the second one");
+    puts("rs shift <set> +|-<hex> - move every address of the set");
+    puts("rs name <set> <name>\t - name a result set");
+    puts("rs x(b|w|d|q) <set> <N>\t - hexdump N units at every address of the set");
     puts("------------------------------------\n");
 }
 
@@ -714,11 +2703,21 @@ static void print_help_list() {
 
 static void print_help_inspect() {
     print_help_inspect_common();
+    puts("------------------------------------");
+    puts("extract <name|*> <dir>\t - write the in-memory image of the <name> module (or of all modules) to <dir>");
+    puts("carve[:<modifiers>] <file-path>\t - write a minidump with the memory regions matching the modifiers (same as search)");
+    puts("carve@<address>:<size>[,@<address>:<size>...] <file-path>\t - write a minidump with the listed memory ranges");
+    puts("carve^<hex-size> <file-path>\t - write a minidump with the memory around the last search matches");
+    puts("*  Thread stacks are always included, the other streams are copied unchanged");
+    puts("pack <file-path>\t - write the dump as a compressed chunked container, which can be opened instead of the dump");
     puts("------------------------------------\n");
 }
 
 static void print_help_calculate() {
     print_help_calculate_common();
+    puts("%<hash>:regions[:<modifiers>]\t - calculate crc32c|xxh3|sha256|blake3 of every memory range of the dump in one parallel pass (e.g. %sha256:regions:i)");
+    puts("%<hash>:module <name>\t\t - calculate crc32c|xxh3|sha256|blake3 of the whole in-memory image of the module");
+    puts("*  xxh3, sha256 and blake3 blocks continue over the adjacent memory ranges, clamped at the first gap");
     puts("------------------------------------\n");
 }
 
@@ -767,11 +2766,32 @@ static void execute_command(input_command cmd, dump_processing_context *ctx) {
         print_help_symbols();
         break;
     case c_search_pattern :
-        wait_for_memory_regions_caching(&ctx->pages_caching_state);
+        if (ctx->common.estimate_fraction > 0.0) {
+            pause_memory_regions_caching(&ctx->pages_caching_state);
+            try_redirect_output_to_file(&ctx->common);
+            estimate_search(ctx);
+            puts("====================================\n");
+            redirect_output_to_stdout(&ctx->common);
+            resume_memory_regions_caching(&ctx->pages_caching_state);
+            break;
+        }
+        if (ctx->common.refine_set[0]) {
+            try_redirect_output_to_file(&ctx->common);
+            refine_cached_result(ctx);
+            puts("====================================\n");
+            redirect_output_to_stdout(&ctx->common);
+            break;
+        }
+        if (ctx->common.background) {
+            launch_search_job(ctx);
+            break;
+        }
+        pause_memory_regions_caching(&ctx->pages_caching_state);
         try_redirect_output_to_file(&ctx->common);
         search_pattern_in_memory((dump_processing_context*)ctx);
         puts("====================================\n");
         redirect_output_to_stdout(&ctx->common);
+        resume_memory_regions_caching(&ctx->pages_caching_state);
         break;
     case c_search_pattern_in_registers :
         try_redirect_output_to_file(&ctx->common);
@@ -835,6 +2855,45 @@ static void execute_command(input_command cmd, dump_processing_context *ctx) {
         puts("====================================\n");
         redirect_output_to_stdout(&ctx->common);
         break;
+    case c_list_results:
+        try_redirect_output_to_file(&ctx->common);
+        list_cached_results(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_result_set:
+        try_redirect_output_to_file(&ctx->common);
+        result_set_command(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_list_jobs:
+        try_redirect_output_to_file(&ctx->common);
+        list_search_jobs(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_wait_job:
+        wait_search_job(ctx);
+        break;
+    case c_kill_job:
+        kill_search_job(ctx);
+        break;
+    case c_resume_job:
+        resume_search_job(ctx);
+        break;
+    case c_show_job:
+        try_redirect_output_to_file(&ctx->common);
+        show_search_job(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_inspect_memory_budget:
+        try_redirect_output_to_file(&ctx->common);
+        print_mem_budget();
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
     case c_inspect_module:
         try_redirect_output_to_file(&ctx->common);
         print_module_info(ctx);
@@ -853,12 +2912,54 @@ static void execute_command(input_command cmd, dump_processing_context *ctx) {
         puts("====================================\n");
         redirect_output_to_stdout(&ctx->common);
         break;
+    case c_verify_modules:
+        try_redirect_output_to_file(&ctx->common);
+        verify_dump_modules(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_extract_modules:
+        try_redirect_output_to_file(&ctx->common);
+        extract_modules(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_carve_dump:
+        try_redirect_output_to_file(&ctx->common);
+        carve_dump(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_pack_dump:
+        try_redirect_output_to_file(&ctx->common);
+        pack_dump(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
     case c_calculate:
         try_redirect_output_to_file(&ctx->common);
         data_block_calculate(ctx);
         puts("====================================\n");
         redirect_output_to_stdout(&ctx->common);
         break;
+    case c_similarity_search:
+        try_redirect_output_to_file(&ctx->common);
+        similarity_search(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_hash_regions:
+        try_redirect_output_to_file(&ctx->common);
+        hash_regions(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_hash_module:
+        try_redirect_output_to_file(&ctx->common);
+        hash_module(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
     case c_symbol_resolve_at_address:
         try_redirect_output_to_file(&ctx->common);
         symbol_find_at_address(&ctx->common);
@@ -904,20 +3005,25 @@ int run_dump_inspection() {
     gets_s(dump_file_path, sizeof(dump_file_path));
 
     HANDLE file_handle, file_mapping_handle, file_base;
-    if (!map_file(dump_file_path, &file_handle, &file_mapping_handle, &file_base)) {
+    uint64_t dump_size = 0;
+    bool packed = false;
+    if (!map_file(dump_file_path, &file_handle, &file_mapping_handle, &file_base, &dump_size, &packed)) {
         return -1;
     }
 
-    dump_processing_context ctx = { { pattern_data{ nullptr, 0, search_scope_type::mrt_all } }, file_handle, file_mapping_handle, file_base };
+    dump_processing_context ctx = { { pattern_data{ nullptr, 0, search_scope_type::mrt_all } }, file_handle, file_mapping_handle, file_base, dump_size, packed };
+    ctx.dump_id = compute_dump_id(&ctx);
     get_system_info(&ctx);
     if (ctx.cpu_info.processor_architecture != PROCESSOR_ARCHITECTURE_AMD64) {
         fprintf(stderr, "\nOnly x86-64 architecture supported at the moment. Exiting..\n");
         return -1;
     }
 
-    if (!is_drive_ssd(dump_file_path)) {
+    ctx.residency.ssd = is_drive_ssd(dump_file_path);
+    if (!ctx.residency.ssd) {
         puts("\nFile is located on an HDD which is going to negatively affect performance.");
     }
+    init_residency_map(&ctx.residency, dump_size);
 
 #ifndef DISABLE_STANDBY_LIST_PURGE
     if (g_purge_standby_pages) {
@@ -931,12 +3037,20 @@ int run_dump_inspection() {
 
     // pre-cache physical pages
     std::thread page_caching_thread;
-    if (!g_disable_page_caching) {
+    if (packed) { // chunks are decoded on demand, there is nothing to pre-cache
+        if (g_max_threads == INVALID_THREAD_NUM) {
+            g_max_threads = IDEAL_THREAD_NUM_DUMP_W_CACHING;
+        }
+    } else if (!g_disable_page_caching) {
         LARGE_INTEGER file_size; file_size.QuadPart = 0;
         GetFileSizeEx(file_handle, &file_size);
         if (0 != file_size.QuadPart) {
             DWORDLONG available_phys_mem, total_phys_mem;
             if (get_available_phys_memory(&total_phys_mem, &available_phys_mem)) {
+                if (g_mem_limit) { // the cached pages count against the limit as well
+                    available_phys_mem = mem_budget_available();
+                    total_phys_mem = (_min(total_phys_mem, (DWORDLONG)g_mem_limit));
+                }
                 const int64_t delta = (int64_t)available_phys_mem - (int64_t)file_size.QuadPart;
                 const int64_t threshold = -(int64_t)total_phys_mem / AVAIL_PHYS_MEM_FACTOR;
                 if ((delta > 0) || (delta > threshold)) {
@@ -959,17 +3073,27 @@ int run_dump_inspection() {
 
     gather_modules(&ctx);
     gather_threads(&ctx);
+    // file rvas, they stay valid across the remaps of the view
+    gather_memory_ranges(&ctx);
+    init_hexdump_cache(&ctx.common.hex_cache, read_dump_page, &ctx, 0);
 
     if (!g_disable_symbols) {
         init_symbols(&ctx);
     }
 
+    start_precompute(&ctx);
+    ctx.jobs.dump_path = dump_file_path;
+    load_job_checkpoints(&ctx);
+    load_cached_results(&ctx, dump_file_path);
+
     char pattern[MAX_PATTERN_LEN];
     char command[MAX_COMMAND_LEN + MAX_ARG_LEN];
     ctx.common.command = command;
     search_data_info sdata;
 
     while (1) {
+        mem_budget_trim();
+        report_finished_jobs(&ctx);
         printf(">: ");
         input_command cmd = parse_command_common(&ctx.common, &sdata, pattern);
         if (cmd == input_command::c_not_set) {
@@ -982,18 +3106,24 @@ int run_dump_inspection() {
         } else if (cmd == c_continue) {
             continue;
         }
+        pause_precompute(&ctx.precompute);
+        ctx.jobs.foreground_busy = (cmd != c_wait_job); // the jobs we are waiting for must not yield
         execute_command(cmd, &ctx);
+        ctx.jobs.foreground_busy = 0;
+        resume_precompute(&ctx.precompute);
     }
 
+    stop_search_jobs(&ctx.jobs);
+    stop_hexdump_cache(&ctx.common.hex_cache);
+    free_cached_results(&ctx.results);
+    stop_precompute(&ctx.precompute);
     stop_memory_regions_caching(&ctx.pages_caching_state, page_caching_thread);
 
     // epilogue
     if (!g_disable_symbols) {
         deinit_symbols(&ctx.common);
     }
-    UnmapViewOfFile(file_base);
-    CloseHandle(file_mapping_handle);
-    CloseHandle(file_handle);
+    close_dump_file(file_handle, ctx.file_mapping, ctx.file_base, packed);
 
     return 0;
 }
@@ -1189,7 +3319,7 @@ static void list_memory_regions_info(const dump_processing_context* ctx, bool sh
     const bool scoped_search = ctx->common.pdata.scope_type != search_scope_type::mrt_all;
 
     const ULONG64 num_entries = memory_info_list->NumberOfEntries;
-    if (!scoped_search && too_many_results(num_entries, output_redirected(&ctx->common))) {
+    if (!scoped_search && !region_filter_set(ctx->common.pdata.filter) && too_many_results(num_entries, output_redirected(&ctx->common))) {
         return;
     }
 
@@ -1206,6 +3336,9 @@ static void list_memory_regions_info(const dump_processing_context* ctx, bool sh
         if (scoped_search && !identify_memory_region_type(ctx->common.pdata.scope_type, mem_info, *ctx)) {
             continue;
         }
+        if (!region_filter_match(ctx->common.pdata.filter, mem_info.Protect, mem_info.Type, mem_info.State, mem_info.RegionSize)) {
+            continue;
+        }
 
         num_regions++;
         for (size_t m = 0, sz = ctx->m_data.size(); m < sz; m++) {
@@ -1267,161 +3400,1859 @@ static void print_memory_info(const dump_processing_context* ctx) {
             get_page_state(mem_info.State), get_page_protect(mem_info.Protect));
         print_page_type(mem_info.Type);
         puts("");
+        print_precomputed_info(&ctx->precompute, (uint64_t)ctx->common.i_data.memory_address);
+        break;
+    }
+}
+
+// case-insensitive match of the file name of the module, as in process mode
+static bool module_name_match(const WCHAR* module_path, const WCHAR* name) {
+    const WCHAR* file_name = wcsrchr(module_path, L'\\');
+    return 0 == _wcsicmp(file_name ? (file_name + 1) : module_path, name);
+}
+
+static void print_module_info(const dump_processing_context* ctx) {
+
+#ifdef _UNICODE
+    LPCWSTR module_name = ctx->common.i_data.module_name;
+#elif defined(_MBCS )
+    WCHAR module_name[MAX_PATH];
+    memset(module_name, 0, sizeof(module_name));
+    const int wc_size = MultiByteToWideChar(CP_UTF8, 0, ctx->common.i_data.module_name, -1, NULL, 0);
+    if (wc_size && (wc_size <= _countof(ctx->common.i_data.module_name))) {
+        int result = MultiByteToWideChar(CP_UTF8, 0, ctx->common.i_data.module_name, -1, module_name, wc_size);
+        if (result == 0) {
+            fprintf(stderr, "Error converting to wide character string: %s\n", module_name);
+            return;
+        }
+    } else {
+        fprintf(stderr, "Module name exceeds maximum length: %s\n", module_name);
+        return;
+    }
+#endif
+
+    for (ULONG i = 0, num_modules = ctx->m_data.size(); i < num_modules; i++) {
+        const module_data& m = ctx->m_data[i];
+        if (nullptr == wcsstr(m.name, module_name)) { // listing, any part of the path
+            continue;
+        }
+        wprintf((LPCWSTR)L"Module name: %s\n", m.name);
+        printf("Base of image: 0x%p | Size of image: 0x%04llx\n\n", m.base_of_image, m.size_of_image);
         break;
     }
 }
 
-static void print_module_info(const dump_processing_context* ctx) {
+struct dump_read_context {
+    const char* file_base;
+    const MINIDUMP_MEMORY_DESCRIPTOR64* memory_descriptors;
+    std::vector<uint64_t> rva_offsets;
+};
+
+static bool init_dump_read_context(const dump_processing_context* ctx, dump_read_context* rctx) {
+    MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
+    ULONG stream_size = 0;
+    if (!MiniDumpReadDumpStream(ctx->file_base, Memory64ListStream, nullptr, reinterpret_cast<void**>(&memory_list), &stream_size)) {
+        fprintf(stderr, "Failed to read Memory64ListStream.\n");
+        return false;
+    }
+    rctx->file_base = (const char*)ctx->file_base;
+    rctx->memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
+    rctx->rva_offsets.clear();
+    rctx->rva_offsets.reserve(memory_list->NumberOfMemoryRanges);
+    uint64_t cumulative_offset = 0;
+    for (ULONG64 i = 0; i < memory_list->NumberOfMemoryRanges; i++) {
+        rctx->rva_offsets.push_back(memory_list->BaseRva + cumulative_offset);
+        cumulative_offset += rctx->memory_descriptors[i].DataSize;
+    }
+    return true;
+}
+
+// Copies the parts of [address, address + size) present in the dump straight from the file view,
+// the bytes of missing pages are left untouched. Returns the number of bytes copied.
+static size_t copy_dump_memory(const dump_read_context* rctx, uint64_t address, uint8_t* buffer, size_t size) {
+    const MINIDUMP_MEMORY_DESCRIPTOR64* descriptors = rctx->memory_descriptors;
+    const size_t num_descriptors = rctx->rva_offsets.size();
+    const uint64_t end = address + size;
+    size_t low = 0, high = num_descriptors;
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (descriptors[mid].StartOfMemoryRange <= address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    size_t bytes_copied = 0;
+    for (size_t i = (low ? low - 1 : 0); i < num_descriptors; i++) {
+        const MINIDUMP_MEMORY_DESCRIPTOR64& mem_desc = descriptors[i];
+        if (mem_desc.StartOfMemoryRange >= end) {
+            break;
+        }
+        const uint64_t range_end = mem_desc.StartOfMemoryRange + mem_desc.DataSize;
+        if (range_end <= address) {
+            continue;
+        }
+        const uint64_t start = _max(address, mem_desc.StartOfMemoryRange);
+        const size_t bytes_to_copy = (size_t)((_min(end, range_end)) - start);
+        memcpy(buffer + (start - address), rctx->file_base + rctx->rva_offsets[i] + (start - mem_desc.StartOfMemoryRange), bytes_to_copy);
+        bytes_copied += bytes_to_copy;
+    }
+    return bytes_copied;
+}
+
+// called with the budget lock held
+static void evict_result_entry(void* owner) {
+    result_entry* entry = (result_entry*)owner;
+    result_cache_ctx* rcache = entry->cache;
+    rcache->entries.erase(std::find(rcache->entries.begin(), rcache->entries.end(), entry));
+    rcache->evicted_budget_ids.push_back(entry->budget_id);
+    delete entry;
+}
+
+static uint64_t result_entry_size(const result_entry* entry) {
+    return sizeof(result_entry) + entry->packed.capacity();
+}
+
+// Sorted unique addresses are stored in blocks of up to RESULT_BLOCK_LEN: the first address,
+// the byte width of the deltas (1, 2, 4 or 8), the number of deltas and the deltas to the previous address.
+static void pack_addresses(const std::vector<uint64_t>& addresses, std::vector<uint8_t>* packed) {
+    packed->clear();
+    for (size_t i = 0, sz = addresses.size(); i < sz; i += RESULT_BLOCK_LEN) {
+        const size_t num = _min(sz - i, (size_t)RESULT_BLOCK_LEN);
+        uint64_t max_delta = 0;
+        for (size_t k = i + 1; k < i + num; k++) {
+            max_delta = _max(max_delta, addresses[k] - addresses[k - 1]);
+        }
+        const uint8_t width = (max_delta <= UINT8_MAX) ? 1 : ((max_delta <= UINT16_MAX) ? 2 : ((max_delta <= UINT32_MAX) ? 4 : 8));
+        const size_t offset = packed->size();
+        packed->resize(offset + sizeof(uint64_t) + 2 + (num - 1) * width);
+        uint8_t* dst = packed->data() + offset;
+        memcpy(dst, &addresses[i], sizeof(uint64_t));
+        dst[sizeof(uint64_t)] = width;
+        dst[sizeof(uint64_t) + 1] = (uint8_t)(num - 1);
+        dst += sizeof(uint64_t) + 2;
+        for (size_t k = i + 1; k < i + num; k++, dst += width) {
+            const uint64_t delta = addresses[k] - addresses[k - 1];
+            memcpy(dst, &delta, width); // little endian
+        }
+    }
+    packed->shrink_to_fit();
+}
+
+template <typename T>
+static const uint8_t* unpack_deltas(const uint8_t* src, size_t num, uint64_t* dst) {
+    uint64_t address = dst[-1];
+    for (size_t k = 0; k < num; k++, src += sizeof(T)) {
+        T delta;
+        memcpy(&delta, src, sizeof(T));
+        address += delta;
+        dst[k] = address;
+    }
+    return src;
+}
+
+static void unpack_addresses(const result_entry* entry, std::vector<uint64_t>* addresses) {
+    addresses->resize((size_t)entry->num_addresses);
+    uint64_t* dst = addresses->data();
+    const uint8_t* src = entry->packed.data();
+    const uint8_t* end = src + entry->packed.size();
+    while (src < end) {
+        memcpy(dst, src, sizeof(uint64_t));
+        const uint8_t width = src[sizeof(uint64_t)];
+        const size_t num = src[sizeof(uint64_t) + 1];
+        src += sizeof(uint64_t) + 2;
+        dst++;
+        switch (width) {
+        case 1: src = unpack_deltas<uint8_t>(src, num, dst); break;
+        case 2: src = unpack_deltas<uint16_t>(src, num, dst); break;
+        case 4: src = unpack_deltas<uint32_t>(src, num, dst); break;
+        default: src = unpack_deltas<uint64_t>(src, num, dst); break;
+        }
+        dst += num;
+    }
+}
+
+// Intersection (keep_common) or difference of two sorted unique sets. Two addresses of each set are compared
+// at once (all four pairs), the block with the lower maximum is consumed.
+template <bool keep_common>
+static void merge_sets_sse(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b, std::vector<uint64_t>* out) {
+    out->resize(keep_common ? (_min(a.size(), b.size())) : a.size());
+    uint64_t* dst = out->data();
+    const size_t na = a.size() & ~(size_t)1, nb = b.size() & ~(size_t)1;
+    size_t i = 0, j = 0;
+    uint32_t matched = 0; // a[i], a[i + 1] found in b so far
+    while ((i < na) && (j < nb)) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&a[i]));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&b[j]));
+        const __m128i vb_swapped = _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2));
+        const __m128i eq = _mm_or_si128(_mm_cmpeq_epi64(va, vb), _mm_cmpeq_epi64(va, vb_swapped));
+        matched |= (uint32_t)_mm_movemask_pd(_mm_castsi128_pd(eq));
+        const uint64_t a_max = a[i + 1], b_max = b[j + 1];
+        if (a_max <= b_max) {
+            const uint32_t keep = keep_common ? matched : (~matched & 0x3);
+            *dst = a[i];
+            dst += keep & 0x1;
+            *dst = a[i + 1];
+            dst += keep >> 1;
+            matched = 0;
+            i += 2;
+        }
+        j += (b_max <= a_max) ? 2 : 0;
+    }
+    for (size_t sz = a.size(); i < sz; i++, matched >>= 1) {
+        while ((j < b.size()) && (b[j] < a[i])) {
+            j++;
+        }
+        const bool found = (matched & 0x1) || ((j < b.size()) && (b[j] == a[i]));
+        if (found == keep_common) {
+            *dst++ = a[i];
+        }
+    }
+    out->resize(dst - out->data());
+}
+
+static void union_sets(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b, std::vector<uint64_t>* out) {
+    out->resize(a.size() + b.size());
+    uint64_t* dst = out->data();
+    size_t i = 0, j = 0;
+    const size_t na = a.size(), nb = b.size();
+    while ((i < na) && (j < nb)) { // branchless merge, equal addresses are written once
+        const uint64_t x = a[i], y = b[j];
+        *dst++ = (x < y) ? x : y;
+        i += (x <= y);
+        j += (y <= x);
+    }
+    dst = std::copy(a.begin() + i, a.end(), dst);
+    dst = std::copy(b.begin() + j, b.end(), dst);
+    out->resize(dst - out->data());
+}
+
+static void shift_set(const std::vector<uint64_t>& a, int64_t shift, std::vector<uint64_t>* out) {
+    out->clear();
+    out->reserve(a.size());
+    for (uint64_t address : a) {
+        const uint64_t shifted = address + (uint64_t)shift;
+        if ((shift < 0) ? (shifted < address) : (shifted >= address)) { // addresses wrapping around are dropped
+            out->push_back(shifted);
+        }
+    }
+}
+
+static const result_entry* find_cached_result(const dump_processing_context* ctx, const result_key& key) {
+    for (const result_entry* entry : ctx->results.entries) {
+        if (0 == memcmp(&entry->key, &key, sizeof(key))) {
+            mem_budget_touch(entry->budget_id);
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+// By the decimal id or by the name given with 'rs name'.
+static result_entry* find_result_set(const dump_processing_context* ctx, const char* ref) {
+    const bool by_id = isdigit((unsigned char)ref[0]) != 0;
+    const uint32_t id = by_id ? (uint32_t)strtoul(ref, NULL, 10) : 0;
+    for (result_entry* entry : ctx->results.entries) {
+        if (by_id ? (entry->id == id) : (0 == strcmp(entry->name, ref))) {
+            mem_budget_touch(entry->budget_id);
+            return entry;
+        }
+    }
+    printf("No result set %s.\n", ref);
+    return nullptr;
+}
+
+static void persist_result_record(const result_cache_ctx* rcache, const result_entry* entry, uint32_t flags) {
+    HANDLE file = CreateFileA(rcache->persist_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to open %s: %lu\n", rcache->persist_path, GetLastError());
+        return;
+    }
+    LARGE_INTEGER file_size; file_size.QuadPart = 0;
+    GetFileSizeEx(file, &file_size);
+    DWORD written = 0;
+    bool ok = true;
+    if (file_size.QuadPart == 0) {
+        const uint64_t header[4] = { RESULTS_MAGIC, RESULTS_VERSION, entry->key.params.dump_size, entry->key.params.dump_id };
+        ok = WriteFile(file, header, sizeof(header), &written, NULL) && (written == sizeof(header));
+    }
+    // records are appended, a torn last record is dropped when loading
+    LARGE_INTEGER zero; zero.QuadPart = 0;
+    SetFilePointerEx(file, zero, NULL, FILE_END);
+    const bool rename = (flags & RESULT_RECORD_RENAME) != 0;
+    result_record_header record;
+    memset(&record, 0, sizeof(record));
+    record.id = entry->id;
+    record.flags = flags;
+    record.num_addresses = rename ? 0 : entry->num_addresses;
+    record.packed_size = rename ? 0 : entry->packed.size();
+    record.packed_crc32c = compute_crc32c(entry->packed.data(), (size_t)record.packed_size);
+    record.key = entry->key;
+    memcpy(record.name, entry->name, sizeof(record.name));
+    memcpy(record.command, entry->command, sizeof(record.command));
+    ok = ok && WriteFile(file, &record, sizeof(record), &written, NULL) && (written == sizeof(record));
+    if (ok && record.packed_size) {
+        ok = write_file_data(file, (const char*)entry->packed.data(), (size_t)record.packed_size);
+    }
+    if (!ok) {
+        fprintf(stderr, "Failed to persist result set #%u: %lu\n", entry->id, GetLastError());
+    }
+    CloseHandle(file);
+}
+
+static bool add_cached_result(dump_processing_context* ctx, result_entry* entry, bool persist) {
+    result_cache_ctx& rcache = ctx->results;
+    for (int budget_id : rcache.evicted_budget_ids) {
+        mem_budget_unregister(budget_id);
+    }
+    rcache.evicted_budget_ids.clear();
+    entry->cache = &rcache;
+    entry->budget_id = mem_budget_register("search result set", 0x20, evict_result_entry, entry);
+    if (!mem_budget_charge(entry->budget_id, result_entry_size(entry))) {
+        mem_budget_unregister(entry->budget_id);
+        return false;
+    }
+    rcache.entries.push_back(entry);
+    rcache.next_id = _max(rcache.next_id, entry->id + 1);
+    if (persist && g_persist_results) {
+        persist_result_record(&rcache, entry, 0);
+    }
+    return true;
+}
+
+// command is the search that produced the set, for a job it is not the command at the prompt
+static const result_entry* cache_result_addresses(dump_processing_context* ctx, const result_key& key, const std::vector<uint64_t>& addresses, const char* command) {
+    result_entry* entry = new result_entry;
+    entry->id = ctx->results.next_id;
+    entry->key = key;
+    memset(entry->name, 0, sizeof(entry->name));
+    strcpy_s(entry->command, sizeof(entry->command), command);
+    entry->num_addresses = addresses.size();
+    pack_addresses(addresses, &entry->packed);
+    if (!add_cached_result(ctx, entry, true)) {
+        delete entry;
+        return nullptr;
+    }
+    return entry;
+}
+
+static const result_entry* cache_search_result(dump_processing_context* ctx, const result_key& key, const std::vector<search_match>& matches, const char* command) {
+    std::vector<uint64_t> addresses;
+    addresses.reserve(matches.size());
+    for (const search_match& match : matches) {
+        addresses.push_back((uint64_t)match.match_address);
+    }
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+    return cache_result_addresses(ctx, key, addresses, command);
+}
+
+// Prints the addresses grouped by the dumped regions, the same layout as the search results.
+static void print_result_addresses(dump_processing_context* ctx, const std::vector<uint64_t>& addresses) {
+    std::vector<search_match> matches;
+    matches.reserve(addresses.size());
+    for (uint64_t address : addresses) {
+        matches.push_back(search_match{ 0, (const char*)address });
+    }
+    store_last_matches(&ctx->common, matches);
+
+    const uint64_t num_matches = addresses.size();
+    if (!num_matches) {
+        puts("*** No matches found. ***");
+        return;
+    }
+    if (too_many_results(num_matches, output_redirected(&ctx->common))) {
+        return;
+    }
+    printf("*** Total number of matches: %llu ***\n\n", num_matches);
+
+    dump_read_context rctx;
+    if (!init_dump_read_context(ctx, &rctx)) {
+        return;
+    }
+    const MINIDUMP_MEMORY_DESCRIPTOR64* descriptors = rctx.memory_descriptors;
+    const size_t num_descriptors = rctx.rva_offsets.size();
+    size_t prev_region = num_descriptors;
+    for (uint64_t address : addresses) {
+        size_t low = 0, high = num_descriptors;
+        while (low < high) { // first region ending above the address
+            const size_t mid = low + (high - low) / 2;
+            if ((descriptors[mid].StartOfMemoryRange + descriptors[mid].DataSize) <= address) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if ((low < num_descriptors) && (low != prev_region) && (descriptors[low].StartOfMemoryRange <= address)) {
+            print_match_region_header(ctx, descriptors[low]);
+            prev_region = low;
+        }
+        printf("\tMatch at address: 0x%p\n", (const char*)address);
+    }
+    puts("");
+}
+
+static void print_cached_result(dump_processing_context* ctx, const result_entry* entry) {
+    std::vector<uint64_t> addresses; // the entry may be evicted while printing
+    unpack_addresses(entry, &addresses);
+    print_result_addresses(ctx, addresses);
+}
+
+// /in <set>[+-offset] <search>: the new pattern is compared only at the match sites of the result set
+static void refine_cached_result(dump_processing_context* ctx) {
+    const int64_t offset = ctx->common.refine_offset;
+    const pattern_data& pdata = ctx->common.pdata;
+    const result_entry* parent = find_result_set(ctx, ctx->common.refine_set);
+    if (!parent) {
+        return;
+    }
+    if (pdata.op == search_op::so_xref) {
+        puts("/xref can't be used as a predicate.");
+        return;
+    }
+    if (ctx->common.rdata.redirect) {
+        puts(ctx->common.command);
+        puts("");
+    }
+    const uint32_t parent_id = parent->id;
+
+    result_key key;
+    memset(&key, 0, sizeof(key));
+    fill_checkpoint_params(ctx, pdata, &key.params);
+    key.parent_id = parent_id;
+    key.offset = offset;
+    const result_entry* cached = find_cached_result(ctx, key);
+    if (cached) {
+        printf("*** Served from result set #%u ***\n", cached->id);
+        print_cached_result(ctx, cached);
+        return;
+    }
+
+    dump_read_context rctx;
+    if (!init_dump_read_context(ctx, &rctx)) {
+        return;
+    }
+    // the predicate keeps its scope and region filter: a site counts only inside the regions the search would read
+    MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
+    ULONG stream_size = 0;
+    if (!MiniDumpReadDumpStream(ctx->file_base, Memory64ListStream, nullptr, reinterpret_cast<void**>(&memory_list), &stream_size)) {
+        fprintf(stderr, "Failed to read Memory64ListStream.\n");
+        return;
+    }
+    search_context_dump scope_ctx;
+    scope_ctx.memory_list = memory_list;
+    scope_ctx.memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
+    scope_ctx.ctx = ctx;
+    scope_ctx.pdata = &pdata;
+    collect_search_regions(scope_ctx);
+    std::vector<MINIDUMP_MEMORY_DESCRIPTOR64>& regions = scope_ctx.mem_info;
+    std::sort(regions.begin(), regions.end(),
+        [](const MINIDUMP_MEMORY_DESCRIPTOR64& a, const MINIDUMP_MEMORY_DESCRIPTOR64& b) { return a.StartOfMemoryRange < b.StartOfMemoryRange; });
+
+    std::vector<uint64_t> sites;
+    unpack_addresses(parent, &sites);
+    const bool ranged = pdata.scope_type == search_scope_type::mrt_range;
+    const uint64_t range_start = (uint64_t)pdata.range.start;
+    std::vector<uint8_t> bytes((size_t)pdata.pattern_len);
+    std::vector<uint64_t> addresses;
+    for (uint64_t address : sites) {
+        const uint64_t site = address + offset;
+        if (ranged && ((site < range_start) || (site >= (range_start + pdata.range.length)))) {
+            continue;
+        }
+        // a match never crosses the end of its region
+        const auto it = std::upper_bound(regions.begin(), regions.end(), site,
+            [](uint64_t v, const MINIDUMP_MEMORY_DESCRIPTOR64& r) { return v < r.StartOfMemoryRange; });
+        if ((it == regions.begin()) || ((site + bytes.size()) > ((it - 1)->StartOfMemoryRange + (it - 1)->DataSize))) {
+            continue;
+        }
+        if ((copy_dump_memory(&rctx, site, bytes.data(), bytes.size()) == bytes.size())
+            && (0 == memcmp(bytes.data(), pdata.pattern, bytes.size()))) {
+            addresses.push_back(address);
+        }
+    }
+    printf("*** %llu of %llu sites of result set #%u match ***\n", (uint64_t)addresses.size(), (uint64_t)sites.size(), parent_id);
+    const result_entry* entry = cache_result_addresses(ctx, key, addresses, ctx->common.command);
+    if (entry) {
+        printf("*** Result set #%u ***\n", entry->id);
+    }
+    print_result_addresses(ctx, addresses);
+}
+
+static void print_result_set_hexdumps(dump_processing_context* ctx, const std::vector<uint64_t>& addresses) {
+    const result_set_data& rs = ctx->common.rsdata;
+    if (too_many_results(addresses.size(), output_redirected(&ctx->common))) {
+        return;
+    }
+    for (uint64_t address : addresses) {
+        ctx->common.hdata.address = (const uint8_t*)address;
+        ctx->common.hdata.num_to_display = rs.hex_num;
+        ctx->common.hdata.mode = rs.hex_mode;
+        ctx->common.hdata.hex_op.op = hexdump_op::ho_none;
+        print_hexdump_dump(ctx);
+    }
+    puts("");
+}
+
+// rs [union|intersect|minus|shift|name|x(b|w|d|q)] <set>...: the derived sets are cached like the search results,
+// keyed by the operation and the operand ids
+static void result_set_command(dump_processing_context* ctx) {
+    const result_set_data& rs = ctx->common.rsdata;
+    const result_entry* operands[MAX_SET_OPERANDS];
+    for (uint32_t i = 0; i < rs.num_operands; i++) {
+        operands[i] = find_result_set(ctx, rs.operands[i]);
+        if (!operands[i]) {
+            return;
+        }
+    }
+    if (rs.op == rso_name) {
+        for (result_entry* entry : ctx->results.entries) {
+            if (0 == strcmp(entry->name, rs.name)) {
+                memset(entry->name, 0, sizeof(entry->name));
+            }
+        }
+        result_entry* entry = (result_entry*)operands[0];
+        strcpy_s(entry->name, sizeof(entry->name), rs.name);
+        if (g_persist_results) {
+            persist_result_record(&ctx->results, entry, RESULT_RECORD_RENAME);
+        }
+        printf("Result set #%u is named %s.\n", entry->id, entry->name);
+        return;
+    }
+    if (ctx->common.rdata.redirect) {
+        puts(ctx->common.command);
+        puts("");
+    }
+    if ((rs.op == rso_show) || (rs.op == rso_hexdump)) {
+        std::vector<uint64_t> addresses;
+        unpack_addresses(operands[0], &addresses);
+        printf("*** Result set #%u ***\n", operands[0]->id);
+        if (rs.op == rso_show) {
+            print_result_addresses(ctx, addresses);
+        } else {
+            print_result_set_hexdumps(ctx, addresses);
+        }
+        return;
+    }
+
+    uint32_t ids[MAX_SET_OPERANDS];
+    for (uint32_t i = 0; i < rs.num_operands; i++) {
+        ids[i] = operands[i]->id;
+    }
+    if ((rs.op == rso_union) || (rs.op == rso_intersect)) { // commutative, the same sets in any order hit the cache
+        std::sort(ids, ids + rs.num_operands);
+    }
+    result_key key;
+    memset(&key, 0, sizeof(key));
+    key.reserved = (uint32_t)rs.op;
+    key.parent_id = ids[0];
+    key.offset = rs.shift;
+    key.params.pattern_len = rs.num_operands * sizeof(uint32_t);
+    memcpy(key.params.pattern, ids, key.params.pattern_len);
+    key.params.dump_size = ctx->dump_size;
+    const result_entry* cached = find_cached_result(ctx, key);
+    if (cached) {
+        printf("*** Served from result set #%u ***\n", cached->id);
+        print_cached_result(ctx, cached);
+        return;
+    }
+
+    const uint64_t start_tick = GetTickCount64();
+    std::vector<uint64_t> result, operand, tmp;
+    unpack_addresses(operands[0], &result);
+    for (uint32_t i = 1; i < rs.num_operands; i++) {
+        unpack_addresses(operands[i], &operand);
+        switch (rs.op) {
+        case rso_union: union_sets(result, operand, &tmp); break;
+        case rso_intersect: merge_sets_sse<true>(result, operand, &tmp); break;
+        default: merge_sets_sse<false>(result, operand, &tmp); break;
+        }
+        result.swap(tmp);
+    }
+    if (rs.op == rso_shift) {
+        shift_set(result, rs.shift, &tmp);
+        result.swap(tmp);
+    }
+    printf("*** %llu addresses, %llu ms ***\n", (uint64_t)result.size(), GetTickCount64() - start_tick);
+    const result_entry* entry = cache_result_addresses(ctx, key, result, ctx->common.command);
+    if (entry) {
+        printf("*** Result set #%u ***\n", entry->id);
+    }
+    print_result_addresses(ctx, result);
+}
+
+static void list_cached_results(const dump_processing_context* ctx) {
+    if (ctx->results.entries.empty()) {
+        puts("No cached result sets.");
+        return;
+    }
+    for (const result_entry* entry : ctx->results.entries) {
+        printf("#%-4u %-12s Matches: %-10llu Packed: 0x%-8llx", entry->id, entry->name, entry->num_addresses, (uint64_t)entry->packed.size());
+        if (entry->key.parent_id && !entry->key.reserved) {
+            printf(" | In #%u%+lld", entry->key.parent_id, entry->key.offset);
+        }
+        printf(" | %s\n", entry->command);
+    }
+}
+
+static void load_cached_results(dump_processing_context* ctx, const char* dump_path) {
+    result_cache_ctx& rcache = ctx->results;
+    sprintf_s(rcache.persist_path, MAX_PATH, "%s.results.qrc", dump_path);
+    if (!g_persist_results) {
+        return;
+    }
+    HANDLE file = CreateFileA(rcache.persist_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    DWORD read = 0;
+    uint64_t header[4];
+    if (ReadFile(file, header, sizeof(header), &read, NULL) && (read == sizeof(header))
+        && (header[0] == RESULTS_MAGIC) && (header[1] == RESULTS_VERSION) && (header[2] == ctx->dump_size) && (header[3] == ctx->dump_id)) {
+        result_record_header record;
+        while (ReadFile(file, &record, sizeof(record), &read, NULL) && (read == sizeof(record))) {
+            record.name[sizeof(record.name) - 1] = 0;
+            if (record.flags & RESULT_RECORD_RENAME) {
+                for (result_entry* entry : rcache.entries) {
+                    if (0 == strcmp(entry->name, record.name)) {
+                        memset(entry->name, 0, sizeof(entry->name));
+                    }
+                    if (entry->id == record.id) {
+                        memcpy(entry->name, record.name, sizeof(entry->name));
+                    }
+                }
+                continue;
+            }
+            result_entry* entry = new result_entry;
+            entry->id = record.id;
+            entry->key = record.key;
+            entry->num_addresses = record.num_addresses;
+            memcpy(entry->name, record.name, sizeof(entry->name));
+            memcpy(entry->command, record.command, sizeof(entry->command));
+            entry->command[sizeof(entry->command) - 1] = 0;
+            entry->packed.resize((size_t)record.packed_size);
+            bool ok = true;
+            uint8_t* dst = entry->packed.data();
+            uint64_t left = record.packed_size;
+            while (ok && left) {
+                const DWORD chunk = (DWORD)(_min(left, (uint64_t)0x4000000));
+                ok = ReadFile(file, dst, chunk, &read, NULL) && (read == chunk);
+                dst += chunk;
+                left -= chunk;
+            }
+            ok = ok && (record.packed_crc32c == compute_crc32c(entry->packed.data(), entry->packed.size()));
+            if (!ok || !add_cached_result(ctx, entry, false)) {
+                delete entry;
+                break;
+            }
+        }
+        if (!rcache.entries.empty()) {
+            printf("\n%llu cached result set(s) loaded, see lr.\n", (uint64_t)rcache.entries.size());
+        }
+    }
+    CloseHandle(file);
+}
+
+static void free_cached_results(result_cache_ctx* rcache) {
+    for (result_entry* entry : rcache->entries) {
+        mem_budget_unregister(entry->budget_id);
+        delete entry;
+    }
+    rcache->entries.clear();
+    for (int budget_id : rcache->evicted_budget_ids) {
+        mem_budget_unregister(budget_id);
+    }
+    rcache->evicted_budget_ids.clear();
+}
+
+static bool read_dump_memory_cb(const void* read_ctx, const char* address, uint8_t* buffer, size_t size) {
+    return copy_dump_memory((const dump_read_context*)read_ctx, (uint64_t)address, buffer, size) == size;
+}
+
+static bool get_selected_module_name(const dump_processing_context* ctx, WCHAR* module_name) {
+    memset(module_name, 0, MAX_PATH * sizeof(WCHAR));
+#ifdef _UNICODE
+    wcscpy_s(module_name, MAX_PATH, ctx->common.i_data.module_name);
+#elif defined(_MBCS )
+    if (ctx->common.i_data.module_name[0] && !MultiByteToWideChar(CP_UTF8, 0, ctx->common.i_data.module_name, -1, module_name, MAX_PATH)) {
+        fprintf(stderr, "Error converting to wide character string: %s\n", ctx->common.i_data.module_name);
+        return false;
+    }
+#endif
+    return true;
+}
+
+static void verify_dump_modules(const dump_processing_context* ctx) {
+    dump_read_context rctx;
+    WCHAR module_name[MAX_PATH];
+    if (!init_dump_read_context(ctx, &rctx) || !get_selected_module_name(ctx, module_name)) {
+        return;
+    }
+
+    const bool show_selected = (module_name[0] != 0);
+    size_t num_checked = 0, num_modified = 0, num_failed = 0;
+    for (size_t i = 0, num_modules = ctx->m_data.size(); i < num_modules; i++) {
+        const module_data& m = ctx->m_data[i];
+        if (show_selected && !module_name_match(m.name, module_name)) {
+            continue;
+        }
+        // the module has to be present on this machine at the path it was loaded from
+        char file_path[MAX_PATH];
+        if (!WideCharToMultiByte(CP_ACP, 0, m.name, -1, file_path, sizeof(file_path), NULL, NULL)) {
+            fprintf(stderr, "Error converting the module path: %lu\n", GetLastError());
+            num_failed++;
+            continue;
+        }
+        printf("\nModule: %s | Base: 0x%p | Size: 0x%llx\n", file_path, m.base_of_image, m.size_of_image);
+        const int64_t num_diff_bytes = verify_module(file_path, m.base_of_image, m.size_of_image, read_dump_memory_cb, &rctx);
+        num_checked++;
+        if (num_diff_bytes < 0) {
+            num_failed++;
+        } else if (num_diff_bytes > 0) {
+            num_modified++;
+        }
+        if (show_selected) {
+            break;
+        }
+    }
+
+    if (show_selected && !num_checked) {
+        puts("Module not found.");
+        return;
+    }
+    printf("\n*** Modules checked: %llu | Modified: %llu | Failed: %llu ***\n", (uint64_t)num_checked, (uint64_t)num_modified, (uint64_t)num_failed);
+}
+
+struct extract_result {
+    char file_path[MAX_PATH];
+    uint64_t bytes_missing;
+    bool success;
+};
+
+struct extract_context {
+    const dump_processing_context* ctx;
+    const dump_read_context* rctx;
+    const std::vector<const module_data*>* modules;
+    const std::vector<uint8_t>* name_taken; // another selected module has the same file name
+    std::vector<extract_result>* results;
+    std::atomic<size_t> next_module{ 0 };
+};
+
+// The image is written in its memory layout: raw pointers are set to the virtual addresses and the
+// file alignment to the section alignment, so the whole image is a single copy from the dump.
+// The headers are parsed by hand, DbgHelp isn't thread safe and the workers run in parallel.
+static bool fix_image_headers(uint8_t* image, uint64_t size_of_image, const char* base_of_image) {
+    if (size_of_image < sizeof(IMAGE_DOS_HEADER)) {
+        return false;
+    }
+    const IMAGE_DOS_HEADER* dos_header = (const IMAGE_DOS_HEADER*)image;
+    if ((dos_header->e_magic != IMAGE_DOS_SIGNATURE) || (dos_header->e_lfanew < 0)
+        || (((uint64_t)dos_header->e_lfanew + sizeof(IMAGE_NT_HEADERS64)) > size_of_image)) {
+        return false;
+    }
+    PIMAGE_NT_HEADERS64 nt_headers = (PIMAGE_NT_HEADERS64)(image + dos_header->e_lfanew);
+    if ((nt_headers->Signature != IMAGE_NT_SIGNATURE) || (nt_headers->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR64_MAGIC)) {
+        return false;
+    }
+    IMAGE_OPTIONAL_HEADER64& optional_header = nt_headers->OptionalHeader;
+    IMAGE_SECTION_HEADER* sections = IMAGE_FIRST_SECTION(nt_headers);
+    const WORD num_sections = nt_headers->FileHeader.NumberOfSections;
+    if (((uint8_t*)(sections + num_sections) - image) > (int64_t)size_of_image) {
+        return false;
+    }
+    for (WORD i = 0; i < num_sections; i++) {
+        IMAGE_SECTION_HEADER& section = sections[i];
+        const uint64_t next_address = (i + 1 < num_sections) ? sections[i + 1].VirtualAddress : size_of_image;
+        if ((section.VirtualAddress >= size_of_image) || (next_address < section.VirtualAddress)) {
+            section.PointerToRawData = 0;
+            section.SizeOfRawData = 0;
+            continue;
+        }
+        section.PointerToRawData = section.VirtualAddress;
+        section.SizeOfRawData = (DWORD)((_min(next_address, size_of_image)) - section.VirtualAddress);
+    }
+    optional_header.FileAlignment = optional_header.SectionAlignment;
+    optional_header.ImageBase = (ULONGLONG)base_of_image;
+    optional_header.CheckSum = 0;
+    return true;
+}
+
+static void extract_module(const extract_context* ectx, const module_data& m, bool name_taken, extract_result& result) {
+    result.success = false;
+    result.bytes_missing = 0;
+
+    const WCHAR* file_name = wcsrchr(m.name, L'\\');
+    file_name = file_name ? file_name + 1 : m.name;
+    char name[MAX_PATH];
+    if (!WideCharToMultiByte(CP_ACP, 0, file_name, -1, name, sizeof(name), NULL, NULL)) {
+        sprintf_s(result.file_path, MAX_PATH, "0x%p", m.base_of_image);
+        return;
+    }
+    int len;
+    if (name_taken) { // the base address goes before the extension
+        const char* ext = strrchr(name, '.');
+        const int stem_len = ext ? (int)(ext - name) : (int)strlen(name);
+        len = sprintf_s(result.file_path, MAX_PATH, "%s\\%.*s_%llx%s", ectx->ctx->common.i_data.file_path, stem_len, name,
+            (uint64_t)m.base_of_image, ext ? ext : "");
+    } else {
+        len = sprintf_s(result.file_path, MAX_PATH, "%s\\%s", ectx->ctx->common.i_data.file_path, name);
+    }
+    if (0 > len) {
+        result.file_path[0] = 0;
+        return;
+    }
+
+    HANDLE file_handle = CreateFileA(result.file_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    const DWORD high = (DWORD)((m.size_of_image >> 0x20) & 0xFFFFFFFF);
+    const DWORD low = (DWORD)(m.size_of_image & 0xFFFFFFFF);
+    HANDLE mapping_handle = CreateFileMapping(file_handle, NULL, PAGE_READWRITE, high, low, NULL);
+    uint8_t* image = mapping_handle ? (uint8_t*)MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, m.size_of_image) : nullptr;
+    if (image) {
+        // a fresh mapping is zero filled, pages missing in the dump stay zeroed
+        result.bytes_missing = m.size_of_image - copy_dump_memory(ectx->rctx, (uint64_t)m.base_of_image, image, m.size_of_image);
+        result.success = fix_image_headers(image, m.size_of_image, m.base_of_image);
+        UnmapViewOfFile(image);
+    }
+    if (mapping_handle) {
+        CloseHandle(mapping_handle);
+    }
+    CloseHandle(file_handle);
+    if (!result.success) {
+        DeleteFileA(result.file_path);
+    }
+}
+
+static void extract_modules_worker(extract_context* ectx) {
+    const std::vector<const module_data*>& modules = *ectx->modules;
+    while (1) {
+        const size_t i = ectx->next_module++;
+        if (i >= modules.size()) {
+            break;
+        }
+        extract_module(ectx, *modules[i], (*ectx->name_taken)[i] != 0, (*ectx->results)[i]);
+    }
+}
+
+static void extract_modules(const dump_processing_context* ctx) {
+    dump_read_context rctx;
+    WCHAR module_name[MAX_PATH];
+    if (!init_dump_read_context(ctx, &rctx) || !get_selected_module_name(ctx, module_name)) {
+        return;
+    }
+    if (!CreateDirectoryA(ctx->common.i_data.file_path, NULL) && (GetLastError() != ERROR_ALREADY_EXISTS)) {
+        fprintf(stderr, "Failed to create the directory %s: %lu\n", ctx->common.i_data.file_path, GetLastError());
+        return;
+    }
+
+    std::vector<const module_data*> modules;
+    for (size_t i = 0, num_modules = ctx->m_data.size(); i < num_modules; i++) {
+        const module_data& m = ctx->m_data[i];
+        if (module_name[0] && !module_name_match(m.name, module_name)) {
+            continue;
+        }
+        modules.push_back(&m);
+    }
+    if (modules.empty()) {
+        puts("Module not found.");
+        return;
+    }
+
+    // modules loaded from different directories may share a file name
+    std::vector<uint8_t> name_taken(modules.size(), 0);
+    for (size_t i = 0, sz = modules.size(); i < sz; i++) {
+        const WCHAR* name = wcsrchr(modules[i]->name, L'\\');
+        name = name ? name + 1 : modules[i]->name;
+        for (size_t j = i + 1; j < sz; j++) {
+            if (module_name_match(modules[j]->name, name)) {
+                name_taken[i] = name_taken[j] = 1;
+            }
+        }
+    }
+
+    std::vector<extract_result> results(modules.size());
+    extract_context ectx;
+    ectx.ctx = ctx;
+    ectx.rctx = &rctx;
+    ectx.modules = &modules;
+    ectx.name_taken = &name_taken;
+    ectx.results = &results;
+
+    const size_t num_threads = _min(_min(std::thread::hardware_concurrency(), (size_t)g_max_threads), modules.size());
+    std::vector<std::thread> workers; workers.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        workers.push_back(std::thread(extract_modules_worker, &ectx));
+    }
+    for (auto& w : workers) {
+        if (w.joinable()) {
+            w.join();
+        }
+    }
+
+    size_t num_extracted = 0;
+    for (size_t i = 0, sz = modules.size(); i < sz; i++) {
+        const extract_result& result = results[i];
+        if (!result.success) {
+            fprintf(stderr, "Failed to extract the module at 0x%p to %s\n", modules[i]->base_of_image, result.file_path);
+            continue;
+        }
+        num_extracted++;
+        printf("0x%p | Size: 0x%llx | %s", modules[i]->base_of_image, modules[i]->size_of_image, result.file_path);
+        if (result.bytes_missing) {
+            printf(" | 0x%llx byte(s) missing in the dump (zero filled)", result.bytes_missing);
+        }
+        puts("");
+    }
+    printf("\n*** Modules extracted: %llu of %llu ***\n", (uint64_t)num_extracted, (uint64_t)modules.size());
+}
+
+struct carve_range {
+    uint64_t start;
+    uint64_t end;
+};
+
+inline bool carve_range_less(const carve_range& a, const carve_range& b) {
+    return a.start < b.start;
+}
+
+static bool write_file_data(HANDLE file_handle, const char* data, uint64_t size) {
+    constexpr uint64_t max_write_size = 0x4000000;
+    while (size) {
+        const DWORD bytes_to_write = (DWORD)(_min(size, max_write_size));
+        DWORD bytes_written = 0;
+        if (!WriteFile(file_handle, data, bytes_to_write, &bytes_written, NULL) || (bytes_written != bytes_to_write)) {
+            return false;
+        }
+        data += bytes_to_write;
+        size -= bytes_to_write;
+    }
+    return true;
+}
+
+// WriteFile doesn't fault the chunks of a packed dump in, they are copied through a buffer
+static bool write_dump_data(const dump_processing_context* ctx, HANDLE file_handle, uint64_t rva, uint64_t size) {
+    if (!ctx->packed) {
+        return write_file_data(file_handle, (const char*)ctx->file_base + rva, size);
+    }
+    std::vector<char> buffer((size_t)(_min(size, (uint64_t)PACK_CHUNK_SIZE)));
+    while (size) {
+        const size_t bytes_to_write = (size_t)(_min(size, (uint64_t)buffer.size()));
+        memcpy(buffer.data(), (const char*)ctx->file_base + rva, bytes_to_write);
+        if (!write_file_data(file_handle, buffer.data(), bytes_to_write)) {
+            return false;
+        }
+        rva += bytes_to_write;
+        size -= bytes_to_write;
+    }
+    return true;
+}
+
+static bool collect_carve_ranges(const dump_processing_context* ctx, const MINIDUMP_MEMORY64_LIST* memory_list, const MINIDUMP_THREAD_LIST* thread_list, std::vector<carve_range>& ranges) {
+    const carve_data& cvdata = ctx->common.cvdata;
+    const MINIDUMP_MEMORY_DESCRIPTOR64* memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
+    const ULONG64 num_regions = memory_list->NumberOfMemoryRanges;
+
+    if (cvdata.source == carve_source::cs_regions) {
+        MINIDUMP_MEMORY_INFO_LIST* memory_info_list = nullptr;
+        if (region_filter_set(cvdata.filter)) {
+            ULONG stream_size = 0;
+            if (!MiniDumpReadDumpStream(ctx->file_base, MemoryInfoListStream, nullptr, reinterpret_cast<void**>(&memory_info_list), &stream_size)) {
+                fprintf(stderr, "Failed to read MemoryInfoListStream.\n");
+                return false;
+            }
+        }
+        for (ULONG64 i = 0; i < num_regions; i++) {
+            const MINIDUMP_MEMORY_DESCRIPTOR64& mem_desc = memory_descriptors[i];
+            if ((cvdata.scope_type != search_scope_type::mrt_all) && !identify_memory_region_type(cvdata.scope_type, mem_desc, *ctx)) {
+                continue;
+            }
+            if (memory_info_list) {
+                const MINIDUMP_MEMORY_INFO* info = find_memory_info(memory_info_list, mem_desc.StartOfMemoryRange);
+                if (!info || !region_filter_match(cvdata.filter, info->Protect, info->Type, info->State, info->RegionSize)) {
+                    continue;
+                }
+            }
+            ranges.push_back(carve_range{ mem_desc.StartOfMemoryRange, mem_desc.StartOfMemoryRange + mem_desc.DataSize });
+        }
+    } else if (cvdata.source == carve_source::cs_ranges) {
+        for (const search_range& range : cvdata.ranges) {
+            ranges.push_back(carve_range{ (uint64_t)range.start, (uint64_t)range.start + range.length });
+        }
+    } else if (cvdata.source == carve_source::cs_matches) {
+        if (ctx->common.last_matches.empty()) {
+            puts("No search matches to carve.");
+            return false;
+        }
+        const uint64_t pattern_len = (uint64_t)_max(ctx->common.pdata.pattern_len, 1);
+        for (const char* match : ctx->common.last_matches) {
+            const uint64_t address = (uint64_t)match;
+            const uint64_t start = (address > cvdata.context) ? (address - cvdata.context) : 0;
+            ranges.push_back(carve_range{ start, address + pattern_len + cvdata.context });
+        }
+    }
+
+    // stacks are needed to walk the threads
+    if (thread_list) {
+        for (ULONG t = 0; t < thread_list->NumberOfThreads; t++) {
+            const MINIDUMP_MEMORY_DESCRIPTOR& stack = thread_list->Threads[t].Stack;
+            if (stack.Memory.DataSize) {
+                ranges.push_back(carve_range{ stack.StartOfMemoryRange, stack.StartOfMemoryRange + stack.Memory.DataSize });
+            }
+        }
+    }
+
+    std::sort(ranges.begin(), ranges.end(), carve_range_less);
+    size_t num_merged = 0;
+    for (size_t i = 0, sz = ranges.size(); i < sz; i++) {
+        if (num_merged && (ranges[i].start <= ranges[num_merged - 1].end)) {
+            ranges[num_merged - 1].end = _max(ranges[num_merged - 1].end, ranges[i].end);
+        } else {
+            ranges[num_merged++] = ranges[i];
+        }
+    }
+    ranges.resize(num_merged);
+    return true;
+}
+
+// The streams preceding the memory data are copied verbatim, followed by a new Memory64ListStream
+// and the selected memory. The directory entry of the memory list and the thread stack RVAs are patched.
+static void carve_dump(const dump_processing_context* ctx) {
+    const MINIDUMP_HEADER* header = (const MINIDUMP_HEADER*)ctx->file_base;
+    MINIDUMP_DIRECTORY* memory_list_dir = nullptr;
+    MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
+    ULONG stream_size = 0;
+    if (!MiniDumpReadDumpStream(ctx->file_base, Memory64ListStream, &memory_list_dir, reinterpret_cast<void**>(&memory_list), &stream_size)) {
+        fprintf(stderr, "Failed to read Memory64ListStream.\n");
+        return;
+    }
+    MINIDUMP_THREAD_LIST* thread_list = nullptr;
+    if (!MiniDumpReadDumpStream(ctx->file_base, ThreadListStream, nullptr, reinterpret_cast<void**>(&thread_list), &stream_size)) {
+        thread_list = nullptr;
+    }
+
+    const uint64_t prefix_size = memory_list->BaseRva;
+    const MINIDUMP_DIRECTORY* directory = (const MINIDUMP_DIRECTORY*)((const char*)ctx->file_base + header->StreamDirectoryRva);
+    if ((header->StreamDirectoryRva + (uint64_t)header->NumberOfStreams * sizeof(MINIDUMP_DIRECTORY)) > prefix_size) {
+        fprintf(stderr, "Unsupported dump layout: the stream directory is stored after the memory data.\n");
+        return;
+    }
+    for (ULONG32 i = 0; i < header->NumberOfStreams; i++) {
+        if ((directory[i].StreamType != Memory64ListStream) && ((directory[i].Location.Rva + (uint64_t)directory[i].Location.DataSize) > prefix_size)) {
+            fprintf(stderr, "Unsupported dump layout: stream %u is stored after the memory data.\n", directory[i].StreamType);
+            return;
+        }
+    }
+
+    std::vector<carve_range> ranges;
+    if (!collect_carve_ranges(ctx, memory_list, thread_list, ranges)) {
+        return;
+    }
+
+    // intersect the selection with the memory present in the dump
+    const MINIDUMP_MEMORY_DESCRIPTOR64* memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
+    std::vector<MINIDUMP_MEMORY_DESCRIPTOR64> out_descriptors;
+    std::vector<uint64_t> in_offsets;
+    uint64_t rva = memory_list->BaseRva;
+    uint64_t total_size = 0, input_size = 0;
+    size_t r = 0;
+    for (ULONG64 i = 0; i < memory_list->NumberOfMemoryRanges; i++) {
+        const MINIDUMP_MEMORY_DESCRIPTOR64& mem_desc = memory_descriptors[i];
+        const uint64_t desc_end = mem_desc.StartOfMemoryRange + mem_desc.DataSize;
+        while ((r < ranges.size()) && (ranges[r].end <= mem_desc.StartOfMemoryRange)) {
+            r++;
+        }
+        for (size_t k = r; (k < ranges.size()) && (ranges[k].start < desc_end); k++) {
+            const uint64_t start = _max(ranges[k].start, mem_desc.StartOfMemoryRange);
+            const uint64_t end = _min(ranges[k].end, desc_end);
+            if (start >= end) {
+                continue;
+            }
+            out_descriptors.push_back(MINIDUMP_MEMORY_DESCRIPTOR64{ start, end - start });
+            in_offsets.push_back(rva + (start - mem_desc.StartOfMemoryRange));
+            total_size += end - start;
+        }
+        rva += mem_desc.DataSize;
+        input_size += mem_desc.DataSize;
+    }
+    if (out_descriptors.empty()) {
+        puts("No memory selected.");
+        return;
+    }
+
+    const uint64_t out_list_rva = prefix_size;
+    const uint64_t out_list_size = sizeof(MINIDUMP_MEMORY64_LIST) + out_descriptors.size() * sizeof(MINIDUMP_MEMORY_DESCRIPTOR64);
+    const uint64_t out_base_rva = out_list_rva + out_list_size;
+
+    // patch a copy of the prefix
+    std::vector<char> prefix((const char*)ctx->file_base, (const char*)ctx->file_base + prefix_size);
+    MINIDUMP_DIRECTORY* out_memory_list_dir = (MINIDUMP_DIRECTORY*)(prefix.data() + ((const char*)memory_list_dir - (const char*)ctx->file_base));
+    if (out_list_rva > 0xFFFFFFFF) {
+        fprintf(stderr, "Unsupported dump layout: the memory list can't be addressed.\n");
+        return;
+    }
+    out_memory_list_dir->Location.Rva = (RVA)out_list_rva;
+    out_memory_list_dir->Location.DataSize = (ULONG32)out_list_size;
+    if (thread_list) {
+        MINIDUMP_THREAD_LIST* out_thread_list = (MINIDUMP_THREAD_LIST*)(prefix.data() + ((const char*)thread_list - (const char*)ctx->file_base));
+        for (ULONG t = 0; t < out_thread_list->NumberOfThreads; t++) {
+            MINIDUMP_MEMORY_DESCRIPTOR& stack = out_thread_list->Threads[t].Stack;
+            uint64_t stack_rva = out_base_rva;
+            bool found = false;
+            for (const MINIDUMP_MEMORY_DESCRIPTOR64& desc : out_descriptors) {
+                if ((stack.StartOfMemoryRange >= desc.StartOfMemoryRange) && ((stack.StartOfMemoryRange + stack.Memory.DataSize) <= (desc.StartOfMemoryRange + desc.DataSize))) {
+                    stack_rva += stack.StartOfMemoryRange - desc.StartOfMemoryRange;
+                    found = true;
+                    break;
+                }
+                stack_rva += desc.DataSize;
+            }
+            if (found && (stack_rva <= 0xFFFFFFFF)) {
+                stack.Memory.Rva = (RVA)stack_rva;
+            } else {
+                stack.Memory.Rva = 0;
+                stack.Memory.DataSize = 0;
+            }
+        }
+    }
+
+    HANDLE file_handle = CreateFileA(ctx->common.i_data.file_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to create the file %s: %lu\n", ctx->common.i_data.file_path, GetLastError());
+        return;
+    }
+    const MINIDUMP_MEMORY64_LIST out_list = { out_descriptors.size(), out_base_rva };
+    bool success = write_file_data(file_handle, prefix.data(), prefix.size())
+        && write_file_data(file_handle, (const char*)&out_list, sizeof(out_list))
+        && write_file_data(file_handle, (const char*)out_descriptors.data(), out_descriptors.size() * sizeof(MINIDUMP_MEMORY_DESCRIPTOR64));
+    // adjacent ranges are stored back to back in the input too, write them in one go
+    for (size_t i = 0, sz = out_descriptors.size(); success && (i < sz);) {
+        uint64_t size = out_descriptors[i].DataSize;
+        size_t n = i + 1;
+        while ((n < sz) && (in_offsets[n] == (in_offsets[n - 1] + out_descriptors[n - 1].DataSize))) {
+            size += out_descriptors[n].DataSize;
+            n++;
+        }
+        success = write_dump_data(ctx, file_handle, in_offsets[i], size);
+        i = n;
+    }
+    CloseHandle(file_handle);
+    if (!success) {
+        fprintf(stderr, "Failed writing to the file %s: %lu\n", ctx->common.i_data.file_path, GetLastError());
+        DeleteFileA(ctx->common.i_data.file_path);
+        return;
+    }
+
+    printf("Memory ranges: %llu | Memory size: 0x%llx of 0x%llx | File size: 0x%llx\n",
+        (uint64_t)out_descriptors.size(), total_size, input_size, out_base_rva + total_size);
+    printf("*** Written to %s ***\n", ctx->common.i_data.file_path);
+}
+
+static void print_thread_info(const dump_processing_context* ctx) {
+    for (ULONG i = 0, num_threads = ctx->t_data.size(); i < num_threads; i++) {
+        const thread_info_dump& thread = ctx->t_data[i];
+        if (thread.tid != ctx->common.i_data.tid) {
+            continue;
+        }
+        printf("ThreadID: 0x%04x | Priority Class: 0x%04x | Priority: 0x%04x | Stack Base: 0x%p\n\n",
+            thread.tid, thread.priority_class, thread.priority, (char*)thread.stack_base);
+        printf("RAX: 0x%p RBX: 0x%p RCX: 0x%p RDI: 0x%p RSI: 0x%p\n",
+            (char*)thread.context->Rax, (char*)thread.context->Rbx, (char*)thread.context->Rcx, (char*)thread.context->Rdx,
+            (char*)thread.context->Rdi, (char*)thread.context->Rsi);
+        printf("RSP: 0x%p RBP: 0x%p RIP: 0x%p RFLAGS: 0x%04x\t\tMXCSR: 0x%04x\n",
+            (char*)thread.context->Rsp, (char*)thread.context->Rbp, (char*)thread.context->Rip,
+            (char*)thread.context->EFlags, (char*)thread.context->MxCsr);
+        printf("R8:  0x%p R9:  0x%p R10: 0x%p R11: 0x%p\n",
+            (char*)thread.context->R8, (char*)thread.context->R9, (char*)thread.context->R10, (char*)thread.context->R11);
+        printf("R12: 0x%p R13: 0x%p R14: 0x%p R15: 0x%p\n",
+            (char*)thread.context->R11, (char*)thread.context->R12, (char*)thread.context->R13, (char*)thread.context->R14);
+        puts("");
+        break;
+    }
+}
+
+static void list_handle_descriptors(const dump_processing_context* ctx) {
+    MINIDUMP_DIRECTORY* directory;
+    MINIDUMP_HANDLE_DATA_STREAM* handle_stream;
+    ULONG stream_size;
+
+    if (MiniDumpReadDumpStream(ctx->file_base, HandleDataStream, &directory, (void**)&handle_stream, &stream_size)) {
+        printf("Number of handles: %lu\n", handle_stream->NumberOfDescriptors);
+
+        MINIDUMP_HANDLE_DESCRIPTOR_2* handles = (MINIDUMP_HANDLE_DESCRIPTOR_2*)(handle_stream + 1);
+        for (ULONG i = 0; i < handle_stream->NumberOfDescriptors; i++) {
+            printf("Handle: 0x%llx\n", (unsigned long long)handles[i].Handle);
+
+            // Print type name directly
+            MINIDUMP_STRING* type_name_rva = (MINIDUMP_STRING*)((uintptr_t)ctx->file_base + handles[i].TypeNameRva);
+            if (type_name_rva && type_name_rva->Buffer) {
+                printf("Type: %ls", type_name_rva->Buffer);
+                puts("");
+            } else {
+                printf("Type: (null)\n");
+            }
+
+            // Print object name directly
+            MINIDUMP_STRING* object_name_rva = (MINIDUMP_STRING*)((uintptr_t)ctx->file_base + handles[i].ObjectNameRva);
+            if (object_name_rva && object_name_rva->Buffer) {
+                printf("Object Name: %ls", object_name_rva->Buffer);
+                puts("");
+            } else {
+                printf("Object Name: (null)\n");
+            }
+
+            printf("Attributes: 0x%lx\n", handles[i].Attributes);
+            printf("Granted Access: 0x%lx\n", handles[i].GrantedAccess);
+            printf("Handle Count: %lu\n", handles[i].HandleCount);
+            printf("Pointer Count: %lu\n", handles[i].PointerCount);
+            printf("-----------------------\n");
+        }
+    } else {
+        fprintf(stderr, "Failed to read HandleDataStream.\n");
+    }
+    puts("");
+}
+
+static void data_block_calculate(dump_processing_context* ctx) {
+    std::vector<uint8_t> bytes;
+    const uint8_t* address = ctx->common.cdata.address;
+
+    if (region_filter_set(ctx->common.cdata.filter)) {
+        MINIDUMP_MEMORY_INFO_LIST* memory_info_list = nullptr;
+        ULONG stream_size = 0;
+        if (!MiniDumpReadDumpStream(ctx->file_base, MemoryInfoListStream, nullptr, reinterpret_cast<void**>(&memory_info_list), &stream_size)) {
+            fprintf(stderr, "Failed to read MemoryInfoListStream.\n");
+            return;
+        }
+        const MINIDUMP_MEMORY_INFO* info = find_memory_info(memory_info_list, (uint64_t)address);
+        if (!info || !region_filter_match(ctx->common.cdata.filter, info->Protect, info->Type, info->State, info->RegionSize)) {
+            puts("The memory region doesn't match the filter.");
+            return;
+        }
+    }
+
+    if ((ctx->common.cdata.op != calculate_op::co_entropy) && (ctx->common.cdata.op != calculate_op::co_crc32c)) {
+        puts("\n------------------------------------\n");
+        if (!hash_dump_range(ctx, address, ctx->common.cdata.size)) {
+            puts("Address not found in commited memory ranges.");
+        }
+        return;
+    }
+
+    MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
+    ULONG stream_size = 0;
+    if (!MiniDumpReadDumpStream(ctx->file_base, Memory64ListStream, nullptr, reinterpret_cast<void**>(&memory_list), &stream_size)) {
+        fprintf(stderr, "Failed to read Memory64ListStream.\n");
+        return;
+    }
+    puts("\n------------------------------------\n");
+
+    const MINIDUMP_MEMORY_DESCRIPTOR64* memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
+    const size_t num_regions = memory_list->NumberOfMemoryRanges;
+    size_t cumulative_offset = 0;
+
+    for (ULONG i = 0; i < num_regions; ++i) {
+        const MINIDUMP_MEMORY_DESCRIPTOR64& mem_desc = memory_descriptors[i];
+        const SIZE_T region_size = static_cast<SIZE_T>(mem_desc.DataSize);
+        if (((ULONG64)address >= mem_desc.StartOfMemoryRange) && ((ULONG64)address < (mem_desc.StartOfMemoryRange + region_size))) {
+            size_t bytes_to_read = ctx->common.cdata.size;
+            const ULONG64 start_offset = (ULONG64)address - mem_desc.StartOfMemoryRange;
+            bytes_to_read = _min(bytes_to_read, (region_size - start_offset));
+
+            const uint64_t rva_offset = memory_list->BaseRva + cumulative_offset + start_offset;
+            HANDLE file_base = NULL;
+            const char* buffer = (const char*)map_dump_view(ctx, rva_offset, bytes_to_read, &file_base);
+            if (!buffer) {
+                fprintf(stderr, "Empty memory region!\n");
+                return;
+            }
+            bytes.reserve(bytes_to_read);
+            for (int i = 0; i < bytes_to_read; i++) {
+                bytes.push_back(buffer[i]);
+            }
+
+            unmap_dump_view(file_base);
+            break;
+        }
+        cumulative_offset += mem_desc.DataSize;
+    }
+
+    if (0 == bytes.size()) {
+        puts("Address not found in commited memory ranges.");
+        return;
+    }
+
+    data_block_calculate_common(&ctx->common.cdata, bytes.data(), bytes.size());
+}
+
+static bool read_file_data(HANDLE file_handle, char* data, uint64_t size) {
+    constexpr uint64_t max_read_size = 0x4000000;
+    while (size) {
+        const DWORD bytes_to_read = (DWORD)(_min(size, max_read_size));
+        DWORD bytes_read = 0;
+        if (!ReadFile(file_handle, data, bytes_to_read, &bytes_read, NULL) || (bytes_read != bytes_to_read)) {
+            return false;
+        }
+        data += bytes_to_read;
+        size -= bytes_to_read;
+    }
+    return true;
+}
+
+struct sim_match {
+    double similarity;
+    uint64_t address;
+};
+
+inline bool sim_match_less(const sim_match& a, const sim_match& b) {
+    return a.similarity < b.similarity;
+}
+
+inline bool sim_band_entry_less(const sim_band_entry& a, const sim_band_entry& b) {
+    return a.hash < b.hash;
+}
+
+struct sim_window_bands {
+    uint64_t address;
+    uint32_t hashes[SIM_NUM_BANDS];
+};
+
+struct similarity_scan_ctx {
+    const dump_processing_context* ctx;
+    uint64_t query_address;
+    uint64_t window_len;
+    const uint32_t* query_signature;
+    std::vector<dump_memory_range> regions;
+    std::atomic<size_t> next_region{ 0 };
+    bool build_index = false;
+    std::mutex lock;
+    std::vector<sim_match> top;
+    std::vector<sim_window_bands> windows;
+    uint64_t num_windows = 0;
+};
+
+// keeps the SIM_TOP_K most similar windows
+static void add_sim_match(std::vector<sim_match>& top, const sim_match& match) {
+    if (top.size() < SIM_TOP_K) {
+        top.push_back(match);
+        return;
+    }
+    auto worst = std::min_element(top.begin(), top.end(), sim_match_less);
+    if (sim_match_less(*worst, match)) {
+        *worst = match;
+    }
+}
+
+// Windows of the query length start every half window, the last one is aligned to the end of the region,
+// so a copy anywhere in a region overlaps a window by at least three quarters. All-zero windows are skipped.
+static void scan_similar_windows(similarity_scan_ctx* sctx) {
+    const uint64_t window_len = sctx->window_len;
+    const uint64_t stride = window_len / 2;
+    std::vector<sim_match> top;
+    std::vector<sim_window_bands> windows;
+    uint64_t num_windows = 0;
+    uint32_t signature[SIM_NUM_HASHES];
+    for (size_t r = sctx->next_region++; r < sctx->regions.size(); r = sctx->next_region++) {
+        const dump_memory_range& range = sctx->regions[r];
+        HANDLE file_base = NULL;
+        const uint8_t* data = map_dump_view(sctx->ctx, range.rva, range.size, &file_base);
+        if (!data) {
+            continue;
+        }
+        for (uint64_t offset = 0; (offset + window_len) <= range.size; ) {
+            if (!precomputed_zero_range(&sctx->ctx->precompute, range.rva + offset, window_len)) {
+                compute_minhash_signature(data + offset, (size_t)window_len, signature);
+                const uint64_t address = range.address + offset;
+                num_windows++;
+                if (sctx->build_index) {
+                    sim_window_bands w;
+                    w.address = address;
+                    for (size_t b = 0; b < SIM_NUM_BANDS; b++) {
+                        w.hashes[b] = minhash_band_hash(signature, b);
+                    }
+                    windows.push_back(w);
+                }
+                if (!ranges_intersect(address, window_len, sctx->query_address, window_len)) {
+                    add_sim_match(top, sim_match{ minhash_similarity(signature, sctx->query_signature), address });
+                }
+            }
+            if ((offset + window_len) == range.size) {
+                break;
+            }
+            offset = _min(offset + stride, range.size - window_len);
+        }
+        unmap_dump_view(file_base);
+    }
+
+    std::unique_lock<std::mutex> lk(sctx->lock);
+    for (const sim_match& match : top) {
+        add_sim_match(sctx->top, match);
+    }
+    sctx->windows.insert(sctx->windows.end(), windows.begin(), windows.end());
+    sctx->num_windows += num_windows;
+}
+
+static void evict_similarity_index(void* owner) {
+    similarity_index* index = (similarity_index*)owner;
+    index->valid = false;
+    index->windows = std::vector<uint64_t>();
+    for (size_t b = 0; b < SIM_NUM_BANDS; b++) {
+        index->bands[b] = std::vector<sim_band_entry>();
+    }
+}
+
+static uint64_t similarity_index_size(const similarity_index& index) {
+    return index.windows.size() * (sizeof(uint64_t) + SIM_NUM_BANDS * sizeof(sim_band_entry));
+}
+
+static void keep_similarity_index(dump_processing_context* ctx) {
+    similarity_index& index = ctx->sim_index;
+    if (index.budget_id == -1) {
+        index.budget_id = mem_budget_register("similarity index", 0x20, evict_similarity_index, &index);
+    }
+    mem_budget_release(index.budget_id, UINT64_MAX);
+    if (!mem_budget_charge(index.budget_id, similarity_index_size(index))) {
+        evict_similarity_index(&index);
+    }
+}
+
+static void get_similarity_index_path(const dump_processing_context* ctx, char* path) {
+    sprintf_s(path, MAX_PATH, "%s.sim.qsi", ctx->jobs.dump_path);
+}
+
+// header | key | number of windows | window addresses | the entries of every band
+static void persist_similarity_index(const dump_processing_context* ctx) {
+    const similarity_index& index = ctx->sim_index;
+    char path[MAX_PATH];
+    get_similarity_index_path(ctx, path);
+    HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to create %s.\n", path);
+        return;
+    }
+    const uint64_t header[4] = { SIM_INDEX_MAGIC, SIM_INDEX_VERSION, ctx->dump_size, ctx->dump_id };
+    const uint64_t num_windows = index.windows.size();
+    bool ok = write_file_data(file, (const char*)header, sizeof(header))
+        && write_file_data(file, (const char*)&index.key, sizeof(index.key))
+        && write_file_data(file, (const char*)&num_windows, sizeof(num_windows))
+        && write_file_data(file, (const char*)index.windows.data(), num_windows * sizeof(uint64_t));
+    for (size_t b = 0; ok && (b < SIM_NUM_BANDS); b++) {
+        ok = write_file_data(file, (const char*)index.bands[b].data(), num_windows * sizeof(sim_band_entry));
+    }
+    CloseHandle(file);
+    if (!ok) {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        DeleteFileA(path);
+    }
+}
+
+static bool load_similarity_index(dump_processing_context* ctx, const sim_index_key& key) {
+    char path[MAX_PATH];
+    get_similarity_index_path(ctx, path);
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    similarity_index& index = ctx->sim_index;
+    uint64_t header[4];
+    sim_index_key file_key;
+    uint64_t num_windows = 0;
+    bool ok = read_file_data(file, (char*)header, sizeof(header))
+        && (header[0] == SIM_INDEX_MAGIC) && (header[1] == SIM_INDEX_VERSION) && (header[2] == ctx->dump_size) && (header[3] == ctx->dump_id)
+        && read_file_data(file, (char*)&file_key, sizeof(file_key)) && (0 == memcmp(&file_key, &key, sizeof(key)))
+        && read_file_data(file, (char*)&num_windows, sizeof(num_windows)) && (num_windows <= UINT32_MAX);
+    if (ok) {
+        evict_similarity_index(&index);
+        index.windows.resize((size_t)num_windows);
+        ok = read_file_data(file, (char*)index.windows.data(), num_windows * sizeof(uint64_t));
+        for (size_t b = 0; ok && (b < SIM_NUM_BANDS); b++) {
+            index.bands[b].resize((size_t)num_windows);
+            ok = read_file_data(file, (char*)index.bands[b].data(), num_windows * sizeof(sim_band_entry));
+        }
+    }
+    CloseHandle(file);
+    if (!ok) {
+        evict_similarity_index(&index);
+        return false;
+    }
+    index.key = key;
+    index.valid = true;
+    keep_similarity_index(ctx);
+    return index.valid;
+}
+
+static void build_similarity_index(dump_processing_context* ctx, const sim_index_key& key, std::vector<sim_window_bands>& windows) {
+    similarity_index& index = ctx->sim_index;
+    evict_similarity_index(&index);
+    std::sort(windows.begin(), windows.end(), [](const sim_window_bands& a, const sim_window_bands& b) { return a.address < b.address; });
+    index.windows.reserve(windows.size());
+    for (size_t b = 0; b < SIM_NUM_BANDS; b++) {
+        index.bands[b].reserve(windows.size());
+    }
+    for (uint32_t w = 0, sz = (uint32_t)windows.size(); w < sz; w++) {
+        index.windows.push_back(windows[w].address);
+        for (size_t b = 0; b < SIM_NUM_BANDS; b++) {
+            index.bands[b].push_back(sim_band_entry{ windows[w].hashes[b], w });
+        }
+    }
+    for (size_t b = 0; b < SIM_NUM_BANDS; b++) {
+        std::sort(index.bands[b].begin(), index.bands[b].end(), sim_band_entry_less);
+    }
+    index.key = key;
+    index.valid = true;
+    keep_similarity_index(ctx);
+    if (index.valid && g_persist_results) {
+        persist_similarity_index(ctx);
+    }
+}
+
+// the windows sharing at least one band with the query, rescored with their full signatures
+static uint64_t query_similarity_index(dump_processing_context* ctx, const uint32_t* query_signature, std::vector<sim_match>& top) {
+    const similarity_index& index = ctx->sim_index;
+    const uint64_t window_len = index.key.window_len;
+    const uint64_t query_address = (uint64_t)ctx->common.simdata.address;
+    std::vector<uint32_t> candidates;
+    for (size_t b = 0; b < SIM_NUM_BANDS; b++) {
+        const sim_band_entry entry = { minhash_band_hash(query_signature, b), 0 };
+        auto range = std::equal_range(index.bands[b].begin(), index.bands[b].end(), entry, sim_band_entry_less);
+        for (auto it = range.first; it != range.second; ++it) {
+            candidates.push_back(it->window);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    std::vector<uint8_t> bytes((size_t)window_len);
+    uint32_t signature[SIM_NUM_HASHES];
+    for (uint32_t w : candidates) {
+        const uint64_t address = index.windows[w];
+        if (ranges_intersect(address, window_len, query_address, window_len) || (read_dump_range(ctx, address, bytes.data(), bytes.size()) != bytes.size())) {
+            continue;
+        }
+        compute_minhash_signature(bytes.data(), bytes.size(), signature);
+        add_sim_match(top, sim_match{ minhash_similarity(signature, query_signature), address });
+    }
+    mem_budget_touch(index.budget_id);
+    return candidates.size();
+}
+
+// the memory ranges of at least min_size bytes in the scope and matching the filter, by address
+static bool gather_scoped_ranges(const dump_processing_context* ctx, search_scope_type scope_type, const region_filter& filter, uint64_t min_size, std::vector<dump_memory_range>* ranges) {
+    MINIDUMP_MEMORY_INFO_LIST* memory_info_list = nullptr;
+    if (region_filter_set(filter)) {
+        ULONG stream_size = 0;
+        if (!MiniDumpReadDumpStream(ctx->file_base, MemoryInfoListStream, nullptr, reinterpret_cast<void**>(&memory_info_list), &stream_size)) {
+            fprintf(stderr, "Failed to read MemoryInfoListStream, region filters can't be applied.\n");
+            return false;
+        }
+    }
+    for (const dump_memory_range& range : ctx->ranges_by_address) {
+        if (range.size < min_size) {
+            continue;
+        }
+        MINIDUMP_MEMORY_DESCRIPTOR64 mem_desc = { range.address, range.size };
+        if ((scope_type != search_scope_type::mrt_all) && !identify_memory_region_type(scope_type, mem_desc, *ctx)) {
+            continue;
+        }
+        if (memory_info_list) {
+            const MINIDUMP_MEMORY_INFO* info = find_memory_info(memory_info_list, range.address);
+            if (!info || !region_filter_match(filter, info->Protect, info->Type, info->State, range.size)) {
+                continue;
+            }
+        }
+        if (!ranges->empty() && (ranges->back().address == range.address)) {
+            continue; // a range listed twice would be scanned twice and fill the top list with duplicates
+        }
+        ranges->push_back(range);
+    }
+    return true;
+}
+
+static void similarity_search(dump_processing_context* ctx) {
+    const similarity_data& simdata = ctx->common.simdata;
+    const uint64_t window_len = simdata.size;
+    std::vector<uint8_t> query((size_t)window_len);
+    if (read_dump_range(ctx, (uint64_t)simdata.address, query.data(), query.size()) != query.size()) {
+        puts("The block has to lie within a memory region of the dump.");
+        return;
+    }
+    uint32_t query_signature[SIM_NUM_HASHES];
+    compute_minhash_signature(query.data(), query.size(), query_signature);
+
+    if (ctx->common.rdata.redirect) {
+        puts(ctx->common.command);
+        puts("");
+    }
+
+    sim_index_key key;
+    memset(&key, 0, sizeof(key));
+    key.window_len = window_len;
+    key.scope_type = simdata.scope_type;
+    key.filter = simdata.filter;
+    similarity_index& index = ctx->sim_index;
+    bool indexed = index.valid && (0 == memcmp(&index.key, &key, sizeof(key)));
+    if (!indexed && g_persist_results) {
+        indexed = load_similarity_index(ctx, key);
+    }
+
+    std::vector<sim_match> top;
+    if (indexed) {
+        const uint64_t num_candidates = query_similarity_index(ctx, query_signature, top);
+        printf("Indexed windows: %llu | LSH candidates: %llu\n", (uint64_t)index.windows.size(), num_candidates);
+    } else {
+        similarity_scan_ctx sctx;
+        sctx.ctx = ctx;
+        sctx.query_address = (uint64_t)simdata.address;
+        sctx.window_len = window_len;
+        sctx.query_signature = query_signature;
+
+        if (!gather_scoped_ranges(ctx, simdata.scope_type, simdata.filter, window_len, &sctx.regions)) {
+            return;
+        }
+        uint64_t scoped_bytes = 0;
+        for (const dump_memory_range& range : sctx.regions) {
+            scoped_bytes += range.size;
+        }
+        // the index is built on the way if it fits the memory
+        const uint64_t max_windows = 2 * scoped_bytes / window_len + sctx.regions.size();
+        sctx.build_index = (max_windows <= UINT32_MAX) && ((max_windows * (sizeof(sim_window_bands) + sizeof(uint64_t) + SIM_NUM_BANDS * sizeof(sim_band_entry))) < mem_budget_available());
+
+        const size_t num_threads = _min(std::thread::hardware_concurrency(), (unsigned)g_max_threads);
+        std::vector<std::thread> workers; workers.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; i++) {
+            workers.push_back(std::thread(scan_similar_windows, &sctx));
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        printf("Scanned windows: %llu | Regions: %llu\n", sctx.num_windows, (uint64_t)sctx.regions.size());
+        top = sctx.top;
+        if (sctx.build_index) {
+            build_similarity_index(ctx, key, sctx.windows);
+        }
+    }
+
+    std::sort(top.begin(), top.end(), [](const sim_match& a, const sim_match& b) { return a.similarity > b.similarity; });
+    printf("*** The windows of 0x%llx bytes most similar to the block at 0x%p ***\n\n", window_len, simdata.address);
+    for (const sim_match& match : top) {
+        printf("\t0x%p | Similarity: %5.1f%%\n", (const char*)match.address, match.similarity * 100.0);
+    }
+    puts("");
+}
+
+#define HASH_SPAN_SUBTREES 0x100 // blake3 subtrees hashed per task, 16 MiB
 
-#ifdef _UNICODE
-    LPCWSTR module_name = ctx->common.i_data.module_name;
-#elif defined(_MBCS )
-    WCHAR module_name[MAX_PATH];
-    memset(module_name, 0, sizeof(module_name));
-    const int wc_size = MultiByteToWideChar(CP_UTF8, 0, ctx->common.i_data.module_name, -1, NULL, 0);
-    if (wc_size && (wc_size <= _countof(ctx->common.i_data.module_name))) {
-        int result = MultiByteToWideChar(CP_UTF8, 0, ctx->common.i_data.module_name, -1, module_name, wc_size);
-        if (result == 0) {
-            fprintf(stderr, "Error converting to wide character string: %s\n", module_name);
-            return;
-        }
-    } else {
-        fprintf(stderr, "Module name exceeds maximum length: %s\n", module_name);
-        return;
+struct hash_span {
+    size_t region;
+    uint64_t first_subtree;
+    uint64_t num_subtrees;
+};
+
+struct hash_regions_ctx {
+    const dump_processing_context* ctx;
+    calculate_op op;
+    std::vector<dump_memory_range> regions;
+    std::vector<uint64_t> first_cv; // index of the first subtree chaining value of every region
+    std::vector<uint32_t> cvs;
+    std::vector<hash_span> spans;
+    std::vector<uint8_t> digests; // MAX_DIGEST_SIZE per region
+    std::vector<std::atomic<size_t>> digest_sizes; // 0 if the region couldn't be read
+    std::atomic<size_t> next_task{ 0 };
+};
+
+// a packed dump has no mapping of the original file, its reserved range is read directly (see packed_dump)
+static const uint8_t* map_dump_view(const dump_processing_context* ctx, uint64_t rva, uint64_t size, HANDLE* view) {
+    if (ctx->packed) {
+        *view = NULL;
+        return (const uint8_t*)ctx->file_base + rva;
     }
-#endif
+    const uint64_t alloc_granularity = get_alloc_granularity();
+    const uint64_t rva_aligned = rva & ~(alloc_granularity - 1);
+    const uint64_t reminder = rva - rva_aligned;
+    const DWORD high = (DWORD)((rva_aligned >> 0x20) & 0xFFFFFFFF);
+    const DWORD low = (DWORD)(rva_aligned & 0xFFFFFFFF);
+    *view = MapViewOfFile(ctx->file_mapping, FILE_MAP_READ, high, low, (SIZE_T)(size + reminder));
+    return *view ? ((const uint8_t*)*view + reminder) : nullptr;
+}
 
-    for (ULONG i = 0, num_modules = ctx->m_data.size(); i < num_modules; i++) {
-        const module_data& m = ctx->m_data[i];
-        if (nullptr == wcsstr(m.name, module_name)) {
+static void unmap_dump_view(HANDLE view) {
+    if (view) {
+        UnmapViewOfFile(view);
+    }
+}
+
+// blake3: the complete subtrees of the regions, large regions are split into spans shared by the workers
+static void hash_region_spans(hash_regions_ctx* hctx) {
+    for (size_t t = hctx->next_task++; t < hctx->spans.size(); t = hctx->next_task++) {
+        const hash_span& span = hctx->spans[t];
+        const dump_memory_range& range = hctx->regions[span.region];
+        HANDLE view = nullptr;
+        const uint8_t* data = map_dump_view(hctx->ctx, range.rva + span.first_subtree * BLAKE3_SUBTREE_SIZE, span.num_subtrees * BLAKE3_SUBTREE_SIZE, &view);
+        if (!data) {
+            hctx->digest_sizes[span.region] = 0;
             continue;
         }
-        wprintf((LPCWSTR)L"Module name: %s\n", m.name);
-        printf("Base of image: 0x%p | Size of image: 0x%04llx\n\n", m.base_of_image, m.size_of_image);
-        break;
+        uint32_t* cvs = &hctx->cvs[8 * (hctx->first_cv[span.region] + span.first_subtree)];
+        for (uint64_t i = 0; i < span.num_subtrees; i++) {
+            blake3_subtree_cv(data + i * BLAKE3_SUBTREE_SIZE, span.first_subtree + i, cvs + 8 * i);
+        }
+        unmap_dump_view(view);
     }
 }
 
-static void print_thread_info(const dump_processing_context* ctx) {
-    for (ULONG i = 0, num_threads = ctx->t_data.size(); i < num_threads; i++) {
-        const thread_info_dump& thread = ctx->t_data[i];
-        if (thread.tid != ctx->common.i_data.tid) {
+// the digest of every region, for blake3 only the tail is left to hash
+static void hash_region_digests(hash_regions_ctx* hctx) {
+    for (size_t r = hctx->next_task++; r < hctx->regions.size(); r = hctx->next_task++) {
+        if (!hctx->digest_sizes[r]) {
             continue;
         }
-        printf("ThreadID: 0x%04x | Priority Class: 0x%04x | Priority: 0x%04x | Stack Base: 0x%p\n\n",
-            thread.tid, thread.priority_class, thread.priority, (char*)thread.stack_base);
-        printf("RAX: 0x%p RBX: 0x%p RCX: 0x%p RDI: 0x%p RSI: 0x%p\n",
-            (char*)thread.context->Rax, (char*)thread.context->Rbx, (char*)thread.context->Rcx, (char*)thread.context->Rdx,
-            (char*)thread.context->Rdi, (char*)thread.context->Rsi);
-        printf("RSP: 0x%p RBP: 0x%p RIP: 0x%p RFLAGS: 0x%04x\t\tMXCSR: 0x%04x\n",
-            (char*)thread.context->Rsp, (char*)thread.context->Rbp, (char*)thread.context->Rip,
-            (char*)thread.context->EFlags, (char*)thread.context->MxCsr);
-        printf("R8:  0x%p R9:  0x%p R10: 0x%p R11: 0x%p\n",
-            (char*)thread.context->R8, (char*)thread.context->R9, (char*)thread.context->R10, (char*)thread.context->R11);
-        printf("R12: 0x%p R13: 0x%p R14: 0x%p R15: 0x%p\n",
-            (char*)thread.context->R11, (char*)thread.context->R12, (char*)thread.context->R13, (char*)thread.context->R14);
-        puts("");
-        break;
+        const dump_memory_range& range = hctx->regions[r];
+        const uint64_t num_subtrees = (hctx->op == calculate_op::co_blake3) ? blake3_num_subtrees(range.size) : 0;
+        const uint64_t offset = num_subtrees * BLAKE3_SUBTREE_SIZE;
+        HANDLE view = nullptr;
+        const uint8_t* data = map_dump_view(hctx->ctx, range.rva + offset, range.size - offset, &view);
+        if (!data) {
+            hctx->digest_sizes[r] = 0;
+            continue;
+        }
+        uint8_t* digest = &hctx->digests[r * MAX_DIGEST_SIZE];
+        if (hctx->op == calculate_op::co_blake3) {
+            blake3_finalize(&hctx->cvs[8 * hctx->first_cv[r]], num_subtrees, data, (size_t)(range.size - offset), digest);
+        } else {
+            hctx->digest_sizes[r] = compute_digest(hctx->op, data, (size_t)range.size, digest, 1);
+        }
+        unmap_dump_view(view);
     }
 }
 
-static void list_handle_descriptors(const dump_processing_context* ctx) {
-    MINIDUMP_DIRECTORY* directory;
-    MINIDUMP_HANDLE_DATA_STREAM* handle_stream;
-    ULONG stream_size;
-
-    if (MiniDumpReadDumpStream(ctx->file_base, HandleDataStream, &directory, (void**)&handle_stream, &stream_size)) {
-        printf("Number of handles: %lu\n", handle_stream->NumberOfDescriptors);
-
-        MINIDUMP_HANDLE_DESCRIPTOR_2* handles = (MINIDUMP_HANDLE_DESCRIPTOR_2*)(handle_stream + 1);
-        for (ULONG i = 0; i < handle_stream->NumberOfDescriptors; i++) {
-            printf("Handle: 0x%llx\n", (unsigned long long)handles[i].Handle);
-
-            // Print type name directly
-            MINIDUMP_STRING* type_name_rva = (MINIDUMP_STRING*)((uintptr_t)ctx->file_base + handles[i].TypeNameRva);
-            if (type_name_rva && type_name_rva->Buffer) {
-                printf("Type: %ls", type_name_rva->Buffer);
-                puts("");
-            } else {
-                printf("Type: (null)\n");
+static void hash_regions(dump_processing_context* ctx) {
+    const calculate_data& cdata = ctx->common.cdata;
+    hash_regions_ctx hctx;
+    hctx.ctx = ctx;
+    hctx.op = cdata.op;
+    if (!gather_scoped_ranges(ctx, cdata.scope_type, cdata.filter, 1, &hctx.regions)) {
+        return;
+    }
+    const size_t num_regions = hctx.regions.size();
+    hctx.digests.resize(num_regions * MAX_DIGEST_SIZE);
+    hctx.digest_sizes = std::vector<std::atomic<size_t>>(num_regions);
+    for (auto& digest_size : hctx.digest_sizes) {
+        digest_size = (cdata.op == calculate_op::co_blake3) ? 0x20 : 1;
+    }
+    if (cdata.op == calculate_op::co_blake3) {
+        uint64_t num_cvs = 0;
+        hctx.first_cv.reserve(num_regions);
+        for (size_t r = 0; r < num_regions; r++) {
+            const uint64_t num_subtrees = blake3_num_subtrees(hctx.regions[r].size);
+            hctx.first_cv.push_back(num_cvs);
+            for (uint64_t first = 0; first < num_subtrees; first += HASH_SPAN_SUBTREES) {
+                hctx.spans.push_back(hash_span{ r, first, _min((uint64_t)HASH_SPAN_SUBTREES, num_subtrees - first) });
             }
+            num_cvs += num_subtrees;
+        }
+        hctx.cvs.resize((size_t)(num_cvs * 8));
+    }
 
-            // Print object name directly
-            MINIDUMP_STRING* object_name_rva = (MINIDUMP_STRING*)((uintptr_t)ctx->file_base + handles[i].ObjectNameRva);
-            if (object_name_rva && object_name_rva->Buffer) {
-                printf("Object Name: %ls", object_name_rva->Buffer);
-                puts("");
-            } else {
-                printf("Object Name: (null)\n");
-            }
+    if (ctx->common.rdata.redirect) {
+        puts(ctx->common.command);
+        puts("");
+    }
 
-            printf("Attributes: 0x%lx\n", handles[i].Attributes);
-            printf("Granted Access: 0x%lx\n", handles[i].GrantedAccess);
-            printf("Handle Count: %lu\n", handles[i].HandleCount);
-            printf("Pointer Count: %lu\n", handles[i].PointerCount);
-            printf("-----------------------\n");
+    const size_t num_threads = _min(std::thread::hardware_concurrency(), (unsigned)g_max_threads);
+    auto run_workers = [&](void (*fn)(hash_regions_ctx*)) {
+        hctx.next_task = 0;
+        std::vector<std::thread> workers; workers.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; i++) {
+            workers.push_back(std::thread(fn, &hctx));
         }
-    } else {
-        fprintf(stderr, "Failed to read HandleDataStream.\n");
+        for (auto& w : workers) {
+            w.join();
+        }
+    };
+    if (!hctx.spans.empty()) {
+        run_workers(hash_region_spans);
     }
-    puts("");
+    run_workers(hash_region_digests);
+
+    uint64_t total_size = 0;
+    printf("*** %s of the memory regions ***\n\n", calculate_op_name(cdata.op));
+    for (size_t r = 0; r < num_regions; r++) {
+        const dump_memory_range& range = hctx.regions[r];
+        printf("\t0x%p | Size: 0x%llx | ", (const char*)range.address, range.size);
+        if (hctx.digest_sizes[r]) {
+            print_digest(&hctx.digests[r * MAX_DIGEST_SIZE], hctx.digest_sizes[r]);
+            puts("");
+        } else {
+            puts("not readable");
+        }
+        total_size += range.size;
+    }
+    printf("\nRegions: %llu | Total size: 0x%llx\n\n", (uint64_t)num_regions, total_size);
 }
 
-static void data_block_calculate(dump_processing_context* ctx) {
-    std::vector<uint8_t> bytes;
-    const uint8_t* address = ctx->common.cdata.address;
-
-    MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
-    ULONG stream_size = 0;
-    if (!MiniDumpReadDumpStream(ctx->file_base, Memory64ListStream, nullptr, reinterpret_cast<void**>(&memory_list), &stream_size)) {
-        fprintf(stderr, "Failed to read Memory64ListStream.\n");
-        return;
+// Hashes the captured memory from address on without a copy, continuing over the adjacent memory ranges
+// which are adjacent in the file too. Returns the number of bytes hashed, clamped at the first gap.
+static uint64_t hash_dump_range(dump_processing_context* ctx, const uint8_t* address, uint64_t size) {
+    const auto& ranges = ctx->ranges_by_address;
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), (uint64_t)address,
+        [](uint64_t addr, const dump_memory_range& range) { return addr < range.address; });
+    if (it == ranges.begin()) {
+        return 0;
     }
-    puts("\n------------------------------------\n");
-
-    const MINIDUMP_MEMORY_DESCRIPTOR64* memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
-    const uint64_t alloc_granularity = get_alloc_granularity();
-    const size_t num_regions = memory_list->NumberOfMemoryRanges;
-    size_t cumulative_offset = 0;
-
-    for (ULONG i = 0; i < num_regions; ++i) {
-        const MINIDUMP_MEMORY_DESCRIPTOR64& mem_desc = memory_descriptors[i];
-        const SIZE_T region_size = static_cast<SIZE_T>(mem_desc.DataSize);
-        if (((ULONG64)address >= mem_desc.StartOfMemoryRange) && ((ULONG64)address < (mem_desc.StartOfMemoryRange + region_size))) {
-            size_t bytes_to_read = ctx->common.cdata.size;
-            const ULONG64 start_offset = (ULONG64)address - mem_desc.StartOfMemoryRange;
-            bytes_to_read = _min(bytes_to_read, (region_size - start_offset));
-
-            const uint64_t rva_offset = memory_list->BaseRva + cumulative_offset + start_offset;
-            uint64_t rva_offset_aligned = rva_offset & ~(alloc_granularity - 1);
-            uint64_t reminder = rva_offset - rva_offset_aligned;
-            const size_t bytes_to_map = bytes_to_read + reminder;
-            const DWORD high = (DWORD)((rva_offset_aligned >> 0x20) & 0xFFFFFFFF);
-            const DWORD low = (DWORD)(rva_offset_aligned & 0xFFFFFFFF);
-            HANDLE file_base = MapViewOfFile(ctx->file_mapping, FILE_MAP_READ, high, low, bytes_to_map);
-            const char* buffer = ((const char*)file_base + reminder);
-            if (!buffer) {
-                UnmapViewOfFile(file_base);
-                fprintf(stderr, "Empty memory region!\n");
-                return;
-            }
-            bytes.reserve(bytes_to_read);
-            for (int i = 0; i < bytes_to_read; i++) {
-                bytes.push_back(buffer[i]);
-            }
-
-            UnmapViewOfFile(file_base);
+    --it;
+    if ((uint64_t)address >= (it->address + it->size)) {
+        return 0;
+    }
+    const uint64_t rva = it->rva + ((uint64_t)address - it->address);
+    uint64_t available = it->address + it->size - (uint64_t)address;
+    for (auto next = it + 1; (available < size) && (next != ranges.end()); ++next) {
+        const dump_memory_range& prev = *(next - 1);
+        if ((next->address != (prev.address + prev.size)) || (next->rva != (prev.rva + prev.size))) {
             break;
         }
-        cumulative_offset += mem_desc.DataSize;
+        available += next->size;
+    }
+    const uint64_t length = _min(size, available);
+    HANDLE view = nullptr;
+    const uint8_t* data = map_dump_view(ctx, rva, length, &view);
+    if (!data) {
+        fprintf(stderr, "Failed to map the block: %lu\n", GetLastError());
+        return 0;
     }
+    calculate_data cdata = ctx->common.cdata;
+    cdata.address = address;
+    data_block_calculate_common(&cdata, (uint8_t*)data, (size_t)length);
+    unmap_dump_view(view);
+    return length;
+}
 
-    if (0 == bytes.size()) {
-        puts("Address not found in commited memory ranges.");
+static void hash_module(dump_processing_context* ctx) {
+    WCHAR module_name[MAX_PATH];
+    if (!get_selected_module_name(ctx, module_name)) {
         return;
     }
-
-    data_block_calculate_common(&ctx->common.cdata, bytes.data(), bytes.size());
+    if (ctx->common.rdata.redirect) {
+        puts(ctx->common.command);
+        puts("");
+    }
+    size_t num_hashed = 0;
+    for (const module_data& m : ctx->m_data) {
+        if (!module_name_match(m.name, module_name)) {
+            continue;
+        }
+        wprintf((LPCWSTR)L"Module name: %s\n", m.name);
+        const uint64_t hashed = hash_dump_range(ctx, (const uint8_t*)m.base_of_image, m.size_of_image);
+        if (!hashed) {
+            puts("The image is not in the dump.\n");
+        } else if (hashed < m.size_of_image) {
+            printf("The image is not fully captured, only the first 0x%llx of 0x%llx bytes are hashed.\n\n", hashed, (uint64_t)m.size_of_image);
+        }
+        num_hashed++;
+    }
+    if (!num_hashed) {
+        puts("Module not found.");
+    }
 }
 
 static bool init_symbols(dump_processing_context* ctx) {
@@ -1489,6 +5320,14 @@ void symbol_set_path(const dump_processing_context* ctx) {
     reload_modules(ctx);
 }
 
+static void init_residency_map(residency_map* residency, uint64_t file_size) {
+    residency->threads_from_cmdline = (g_max_threads != INVALID_THREAD_NUM);
+    residency->chunk_size = get_alloc_granularity() * g_num_alloc_blocks;
+    residency->num_chunks = (size_t)((file_size + residency->chunk_size - 1) / residency->chunk_size);
+    residency->touched = std::vector<std::atomic<uint64_t>>(residency->num_chunks); // value initialized to 0
+    residency->released = std::vector<std::atomic<uint8_t>>(residency->num_chunks);
+}
+
 static bool is_drive_ssd(const char* file_path) {
     char volume_path[MAX_PATH] = {0};
 
@@ -1537,8 +5376,10 @@ static DWORD get_page_size() {
     return system_info.dwPageSize;
 }
 
-static void cache_memory_regions(dump_processing_context* ctx) {
+// Touches the pages of the blocks whose file stripe belongs to the node, so first touch places them in that node's memory
+static void cache_node_memory_regions(dump_processing_context* ctx, uint32_t node, uint32_t num_nodes) {
     const DWORD page_size = get_page_size();
+    pin_thread_to_numa_node(node);
 
     MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
     ULONG stream_size = 0;
@@ -1554,6 +5395,7 @@ static void cache_memory_regions(dump_processing_context* ctx) {
     size_t cumulative_offset = 0;
 
     const size_t block_size = alloc_granularity * g_num_alloc_blocks;
+    const uint64_t stripe_size = block_size * NUMA_STRIPE_BLOCKS;
 
     for (ULONG i = 0; i < num_regions; ++i) {
         const MINIDUMP_MEMORY_DESCRIPTOR64& mem_desc = memory_descriptors[i];
@@ -1578,8 +5420,19 @@ static void cache_memory_regions(dump_processing_context* ctx) {
 
             const DWORD high = (DWORD)((offset_aligned >> 0x20) & 0xFFFFFFFF);
             const DWORD low = (DWORD)(offset_aligned & 0xFFFFFFFF);
+            const uint64_t block_rva = offset_aligned + reminder;
             offset_aligned += block_size;
 
+            while (ctx->pages_caching_state.paused && !ctx->pages_caching_state.interrupt) {
+                Sleep(1);
+            }
+            // another node's stripe, read by a search already or released by one (-u)
+            if ((numa_node_of_offset(block_rva, stripe_size, num_nodes) != node) || is_resident(ctx->residency, block_rva, bytes_to_read, UINT64_MAX)
+                || is_released(ctx->residency, block_rva, bytes_to_read)) {
+                reminder = 0;
+                continue;
+            }
+
             HANDLE file_base = MapViewOfFile(ctx->file_mapping, FILE_MAP_READ, high, low, bytes_to_map);
             if (!file_base) {
                 fprintf(stderr, "Failed to map view of file.\n");
@@ -1592,6 +5445,7 @@ static void cache_memory_regions(dump_processing_context* ctx) {
             }
 
             UnmapViewOfFile(file_base);
+            mark_resident(ctx->residency, block_rva, bytes_to_read);
             reminder = 0;
 
             if (ctx->pages_caching_state.interrupt) {
@@ -1599,30 +5453,32 @@ static void cache_memory_regions(dump_processing_context* ctx) {
             }
         }
     }
-
-    ctx->pages_caching_state.ready = 1;
 }
 
-static void wait_for_memory_regions_caching(cache_memory_regions_ctx* ctx) {
-    if (g_disable_page_caching || ctx->ready) {
-        return;
+static void cache_memory_regions(dump_processing_context* ctx) {
+    const size_t num_threads = _min(std::thread::hardware_concurrency(), (unsigned)g_max_threads);
+    const uint32_t num_nodes = get_num_numa_nodes(num_threads);
+
+    std::vector<std::thread> helpers; helpers.reserve(num_nodes - 1);
+    for (uint32_t n = 1; n < num_nodes; n++) {
+        helpers.push_back(std::thread(cache_node_memory_regions, ctx, n, num_nodes));
     }
-    
-    printf("Caching memory regions..");
-    int line_counter = 0;
-    int dot_counter = 0;
-    while (!ctx->ready) {
-        if (dot_counter++ > NEXT_DOT_INTERVAL) {
-            printf(".");
-            dot_counter = 0;
-            if (line_counter++ > NUM_WAITING_DOTS) {
-                puts("");
-                line_counter = 0;
-            }
-        }
-        Sleep(WAIT_FOR_MS);
+    cache_node_memory_regions(ctx, 0, num_nodes);
+    for (auto& t : helpers) {
+        t.join();
+    }
+
+    if (!ctx->pages_caching_state.interrupt) {
+        ctx->pages_caching_state.ready = 1;
     }
-    puts("\n");
+}
+
+static void pause_memory_regions_caching(cache_memory_regions_ctx* ctx) {
+    ctx->paused = 1;
+}
+
+static void resume_memory_regions_caching(cache_memory_regions_ctx* ctx) {
+    ctx->paused = 0;
 }
 
 static void stop_memory_regions_caching(cache_memory_regions_ctx* ctx, std::thread& t) {
@@ -1632,6 +5488,244 @@ static void stop_memory_regions_caching(cache_memory_regions_ctx* ctx, std::thre
     }
 }
 
+static void precompute_page(precompute_ctx* pctx, uint64_t page, const uint8_t* data, size_t size) {
+    bool zero = true;
+    for (size_t i = 0; zero && (i < size); i += sizeof(__m128i)) {
+        const __m128i xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        zero = (_mm_movemask_epi8(_mm_cmpeq_epi8(xmm0, _mm_setzero_si128())) == 0xFFFF);
+    }
+    if (zero) {
+        pctx->zero_pages[page >> 6] |= (1ULL << (page & 0x3F));
+        return; // crc, entropy and pointers of a zero page are implied
+    }
+    pctx->page_crc[page] = compute_crc32c(data, size);
+
+    entropy_context e_ctx;
+    entropy_init(&e_ctx);
+    entropy_calculate_frequencies(&e_ctx, data, size);
+    pctx->page_entropy[page] = (uint8_t)(entropy_compute(&e_ctx, size) * 0x1F);
+
+    const auto& regions = pctx->sorted_regions;
+    const uint64_t min_address = regions.front().StartOfMemoryRange;
+    const uint64_t max_address = regions.back().StartOfMemoryRange + regions.back().DataSize;
+    uint32_t num_pointers = 0;
+    for (size_t i = 0; (i + sizeof(uint64_t)) <= size; i += sizeof(uint64_t)) {
+        const uint64_t value = *(const uint64_t*)(data + i);
+        if ((value < min_address) || (value >= max_address)) {
+            continue;
+        }
+        size_t low = 0, high = regions.size();
+        while (low < high) {
+            const size_t mid = low + (high - low) / 2;
+            if (regions[mid].StartOfMemoryRange <= value) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        num_pointers += (low && (value < (regions[low - 1].StartOfMemoryRange + regions[low - 1].DataSize)));
+    }
+    pctx->page_pointers[page] = (uint16_t)(_min(num_pointers, 0xFFFF));
+}
+
+// returns false when asked to exit
+static bool precompute_checkpoint(precompute_ctx* pctx) {
+    std::unique_lock<std::mutex> lk(pctx->mtx);
+    if (pctx->pause) {
+        pctx->paused = true;
+        pctx->cv.notify_all();
+        pctx->cv.wait(lk, [pctx] { return !pctx->pause || pctx->exit; });
+        pctx->paused = false;
+    }
+    return !pctx->exit;
+}
+
+static void precompute(dump_processing_context* ctx) {
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN); // lowers the I/O priority as well
+    precompute_ctx* pctx = &ctx->precompute;
+    const uint64_t alloc_granularity = get_alloc_granularity();
+    const uint64_t block_size = PRECOMPUTE_PAGE_SIZE * PRECOMPUTE_BLOCK_PAGES;
+
+    while (pctx->cursor_region < pctx->regions.size()) {
+        const uint64_t r = pctx->cursor_region;
+        const MINIDUMP_MEMORY_DESCRIPTOR64& region = pctx->regions[r];
+        const uint64_t offset = pctx->cursor_page * PRECOMPUTE_PAGE_SIZE;
+        if (offset >= region.DataSize) {
+            pctx->cursor_region++;
+            pctx->cursor_page = 0;
+            continue;
+        }
+        if (!precompute_checkpoint(pctx)) {
+            return;
+        }
+
+        // map our own view, the dump view is replaced while searching
+        const uint64_t bytes_to_read = _min(block_size, region.DataSize - offset);
+        const uint64_t rva_offset = pctx->rva_offsets[r] + offset;
+        const uint64_t rva_offset_aligned = rva_offset & ~(alloc_granularity - 1);
+        const uint64_t reminder = rva_offset - rva_offset_aligned;
+        const DWORD high = (DWORD)((rva_offset_aligned >> 0x20) & 0xFFFFFFFF);
+        const DWORD low = (DWORD)(rva_offset_aligned & 0xFFFFFFFF);
+        void* view = MapViewOfFile(ctx->file_mapping, FILE_MAP_READ, high, low, bytes_to_read + reminder);
+        if (view) {
+            const uint8_t* data = (const uint8_t*)view + reminder;
+            for (uint64_t p = 0; (p * PRECOMPUTE_PAGE_SIZE) < bytes_to_read; p++) {
+                const size_t size = (size_t)(_min((uint64_t)PRECOMPUTE_PAGE_SIZE, bytes_to_read - p * PRECOMPUTE_PAGE_SIZE));
+                precompute_page(pctx, pctx->first_page[r] + pctx->cursor_page + p, data + p * PRECOMPUTE_PAGE_SIZE, size);
+            }
+            UnmapViewOfFile(view);
+        }
+        pctx->cursor_page += (bytes_to_read + PRECOMPUTE_PAGE_SIZE - 1) / PRECOMPUTE_PAGE_SIZE;
+        pctx->num_pages_done = pctx->first_page[r] + pctx->cursor_page;
+    }
+    std::unique_lock<std::mutex> lk(pctx->mtx); // a pause may be waiting for us
+    pctx->num_pages_done = pctx->num_pages;
+    pctx->cv.notify_all();
+}
+
+static void start_precompute(dump_processing_context* ctx) {
+    if (ctx->packed) {
+        return; // the index knows the zero chunks, a full pass would decode the whole container
+    }
+    MINIDUMP_MEMORY64_LIST* memory_list = nullptr;
+    ULONG stream_size = 0;
+    if (!MiniDumpReadDumpStream(ctx->file_base, Memory64ListStream, nullptr, reinterpret_cast<void**>(&memory_list), &stream_size)
+        || !memory_list->NumberOfMemoryRanges) {
+        return;
+    }
+    precompute_ctx* pctx = &ctx->precompute;
+    const MINIDUMP_MEMORY_DESCRIPTOR64* memory_descriptors = (MINIDUMP_MEMORY_DESCRIPTOR64*)((char*)(memory_list)+sizeof(MINIDUMP_MEMORY64_LIST));
+    pctx->regions.assign(memory_descriptors, memory_descriptors + memory_list->NumberOfMemoryRanges);
+    uint64_t rva_offset = memory_list->BaseRva;
+    for (const MINIDUMP_MEMORY_DESCRIPTOR64& region : pctx->regions) {
+        pctx->rva_offsets.push_back(rva_offset);
+        pctx->first_page.push_back(pctx->num_pages);
+        rva_offset += region.DataSize;
+        pctx->num_pages += (region.DataSize + PRECOMPUTE_PAGE_SIZE - 1) / PRECOMPUTE_PAGE_SIZE;
+
+        region_class rc = rc_other;
+        if (identify_memory_region_type(search_scope_type::mrt_image, region, *ctx)) {
+            rc = rc_image;
+        } else if (identify_memory_region_type(search_scope_type::mrt_stack, region, *ctx)) {
+            rc = rc_stack;
+        }
+        pctx->region_class.push_back((uint8_t)rc);
+    }
+    pctx->sorted_regions = pctx->regions;
+    std::sort(pctx->sorted_regions.begin(), pctx->sorted_regions.end(),
+        [](const MINIDUMP_MEMORY_DESCRIPTOR64& a, const MINIDUMP_MEMORY_DESCRIPTOR64& b) { return a.StartOfMemoryRange < b.StartOfMemoryRange; });
+
+    const uint64_t bitmap_size = ((pctx->num_pages + 0x3F) / 0x40) * sizeof(uint64_t);
+    const uint64_t storage_size = bitmap_size + pctx->num_pages * (sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t));
+    pctx->budget_id = mem_budget_register("precomputed page data", 0x10, nullptr, nullptr);
+    if (!mem_budget_charge(pctx->budget_id, storage_size)) {
+        mem_budget_unregister(pctx->budget_id);
+        pctx->budget_id = -1;
+        return;
+    }
+    pctx->storage.resize(storage_size, 0);
+    uint8_t* storage = pctx->storage.data();
+    pctx->zero_pages = (uint64_t*)storage;
+    pctx->page_crc = (uint32_t*)(storage + bitmap_size);
+    pctx->page_pointers = (uint16_t*)(storage + bitmap_size + pctx->num_pages * sizeof(uint32_t));
+    pctx->page_entropy = storage + bitmap_size + pctx->num_pages * (sizeof(uint32_t) + sizeof(uint16_t));
+    pctx->worker = std::thread(precompute, ctx);
+}
+
+// blocks until the worker reaches its next checkpoint
+static void pause_precompute(precompute_ctx* pctx) {
+    if (!pctx->worker.joinable()) {
+        return;
+    }
+    // the worker stops at its next block, a command never competes with it for the disk
+    std::unique_lock<std::mutex> lk(pctx->mtx);
+    pctx->pause = true;
+    pctx->cv.wait(lk, [pctx] { return pctx->paused || (pctx->num_pages_done == pctx->num_pages); });
+}
+
+static void resume_precompute(precompute_ctx* pctx) {
+    std::unique_lock<std::mutex> lk(pctx->mtx);
+    pctx->pause = false;
+    pctx->cv.notify_all();
+}
+
+static void stop_precompute(precompute_ctx* pctx) {
+    {
+        std::unique_lock<std::mutex> lk(pctx->mtx);
+        pctx->exit = true;
+        pctx->cv.notify_all();
+    }
+    if (pctx->worker.joinable()) {
+        pctx->worker.join();
+    }
+    mem_budget_unregister(pctx->budget_id);
+}
+
+static bool precomputed_zero_range(const precompute_ctx* pctx, uint64_t rva, uint64_t size) {
+    if (packed_zero_range(rva, size)) {
+        return true;
+    }
+    // rva offsets grow with the region index
+    const auto it = std::upper_bound(pctx->rva_offsets.begin(), pctx->rva_offsets.end(), rva);
+    if ((it == pctx->rva_offsets.begin()) || !size) {
+        return false;
+    }
+    const uint64_t region = (it - pctx->rva_offsets.begin()) - 1;
+    const uint64_t offset = rva - pctx->rva_offsets[region];
+    if ((offset + size) > pctx->regions[region].DataSize) {
+        return false;
+    }
+    const uint64_t first = pctx->first_page[region] + offset / PRECOMPUTE_PAGE_SIZE;
+    const uint64_t last = pctx->first_page[region] + (offset + size - 1) / PRECOMPUTE_PAGE_SIZE;
+    if (last >= pctx->num_pages_done) {
+        return false;
+    }
+    for (uint64_t p = first; p <= last; p++) {
+        if (!(pctx->zero_pages[p >> 6] & (1ULL << (p & 0x3F)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_precomputed_info(const precompute_ctx* pctx, uint64_t address) {
+    const auto& regions = pctx->regions;
+    for (size_t r = 0, sz = regions.size(); r < sz; r++) {
+        if ((address < regions[r].StartOfMemoryRange) || (address >= (regions[r].StartOfMemoryRange + regions[r].DataSize))) {
+            continue;
+        }
+        static const char* region_classes[] = { "Other", "Image", "Stack" };
+        const uint64_t first = pctx->first_page[r];
+        const uint64_t end = (r + 1 < sz) ? pctx->first_page[r + 1] : pctx->num_pages;
+        const uint64_t done = _min(end, (_max(first, pctx->num_pages_done.load())));
+        uint64_t num_zero = 0, num_pointers = 0, entropy_sum = 0;
+        for (uint64_t p = first; p < done; p++) {
+            if (pctx->zero_pages[p >> 6] & (1ULL << (p & 0x3F))) {
+                num_zero++;
+            }
+            num_pointers += pctx->page_pointers[p];
+            entropy_sum += pctx->page_entropy[p];
+        }
+        const uint64_t page = first + (address - regions[r].StartOfMemoryRange) / PRECOMPUTE_PAGE_SIZE;
+        printf("Dumped range: 0x%p | Size: 0x%llx | Class: %s | Precomputed pages: %llu of %llu\n",
+            (const char*)regions[r].StartOfMemoryRange, regions[r].DataSize, region_classes[pctx->region_class[r]], done - first, end - first);
+        if (done > first) {
+            printf("Zero pages: %llu | Pointers: %llu | Average page entropy: %.2f\n",
+                num_zero, num_pointers, (double)entropy_sum / (double)(done - first) / 0x1F);
+        }
+        if (page < done) {
+            const char* page_address = (const char*)(address & ~(uint64_t)(PRECOMPUTE_PAGE_SIZE - 1));
+            if (pctx->zero_pages[page >> 6] & (1ULL << (page & 0x3F))) {
+                printf("Page 0x%p: zero filled\n", page_address);
+            } else {
+                printf("Page 0x%p: CRC32C: 0x%08x | Entropy: %.2f | Pointers: %u\n",
+                    page_address, pctx->page_crc[page], (double)pctx->page_entropy[page] / 0x1F, pctx->page_pointers[page]);
+            }
+        }
+        break;
+    }
+}
+
 static bool is_elevated() {
     HANDLE token = nullptr;
     TOKEN_ELEVATION elevation;
@@ -0,0 +1,799 @@
+#include "common.h"
+
+// Raw guest physical memory images: QEMU dump-guest-memory ELF cores or flat .mem files.
+// Virtual addresses are resolved by walking the x86-64 page tables of the given CR3.
+
+#define ELF_MAGIC 0x464c457f // "\x7fELF"
+#define ELF_CLASS_64 2
+#define ELF_PT_LOAD 1
+
+#define GUEST_TLB_SIZE 0x200 // power of 2
+#define GUEST_PAGE_SIZE 0x1000ULL
+#define GUEST_PTE_PRESENT (1ULL << 0)
+#define GUEST_PTE_WRITE (1ULL << 1)
+#define GUEST_PTE_USER (1ULL << 2)
+#define GUEST_PTE_LARGE (1ULL << 7)
+#define GUEST_PTE_NX (1ULL << 63)
+#define GUEST_PTE_ADDRESS_MASK 0x000FFFFFFFFFF000ULL
+
+struct elf64_header {
+    uint8_t ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint64_t entry;
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+};
+
+struct elf64_program_header {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t align;
+};
+
+enum guest_page_flags {
+    gp_none = 0,
+    gp_write = 1 << 0,
+    gp_user = 1 << 1,
+    gp_execute = 1 << 2,
+};
+
+struct guest_phys_range {
+    uint64_t phys_start;
+    uint64_t size;
+    uint64_t file_offset;
+};
+
+// virtually and file contiguous run of mappings with the same access flags
+struct guest_region {
+    uint64_t va;
+    uint64_t size;
+    uint64_t file_offset;
+    uint32_t flags;
+};
+
+struct guest_tlb_entry {
+    uint64_t va_page; // va & ~page_mask, ~0 - invalid (never matches, the masked va has its low bits clear)
+    uint64_t file_offset; // of the page start
+    uint64_t page_mask;
+    uint32_t flags;
+};
+
+struct guest_processing_context {
+    common_processing_context common;
+    HANDLE file_handle;
+    HANDLE file_mapping;
+    const uint8_t* file_base;
+    uint64_t file_size;
+    uint64_t cr3;
+    int paging_levels;
+    std::vector<guest_phys_range> phys_ranges;
+    std::vector<guest_region> regions;
+    guest_tlb_entry tlb[GUEST_TLB_SIZE];
+    uint64_t tlb_hits;
+    uint64_t tlb_misses;
+};
+
+struct guest_search_block {
+    uint64_t region_id;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct search_context_guest {
+    search_context_common common;
+    const guest_processing_context* ctx;
+    std::vector<guest_search_block> blocks;
+    std::atomic<size_t> next_block{ 0 };
+};
+
+static void print_help_main();
+static void print_help_search();
+static void print_help_redirect();
+static void print_help_hexdump();
+static void print_help_list();
+static void print_help_inspect();
+static void print_help_calculate();
+static input_command parse_command(guest_processing_context* ctx, search_data_info* data, char* pattern);
+static void execute_command(input_command cmd, guest_processing_context* ctx);
+static void search_pattern_in_memory(guest_processing_context* ctx);
+static void print_hexdump_guest(guest_processing_context* ctx);
+static size_t read_guest_page(void* owner, uint64_t page_address, uint8_t* page);
+static void list_memory_regions_info(const guest_processing_context* ctx);
+static void print_memory_info(guest_processing_context* ctx);
+static void data_block_calculate(guest_processing_context* ctx);
+
+static bool map_file(const char* file_path, HANDLE* file_handle, HANDLE* file_mapping_handle, const uint8_t** file_base, uint64_t* file_size) {
+    *file_handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (*file_handle == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "\nFailed to open the file.\n");
+        return false;
+    }
+    LARGE_INTEGER size; size.QuadPart = 0;
+    if (!GetFileSizeEx(*file_handle, &size) || (size.QuadPart < (LONGLONG)GUEST_PAGE_SIZE)) {
+        fprintf(stderr, "\nThe file is too small to be a memory image.\n");
+        CloseHandle(*file_handle);
+        return false;
+    }
+    *file_size = (uint64_t)size.QuadPart;
+
+    *file_mapping_handle = CreateFileMapping(*file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!*file_mapping_handle) {
+        fprintf(stderr, "\nFailed to create file mapping.\n");
+        CloseHandle(*file_handle);
+        return false;
+    }
+
+    *file_base = (const uint8_t*)MapViewOfFile(*file_mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (!*file_base) {
+        fprintf(stderr, "\nFailed to map view of file.\n");
+        CloseHandle(*file_mapping_handle);
+        CloseHandle(*file_handle);
+        return false;
+    }
+    return true;
+}
+
+inline bool guest_phys_range_less(const guest_phys_range& a, const guest_phys_range& b) {
+    return a.phys_start < b.phys_start;
+}
+
+// ELF cores describe the physical memory with PT_LOAD segments, a raw image maps it 1:1 from offset 0
+static bool gather_phys_ranges(guest_processing_context* ctx) {
+    const elf64_header* header = (const elf64_header*)ctx->file_base;
+    if (*(const uint32_t*)header->ident != ELF_MAGIC) {
+        ctx->phys_ranges.push_back(guest_phys_range{ 0, ctx->file_size, 0 });
+        puts("\nRaw physical memory image.");
+        return true;
+    }
+    if ((header->ident[4] != ELF_CLASS_64) || (header->phentsize != sizeof(elf64_program_header))
+        || ((header->phoff + (uint64_t)header->phnum * sizeof(elf64_program_header)) > ctx->file_size)) {
+        fprintf(stderr, "\nUnsupported ELF file.\n");
+        return false;
+    }
+    const elf64_program_header* program_headers = (const elf64_program_header*)(ctx->file_base + header->phoff);
+    for (uint16_t i = 0; i < header->phnum; i++) {
+        const elf64_program_header& ph = program_headers[i];
+        if ((ph.type != ELF_PT_LOAD) || !ph.filesz || ((ph.offset + ph.filesz) > ctx->file_size)) {
+            continue;
+        }
+        ctx->phys_ranges.push_back(guest_phys_range{ ph.paddr, ph.filesz, ph.offset });
+    }
+    std::sort(ctx->phys_ranges.begin(), ctx->phys_ranges.end(), guest_phys_range_less);
+    printf("\nELF core with %llu physical memory range(s).\n", (uint64_t)ctx->phys_ranges.size());
+    return !ctx->phys_ranges.empty();
+}
+
+// returns the number of bytes available in the image from phys on, 0 if phys isn't there
+static uint64_t phys_to_file(const guest_processing_context* ctx, uint64_t phys, uint64_t* file_offset) {
+    const auto& ranges = ctx->phys_ranges;
+    size_t low = 0, high = ranges.size();
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (ranges[mid].phys_start <= phys) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) {
+        return 0;
+    }
+    const guest_phys_range& range = ranges[low - 1];
+    const uint64_t offset = phys - range.phys_start;
+    if (offset >= range.size) {
+        return 0;
+    }
+    *file_offset = range.file_offset + offset;
+    return range.size - offset;
+}
+
+static bool read_phys_u64(const guest_processing_context* ctx, uint64_t phys, uint64_t* value) {
+    uint64_t file_offset = 0;
+    if (phys_to_file(ctx, phys, &file_offset) < sizeof(uint64_t)) {
+        return false;
+    }
+    *value = *(const uint64_t*)(ctx->file_base + file_offset);
+    return true;
+}
+
+inline int guest_level_shift(int level) {
+    return 12 + 9 * (level - 1);
+}
+
+inline uint64_t guest_canonical(uint64_t va, int paging_levels) {
+    const int top_bit = (paging_levels == 5) ? 56 : 47;
+    return (va & (1ULL << top_bit)) ? (va | ~((1ULL << (top_bit + 1)) - 1)) : va;
+}
+
+static void add_guest_mapping(guest_processing_context* ctx, uint64_t va, uint64_t phys, uint64_t size, uint32_t flags) {
+    auto& regions = ctx->regions;
+    // a large page can straddle physical ranges of the image
+    while (size) {
+        uint64_t file_offset = 0;
+        const uint64_t available = phys_to_file(ctx, phys, &file_offset);
+        const uint64_t chunk = available ? (_min(available, size)) : GUEST_PAGE_SIZE;
+        if (available) {
+            if (!regions.empty()) {
+                guest_region& last = regions.back();
+                if (((last.va + last.size) == va) && ((last.file_offset + last.size) == file_offset) && (last.flags == flags)) {
+                    last.size += chunk;
+                    va += chunk; phys += chunk; size -= chunk;
+                    continue;
+                }
+            }
+            regions.push_back(guest_region{ va, chunk, file_offset, flags });
+        }
+        va += chunk; phys += chunk; size -= chunk;
+    }
+}
+
+static void walk_page_table(guest_processing_context* ctx, int level, uint64_t table_phys, uint64_t va_base, uint32_t flags) {
+    const int shift = guest_level_shift(level);
+    for (uint64_t i = 0; i < 0x200; i++) {
+        uint64_t entry = 0;
+        if (!read_phys_u64(ctx, table_phys + i * sizeof(uint64_t), &entry) || !(entry & GUEST_PTE_PRESENT)) {
+            continue;
+        }
+        uint64_t va = va_base | (i << shift);
+        if (level == ctx->paging_levels) {
+            va = guest_canonical(va, ctx->paging_levels);
+        }
+        // write and user access have to be granted on every level, nx on any level forbids execution
+        uint32_t entry_flags = flags;
+        if (!(entry & GUEST_PTE_WRITE)) {
+            entry_flags &= ~gp_write;
+        }
+        if (!(entry & GUEST_PTE_USER)) {
+            entry_flags &= ~gp_user;
+        }
+        if (entry & GUEST_PTE_NX) {
+            entry_flags &= ~gp_execute;
+        }
+        const uint64_t page_size = 1ULL << shift;
+        if ((level == 1) || (((level == 2) || (level == 3)) && (entry & GUEST_PTE_LARGE))) {
+            add_guest_mapping(ctx, va, entry & GUEST_PTE_ADDRESS_MASK & ~(page_size - 1), page_size, entry_flags);
+        } else if (level > 1) {
+            walk_page_table(ctx, level - 1, entry & GUEST_PTE_ADDRESS_MASK, va, entry_flags);
+        }
+    }
+}
+
+static void tlb_flush(guest_processing_context* ctx) {
+    for (size_t i = 0; i < GUEST_TLB_SIZE; i++) {
+        ctx->tlb[i].va_page = ~0ULL;
+        ctx->tlb[i].page_mask = GUEST_PAGE_SIZE - 1;
+    }
+    ctx->tlb_hits = 0;
+    ctx->tlb_misses = 0;
+}
+
+// returns the number of bytes readable from va on within the same page, 0 if va isn't mapped
+static uint64_t translate(guest_processing_context* ctx, uint64_t va, uint64_t* file_offset, uint32_t* flags = nullptr) {
+    guest_tlb_entry& e = ctx->tlb[(va >> 12) & (GUEST_TLB_SIZE - 1)];
+    if ((va & ~e.page_mask) == e.va_page) {
+        ctx->tlb_hits++;
+    } else {
+        ctx->tlb_misses++;
+        uint64_t table_phys = ctx->cr3 & GUEST_PTE_ADDRESS_MASK;
+        uint32_t entry_flags = gp_write | gp_user | gp_execute;
+        for (int level = ctx->paging_levels; level >= 1; level--) {
+            const int shift = guest_level_shift(level);
+            uint64_t entry = 0;
+            if (!read_phys_u64(ctx, table_phys + ((va >> shift) & 0x1FF) * sizeof(uint64_t), &entry) || !(entry & GUEST_PTE_PRESENT)) {
+                return 0;
+            }
+            if (!(entry & GUEST_PTE_WRITE)) {
+                entry_flags &= ~gp_write;
+            }
+            if (!(entry & GUEST_PTE_USER)) {
+                entry_flags &= ~gp_user;
+            }
+            if (entry & GUEST_PTE_NX) {
+                entry_flags &= ~gp_execute;
+            }
+            if ((level == 1) || (((level == 2) || (level == 3)) && (entry & GUEST_PTE_LARGE))) {
+                uint64_t page_mask = (1ULL << shift) - 1;
+                uint64_t phys = entry & GUEST_PTE_ADDRESS_MASK & ~page_mask;
+                uint64_t page_file_offset = 0;
+                // cache large pages only if they are file contiguous, otherwise fall back to the 4K page
+                if (phys_to_file(ctx, phys, &page_file_offset) < (page_mask + 1)) {
+                    phys += va & page_mask & ~(GUEST_PAGE_SIZE - 1);
+                    page_mask = GUEST_PAGE_SIZE - 1;
+                    if (phys_to_file(ctx, phys, &page_file_offset) < GUEST_PAGE_SIZE) {
+                        return 0;
+                    }
+                }
+                e.va_page = va & ~page_mask;
+                e.page_mask = page_mask;
+                e.file_offset = page_file_offset;
+                e.flags = entry_flags;
+                break;
+            }
+            table_phys = entry & GUEST_PTE_ADDRESS_MASK;
+        }
+    }
+    *file_offset = e.file_offset + (va & e.page_mask);
+    if (flags) {
+        *flags = e.flags;
+    }
+    return e.page_mask + 1 - (va & e.page_mask);
+}
+
+// stops at the first unmapped page, returns the number of bytes read
+static size_t read_guest_memory(guest_processing_context* ctx, uint64_t va, uint8_t* buffer, size_t size) {
+    size_t bytes_read = 0;
+    while (bytes_read < size) {
+        uint64_t file_offset = 0;
+        const uint64_t available = translate(ctx, va + bytes_read, &file_offset);
+        if (!available) {
+            break;
+        }
+        const size_t bytes_to_copy = (size_t)(_min(available, (uint64_t)(size - bytes_read)));
+        memcpy(buffer + bytes_read, ctx->file_base + file_offset, bytes_to_copy);
+        bytes_read += bytes_to_copy;
+    }
+    return bytes_read;
+}
+
+static DWORD guest_flags_to_protect(uint32_t flags) {
+    if (flags & gp_execute) {
+        return (flags & gp_write) ? PAGE_EXECUTE_READWRITE : PAGE_EXECUTE_READ;
+    }
+    return (flags & gp_write) ? PAGE_READWRITE : PAGE_READONLY;
+}
+
+static bool guest_region_filter_match(const region_filter& filter, const guest_region& region) {
+    // present mappings are always committed, private/mapped is unknown
+    return region_filter_match(filter, guest_flags_to_protect(region.flags), 0, MEM_COMMIT, region.size);
+}
+
+static const guest_region* find_guest_region(const guest_processing_context* ctx, uint64_t va) {
+    const auto& regions = ctx->regions;
+    size_t low = 0, high = regions.size();
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (regions[mid].va <= va) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if ((low == 0) || (va >= (regions[low - 1].va + regions[low - 1].size))) {
+        return nullptr;
+    }
+    return &regions[low - 1];
+}
+
+static void print_guest_region(const guest_region& region) {
+    printf("Base Address: 0x%p | Size: 0x%016llx | Protect: %s\t | %s\n",
+        (const char*)region.va, region.size, get_page_protect(guest_flags_to_protect(region.flags)),
+        (region.flags & gp_user) ? "User" : "Supervisor");
+}
+
+static void print_help_main() {
+    print_help_main_common();
+    puts("------------------------------------\n");
+}
+
+static void print_help_search() {
+    print_help_search_common();
+    puts("--------------------------------");
+    puts("*  The :i|:s|:o modifiers are not available for guest memory");
+    puts("------------------------------------\n");
+}
+
+static void print_help_redirect() {
+    print_help_redirect_common();
+    puts("------------------------------------\n");
+}
+
+static void print_help_hexdump() {
+    print_help_hexdump_common();
+    puts("------------------------------------\n");
+}
+
+static void print_help_list() {
+    puts("\n------------------------------------");
+    puts("lm\t\t\t - list mapped virtual memory regions");
+    puts("*  Region filter modifiers can be appended (e.g. lm:x:><size>)");
+    puts("------------------------------------\n");
+}
+
+static void print_help_inspect() {
+    puts("\n------------------------------------");
+    puts("im@<address>\t\t - translate the address and show its region");
+    puts("------------------------------------\n");
+}
+
+static void print_help_calculate() {
+    print_help_calculate_common();
+    puts("------------------------------------\n");
+}
+
+static input_command parse_command(guest_processing_context* ctx, search_data_info* data, char* pattern) {
+    fprintf(stderr, unknown_command);
+    return c_continue;
+}
+
+static void execute_command(input_command cmd, guest_processing_context* ctx) {
+    switch (cmd) {
+    case c_help_main:
+        print_help_main();
+        break;
+    case c_help_search:
+        print_help_search();
+        break;
+    case c_help_redirect:
+        print_help_redirect();
+        break;
+    case c_help_list:
+        print_help_list();
+        break;
+    case c_help_hexdump:
+        print_help_hexdump();
+        break;
+    case c_help_inspect:
+        print_help_inspect();
+        break;
+    case c_help_calculate:
+        print_help_calculate();
+        break;
+    case c_search_pattern:
+        if (ctx->common.refine_set[0]) {
+            puts("Result sets are supported in dump mode only.\n");
+            break;
+        }
+        if (ctx->common.estimate_fraction > 0.0) {
+            puts("Sampled estimates are supported in dump mode only.\n");
+            break;
+        }
+        if (ctx->common.background) {
+            puts("Background jobs are supported in dump mode only, searching in the foreground.\n");
+        }
+        try_redirect_output_to_file(&ctx->common);
+        search_pattern_in_memory(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_print_hexdump:
+        try_redirect_output_to_file(&ctx->common);
+        print_hexdump_guest(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_list_memory_regions_info:
+    case c_list_memory_regions_info_committed:
+        try_redirect_output_to_file(&ctx->common);
+        list_memory_regions_info(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_inspect_memory:
+        try_redirect_output_to_file(&ctx->common);
+        print_memory_info(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_inspect_memory_budget:
+        try_redirect_output_to_file(&ctx->common);
+        print_mem_budget();
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    case c_calculate:
+        try_redirect_output_to_file(&ctx->common);
+        data_block_calculate(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
+    default:
+        puts(command_not_implemented);
+        puts("");
+        break;
+    }
+}
+
+int run_guest_inspection() {
+    char file_path[MAX_PATH];
+    memset(file_path, 0, sizeof(file_path));
+    printf("\nProvide the absolute path to the guest memory image (ELF core or raw): ");
+    gets_s(file_path, sizeof(file_path));
+
+    char cr3_input[MAX_ARG_LEN];
+    memset(cr3_input, 0, sizeof(cr3_input));
+    printf("Provide the CR3 value (hex, append :5 for 5-level paging): ");
+    gets_s(cr3_input, sizeof(cr3_input));
+    uint64_t cr3 = 0;
+    int paging_levels = 0;
+    const int res = sscanf_s(cr3_input, "%llx:%d", &cr3, &paging_levels);
+    if ((res < 1) || ((res == 2) && (paging_levels != 4) && (paging_levels != 5))) {
+        fprintf(stderr, "\nInvalid CR3 value. Exiting..\n");
+        return -1;
+    }
+
+    guest_processing_context ctx = { { pattern_data{ nullptr, 0, search_scope_type::mrt_all } } };
+    ctx.cr3 = cr3;
+    ctx.paging_levels = (res == 2) ? paging_levels : 4;
+    if (!map_file(file_path, &ctx.file_handle, &ctx.file_mapping, &ctx.file_base, &ctx.file_size)) {
+        return -1;
+    }
+    if (g_max_threads == INVALID_THREAD_NUM) {
+        g_max_threads = IDEAL_THREAD_NUM_DUMP_W_CACHING;
+    }
+    g_disable_symbols = 1;
+
+    if (gather_phys_ranges(&ctx)) {
+        walk_page_table(&ctx, ctx.paging_levels, ctx.cr3 & GUEST_PTE_ADDRESS_MASK, 0, gp_write | gp_user | gp_execute);
+    }
+    tlb_flush(&ctx);
+    if (ctx.regions.empty()) {
+        fprintf(stderr, "\nNo virtual memory could be mapped with the given CR3. Exiting..\n");
+    } else {
+        uint64_t mapped_size = 0;
+        for (const guest_region& region : ctx.regions) {
+            mapped_size += region.size;
+        }
+        printf("%d-level paging | Regions: %llu | Mapped: 0x%llx bytes\n", ctx.paging_levels, (uint64_t)ctx.regions.size(), mapped_size);
+
+        puts("");
+        print_help_main();
+
+        char pattern[MAX_PATTERN_LEN];
+        char command[MAX_COMMAND_LEN + MAX_ARG_LEN];
+        ctx.common.command = command;
+        search_data_info sdata;
+        init_hexdump_cache(&ctx.common.hex_cache, read_guest_page, &ctx, 0);
+
+        while (1) {
+            mem_budget_trim();
+            printf(">: ");
+            input_command cmd = parse_command_common(&ctx.common, &sdata, pattern);
+            if (cmd == input_command::c_not_set) {
+                cmd = parse_command(&ctx, &sdata, pattern);
+            } else {
+                puts("");
+            }
+            if (cmd == c_quit_program) {
+                break;
+            } else if (cmd == c_continue) {
+                continue;
+            }
+            execute_command(cmd, &ctx);
+        }
+        stop_hexdump_cache(&ctx.common.hex_cache);
+    }
+
+    // epilogue
+    UnmapViewOfFile(ctx.file_base);
+    CloseHandle(ctx.file_mapping);
+    CloseHandle(ctx.file_handle);
+
+    return 0;
+}
+
+static void find_pattern_in_segment(search_context_guest* search_ctx, const char* data, int64_t size, uint64_t info_id, const char* address) {
+    const char* pattern = search_ctx->ctx->common.pdata.pattern;
+    auto& matches = search_ctx->common.matches;
+
+    if (search_ctx->ctx->common.pdata.op == search_op::so_xref) {
+        std::vector<const char*> xrefs;
+        find_xrefs((const uint8_t*)data, (size_t)size, address, *(const uint64_t*)pattern, xrefs);
+        if (!xrefs.empty()) {
+            search_ctx->common.matches_lock.lock();
+            for (const char* xref : xrefs) {
+                matches.push_back(search_match{ info_id, xref });
+            }
+            search_ctx->common.matches_lock.unlock();
+        }
+        return;
+    }
+
+    find_pattern_with_kernel(&search_ctx->common, data, size, info_id, address);
+}
+
+static void find_pattern(search_context_guest* search_ctx, uint32_t node) {
+    pin_thread_to_numa_node(node);
+    const guest_processing_context* ctx = search_ctx->ctx;
+    while (1) {
+        const size_t b = search_ctx->next_block++;
+        if (b >= search_ctx->blocks.size()) {
+            break;
+        }
+        const guest_search_block& block = search_ctx->blocks[b];
+        const guest_region& region = ctx->regions[block.region_id];
+        const char* data = (const char*)ctx->file_base + region.file_offset + block.offset;
+        find_pattern_in_segment(search_ctx, data, (int64_t)block.size, block.region_id, (const char*)(region.va + block.offset));
+    }
+}
+
+static void print_search_results(search_context_guest& search_ctx) {
+    const uint64_t num_matches = prepare_matches(&search_ctx.ctx->common, search_ctx.common.matches);
+    if (!num_matches) {
+        return;
+    }
+
+    printf("*** Total number of matches: %llu ***\n\n", num_matches);
+
+    uint64_t prev_info_id = (uint64_t)(-1);
+    for (size_t i = 0; i < num_matches; i++) {
+        const size_t info_id = search_ctx.common.matches[i].info_id;
+        if (info_id != prev_info_id) {
+            puts("\n------------------------------------\n");
+            print_guest_region(search_ctx.ctx->regions[info_id]);
+            puts("");
+            prev_info_id = info_id;
+        }
+        printf("\tMatch at address: 0x%p\n", search_ctx.common.matches[i].match_address);
+    }
+    puts("");
+}
+
+static void search_pattern_in_memory(guest_processing_context* ctx) {
+    const pattern_data& pdata = ctx->common.pdata;
+    const bool xref_search = (pdata.op == search_op::so_xref);
+    if ((pdata.scope_type != search_scope_type::mrt_all) && (pdata.scope_type != search_scope_type::mrt_range) && !xref_search) {
+        puts("The :i|:s|:o modifiers are not available for guest memory.");
+        return;
+    }
+    if (ctx->common.rdata.redirect) {
+        puts(ctx->common.command);
+        puts("");
+    }
+    puts("Searching guest memory...");
+    puts("\n------------------------------------\n");
+
+    const bool ranged_search = (pdata.scope_type == search_scope_type::mrt_range);
+    const uint64_t pattern_len = (uint64_t)pdata.pattern_len;
+    const uint64_t extra_chunk = multiple_of_n(pattern_len, sizeof(__m128i));
+    const uint64_t block_size = get_alloc_granularity() * g_num_alloc_blocks;
+
+    search_context_guest search_ctx;
+    search_ctx.ctx = ctx;
+    search_ctx.common.exit_workers = 0;
+    init_scan_kernel(&search_ctx.common, ctx->common.pdata, sm_collect);
+    for (size_t r = 0, sz = ctx->regions.size(); r < sz; r++) {
+        const guest_region& region = ctx->regions[r];
+        if ((region.size < pattern_len) || !guest_region_filter_match(pdata.filter, region)) {
+            continue;
+        }
+        if (ranged_search && !ranges_intersect(region.va, region.size, (uint64_t)pdata.range.start, pdata.range.length)) {
+            continue;
+        }
+        for (uint64_t offset = 0; offset < region.size; offset += block_size) {
+            const uint64_t size = _min(block_size + extra_chunk, region.size - offset);
+            search_ctx.blocks.push_back(guest_search_block{ r, offset, size });
+        }
+    }
+
+    const size_t num_threads = _min(_min((size_t)std::thread::hardware_concurrency(), (size_t)g_max_threads), search_ctx.blocks.size());
+    std::vector<std::thread> workers; workers.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        workers.push_back(std::thread(find_pattern, &search_ctx, numa_node_of_worker(i, num_threads)));
+    }
+    for (auto& w : workers) {
+        if (w.joinable()) {
+            w.join();
+        }
+    }
+
+    print_search_results(search_ctx);
+
+    store_last_matches(&ctx->common, search_ctx.common.matches);
+}
+
+// Goes through the region list rather than the TLB, so the prefetch thread can read beside the prompt
+static size_t read_guest_page(void* owner, uint64_t page_address, uint8_t* page) {
+    const guest_processing_context* ctx = (const guest_processing_context*)owner;
+    const auto& regions = ctx->regions;
+    auto it = std::upper_bound(regions.begin(), regions.end(), page_address,
+        [](uint64_t va, const guest_region& region) { return va < region.va; });
+    if (it == regions.begin()) {
+        return 0;
+    }
+    --it;
+    if (page_address >= (it->va + it->size)) {
+        return 0;
+    }
+    const size_t bytes_to_read = (size_t)(_min((uint64_t)HEXDUMP_PAGE_SIZE, it->va + it->size - page_address));
+    memcpy(page, ctx->file_base + it->file_offset + (page_address - it->va), bytes_to_read);
+    return bytes_to_read;
+}
+
+static void print_hexdump_guest(guest_processing_context* ctx) {
+    puts("\n------------------------------------\n");
+    hexdump_data& hdata = ctx->common.hdata;
+    std::vector<uint8_t> bytes(hdata.num_to_display * hdata.mode);
+    const size_t bytes_read = read_hexdump_memory(&ctx->common.hex_cache, (uint64_t)hdata.address, bytes.data(), bytes.size());
+    hdata.num_to_display = bytes_read / hdata.mode;
+    bytes.resize(hdata.num_to_display * hdata.mode);
+    if (bytes.empty()) {
+        puts("Address is not mapped.");
+        return;
+    }
+
+    switch (hdata.hex_op.op) {
+    case hexdump_op::ho_xor:
+        for (int i = 0, j = 0, sz = bytes.size(); i < sz; i++, j = (j + 1) % hdata.hex_op.str_len) {
+            bytes[i] ^= hdata.hex_op.hex_str[j];
+        }
+        break;
+    case hexdump_op::ho_and:
+        for (int i = 0, j = 0, sz = bytes.size(); i < sz; i++, j = (j + 1) % hdata.hex_op.str_len) {
+            bytes[i] &= hdata.hex_op.hex_str[j];
+        }
+        break;
+    default:
+        break;
+    }
+
+    print_hexdump(hdata, bytes.data(), bytes.size());
+}
+
+static void list_memory_regions_info(const guest_processing_context* ctx) {
+    const pattern_data& pdata = ctx->common.pdata;
+    if (pdata.scope_type != search_scope_type::mrt_all) {
+        puts("The :i|:s|:o modifiers are not available for guest memory.");
+        return;
+    }
+    if (!region_filter_set(pdata.filter) && too_many_results(ctx->regions.size(), output_redirected(&ctx->common))) {
+        return;
+    }
+    uint64_t num_regions = 0;
+    for (const guest_region& region : ctx->regions) {
+        if (!guest_region_filter_match(pdata.filter, region)) {
+            continue;
+        }
+        num_regions++;
+        print_guest_region(region);
+    }
+    puts("");
+    printf("*** Number of Memory Regions: %llu ***\n\n", num_regions);
+}
+
+static void print_memory_info(guest_processing_context* ctx) {
+    const uint64_t va = (uint64_t)ctx->common.i_data.memory_address;
+    uint64_t file_offset = 0;
+    uint32_t flags = 0;
+    if (!translate(ctx, va, &file_offset, &flags)) {
+        puts("Address is not mapped.");
+        return;
+    }
+    const guest_region* region = find_guest_region(ctx, va);
+    if (region) {
+        print_guest_region(*region);
+    }
+    printf("File offset: 0x%016llx | Protect: %s\n", file_offset, get_page_protect(guest_flags_to_protect(flags)));
+    printf("TLB hits: %llu | TLB misses: %llu\n", ctx->tlb_hits, ctx->tlb_misses);
+}
+
+static void data_block_calculate(guest_processing_context* ctx) {
+    const uint64_t va = (uint64_t)ctx->common.cdata.address;
+    const guest_region* region = find_guest_region(ctx, va);
+    if (!region) {
+        puts("Address is not mapped.");
+        return;
+    }
+    if (!guest_region_filter_match(ctx->common.cdata.filter, *region)) {
+        puts("The memory region doesn't match the filter.");
+        return;
+    }
+    puts("\n------------------------------------\n");
+    const size_t bytes_to_read = (size_t)(_min(ctx->common.cdata.size, region->va + region->size - va));
+    std::vector<uint8_t> bytes(bytes_to_read);
+    const size_t bytes_read = read_guest_memory(ctx, va, bytes.data(), bytes_to_read);
+    data_block_calculate_common(&ctx->common.cdata, bytes.data(), bytes_read);
+}
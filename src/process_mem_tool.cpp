@@ -5,23 +5,74 @@
 const char* select_pid_first = "Select the PID first.\n";
 const char* handle_invalid = "The process handle is not longer valid.\n";
 
+// clean (unmodified) image regions are identified by the backing file, the load address and the region itself,
+// so the results stay valid for any process that has the same module mapped at the same base
+struct clean_image_key {
+    DWORD volume_serial;
+    DWORD file_index_high;
+    DWORD file_index_low;
+    uint64_t base_of_image;
+    uint64_t region_rva;
+    uint64_t region_size;
+    uint64_t op;
+    char pattern[MAX_PATTERN_LEN];
+    int64_t pattern_len;
+};
+
+inline bool operator<(const clean_image_key& a, const clean_image_key& b) {
+    const int res = memcmp(&a, &b, offsetof(clean_image_key, pattern));
+    if (res) {
+        return res < 0;
+    }
+    if (a.pattern_len != b.pattern_len) {
+        return a.pattern_len < b.pattern_len;
+    }
+    return memcmp(a.pattern, b.pattern, a.pattern_len) < 0;
+}
+
 struct proc_processing_context {
     common_processing_context common;
     DWORD pid;
     HANDLE process;
     bool process_initialized = false;
+    std::map<clean_image_key, std::vector<uint64_t>> clean_image_cache; // match offsets within the region
+    int clean_image_budget_id = -1;
 };
 
 struct block_info_proc {
     const char* ptr;
     size_t size;
     size_t info_id;
+    const char* local_ptr; // the same bytes readable in this process, nullptr if they have to be read from the target
+    bool copy_local;
+    size_t num_regions; // > 1 if adjacent small regions have been coalesced into a single read
+};
+
+struct read_span {
+    size_t offset;
+    size_t size;
+};
+
+struct clean_image_view {
+    const char* alloc_base;
+    const char* local_base; // nullptr if the image can't be read locally
+    const char* mapped_view; // nullptr if the module is shared with this process
+    BY_HANDLE_FILE_INFORMATION file_info;
+};
+
+struct clean_region_info {
+    int64_t view_id; // -1 if the region is not clean
+    bool cached;
 };
 
 struct search_context_proc {
     circular_buffer<block_info_proc, SEARCH_DATA_QUEUE_SIZE_POW2> block_info_queue;
     std::vector<MEMORY_BASIC_INFORMATION> mem_info;
+    std::vector<clean_image_view> image_views;
+    std::vector<clean_region_info> clean_regions;
     uint64_t block_size_ideal = 0;
+    uint64_t block_size = 0;
+    std::atomic<uint64_t> unreadable_bytes{ 0 };
     proc_processing_context *ctx = nullptr;
     search_context_common common{};
     std::mutex err_mtx;
@@ -47,6 +98,7 @@ static bool test_selected_pid(proc_processing_context* ctx);
 static void print_memory_info(const proc_processing_context* ctx);
 static void data_block_calculate(proc_processing_context* ctx);
 static void print_module_info(const proc_processing_context* ctx, const TCHAR* module_name);
+static void verify_process_modules(const proc_processing_context* ctx);
 static bool init_symbols(proc_processing_context* ctx);
 static void deinit_symbols(common_processing_context* ctx);
 static void symbol_set_path(const common_processing_context* ctx);
@@ -60,21 +112,82 @@ static bool is_process_handle_valid(HANDLE process) {
     return false;
 }
 
-static void find_pattern(search_context_proc* search_ctx) {
-    HANDLE process = search_ctx->ctx->process;
+static void add_read_span(std::vector<read_span>& spans, size_t offset, size_t size) {
+    if (!spans.empty() && ((spans.back().offset + spans.back().size) == offset)) {
+        spans.back().size += size;
+    } else {
+        spans.push_back(read_span{ offset, size });
+    }
+}
+
+// Reads the block in one go if possible, otherwise splits it at page boundaries
+// to recover every readable page around the guard / decommitted / no access ones.
+// The error of the first failed read is kept, later calls overwrite GetLastError().
+static void read_process_memory_bisect(HANDLE process, const char* ptr, char* buffer, size_t offset, size_t size, size_t page_size, std::vector<read_span>& spans, DWORD* first_error) {
+    SIZE_T bytes_read = 0;
+    const BOOL res = ReadProcessMemory(process, ptr + offset, buffer + offset, size, &bytes_read);
+    if (res && (bytes_read == size)) {
+        add_read_span(spans, offset, size);
+        return;
+    }
+    if (!res && !*first_error) {
+        *first_error = GetLastError();
+    }
+    if (bytes_read && (bytes_read < size)) {
+        add_read_span(spans, offset, bytes_read);
+        offset += bytes_read;
+        size -= bytes_read;
+    }
+
+    const uint64_t start = (uint64_t)(ptr + offset);
+    const uint64_t end = start + size;
+    uint64_t mid = (start + size / 2) & ~((uint64_t)page_size - 1);
+    if (mid <= start) {
+        mid = (start & ~((uint64_t)page_size - 1)) + page_size;
+    }
+    if (mid >= end) {
+        return; // a single unreadable page
+    }
+    const size_t left_size = (size_t)(mid - start);
+    read_process_memory_bisect(process, ptr, buffer, offset, left_size, page_size, spans, first_error);
+    read_process_memory_bisect(process, ptr, buffer, offset + left_size, size - left_size, page_size, spans, first_error);
+}
+
+static void find_pattern_in_segment(search_context_proc* search_ctx, const char* data, int64_t size, uint64_t info_id, const char* address) {
     const char* pattern = search_ctx->ctx->common.pdata.pattern;
-    const int64_t pattern_len = search_ctx->ctx->common.pdata.pattern_len;
     auto& matches = search_ctx->common.matches;
+
+    if (search_ctx->ctx->common.pdata.op == search_op::so_xref) {
+        std::vector<const char*> xrefs;
+        find_xrefs((const uint8_t*)data, (size_t)size, address, *(const uint64_t*)pattern, xrefs);
+        if (!xrefs.empty()) {
+            search_ctx->common.matches_lock.lock();
+            for (const char* xref : xrefs) {
+                matches.push_back(search_match{ info_id, xref });
+            }
+            search_ctx->common.matches_lock.unlock();
+        }
+        return;
+    }
+
+    find_pattern_with_kernel(&search_ctx->common, data, size, info_id, address);
+}
+
+static void find_pattern(search_context_proc* search_ctx, uint32_t node) {
+    pin_thread_to_numa_node(node);
+    HANDLE process = search_ctx->ctx->process;
+    const int64_t pattern_len = search_ctx->ctx->common.pdata.pattern_len;
     auto& mem_info = search_ctx->mem_info;
     auto& block_info_queue = search_ctx->block_info_queue;
     auto& exit_workers = search_ctx->common.exit_workers;
 
-    char* buffer = (char*)malloc(search_ctx->block_size_ideal);
+    char* buffer = (char*)alloc_node_buffer(search_ctx->block_size_ideal, node);
     block_info_proc block;
+    std::vector<read_span> spans;
 
-    const bool ranged_search = search_ctx->ctx->common.pdata.scope_type == search_scope_type::mrt_range;
-    const char* range_start = search_ctx->ctx->common.pdata.range.start;
-    const char* range_end = search_ctx->ctx->common.pdata.range.start + search_ctx->ctx->common.pdata.range.length;
+    SYSTEM_INFO sysinfo = { 0 };
+    GetSystemInfo(&sysinfo);
+    const size_t page_size = sysinfo.dwPageSize;
 
     while (1) {
         int exit = false;
@@ -97,15 +210,51 @@ static void find_pattern(search_context_proc* search_ctx) {
 
         assert((r_info.Type == MEM_MAPPED || r_info.Type == MEM_PRIVATE || r_info.Type == MEM_IMAGE));
 
-        SIZE_T bytes_read;
-        const BOOL res = ReadProcessMemory(process, ptr, buffer, bytes_to_read, &bytes_read);
-
-        if (!res || (bytes_read != bytes_to_read)) {
-            if (!g_show_failed_readings) {
-                if (!res) {
-                    continue;
-                }
+        const char* data = buffer;
+        DWORD read_error = 0;
+        spans.clear();
+        if (block.local_ptr) {
+            // clean image pages are shared with our own view, no need to copy them through the target
+            if (block.copy_local) {
+                memcpy(buffer, block.local_ptr, bytes_to_read);
             } else {
+                data = block.local_ptr;
+            }
+            spans.push_back(read_span{ 0, bytes_to_read });
+        } else {
+            // regions that can't be read are skipped whole, only a failed read of a readable one is bisected
+            size_t num_unreadable = 0;
+            for (size_t r = info_id, r_end = info_id + block.num_regions; r < r_end; r++) {
+                num_unreadable += (mem_info[r].Protect & (PAGE_NOACCESS | PAGE_GUARD)) != 0;
+            }
+            if (!num_unreadable) {
+                read_process_memory_bisect(process, ptr, buffer, 0, bytes_to_read, page_size, spans, &read_error);
+            } else {
+                read_error = ERROR_NOACCESS;
+                for (size_t r = info_id, r_end = info_id + block.num_regions; r < r_end; r++) {
+                    if (mem_info[r].Protect & (PAGE_NOACCESS | PAGE_GUARD)) {
+                        continue;
+                    }
+                    const size_t seg_start = (block.num_regions > 1) ? (size_t)((const char*)mem_info[r].BaseAddress - ptr) : 0;
+                    const size_t seg_end = (block.num_regions > 1) ? (seg_start + mem_info[r].RegionSize) : bytes_to_read;
+                    read_process_memory_bisect(process, ptr, buffer, seg_start, seg_end - seg_start, page_size, spans, &read_error);
+                }
+            }
+        }
+
+        size_t bytes_read = 0;
+        size_t own_bytes_read = 0; // the overlap with the next block gets accounted for by that block
+        const size_t own_size = (bytes_to_read == search_ctx->block_size_ideal) ? search_ctx->block_size : bytes_to_read;
+        for (const auto& span : spans) {
+            bytes_read += span.size;
+            own_bytes_read += (_min(span.offset + span.size, own_size)) - (_min(span.offset, own_size));
+        }
+        if (own_bytes_read != own_size) {
+            search_ctx->unreadable_bytes += own_size - own_bytes_read;
+        }
+
+        if (bytes_read != bytes_to_read) {
+            if (g_show_failed_readings) {
                 std::unique_lock<std::mutex> lk(search_ctx->err_mtx);
                 if (r_info.Type == MEM_IMAGE) {
                     char module_name[MAX_PATH];
@@ -117,39 +266,33 @@ static void find_pattern(search_context_proc* search_ctx) {
                 printf("Base address: 0x%p\tAllocation Base: 0x%p\tRegion Size: 0x%016llx\nState: %s\tProtect: %s\t",
                     r_info.BaseAddress, r_info.AllocationBase, r_info.RegionSize, get_page_protect(r_info.Protect), get_page_state(r_info.State));
                 print_page_type(r_info.Type);
-                if (!res) {
-                    printf("Failed reading process memory. Error code: %lu\n\n", GetLastError());
-                    continue;
+                if (!bytes_read) {
+                    printf("Failed reading process memory. Error code: %lu\n\n", read_error);
                 } else {
                     printf("Process memory not read in it's entirety! 0x%llx bytes skipped out of 0x%llx\n\n", (bytes_to_read - bytes_read), bytes_to_read);
                 }
             }
+            if (!bytes_read) {
+                continue;
+            }
         }
 
-        if (bytes_read >= pattern_len) {
-            const char* buffer_ptr = buffer;
-            int64_t buffer_size = (int64_t)bytes_read;
-
-            while (buffer_size >= pattern_len) {
-                const char* old_buf_ptr = buffer_ptr;
-                buffer_ptr = (const char*)strstr_u8((const uint8_t*)buffer_ptr, buffer_size, (const uint8_t*)pattern, pattern_len);
-                if (!buffer_ptr) {
-                    break;
-                }
-
-                const ptrdiff_t buffer_offset = buffer_ptr - buffer;
-                const char* match = ptr + buffer_offset;
-                if (!ranged_search || ((match >= range_start) && ((match < range_end)))) {
-                    search_ctx->common.matches_lock.lock();
-                    matches.push_back(search_match{ block.info_id, match });
-                    search_ctx->common.matches_lock.unlock();
+        // coalesced regions are searched one by one, matches never cross region boundaries
+        for (size_t r = info_id, r_end = info_id + block.num_regions; r < r_end; r++) {
+            const MEMORY_BASIC_INFORMATION& seg_info = mem_info[r];
+            const size_t seg_start = (block.num_regions > 1) ? (size_t)((const char*)seg_info.BaseAddress - ptr) : 0;
+            const size_t seg_end = (block.num_regions > 1) ? (seg_start + seg_info.RegionSize) : bytes_to_read;
+            for (const auto& span : spans) {
+                const size_t start = _max(span.offset, seg_start);
+                const size_t end = _min(span.offset + span.size, seg_end);
+                if ((start >= end) || ((int64_t)(end - start) < pattern_len)) {
+                    continue;
                 }
-                buffer_ptr++;
-                buffer_size -= (buffer_ptr - old_buf_ptr);
+                find_pattern_in_segment(search_ctx, data + start, (int64_t)(end - start), r, ptr + start);
             }
         }
     }
-    free(buffer);
+    free_node_buffer(buffer);
 }
 
 static bool identify_memory_region_type(search_scope_type scope_type, const MEMORY_BASIC_INFORMATION &info, const std::vector<thread_info_proc> &thread_info) {
@@ -180,6 +323,236 @@ static bool identify_memory_region_type(search_scope_type scope_type, const MEMO
     return false;
 }
 
+static bool image_pages_shared(HANDLE process, const char* base, size_t size) {
+    SYSTEM_INFO sysinfo = { 0 };
+    GetSystemInfo(&sysinfo);
+    const size_t page_size = sysinfo.dwPageSize;
+    const size_t num_pages = size / page_size;
+    if (!num_pages) {
+        return false;
+    }
+    std::vector<PSAPI_WORKING_SET_EX_INFORMATION> ws_info(num_pages);
+    for (size_t i = 0; i < num_pages; i++) {
+        ws_info[i].VirtualAddress = (PVOID)(base + i * page_size);
+    }
+    if (!QueryWorkingSetEx(process, ws_info.data(), (DWORD)(num_pages * sizeof(PSAPI_WORKING_SET_EX_INFORMATION)))) {
+        return false;
+    }
+    // a private page means the image has been written to (copy-on-write, patched code, applied relocations)
+    for (const auto& ws : ws_info) {
+        const PSAPI_WORKING_SET_EX_BLOCK& attr = ws.VirtualAttributes;
+        const bool shared = attr.Valid ? attr.Shared : attr.Invalid.Shared;
+        if (!shared) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_clean_image_region(HANDLE process, const MEMORY_BASIC_INFORMATION& info) {
+    if (info.Type != MEM_IMAGE) {
+        return false;
+    }
+    if ((info.Protect != PAGE_READONLY) && (info.Protect != PAGE_EXECUTE_READ)) {
+        return false;
+    }
+    return image_pages_shared(process, (const char*)info.BaseAddress, info.RegionSize);
+}
+
+static bool is_locally_readable(const char* ptr, size_t size) {
+    MEMORY_BASIC_INFORMATION info;
+    if (VirtualQuery(ptr, &info, sizeof(info)) != sizeof(info)) {
+        return false;
+    }
+    if ((info.State != MEM_COMMIT) || (info.Protect & (PAGE_NOACCESS | PAGE_GUARD | PAGE_EXECUTE))) {
+        return false;
+    }
+    return (ptr + size) <= ((const char*)info.BaseAddress + info.RegionSize);
+}
+
+static bool image_headers_match(HANDLE process, const clean_image_view& view) {
+    SYSTEM_INFO sysinfo = { 0 };
+    GetSystemInfo(&sysinfo);
+    const size_t page_size = sysinfo.dwPageSize;
+    if (!is_locally_readable(view.local_base, page_size)) {
+        return false;
+    }
+    uint8_t* buffer = (uint8_t*)malloc(page_size);
+    SIZE_T bytes_read = 0;
+    const BOOL res = ReadProcessMemory(process, view.alloc_base, buffer, page_size, &bytes_read);
+    const bool match = res && (bytes_read == page_size) && (memcmp(buffer, view.local_base, page_size) == 0);
+    free(buffer);
+    return match;
+}
+
+// Maps the module file as an image at the same address the target has it loaded at. The image section is
+// shared system wide, so the unmodified pages of the target and of our view are the same physical pages.
+// If the address is taken in this process, it's most likely the same module loaded by us.
+static int64_t acquire_clean_image_view(search_context_proc& search_ctx, const char* alloc_base) {
+    auto& image_views = search_ctx.image_views;
+    for (size_t i = 0, sz = image_views.size(); i < sz; i++) {
+        if (image_views[i].alloc_base == alloc_base) {
+            return image_views[i].local_base ? (int64_t)i : -1;
+        }
+    }
+
+    const HANDLE process = search_ctx.ctx->process;
+    clean_image_view view = { alloc_base, nullptr, nullptr };
+    memset(&view.file_info, 0, sizeof(view.file_info));
+    char module_name[MAX_PATH];
+    if (GetModuleFileNameExA(process, (HMODULE)alloc_base, module_name, MAX_PATH)) {
+        HANDLE file = CreateFileA(module_name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file != INVALID_HANDLE_VALUE) {
+            if (GetFileInformationByHandle(file, &view.file_info)) {
+                HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY | SEC_IMAGE, 0, 0, NULL);
+                if (mapping != NULL) {
+                    view.mapped_view = (const char*)MapViewOfFileEx(mapping, FILE_MAP_READ, 0, 0, 0, (LPVOID)alloc_base);
+                    CloseHandle(mapping);
+                }
+                if (view.mapped_view) {
+                    view.local_base = view.mapped_view;
+                } else {
+                    char local_name[MAX_PATH];
+                    if (GetModuleFileNameExA(GetCurrentProcess(), (HMODULE)alloc_base, local_name, MAX_PATH) && !_stricmp(local_name, module_name)) {
+                        view.local_base = alloc_base;
+                    }
+                }
+            }
+            CloseHandle(file);
+        }
+    }
+    if (view.local_base && !image_headers_match(process, view)) {
+        if (view.mapped_view) {
+            UnmapViewOfFile(view.mapped_view);
+            view.mapped_view = nullptr;
+        }
+        view.local_base = nullptr;
+    }
+
+    image_views.push_back(view);
+    return view.local_base ? (int64_t)(image_views.size() - 1) : -1;
+}
+
+static void release_clean_image_views(search_context_proc& search_ctx) {
+    for (const auto& view : search_ctx.image_views) {
+        if (view.mapped_view) {
+            UnmapViewOfFile(view.mapped_view);
+        }
+    }
+    search_ctx.image_views.clear();
+}
+
+static void make_clean_image_key(const search_context_proc& search_ctx, size_t info_id, clean_image_key& key) {
+    const MEMORY_BASIC_INFORMATION& info = search_ctx.mem_info[info_id];
+    const clean_image_view& view = search_ctx.image_views[search_ctx.clean_regions[info_id].view_id];
+    const pattern_data& pdata = search_ctx.ctx->common.pdata;
+
+    memset(&key, 0, sizeof(key));
+    key.volume_serial = view.file_info.dwVolumeSerialNumber;
+    key.file_index_high = view.file_info.nFileIndexHigh;
+    key.file_index_low = view.file_info.nFileIndexLow;
+    key.base_of_image = (uint64_t)view.alloc_base;
+    key.region_rva = (uint64_t)((const char*)info.BaseAddress - view.alloc_base);
+    key.region_size = info.RegionSize;
+    key.op = pdata.op;
+    memcpy(key.pattern, pdata.pattern, pdata.pattern_len);
+    key.pattern_len = pdata.pattern_len;
+}
+
+static void collect_clean_image_regions(search_context_proc& search_ctx, uint64_t& num_scanned, uint64_t& num_cached) {
+    const HANDLE process = search_ctx.ctx->process;
+    const pattern_data& pdata = search_ctx.ctx->common.pdata;
+    const bool ranged_search = pdata.scope_type == search_scope_type::mrt_range;
+    const char* range_start = pdata.range.start;
+    const char* range_end = pdata.range.start + pdata.range.length;
+    auto& mem_info = search_ctx.mem_info;
+    auto& clean_regions = search_ctx.clean_regions;
+    auto& cache = search_ctx.ctx->clean_image_cache;
+
+    num_scanned = 0;
+    num_cached = 0;
+    clean_regions.assign(mem_info.size(), clean_region_info{ -1, false });
+    for (size_t i = 0, sz = mem_info.size(); i < sz; i++) {
+        const MEMORY_BASIC_INFORMATION& info = mem_info[i];
+        if (!is_clean_image_region(process, info)) {
+            continue;
+        }
+        const int64_t view_id = acquire_clean_image_view(search_ctx, (const char*)info.AllocationBase);
+        if (view_id < 0) {
+            continue;
+        }
+        const clean_image_view& view = search_ctx.image_views[view_id];
+        const char* local_ptr = view.local_base + ((const char*)info.BaseAddress - view.alloc_base);
+        if (!is_locally_readable(local_ptr, info.RegionSize)) {
+            continue;
+        }
+        if (!view.mapped_view && !image_pages_shared(GetCurrentProcess(), local_ptr, info.RegionSize)) {
+            continue;
+        }
+        clean_regions[i].view_id = view_id;
+
+        clean_image_key key;
+        make_clean_image_key(search_ctx, i, key);
+        const auto it = cache.find(key);
+        if (it == cache.end()) {
+            num_scanned++;
+            continue;
+        }
+        clean_regions[i].cached = true;
+        num_cached++;
+        for (const uint64_t offset : it->second) {
+            const char* match = (const char*)info.BaseAddress + offset;
+            if (!ranged_search || ((match >= range_start) && (match < range_end))) {
+                search_ctx.common.matches.push_back(search_match{ i, match });
+            }
+        }
+    }
+}
+
+static void evict_clean_image_cache(void* owner) {
+    std::map<clean_image_key, std::vector<uint64_t>>().swap(((proc_processing_context*)owner)->clean_image_cache);
+}
+
+static void cache_clean_image_results(search_context_proc& search_ctx) {
+    // ranged searches only see a part of the region
+    if (search_ctx.ctx->common.pdata.scope_type == search_scope_type::mrt_range) {
+        return;
+    }
+    auto& mem_info = search_ctx.mem_info;
+    auto& clean_regions = search_ctx.clean_regions;
+    auto& cache = search_ctx.ctx->clean_image_cache;
+
+    std::vector<std::vector<uint64_t>> offsets(mem_info.size());
+    for (const auto& m : search_ctx.common.matches) {
+        const clean_region_info& cr = clean_regions[m.info_id];
+        if ((cr.view_id >= 0) && !cr.cached) {
+            offsets[m.info_id].push_back((uint64_t)(m.match_address - (const char*)mem_info[m.info_id].BaseAddress));
+        }
+    }
+    int& budget_id = search_ctx.ctx->clean_image_budget_id;
+    if (budget_id == -1) {
+        budget_id = mem_budget_register("clean image matches", 0x04, evict_clean_image_cache, search_ctx.ctx);
+    }
+    if (cache.size() > CLEAN_IMAGE_CACHE_MAX_ENTRIES) {
+        cache.clear();
+        mem_budget_release(budget_id, UINT64_MAX);
+    }
+    for (size_t i = 0, sz = mem_info.size(); i < sz; i++) {
+        if ((clean_regions[i].view_id < 0) || clean_regions[i].cached) {
+            continue;
+        }
+        auto& region_offsets = offsets[i];
+        std::sort(region_offsets.begin(), region_offsets.end());
+        region_offsets.erase(std::unique(region_offsets.begin(), region_offsets.end()), region_offsets.end());
+        if (!mem_budget_charge(budget_id, sizeof(clean_image_key) + region_offsets.size() * sizeof(uint64_t))) {
+            continue; // the region is read again by the next search
+        }
+        clean_image_key key;
+        make_clean_image_key(search_ctx, i, key);
+        cache[key] = std::move(region_offsets);
+    }
+}
+
 static void search_and_sync(search_context_proc& search_ctx) {
     const proc_processing_context& ctx = *search_ctx.ctx;
 
@@ -207,6 +580,9 @@ static void search_and_sync(search_context_proc& search_ctx) {
                 if (region_size < pattern_len) {
                     continue;
                 }
+                if (!region_filter_match(ctx.common.pdata.filter, info.Protect, info.Type, info.State, info.RegionSize)) {
+                    continue;
+                }
                 if (scoped_search) {
                     if (ranged_search) {
                         if (!ranges_intersect((uint64_t)info.BaseAddress, info.RegionSize, (uint64_t)ctx.common.pdata.range.start, ctx.common.pdata.range.length)) {
@@ -226,21 +602,61 @@ static void search_and_sync(search_context_proc& search_ctx) {
         return;
     }
 
+    uint64_t num_clean_scanned = 0, num_clean_cached = 0;
+    collect_clean_image_regions(search_ctx, num_clean_scanned, num_clean_cached);
+    if (num_clean_scanned || num_clean_cached) {
+        printf("Clean image regions: %llu read locally, %llu taken from the cache.\n\n", num_clean_scanned, num_clean_cached);
+    }
+    const auto& clean_regions = search_ctx.clean_regions;
+
     const size_t extra_chunk = multiple_of_n(pattern_len, sizeof(__m128i));
     const size_t block_size = alloc_granularity * g_num_alloc_blocks;
     const size_t bytes_to_read_ideal = block_size + extra_chunk;
     search_ctx.block_size_ideal = bytes_to_read_ideal;
+    search_ctx.block_size = block_size;
 
     const size_t num_threads = _min(std::thread::hardware_concurrency(), g_max_threads);
     search_ctx.common.workers_sem.set_max_count(num_threads);
     std::vector<std::thread> workers; workers.reserve(num_threads);
     for (size_t i = 0; i < num_threads; i++) {
-        workers.push_back(std::thread(find_pattern, &search_ctx));
+        workers.push_back(std::thread(find_pattern, &search_ctx, numa_node_of_worker(i, num_threads)));
     }
     
     //produce block_info
     auto& block_info_queue = search_ctx.block_info_queue;
     for (size_t i = 0; i < num_regions; i++) {
+        if (clean_regions[i].cached) {
+            continue;
+        }
+        mem_budget_trim(); // the caches go first when the system runs low on memory during a long scan
+        // coalesce small address-adjacent regions into a single read
+        if ((clean_regions[i].view_id < 0) && (mem_info[i].RegionSize < block_size)) {
+            size_t num_segments = 1;
+            uint64_t total_size = mem_info[i].RegionSize;
+            while ((i + num_segments) < num_regions) {
+                const size_t n = i + num_segments;
+                if ((blocks[n] != (blocks[n - 1] + mem_info[n - 1].RegionSize)) || (clean_regions[n].view_id >= 0) || ((total_size + mem_info[n].RegionSize) > block_size)) {
+                    break;
+                }
+                total_size += mem_info[n].RegionSize;
+                num_segments++;
+            }
+            if (num_segments > 1) {
+                while (block_info_queue.is_full()) {
+                    search_ctx.common.master_sem.wait();
+                }
+                block_info_proc b = { blocks[i], total_size, i, nullptr, false, num_segments };
+                block_info_queue.try_push(b);
+                search_ctx.common.workers_sem.signal();
+                i += num_segments - 1;
+                continue;
+            }
+        }
+        const char* local_base = nullptr;
+        if (clean_regions[i].view_id >= 0) {
+            const clean_image_view& view = search_ctx.image_views[clean_regions[i].view_id];
+            local_base = view.local_base + (blocks[i] - view.alloc_base);
+        }
         uint64_t region_size = mem_info[i].RegionSize;
         const char* p = blocks[i];
         uint64_t bytes_offset = 0;
@@ -258,7 +674,12 @@ static void search_and_sync(search_context_proc& search_ctx) {
             }
             const char* block_start = p + bytes_offset;
             if (!ranged_search || ranges_intersect((uint64_t)block_start, bytes_to_read, (uint64_t)ctx.common.pdata.range.start, ctx.common.pdata.range.length)) {
-                block_info_proc b = { block_start, bytes_to_read, i };
+                block_info_proc b = { block_start, bytes_to_read, i, nullptr, false, 1 };
+                if (local_base) {
+                    b.local_ptr = local_base + bytes_offset;
+                    // the search reads a bit past the end of the block, keep it inside the region
+                    b.copy_local = (bytes_offset + bytes_to_read + sizeof(__m128i)) > mem_info[i].RegionSize;
+                }
                 block_info_queue.try_push(b);
                 search_ctx.common.workers_sem.signal();
             }
@@ -273,6 +694,9 @@ static void search_and_sync(search_context_proc& search_ctx) {
             w.join();
         }
     }
+
+    cache_clean_image_results(search_ctx);
+    release_clean_image_views(search_ctx);
 }
 
 static void print_search_results(search_context_proc& search_ctx) {
@@ -353,16 +777,23 @@ static void search_pattern_in_memory(proc_processing_context* ctx) {
     search_context_proc search_ctx{};
     search_ctx.ctx = ctx;
     search_ctx.common.exit_workers = 0;
+    init_scan_kernel(&search_ctx.common, ctx->common.pdata, sm_collect);
 
     search_and_sync(search_ctx);
     print_search_results(search_ctx);
+    if (search_ctx.unreadable_bytes) {
+        printf("*** Unreadable bytes skipped: 0x%llx ***\n\n", (uint64_t)search_ctx.unreadable_bytes);
+    }
 }
 
-static void print_hexdump_proc(proc_processing_context* ctx) {
-    const uint8_t* address = ctx->common.hdata.address;
-    uint8_t* buffer = nullptr;
-    size_t bytes_to_read = 0;
+static size_t read_process_page(void* owner, uint64_t page_address, uint8_t* page) {
+    const proc_processing_context* ctx = (const proc_processing_context*)owner;
+    SIZE_T bytes_read = 0;
+    ReadProcessMemory(ctx->process, (LPCVOID)page_address, page, HEXDUMP_PAGE_SIZE, &bytes_read); // a partial copy counts
+    return bytes_read;
+}
 
+static void print_hexdump_proc(proc_processing_context* ctx) {
     if (!ctx->process_initialized) {
         fprintf(stderr, select_pid_first);
         return;
@@ -372,69 +803,42 @@ static void print_hexdump_proc(proc_processing_context* ctx) {
         return;
     }
 
-    HANDLE process = ctx->process;
-
     char proc_name[MAX_PATH];
-    if (GetModuleFileNameExA(process, NULL, proc_name, MAX_PATH)) {
+    if (GetModuleFileNameExA(ctx->process, NULL, proc_name, MAX_PATH)) {
         printf("Process name: %s\n\n", proc_name);
     }
     puts("\n------------------------------------\n");
 
-    {
-        const char* p = NULL;
-        MEMORY_BASIC_INFORMATION info;
-        for (p = NULL; VirtualQueryEx(process, p, &info, sizeof(info)) == sizeof(info); p += info.RegionSize) {
-            if (info.State == MEM_COMMIT) {
-                const size_t region_size = info.RegionSize;
-                if ((address >= info.BaseAddress) && (address < ((uint8_t*)info.BaseAddress + region_size))) {
-                    bytes_to_read = ctx->common.hdata.num_to_display * ctx->common.hdata.mode;
-                    bytes_to_read = _min(bytes_to_read, (region_size - (address - info.BaseAddress)));
-                    bytes_to_read = (bytes_to_read / ctx->common.hdata.mode) * ctx->common.hdata.mode;
-                    buffer = (uint8_t*)malloc(bytes_to_read);
-                    SIZE_T bytes_read = 0;
-                    const BOOL res = ReadProcessMemory(process, address, buffer, bytes_to_read, &bytes_read);
-                    if (!res || !bytes_read) {
-                        fprintf(stderr, "Error reading the memory region.\n");
-                        free(buffer);
-                        return;
-                    }
-                    if (bytes_to_read == bytes_read) {
-                        ctx->common.hdata.num_to_display = bytes_to_read / ctx->common.hdata.mode;
-                    } else {
-                        ctx->common.hdata.num_to_display = bytes_read / ctx->common.hdata.mode;
-                        bytes_to_read = ctx->common.hdata.num_to_display * ctx->common.hdata.mode;
-                    }
-
-                    break;
-                }
-            }
-        }
+    // the memory is live: only x+ and x- reuse the pages read ahead within HEXDUMP_LIVE_PAGE_TTL_MS
+    hexdump_data& hdata = ctx->common.hdata;
+    if (!hdata.continued) {
+        invalidate_hexdump_cache(&ctx->common.hex_cache);
     }
-
-    if (0 == bytes_to_read) {
+    std::vector<uint8_t> bytes(hdata.num_to_display * hdata.mode);
+    const size_t bytes_read = read_hexdump_memory(&ctx->common.hex_cache, (uint64_t)hdata.address, bytes.data(), bytes.size());
+    if (!bytes_read) {
         puts("Address not found in commited memory ranges.");
-        free(buffer);
         return;
     }
+    hdata.num_to_display = bytes_read / hdata.mode;
+    bytes.resize(hdata.num_to_display * hdata.mode);
 
-    switch (ctx->common.hdata.hex_op.op) {
+    switch (hdata.hex_op.op) {
     case hexdump_op::ho_xor:
-        for (int i = 0, j = 0; i < bytes_to_read; i++, j = (j + 1) % ctx->common.hdata.hex_op.str_len) {
-            buffer[i] ^= ctx->common.hdata.hex_op.hex_str[j];
+        for (int i = 0, j = 0, sz = bytes.size(); i < sz; i++, j = (j + 1) % hdata.hex_op.str_len) {
+            bytes[i] ^= hdata.hex_op.hex_str[j];
         }
         break;
     case hexdump_op::ho_and:
-        for (int i = 0, j = 0; i < bytes_to_read; i++, j = (j + 1) % ctx->common.hdata.hex_op.str_len) {
-            buffer[i] &= ctx->common.hdata.hex_op.hex_str[j];
+        for (int i = 0, j = 0, sz = bytes.size(); i < sz; i++, j = (j + 1) % hdata.hex_op.str_len) {
+            bytes[i] &= hdata.hex_op.hex_str[j];
         }
         break;
     default:
         break;
     }
 
-    print_hexdump(ctx->common.hdata, buffer, bytes_to_read);
-
-    free(buffer);
+    print_hexdump(hdata, bytes.data(), bytes.size());
 }
 
 static void print_help_main() {
@@ -598,12 +1002,34 @@ static void execute_command(input_command cmd, proc_processing_context *ctx) {
         print_help_traverse_heap();
         break;
     case c_search_pattern :
+        if (ctx->common.refine_set[0]) {
+            puts("Result sets are supported in dump mode only.\n");
+            break;
+        }
+        if (ctx->common.estimate_fraction > 0.0) {
+            puts("Sampled estimates are supported in dump mode only.\n");
+            break;
+        }
+        if (ctx->common.background) {
+            puts("Background jobs are supported in dump mode only, searching in the foreground.\n");
+        }
         try_redirect_output_to_file(&ctx->common);
         search_pattern_in_memory(ctx);
         puts("====================================\n");
         redirect_output_to_stdout(&ctx->common);
         break;
     case c_search_pattern_in_registers :
+    case c_extract_modules :
+    case c_list_jobs :
+    case c_wait_job :
+    case c_kill_job :
+    case c_show_job :
+    case c_resume_job :
+    case c_list_results :
+    case c_result_set :
+    case c_similarity_search :
+    case c_hash_regions :
+    case c_hash_module :
         puts(command_not_implemented);
         puts("");
         break;
@@ -655,6 +1081,12 @@ static void execute_command(input_command cmd, proc_processing_context *ctx) {
         puts("====================================\n");
         redirect_output_to_stdout(&ctx->common);
         break;
+    case c_inspect_memory_budget:
+        try_redirect_output_to_file(&ctx->common);
+        print_mem_budget();
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
     case c_inspect_module:
         try_redirect_output_to_file(&ctx->common);
         list_process_modules(ctx, true);
@@ -679,6 +1111,12 @@ static void execute_command(input_command cmd, proc_processing_context *ctx) {
         puts("====================================\n");
         redirect_output_to_stdout(&ctx->common);
         break;
+    case c_verify_modules:
+        try_redirect_output_to_file(&ctx->common);
+        verify_process_modules(ctx);
+        puts("====================================\n");
+        redirect_output_to_stdout(&ctx->common);
+        break;
     case c_calculate:
         try_redirect_output_to_file(&ctx->common);
         data_block_calculate(ctx);
@@ -761,8 +1199,10 @@ int run_process_inspection() {
     char pattern[MAX_PATTERN_LEN];
     char command[MAX_COMMAND_LEN + MAX_ARG_LEN];
     ctx.common.command = command;
+    init_hexdump_cache(&ctx.common.hex_cache, read_process_page, &ctx, HEXDUMP_LIVE_PAGE_TTL_MS);
 
     while (1) {
+        mem_budget_trim();
         printf(">: ");
         input_command cmd = parse_command_common(&ctx.common, &sdata, pattern);
         if (cmd == input_command::c_not_set) {
@@ -771,6 +1211,7 @@ int run_process_inspection() {
             puts("");
         }
         if (cmd == c_quit_program) {
+            stop_hexdump_cache(&ctx.common.hex_cache);
             return 0;
         } else if (cmd == c_continue) {
             continue;
@@ -901,6 +1342,70 @@ static int list_process_modules(const proc_processing_context* ctx, bool show_se
     return(TRUE);
 }
 
+static bool read_process_memory_cb(const void* read_ctx, const char* address, uint8_t* buffer, size_t size) {
+    HANDLE process = (HANDLE)read_ctx;
+    SIZE_T bytes_read = 0;
+    return ReadProcessMemory(process, address, buffer, size, &bytes_read) && (bytes_read == size);
+}
+
+static void verify_process_modules(const proc_processing_context* ctx) {
+    if (!is_process_handle_valid(ctx->process)) {
+        fprintf(stderr, handle_invalid);
+        return;
+    }
+    HANDLE hModuleSnap = CreateToolhelp32Snapshot(TH32CS_SNAPMODULE, ctx->pid);
+    if (hModuleSnap == INVALID_HANDLE_VALUE) {
+        print_error(TEXT("CreateToolhelp32Snapshot (of modules)"));
+        return;
+    }
+    MODULEENTRY32 me32;
+    me32.dwSize = sizeof(MODULEENTRY32);
+    if (!Module32First(hModuleSnap, &me32)) {
+        print_error(TEXT("Module32First"));
+        CloseHandle(hModuleSnap);
+        return;
+    }
+
+    const bool show_selected = (ctx->common.i_data.module_name[0] != 0);
+    size_t num_checked = 0, num_modified = 0, num_failed = 0;
+    do {
+#ifdef _UNICODE
+        if (show_selected && (0 != _wcsicmp(me32.szModule, ctx->common.i_data.module_name))) {
+            continue;
+        }
+        char file_path[MAX_PATH];
+        if (!WideCharToMultiByte(CP_ACP, 0, me32.szExePath, -1, file_path, sizeof(file_path), NULL, NULL)) {
+            fprintf(stderr, "Error converting the module path: %lu\n", GetLastError());
+            num_failed++;
+            continue;
+        }
+#elif defined(_MBCS )
+        if (show_selected && (0 != _stricmp(me32.szModule, ctx->common.i_data.module_name))) {
+            continue;
+        }
+        const char* file_path = me32.szExePath;
+#endif
+        printf("\nModule: %s | Base: 0x%p | Size: 0x%x\n", file_path, me32.modBaseAddr, me32.modBaseSize);
+        const int64_t num_diff_bytes = verify_module(file_path, (const char*)me32.modBaseAddr, me32.modBaseSize, read_process_memory_cb, ctx->process);
+        num_checked++;
+        if (num_diff_bytes < 0) {
+            num_failed++;
+        } else if (num_diff_bytes > 0) {
+            num_modified++;
+        }
+        if (show_selected) {
+            break;
+        }
+    } while (Module32Next(hModuleSnap, &me32));
+    CloseHandle(hModuleSnap);
+
+    if (show_selected && !num_checked) {
+        puts("Module not found.");
+        return;
+    }
+    printf("\n*** Modules checked: %llu | Modified: %llu | Failed: %llu ***\n", (uint64_t)num_checked, (uint64_t)num_modified, (uint64_t)num_failed);
+}
+
 typedef struct stack_info {
     DWORD_PTR sp;
     SIZE_T size;
@@ -1147,6 +1652,9 @@ static void list_memory_regions_info(const proc_processing_context* ctx, bool sh
         if (scoped_search && !identify_memory_region_type(ctx->common.pdata.scope_type, r_info, thread_info)) {
             continue;
         }
+        if (!region_filter_match(ctx->common.pdata.filter, r_info.Protect, r_info.Type, r_info.State, r_info.RegionSize)) {
+            continue;
+        }
 
         if (check_num_results && (num_regions >= TOO_MANY_RESULTS)) {
             if (too_many_results(num_regions, redirected, false)) {
@@ -1246,7 +1754,9 @@ static void print_memory_usage(const proc_processing_context* ctx) {
     return;
 }
 
-static bool test_selected_pid(proc_processing_context* ctx) {
+// runs with the hexdump reads blocked, a page is never read through the closed or a reused handle
+static void swap_selected_process(void* owner) {
+    proc_processing_context* ctx = (proc_processing_context*)owner;
     if (is_process_handle_valid(ctx->process)) {
         if (!CloseHandle(ctx->process)) {
             fprintf(stderr, "Failed closing the handle for PID: 0x%%x\n", ctx->pid);
@@ -1255,12 +1765,20 @@ static bool test_selected_pid(proc_processing_context* ctx) {
     HANDLE process;
     if (!try_open_process(ctx->pid, process)) {
         ctx->pid = INVALID_ID;
+        ctx->process = NULL;
         ctx->process_initialized = false;
-        return false;
+        return;
     }
 
     ctx->process = process;
     ctx->process_initialized = true;
+}
+
+static bool test_selected_pid(proc_processing_context* ctx) {
+    invalidate_hexdump_cache(&ctx->common.hex_cache, swap_selected_process);
+    if (!ctx->process_initialized) {
+        return false;
+    }
 
     print_memory_usage(ctx);
 
@@ -1368,8 +1886,16 @@ static void data_block_calculate(proc_processing_context* ctx) {
             if (info.State == MEM_COMMIT) {
                 const size_t region_size = info.RegionSize;
                 if ((address >= info.BaseAddress) && (address < ((uint8_t*)info.BaseAddress + region_size))) {
+                    if (!region_filter_match(ctx->common.cdata.filter, info.Protect, info.Type, info.State, info.RegionSize)) {
+                        puts("The memory region doesn't match the filter.");
+                        return;
+                    }
                     bytes_to_read = ctx->common.cdata.size;
                     buffer = (uint8_t*)malloc(bytes_to_read);
+                    if (!buffer) {
+                        fprintf(stderr, "Failed to allocate 0x%llx bytes.\n", (uint64_t)bytes_to_read);
+                        return;
+                    }
                     SIZE_T bytes_read = 0;
                     const BOOL res = ReadProcessMemory(process, address, buffer, bytes_to_read, &bytes_read);
                     if (!res || !bytes_read) {
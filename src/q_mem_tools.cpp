@@ -2,6 +2,7 @@
 
 extern int run_process_inspection();
 extern int run_dump_inspection();
+extern int run_guest_inspection();
 
 int main(int argc, const char** argv) {
     if (!check_architecture_rt()) {
@@ -18,6 +19,8 @@ int main(int argc, const char** argv) {
         result = run_process_inspection();
     } else if (g_inspection_mode == inspection_mode::im_dump) {
         result = run_dump_inspection();
+    } else if (g_inspection_mode == inspection_mode::im_guest) {
+        result = run_guest_inspection();
     } else {
         assert(false);
     }